@@ -5,6 +5,170 @@
 
 #include <NRF24.h>
 #include <SPI.h>
+#include <SpscQueue.h>
+#include <util/atomic.h>
+
+// Background transfer queue, shared by all instances since they share the SPI bus.
+// Transactions are added by the main program and run by the SPI interrupt handler,
+// the one at the front staying in the queue until it is complete.
+static SpscQueue<NRF24Transfer*, NRF24_TRANSFER_QUEUE_LEN> transferQueue;
+static uint8_t transferIndex; // Bytes of the current transaction sent so far
+
+// Interrupt driven receive queue, see enableRxInterrupt(). One radio at a time.
+// Packets are added at rxHead, by the IRQ handler or by the main program when the
+// handler had to leave the drain to it, and consumed at rxTail by rxPop()
+static NRF24* rxRadio = NULL;
+static uint8_t rxInterruptNumber;
+static uint8_t rxMasks;                      // rxRadio's IRQ masks before the queue started
+static NRF24Packet* rxQueue;
+static uint8_t rxSize;
+static volatile uint8_t rxHead = 0;
+static volatile uint8_t rxTail = 0;
+static volatile boolean spiBusy = false;     // A foreground transaction is in progress
+static volatile boolean rxServicing = false; // The RX FIFO is being drained
+static volatile boolean rxPending = false;   // An IRQ arrived while the bus was busy
+static volatile boolean rxFull = false;      // The queue filled with packets left in the RX FIFO
+static volatile unsigned long rxTime;        // micros() at the last IRQ
+static NRF24RxStats rxCounts;
+
+#if NRF24_TRACE
+// SPI transaction trace, see traceStart(). Records are built from traceHead, by the
+// foreground or by the SPI interrupt handler (never both at once, since they take
+// turns with the bus), and are dumped from traceTail. A record that does not fit is
+// dropped and counted. A transaction that repeats the last one, as when polling STATUS,
+// is counted in a repeat record after it instead.
+static uint8_t traceBuf[NRF24_TRACE_LEN];
+static volatile uint8_t traceHead = 0;       // End of the last complete record
+static volatile uint8_t traceTail = 0;       // Start of the oldest record not yet dumped
+static volatile uint16_t traceLost = 0;
+static boolean traceOn = false;
+static unsigned long traceLastTime;
+// The record in progress
+static boolean traceRecording = false;
+static boolean traceFirst;                   // The next octet is the command
+static boolean traceRead;                    // Record the octets read, else those written
+static boolean traceOverflow;
+static uint8_t traceFlags;
+static uint8_t traceNext;
+static uint8_t traceStreamOut;               // Last octet written by the stream functions
+// The last record not yet dumped, and whether a repeat record follows it
+static boolean traceHaveLast = false;
+static boolean traceRepeating;
+static uint8_t traceLast;
+
+static inline void traceByte(uint8_t b)
+{
+    if ((uint8_t)(traceNext + 1) == traceTail)
+	traceOverflow = true;
+    else
+	traceBuf[traceNext++] = b;
+}
+
+static void traceBegin(uint8_t flags)
+{
+    traceRecording = traceOn;
+    if (!traceRecording)
+	return;
+    unsigned long now = micros();
+    if (now - traceLastTime > 0xffffUL * 4)
+	flags |= NRF24_TRACE_LONG_GAP;
+    traceLastTime = now;
+    traceFlags = flags;
+    traceFirst = true;
+    traceOverflow = false;
+    traceNext = traceHead;
+    traceByte(0); // Flags and length, when they are known
+    traceByte(now >> 2);
+    traceByte(now >> 10);
+}
+
+static void traceTransfer(uint8_t out, uint8_t in)
+{
+    if (traceFirst)
+    {
+	// The command, and the STATUS clocked out with it
+	traceFirst = false;
+	traceRead = out <= (NRF24_COMMAND_R_REGISTER | NRF24_REGISTER_MASK)
+	    || out == NRF24_COMMAND_R_RX_PAYLOAD || out == NRF24_COMMAND_R_RX_PL_WID;
+	traceByte(out);
+	traceByte(in);
+    }
+    else
+	traceByte(traceRead ? in : out);
+}
+
+// If the record just built at traceHead repeats the last one, apart from the time,
+// counts it in the repeat record after that one, adding the repeat record if need be
+static boolean traceRepeats(uint8_t len)
+{
+    if ((traceBuf[traceLast] ^ traceBuf[traceHead]) & ~NRF24_TRACE_LONG_GAP)
+	return false;
+    uint8_t i;
+    for (i = 3; i < NRF24_TRACE_HEADER_LEN + len; i++)
+	if (traceBuf[(uint8_t)(traceLast + i)] != traceBuf[(uint8_t)(traceHead + i)])
+	    return false;
+
+    if (traceRepeating)
+    {
+	// Update the repeat record in place, with the time of this one
+	uint8_t r = traceHead - NRF24_TRACE_HEADER_LEN;
+	uint16_t count = traceBuf[(uint8_t)(r + 3)] | (traceBuf[(uint8_t)(r + 4)] << 8);
+	if (count == 0xffff)
+	    return false;
+	count++;
+	traceBuf[(uint8_t)(r + 1)] = traceBuf[(uint8_t)(traceHead + 1)];
+	traceBuf[(uint8_t)(r + 2)] = traceBuf[(uint8_t)(traceHead + 2)];
+	traceBuf[(uint8_t)(r + 3)] = count;
+	traceBuf[(uint8_t)(r + 4)] = count >> 8;
+    }
+    else
+    {
+	// Turn this record into a repeat record, which is no longer
+	traceBuf[traceHead] = NRF24_TRACE_REPEAT;
+	traceBuf[(uint8_t)(traceHead + 3)] = 1;
+	traceBuf[(uint8_t)(traceHead + 4)] = 0;
+	traceHead += NRF24_TRACE_HEADER_LEN;
+	traceRepeating = true;
+    }
+    return true;
+}
+
+static void traceEnd()
+{
+    if (!traceRecording)
+	return;
+    traceRecording = false;
+    if (traceOverflow)
+    {
+	traceLost++;
+	return;
+    }
+    uint8_t len = traceNext - traceHead - NRF24_TRACE_HEADER_LEN;
+    traceBuf[traceHead] = traceFlags | len;
+    if (traceHaveLast && !(traceFlags & NRF24_TRACE_LONG_GAP) && traceRepeats(len))
+	return;
+    traceHaveLast = true;
+    traceRepeating = false;
+    traceLast = traceHead;
+    traceHead = traceNext;
+}
+
+#define TRACE_BEGIN(flags)      traceBegin(flags)
+#define TRACE_TRANSFER(out, in) if (traceRecording) traceTransfer(out, in)
+#define TRACE_END()             traceEnd()
+#else
+#define TRACE_BEGIN(flags)
+#define TRACE_TRANSFER(out, in)
+#define TRACE_END()
+#endif
+
+// Every octet of a foreground transaction, except the streamed ones, goes through here
+static inline uint8_t spiTransfer(uint8_t out)
+{
+    uint8_t in = SPI.transfer(out);
+    TRACE_TRANSFER(out, in);
+    return in;
+}
 
 NRF24::NRF24(uint8_t chipEnablePin, uint8_t chipSelectPin)
 {
@@ -13,7 +177,7 @@ NRF24::NRF24(uint8_t chipEnablePin, uint8_t chipSelectPin)
     _chipSelectPin = chipSelectPin;
 }
 
-boolean NRF24::init()
+boolean NRF24::init(boolean waitPowerOnReset)
 {
     // Initialise the slave select pin
     pinMode(_chipEnablePin, OUTPUT);
@@ -21,12 +185,9 @@ boolean NRF24::init()
     pinMode(_chipSelectPin, OUTPUT);
     digitalWrite(_chipSelectPin, HIGH);
   
-    // Added code to initilize the SPI interface and wait 100 ms
-    // to allow NRF24 device to "settle".  100 ms may be overkill.
+    // Added code to initilize the SPI interface
     pinMode(SCK, OUTPUT);
     pinMode(MOSI, OUTPUT);
-    // Wait for NRF24 POR (up to 100msec)
-    delay(100);
 
     // start the SPI library:
     // Note the NRF24 wants mode 0, MSB first and default to 1 Mbps
@@ -36,6 +197,10 @@ boolean NRF24::init()
 //    SPI.setClockDivider(SPI_2XCLOCK_MASK); // 1 MHz SPI clock
     SPI.setClockDivider(SPI_CLOCK_DIV2); // 8MHz SPI clock
 
+    // Wait for NRF24 POR (up to 100msec), unless the caller knows the radio kept its power
+    if (waitPowerOnReset)
+	delay(NRF24_POR_TIME);
+
     // Clear interrupts
     if (!spiWriteRegister(NRF24_REG_07_STATUS, NRF24_RX_DR | NRF24_TX_DS | NRF24_MAX_RT))
 	return false; // Could not write to device. Not connected?
@@ -50,54 +215,195 @@ boolean NRF24::init()
     return powerUpRx();
 }
 
-// Low level commands for interfacing with the device
-uint8_t NRF24::spiCommand(uint8_t command)
+// Every foreground transaction starts and ends here. The bus is left to
+// queued transfers first, and an IRQ that arrives meanwhile is serviced at the end
+void NRF24::spiSelect()
 {
+    waitTransfers();
+    spiBusy = true;
     digitalWrite(_chipSelectPin, LOW);
-    uint8_t status = SPI.transfer(command);
+    TRACE_BEGIN(0);
+}
+
+void NRF24::spiDeselect()
+{
     digitalWrite(_chipSelectPin, HIGH);
+    TRACE_END();
+    spiBusy = false;
+    if (rxPending && !rxServicing)
+	serviceRx();
+}
+
+// Low level commands for interfacing with the device
+uint8_t NRF24::spiCommand(uint8_t command)
+{
+    spiSelect();
+    uint8_t status = spiTransfer(command);
+    spiDeselect();
     return status;
 }
 
 // Read and write commands
 uint8_t NRF24::spiRead(uint8_t command)
 {
-    digitalWrite(_chipSelectPin, LOW);
-    SPI.transfer(command); // Send the address, discard status
-    uint8_t val = SPI.transfer(0); // The MOSI value is ignored, value is read
-    digitalWrite(_chipSelectPin, HIGH);
+    spiSelect();
+    spiTransfer(command); // Send the address, discard status
+    uint8_t val = spiTransfer(0); // The MOSI value is ignored, value is read
+    spiDeselect();
     return val;
 }
 
 uint8_t NRF24::spiWrite(uint8_t command, uint8_t val)
 {
-    digitalWrite(_chipSelectPin, LOW);
-    uint8_t status = SPI.transfer(command);
-    SPI.transfer(val); // New register value follows
-    digitalWrite(_chipSelectPin, HIGH);
+    spiSelect();
+    uint8_t status = spiTransfer(command);
+    spiTransfer(val); // New register value follows
+    spiDeselect();
     return status;
 }
 
 void NRF24::spiBurstRead(uint8_t command, uint8_t* dest, uint8_t len)
 {
-    digitalWrite(_chipSelectPin, LOW);
-    SPI.transfer(command); // Send the start address, discard status
+    spiSelect();
+    spiTransfer(command); // Send the start address, discard status
     while (len--)
-	*dest++ = SPI.transfer(0); // The MOSI value is ignored, value is read
-    digitalWrite(_chipSelectPin, HIGH);
+	*dest++ = spiTransfer(0); // The MOSI value is ignored, value is read
+    spiDeselect();
     // 300 microsecs for 32 octet payload
 }
 
 uint8_t NRF24::spiBurstWrite(uint8_t command, uint8_t* src, uint8_t len)
 {
-    digitalWrite(_chipSelectPin, LOW);
-    uint8_t status = SPI.transfer(command);
+    spiSelect();
+    uint8_t status = spiTransfer(command);
     while (len--)
-	SPI.transfer(*src++);
-    digitalWrite(_chipSelectPin, HIGH);
+	spiTransfer(*src++);
+    spiDeselect();
     return status;
 }
 
+uint8_t NRF24::spiBurstWrite_P(uint8_t command, const uint8_t* src, uint8_t len)
+{
+    spiSelect();
+    uint8_t status = spiTransfer(command);
+    while (len--)
+	spiTransfer(pgm_read_byte(src++));
+    spiDeselect();
+    return status;
+}
+
+// Streamed commands drive the SPI data register directly, so the caller can work
+// while each byte is shifted out. 1 microsec per byte @ 8MHz SPI clock
+void NRF24::spiStreamBegin(uint8_t command)
+{
+    spiSelect();
+    SPDR = command;
+#if NRF24_TRACE
+    traceStreamOut = command;
+#endif
+}
+
+uint8_t NRF24::spiStreamWrite(uint8_t val)
+{
+    while (!(SPSR & _BV(SPIF)))
+	;
+    uint8_t in = SPDR;
+    SPDR = val;
+    TRACE_TRANSFER(traceStreamOut, in);
+#if NRF24_TRACE
+    traceStreamOut = val;
+#endif
+    return in;
+}
+
+uint8_t NRF24::spiStreamEnd()
+{
+    while (!(SPSR & _BV(SPIF)))
+	;
+    uint8_t in = SPDR;
+    TRACE_TRANSFER(traceStreamOut, in);
+    spiDeselect();
+    return in;
+}
+
+// Start the transaction at the front of the queue, if any, with the SPI interrupt
+// enabled. Called with interrupts disabled
+static void startTransfer()
+{
+    if (transferQueue.empty())
+    {
+	SPCR &= ~_BV(SPIE);
+	return;
+    }
+    NRF24Transfer* transfer = *transferQueue.front();
+    transferIndex = 0;
+    digitalWrite(transfer->chipSelectPin, LOW);
+    TRACE_BEGIN(NRF24_TRACE_BACKGROUND);
+    SPCR |= _BV(SPIE);
+    SPDR = transfer->command;
+}
+
+boolean NRF24::queueTransfer(NRF24Transfer* transfer)
+{
+    transfer->chipSelectPin = _chipSelectPin;
+    transfer->done = false;
+
+    noInterrupts();
+    boolean idle = transferQueue.empty();
+    if (!transferQueue.push(transfer))
+    {
+	interrupts();
+	return false; // Full
+    }
+    if (idle)
+	startTransfer();
+    interrupts();
+    return true;
+}
+
+boolean NRF24::transferBusy()
+{
+    return !transferQueue.empty();
+}
+
+void NRF24::waitTransfers()
+{
+    while (!transferQueue.empty())
+	;
+}
+
+// Called each time a byte has been shifted: store what came back and send
+// the next byte, or finish the transaction and start the next one
+void NRF24::spiInterrupt()
+{
+    NRF24Transfer* transfer = *transferQueue.front();
+    uint8_t in = SPDR;
+    uint8_t i = transferIndex++;
+
+    TRACE_TRANSFER(i == 0 ? transfer->command : transfer->src ? transfer->src[i - 1] : 0, in);
+    if (i == 0)
+	transfer->status = in;
+    else if (transfer->dest)
+	transfer->dest[i - 1] = in;
+
+    if (i < transfer->len)
+    {
+	SPDR = transfer->src ? transfer->src[i] : 0;
+	return;
+    }
+
+    digitalWrite(transfer->chipSelectPin, HIGH);
+    TRACE_END();
+    transferQueue.pop();
+    transfer->done = true;
+    if (transfer->callback)
+	transfer->callback(transfer);
+    startTransfer();
+    // Drain the RX FIFO if its IRQ arrived while the queue was running
+    if (rxPending && transferQueue.empty() && !spiBusy && !rxServicing)
+	drainRxFromInterrupt(rxTime);
+}
+
 // Use the register commands to read and write the registers
 uint8_t NRF24::spiReadRegister(uint8_t reg)
 {
@@ -119,6 +425,11 @@ uint8_t NRF24::spiBurstWriteRegister(uint8_t reg, uint8_t* src, uint8_t len)
     return spiBurstWrite((reg & NRF24_REGISTER_MASK) | NRF24_COMMAND_W_REGISTER, src, len);
 }
 
+uint8_t NRF24::spiBurstWriteRegister_P(uint8_t reg, const uint8_t* src, uint8_t len)
+{
+    return spiBurstWrite_P((reg & NRF24_REGISTER_MASK) | NRF24_COMMAND_W_REGISTER, src, len);
+}
+
 uint8_t NRF24::statusRead()
 {
     return spiReadRegister(NRF24_REG_07_STATUS);
@@ -143,6 +454,7 @@ boolean NRF24::setChannel(uint8_t channel)
 boolean NRF24::setConfiguration(uint8_t configuration)
 {
     _configuration = configuration;
+    return true;
 }
 
 boolean NRF24::setPipeAddress(uint8_t pipe, uint8_t* address, uint8_t len)
@@ -199,6 +511,11 @@ boolean NRF24::setRF(uint8_t data_rate, uint8_t power)
     return true;
 }
 
+void NRF24::setChipEnable(boolean enable)
+{
+    digitalWrite(_chipEnablePin, enable ? HIGH : LOW);
+}
+
 boolean NRF24::powerDown()
 {
     spiWriteRegister(NRF24_REG_00_CONFIG, _configuration);
@@ -257,14 +574,15 @@ boolean NRF24::isSending()
 
 boolean NRF24::printRegisters()
 {
-    uint8_t registers[] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0d, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x1c, 0x1d};
+    static const uint8_t registers[] PROGMEM = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x1c, 0x1d};
 
     uint8_t i;
     for (i = 0; i < sizeof(registers); i++)
     {
-	Serial.print(i, HEX);
-	Serial.print(": ");
-	Serial.println(spiReadRegister(i), HEX);
+	uint8_t reg = pgm_read_byte(&registers[i]);
+	Serial.print(reg, HEX);
+	Serial.print(F(": "));
+	Serial.println(spiReadRegister(reg), HEX);
     }
     return true;
 }
@@ -318,3 +636,238 @@ boolean NRF24::recv(uint8_t* buf, uint8_t* len)
 
     return true;
 }
+
+uint8_t NRF24::recvAll(NRF24Packet* ring, uint8_t size, uint8_t* head, uint8_t tail)
+{
+    uint8_t start = *head;
+    drainRx(ring, size, head, tail, micros());
+    return (*head + size - start) % size;
+}
+
+boolean NRF24::drainRx(NRF24Packet* ring, uint8_t size, uint8_t* head, uint8_t tail, unsigned long time)
+{
+    boolean full = false;
+    uint8_t i = *head;
+
+    // Clear read interrupt first, so a message arriving from here on sets it again
+    spiWriteRegister(NRF24_REG_07_STATUS, NRF24_RX_DR);
+    while (true)
+    {
+	// The STATUS clocked out with the command gives the pipe of the
+	// message at the head of the RX FIFO, or 7 if it is empty
+	spiSelect();
+	uint8_t status = spiTransfer(NRF24_COMMAND_R_RX_PL_WID);
+	uint8_t len = spiTransfer(0);
+	spiDeselect();
+	uint8_t pipe = (status & NRF24_RX_P_NO) >> 1;
+	if (pipe > 5)
+	    break;
+	// Manual says that messages > 32 octets should be discarded
+	if (len > NRF24_MAX_MESSAGE_LEN)
+	{
+	    flushRx();
+	    break;
+	}
+	uint8_t next = (i + 1) % size;
+	if (next == tail)
+	{
+	    full = true;
+	    break;
+	}
+
+	NRF24Packet* packet = &ring[i];
+	packet->pipe = pipe;
+	packet->len = len;
+	packet->time = time;
+	uint8_t* dest = packet->data;
+	spiSelect();
+	spiTransfer(NRF24_COMMAND_R_RX_PAYLOAD);
+	while (len--)
+	    *dest++ = spiTransfer(0);
+	spiDeselect();
+	i = next;
+    }
+    *head = i;
+    return full;
+}
+
+boolean NRF24::enableRxInterrupt(uint8_t interrupt, NRF24Packet* queue, uint8_t size)
+{
+    if (rxRadio || size < 2)
+	return false;
+    rxQueue = queue;
+    rxSize = size;
+    rxHead = 0;
+    rxTail = 0;
+    rxPending = false;
+    rxFull = false;
+    resetRxStats();
+    rxInterruptNumber = interrupt;
+    rxRadio = this;
+
+    // IRQ is asserted for RX_DR only: TX_DS and MAX_RT can still be polled,
+    // but would otherwise hold IRQ low and hide the next RX_DR edge
+    rxMasks = _configuration & (NRF24_MASK_RX_DR | NRF24_MASK_TX_DS | NRF24_MASK_MAX_RT);
+    _configuration = (_configuration & ~NRF24_MASK_RX_DR) | NRF24_MASK_TX_DS | NRF24_MASK_MAX_RT;
+    attachInterrupt(interrupt, rxInterrupt, FALLING);
+    powerUpRx();
+    // Messages that arrived earlier hold IRQ low, so would never cause an edge
+    rxTime = micros();
+    rxPending = true;
+    serviceRx();
+    return true;
+}
+
+void NRF24::disableRxInterrupt()
+{
+    if (rxRadio != this)
+	return;
+    detachInterrupt(rxInterruptNumber);
+    rxRadio = NULL;
+    rxPending = false;
+    rxFull = false;
+    // The IRQ masks as they were before enableRxInterrupt()
+    uint8_t masks = NRF24_MASK_RX_DR | NRF24_MASK_TX_DS | NRF24_MASK_MAX_RT;
+    _configuration = (_configuration & ~masks) | rxMasks;
+    spiWriteRegister(NRF24_REG_00_CONFIG, (spiReadRegister(NRF24_REG_00_CONFIG) & ~masks) | rxMasks);
+}
+
+NRF24Packet* NRF24::rxPeek()
+{
+    if (rxTail == rxHead)
+	return NULL;
+    return &rxQueue[rxTail];
+}
+
+void NRF24::rxPop()
+{
+    if (rxTail == rxHead)
+	return;
+    rxTail = (rxTail + 1) % rxSize;
+    // Messages left in the RX FIFO when the queue filled do not cause another IRQ
+    if (rxFull)
+    {
+	rxPending = true;
+	serviceRx();
+    }
+}
+
+NRF24RxStats NRF24::rxStats()
+{
+    // The counts are updated by the interrupt handlers
+    noInterrupts();
+    NRF24RxStats stats = rxCounts;
+    interrupts();
+    return stats;
+}
+
+void NRF24::resetRxStats()
+{
+    noInterrupts();
+    memset(&rxCounts, 0, sizeof(rxCounts));
+    interrupts();
+}
+
+// IRQ handler. Drains the RX FIFO straight away, unless the bus is in use,
+// in which case whoever is using it drains it when they have finished, or
+// another drain is already in progress
+void NRF24::rxInterrupt()
+{
+    unsigned long now = micros();
+    if (spiBusy || rxServicing || !transferQueue.empty())
+    {
+	if (!rxPending)
+	    rxTime = now;
+	rxPending = true;
+	rxCounts.deferred++;
+	return;
+    }
+    rxTime = now;
+    drainRxFromInterrupt(now);
+}
+
+// Drains the RX FIFO from an interrupt handler with interrupts enabled, so
+// the SPI traffic (up to 3 payloads) does not hold up other handlers, such as
+// PPM edges and timers. rxServicing is set first, so an IRQ that arrives
+// meanwhile only marks the drain pending, and it is picked up here
+void NRF24::drainRxFromInterrupt(unsigned long time)
+{
+    rxServicing = true;
+    interrupts();
+    drainRxQueue(time);
+    serviceRx();
+    noInterrupts();
+}
+
+// Drains the RX FIFO into the receive queue. Called with the bus free, from
+// the IRQ or SPI interrupt handler, or from serviceRx()
+void NRF24::drainRxQueue(unsigned long time)
+{
+    // Set first, so the IRQ handler leaves rxHead alone
+    rxServicing = true;
+    rxPending = false;
+    uint8_t head = rxHead;
+    uint8_t start = head;
+    rxFull = rxRadio->drainRx(rxQueue, rxSize, &head, rxTail, time);
+    rxHead = head;
+    rxCounts.packets += (head + rxSize - start) % rxSize;
+    if (rxFull)
+	rxCounts.overruns++;
+    rxServicing = false;
+}
+
+// Drains the RX FIFO, for as long as IRQs keep arriving while it does
+void NRF24::serviceRx()
+{
+    while (rxPending && !rxServicing && rxRadio)
+    {
+	noInterrupts();
+	unsigned long time = rxTime;
+	interrupts();
+	drainRxQueue(time);
+    }
+}
+
+#if NRF24_TRACE
+// A record the SPI interrupt handler has in progress is dropped, since it would end at
+// the old traceHead. Interrupts are left as they were, so this can be called with them off
+void NRF24::traceStart()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+	traceHead = traceTail = 0;
+	traceLost = 0;
+	traceRecording = false;
+	traceHaveLast = false;
+	traceLastTime = micros();
+	traceOn = true;
+    }
+}
+
+void NRF24::traceStop()
+{
+    traceOn = false;
+}
+
+// Records between traceTail and traceHead are complete, and are not touched by the
+// tracer until traceTail moves past them, so they can be written out with interrupts enabled
+void NRF24::traceDump()
+{
+    noInterrupts();
+    uint8_t tail = traceTail;
+    uint8_t head = traceHead;
+    uint16_t lost = traceLost;
+    traceLost = 0;
+    // The records are about to be freed, so later ones can not be counted in them
+    traceHaveLast = false;
+    interrupts();
+
+    uint8_t len = head - tail;
+    uint8_t header[4] = { (uint8_t)lost, (uint8_t)(lost >> 8), len, 0 };
+    Serial.write((const uint8_t*)NRF24_TRACE_MAGIC, 8);
+    Serial.write(header, sizeof(header));
+    while (tail != head)
+	Serial.write(traceBuf[tail++]);
+    traceTail = tail;
+}
+#endif
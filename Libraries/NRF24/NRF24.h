@@ -81,6 +81,8 @@
 ///                              IRQ   (Interrupt output, not connected)
 ///                 GND----------GND   (ground in)
 /// \endcode
+/// IRQ is only needed for the interrupt driven receive queue (see enableRxInterrupt()),
+/// connected to D2 (interrupt 0) or D3 (interrupt 1).
 ///
 /// For an Arduino Leonardo (the SPI pins do not come out on the Digital pins as for normal Arduino, but only
 /// appear on the ICSP header)
@@ -281,6 +283,9 @@
 // This address in the TO addreess signifies a broadcast
 #define NRF24_BROADCAST_ADDRESS 0xffffffffff
 
+// Longest power on reset, in millisecs
+#define NRF24_POR_TIME 100
+
 // SPI Command names
 #define NRF24_COMMAND_R_REGISTER                        0x00
 #define NRF24_COMMAND_W_REGISTER                        0x20
@@ -361,6 +366,7 @@
 
 // #define NRF24_REG_05_RF_CH                              0x05
 #define NRF24_RF_CH                                     0x7f
+#define NRF24_RF_CH_DEFAULT                             0x02
 
 // #define NRF24_REG_06_RF_SETUP                           0x06
 #define NRF24_CONT_WAVE                                 0x80
@@ -408,6 +414,77 @@
 #define NRF24_EN_ACK_PAY                                0x02
 #define NRF24_EN_DYN_ACK                                0x01
 
+// Number of transactions that can be waiting in the background transfer queue, a power of two
+#define NRF24_TRANSFER_QUEUE_LEN 4
+
+// Set to 1 to build in the SPI transaction tracer, see NRF24::traceStart().
+// At 0 (the default) there is no trace code at all.
+#ifndef NRF24_TRACE
+#define NRF24_TRACE 0
+#endif
+
+// Size of the trace ring buffer. Must be 256: the indexes are 8 bits, and wrap with it
+#define NRF24_TRACE_LEN 256
+
+// Each trace record is:
+// [flags | data length][time, 2 octets LSB first][command][STATUS][data]
+// The time is micros() / 4, modulo 65536. The data is what was read for read commands
+// (R_REGISTER, R_RX_PAYLOAD, R_RX_PL_WID), else what was written.
+// Transactions that repeat the one before, apart from the time, are counted in a
+// repeat record after it instead: [NRF24_TRACE_REPEAT][time of the last repeat][count, 2 octets]
+#define NRF24_TRACE_HEADER_LEN   5
+#define NRF24_TRACE_BACKGROUND   0x80  // Done by the background transfer queue
+#define NRF24_TRACE_LONG_GAP     0x40  // Too long since the previous record for the time to tell
+#define NRF24_TRACE_DATA_LEN     0x3f
+#define NRF24_TRACE_REPEAT       0x3f  // No transaction has this much data
+
+// traceDump() writes this, then the lost record count and the length of the records
+// that follow, 2 octets each, LSB first
+#define NRF24_TRACE_MAGIC "NRF24TR1"
+
+/////////////////////////////////////////////////////////////////////
+/// \struct NRF24Transfer NRF24.h <NRF24.h>
+/// \brief An SPI transaction for the background transfer queue
+///
+/// Describes a command and the bytes that follow it, for NRF24::queueTransfer().
+/// The caller owns the structure and the buffers it points to, and must not change or 
+/// queue it again until done is set.
+typedef struct NRF24Transfer
+{
+    uint8_t          command;  ///< Command number, one of NRF24_COMMAND_*
+    const uint8_t*   src;      ///< The len bytes to send after the command, or NULL to send zeroes
+    uint8_t*         dest;     ///< Where to put the len bytes received after the command, or NULL
+    uint8_t          len;      ///< Number of bytes after the command
+    uint8_t          status;   ///< Set to the STATUS register, which is clocked out with the command
+    volatile boolean done;     ///< Set when the transaction is complete
+    /// Called from the SPI interrupt handler when the transaction is complete, or NULL.
+    /// Runs with interrupts disabled, so must be short, and must not call any
+    /// NRF24 functions.
+    void             (*callback)(struct NRF24Transfer* transfer);
+    uint8_t          chipSelectPin; ///< Set by queueTransfer()
+} NRF24Transfer;
+
+/////////////////////////////////////////////////////////////////////
+/// \struct NRF24Packet NRF24.h <NRF24.h>
+/// \brief A received packet, as stored by NRF24::recvAll() and the interrupt driven receive queue
+typedef struct
+{
+    uint8_t          pipe;     ///< Pipe number the packet arrived on, 0 to 5
+    uint8_t          len;      ///< Number of octets in data
+    unsigned long    time;     ///< micros() when it was signalled by IRQ, or read by recvAll()
+    uint8_t          data[NRF24_MAX_MESSAGE_LEN]; ///< The payload
+} NRF24Packet;
+
+/////////////////////////////////////////////////////////////////////
+/// \struct NRF24RxStats NRF24.h <NRF24.h>
+/// \brief Counts kept by the interrupt driven receive queue, see NRF24::enableRxInterrupt()
+typedef struct
+{
+    uint32_t         packets;  ///< Packets added to the queue
+    uint32_t         overruns; ///< Times the queue was full with packets still waiting in the RX FIFO
+    uint32_t         deferred; ///< IRQs that found the SPI bus busy, and were serviced when it was released
+} NRF24RxStats;
+
 
 /////////////////////////////////////////////////////////////////////
 /// \class NRF24 NRF24.h <NRF24.h>
@@ -473,10 +550,13 @@ public:
     /// - Initialise the SPI interface library to 8MHz (Hint, if you want to lower
     /// the SPI frequency (perhaps where you have other SPI shields, low voltages etc), 
     /// call SPI.setClockDivider() after init()).
+    /// - Wait NRF24_POR_TIME millisecs for the radio to come out of power on reset, if asked to
     /// -Flush the receiver and transmitter buffers
     /// - Set the radio to receive with powerUpRx();
+    /// \param[in] waitPowerOnReset false to skip the wait, when the radio is known to have
+    /// kept its power, as after a watchdog or reset button reset of the Arduino alone
     /// \return  true if everything was successful
-    boolean        init();
+    boolean        init(boolean waitPowerOnReset = true);
 
     /// Execute an SPI command that requires neither reading or writing
     /// \param[in] command the SPI command to execute, one of NRF24_COMMAND_*
@@ -508,6 +588,62 @@ public:
     /// \return the value of the device status register
     uint8_t        spiBurstWrite(uint8_t command, uint8_t* src, uint8_t len);
 
+    /// As spiBurstWrite(), but the bytes are read from program memory, so constant
+    /// data such as fixed addresses need not take up RAM
+    /// \param[in] command Command number of the first register, one of NRF24_COMMAND_*
+    /// \param[in] src Array of bytes to write, declared PROGMEM. Must be at least len bytes
+    /// \param[in] len Number of bytes to write
+    /// \return the value of the device status register
+    uint8_t        spiBurstWrite_P(uint8_t command, const uint8_t* src, uint8_t len);
+
+    /// Starts a streamed SPI command: selects the NRF24 and starts shifting out the command byte,
+    /// then returns without waiting for it to complete. Send each following byte with
+    /// spiStreamWrite() and finish with spiStreamEnd(). This allows the caller to compute
+    /// each byte (or do other work) while the previous one is being shifted out, instead of
+    /// preparing a buffer for spiBurstWrite().
+    /// \param[in] command Command number, one of NRF24_COMMAND_*
+    void           spiStreamBegin(uint8_t command);
+
+    /// Waits for the previous byte of a streamed command to finish shifting, then starts shifting 
+    /// out the next one.
+    /// \param[in] val The byte to send
+    /// \return the byte received while the previous byte was sent (the device status register
+    /// for the first call after spiStreamBegin())
+    uint8_t        spiStreamWrite(uint8_t val);
+
+    /// Waits for the last byte of a streamed command to finish shifting and deselects the NRF24
+    /// \return the byte received while the last byte was sent
+    uint8_t        spiStreamEnd();
+
+    /// Adds a transaction to the background transfer queue, and returns without waiting for it. 
+    /// Queued transactions are run in order, one byte per SPI interrupt, while the caller 
+    /// gets on with something else. The sketch must route the SPI interrupt to
+    /// spiInterrupt():
+    /// \code
+    /// ISR(SPI_STC_vect)
+    /// {
+    ///     NRF24::spiInterrupt();
+    /// }
+    /// \endcode
+    /// All the other spi* functions wait for the queue to empty before they use the bus.
+    /// At the 8MHz SPI clock set by init() each byte takes only 16 CPU cycles, which is less than
+    /// the interrupt overhead, so queueing is most useful for taking housekeeping off a critical path
+    /// rather than for saving cycles.
+    /// \param[in] transfer The transaction to run. Its done flag is cleared.
+    /// \return true if the transaction was queued, false if the queue is full
+    boolean        queueTransfer(NRF24Transfer* transfer);
+
+    /// Tests whether any queued transactions are yet to complete
+    /// \return true if the background transfer queue is not empty
+    static boolean transferBusy();
+
+    /// Waits until all queued transactions are complete. Interrupts must be enabled.
+    static void    waitTransfers();
+
+    /// SPI transfer complete interrupt handler for the background transfer queue. 
+    /// Call it from ISR(SPI_STC_vect) in the sketch.
+    static void    spiInterrupt();
+
     /// Reads a single register from the NRF24
     /// \param[in] reg Register number, one of NRF24_REG_*
     /// \return The value of the register
@@ -533,6 +669,13 @@ public:
     /// \return the value of the device status register
     uint8_t        spiBurstWriteRegister(uint8_t reg, uint8_t* src, uint8_t len);
 
+    /// As spiBurstWriteRegister(), but the new values are read from program memory
+    /// \param[in] reg Register number of the first register, one of NRF24_REG_*
+    /// \param[in] src Array of new register values to write, declared PROGMEM. Must be at least len bytes
+    /// \param[in] len Number of bytes to write
+    /// \return the value of the device status register
+    uint8_t        spiBurstWriteRegister_P(uint8_t reg, const uint8_t* src, uint8_t len);
+
     /// Reads and returns the device status register NRF24_REG_02_DEVICE_STATUS
     /// \return The value of the device status register
     uint8_t        statusRead();
@@ -672,9 +815,114 @@ public:
     /// \return true if a valid message was copied to buf
     boolean        recv(uint8_t* buf, uint8_t* len);
 
+    /// Copies every message waiting in the RX FIFO (up to 3) into a ring buffer of packets
+    /// owned by the caller, oldest first, and clears RX_DR. Where recv() takes 5 SPI transactions
+    /// per message, this takes 2, plus 2 per call: the pipe number comes from the STATUS octet
+    /// clocked out at the start of each transaction, and the payload width is read only once.
+    /// Does not turn the receiver on.
+    /// \param[in] ring The ring buffer
+    /// \param[in] size Number of entries in ring
+    /// \param[in,out] head Index of the entry to fill next. Advanced past the entries filled.
+    /// \param[in] tail Index of the oldest entry not yet consumed by the caller. The ring is
+    /// full when head is just before tail, and messages that do not fit are left in the RX FIFO.
+    /// \return the number of messages copied
+    uint8_t        recvAll(NRF24Packet* ring, uint8_t size, uint8_t* head, uint8_t tail);
+
+    /// Starts the interrupt driven receive queue, and turns the receiver on. The nRF24 IRQ
+    /// output must be connected to an external interrupt pin (D2 for interrupt 0 or D3 for
+    /// interrupt 1 on Uno). When IRQ falls, the interrupt handler drains the RX FIFO into the
+    /// queue, stamping each packet with micros() at the IRQ, and loop() takes packets with
+    /// rxPeek() and rxPop() without touching the radio. If the SPI bus is in use when IRQ falls
+    /// (by any NRF24 function, or the background transfer queue), the drain is left to
+    /// the end of that transaction, so the rest of the NRF24 API may still be used, except
+    /// recv(), recvAll() and available(), which would race the handler for the RX FIFO.
+    /// The handler drains with interrupts enabled, so other interrupt handlers (PPM
+    /// decoding, timers) are not held up by the SPI traffic, and must not use the radio.
+    /// IRQ is asserted for RX_DR only: TX_DS and MAX_RT are masked, and are still polled
+    /// by waitPacketSent() etc. Only one radio at a time can have the receive queue.
+    /// A packet that arrives while both the queue and the RX FIFO are full is dropped by
+    /// the radio, unseen: rxStats() counts the times that could have happened.
+    /// \param[in] interrupt The external interrupt number IRQ is connected to, as for attachInterrupt()
+    /// \param[in] queue The queue storage, owned by the caller
+    /// \param[in] size Number of entries in queue, at least 2. It holds size - 1 packets
+    /// \return true if the queue was started, false if another radio has it or size is too small
+    boolean        enableRxInterrupt(uint8_t interrupt, NRF24Packet* queue, uint8_t size);
+
+    /// Stops the interrupt driven receive queue, and puts the RX_DR, TX_DS and MAX_RT
+    /// masks on IRQ back as they were before enableRxInterrupt().
+    /// Packets still in the queue are discarded.
+    void           disableRxInterrupt();
+
+    /// \return the oldest packet in the interrupt driven receive queue, or NULL if it is empty.
+    /// The packet stays valid until rxPop()
+    static NRF24Packet* rxPeek();
+
+    /// Removes the oldest packet from the interrupt driven receive queue, and drains any packets
+    /// left waiting in the RX FIFO because the queue was full
+    static void    rxPop();
+
+    /// \return a copy of the interrupt driven receive queue counts since the last
+    /// resetRxStats() or enableRxInterrupt(), taken with interrupts disabled
+    static NRF24RxStats rxStats();
+
+    /// Sets all the interrupt driven receive queue counts to 0
+    static void    resetRxStats();
+
+#if NRF24_TRACE
+    /// Starts recording every SPI transaction, by the foreground and by the background
+    /// transfer queue, to a RAM ring buffer of NRF24_TRACE_LEN octets, discarding any
+    /// records not yet dumped. Each record holds the command, the STATUS clocked out with it,
+    /// the data and a 4 microsec timestamp. Repeats of the same transaction, as when polling
+    /// STATUS, are counted rather than recorded again.
+    /// Only built when NRF24_TRACE is 1. Costs a test per octet while stopped, and a few
+    /// microsecs per transaction while recording. A transaction that does not fit in the buffer is
+    /// dropped and counted, so dump often enough to keep up.
+    static void    traceStart();
+
+    /// Stops recording. Records not yet dumped are kept
+    static void    traceStop();
+
+    /// Writes the records recorded since the last dump to Serial, as binary, and frees
+    /// their space. Recording carries on meanwhile. tools/nrf24_trace decodes the dumps.
+    /// The format is NRF24_TRACE_MAGIC, the number of records dropped since the last dump,
+    /// the length of the records, both 2 octets LSB first, then the records.
+    static void    traceDump();
+#endif
+
 protected:
+    /// Selects the NRF24 for a foreground transaction, after waiting for queued transfers
+    void           spiSelect();
+
+    /// Deselects the NRF24 at the end of a foreground transaction, and drains the RX FIFO
+    /// into the receive queue if its IRQ arrived meanwhile
+    void           spiDeselect();
+
+    /// Sets the CE pin
+    /// \param[in] enable The level for CE: true to enable the chip to transmit or receive
+    void           setChipEnable(boolean enable);
+
+    /// Copies messages from the RX FIFO into a ring buffer, as recvAll()
+    /// \param[in] ring The ring buffer
+    /// \param[in] size Number of entries in ring
+    /// \param[in,out] head Index of the entry to fill next
+    /// \param[in] tail Index of the oldest entry not yet consumed
+    /// \param[in] time Value for the time of each packet
+    /// \return true if messages were left in the RX FIFO because the ring is full
+    boolean        drainRx(NRF24Packet* ring, uint8_t size, uint8_t* head, uint8_t tail, unsigned long time);
 
 private:
+    /// IRQ handler for the receive queue
+    static void    rxInterrupt();
+
+    /// Drains the RX FIFO into the receive queue, with the bus free
+    static void    drainRxQueue(unsigned long time);
+
+    /// Drains the RX FIFO into the receive queue from an interrupt handler, with interrupts enabled
+    static void    drainRxFromInterrupt(unsigned long time);
+
+    /// Drains the RX FIFO into the receive queue, if an IRQ is pending
+    static void    serviceRx();
+
     uint8_t             _configuration;
     uint8_t             _chipEnablePin;
     uint8_t             _chipSelectPin;
@@ -684,11 +932,11 @@ private:
 /// Example sketch showing how to create an audio digital receiver
 /// with the NRF24 class. 
 /// Works with the nrf24_audio_tx sample transmitter
-/// Connect audio output to pin 6, through a low pass filter consisting of a 1k resistor in series followed by a 
+/// Connect audio output to pin 3, through a low pass filter consisting of a 1k resistor in series followed by a 
 /// 0.0033 microfarad capacitor to ground (48kHz filter).
-/// The audio quality is poor: dont expect hi-fi!
-/// We have to change the PWM frequency to 62 kHz so we can get bandwidth reasonable 
-/// audio out through the low pass filter
+/// Received samples are decoded into a jitter buffer and played out at a fixed rate
+/// by a timer interrupt, on 62.5kHz PWM from timer2. 
+/// Reports sample rate, underruns and packet loss once a second.
 /// Tested on UNO
 
 /// @example nrf24_audio_tx.pde
@@ -696,9 +944,10 @@ private:
 /// with the NRF24 class. 
 /// Connect a 1Vp-p audio sigal to analog input 0, connected through a 1uF capacitor
 /// Works with the nrf24_audio_rx sample receiver
-/// The audio quality is poor: dont expect hi-fi!
 ///
-/// This code sends about 250 messages per second, each with 32 8 bit samples from analog input 0
+/// Analog input 0 is sampled by a timer interrupt, at 16kHz with IMA ADPCM or 8kHz with 8 bit PCM.
+/// About 286 messages per second are sent, each with 28 bytes of samples, 
+/// queued in the TX FIFO while the previous one is sent.
 /// It uses the NRF4 in NOACK mode. The receiver never acknowledges or replies
 /// Tested on UNO
 
@@ -733,4 +982,29 @@ private:
 /// http://wiki.bitcraze.se/projects:crazyflie:firmware:comm_protocol
 /// to control a Crazyflie quadcopter http://www.bitcraze.se/
 /// using a RC transmitter in trainer mode, such as the Spektrum DX6i and others.
+/// The link is run by the NRF24Crtp class, which streams setpoints at a fixed rate
+/// and collects console output from the copter in the ACK payloads.
+/// Reports the achieved setpoint rate and downlink throughput once a second.
+
+/// @example nrf24_bench_client.ino
+/// Example sketch showing how to benchmark a link with the NRF24 class.
+/// Sweeps data rate, payload size, ACK, NOACK and ACK payload modes and retry settings,
+/// measuring round trip time distribution and goodput, and prints CSV.
+/// It is designed to work with the example nrf24_bench_server
+
+/// @example nrf24_bench_server.ino
+/// Example sketch showing how to create the server end of a link benchmark
+/// with the NRF24 class. 
+/// It is designed to work with the example nrf24_bench_client
+
+/// @example nrf24_irq_rx.ino
+/// Example sketch showing how to receive with the interrupt driven receive queue
+/// of the NRF24 class, instead of polling. Connect the nRF24 IRQ output to D2.
+/// Reports packets, loss, queue overruns and the latency from IRQ to loop() once a second.
+
+/// @example nrf24_trace.ino
+/// Example sketch showing how to trace SPI transactions with the NRF24 class.
+/// Sends pings, and dumps the trace when 'd' is received on Serial, for tools/nrf24_trace
+/// to decode. Needs NRF24_TRACE set to 1 in NRF24.h.
+/// It is designed to work with the example nrf24_ping_server
 #endif 
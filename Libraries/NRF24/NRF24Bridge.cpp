@@ -0,0 +1,181 @@
+// NRF24Bridge.cpp
+//
+
+#include <NRF24Bridge.h>
+
+// Commands whose data is read from the radio, rather than written to it
+static boolean isRead(uint8_t command)
+{
+    return command <= (NRF24_COMMAND_R_REGISTER | NRF24_REGISTER_MASK)
+	|| command == NRF24_COMMAND_R_RX_PAYLOAD || command == NRF24_COMMAND_R_RX_PL_WID;
+}
+
+NRF24Bridge::NRF24Bridge(uint8_t chipEnablePin, uint8_t chipSelectPin)
+    : NRF24(chipEnablePin, chipSelectPin)
+{
+    _state = 0;
+    _requests = 0;
+    _errors = 0;
+}
+
+void NRF24Bridge::begin(unsigned long baud)
+{
+    Serial.begin(baud);
+    _state = 0;
+}
+
+void NRF24Bridge::poll()
+{
+    if (_state && millis() - _lastOctet > NRF24_BRIDGE_FRAME_TIMEOUT)
+    {
+	// The rest of the request is not coming
+	_state = 0;
+	_errors++;
+    }
+    while (Serial.available())
+    {
+	uint8_t c = Serial.read();
+	_lastOctet = millis();
+	switch (_state)
+	{
+	case 0:
+	    // Anything but the start of a request is ignored
+	    if (c == NRF24_BRIDGE_REQUEST)
+		_state++;
+	    continue;
+	case 1:
+	    _seq = c;
+	    _state++;
+	    continue;
+	case 2:
+	    _len = c;
+	    _received = 0;
+	    _state++;
+	    break;
+	default:
+	    if (_received < NRF24_BRIDGE_MAX_FRAME)
+		_frame[_received] = c;
+	    _received++;
+	    break;
+	}
+	if (_received < _len)
+	    continue;
+
+	// The whole request is here. Reply to it, then read the next one
+	_state = 0;
+	uint8_t resultLen = 0;
+	uint8_t result = _len > NRF24_BRIDGE_MAX_FRAME ? NRF24_BRIDGE_BAD_FRAME : check(&resultLen);
+	uint8_t header[NRF24_BRIDGE_REPLY_HEADER_LEN] = { NRF24_BRIDGE_REPLY, _seq, result, resultLen };
+	Serial.write(header, sizeof(header));
+	if (result == NRF24_BRIDGE_OK)
+	{
+	    run();
+	    _requests++;
+	}
+	else
+	    _errors++;
+	return;
+    }
+}
+
+uint8_t NRF24Bridge::check(uint8_t* resultLen)
+{
+    uint16_t results = 0;
+    uint8_t i = 0;
+    while (i < _len)
+    {
+	if (_len - i < 2)
+	    return NRF24_BRIDGE_BAD_FRAME;
+	uint8_t command = _frame[i];
+	uint8_t len = _frame[i + 1];
+	switch (command)
+	{
+	case NRF24_BRIDGE_CE:
+	    i += 2;
+	    results++;
+	    break;
+	case NRF24_BRIDGE_WAIT:
+	case NRF24_BRIDGE_DELAY:
+	    if (_len - i < 3)
+		return NRF24_BRIDGE_BAD_FRAME;
+	    i += 3;
+	    results++;
+	    break;
+	default:
+	    if (command > NRF24_BRIDGE_CE && command != NRF24_COMMAND_NOP)
+		return NRF24_BRIDGE_BAD_FRAME;
+	    if (len > NRF24_MAX_MESSAGE_LEN)
+		return NRF24_BRIDGE_BAD_FRAME;
+	    i += 2;
+	    results++;
+	    if (isRead(command))
+		results += len;
+	    else if (_len - i < len)
+		return NRF24_BRIDGE_BAD_FRAME;
+	    else
+		i += len;
+	    break;
+	}
+    }
+    if (results > NRF24_BRIDGE_MAX_RESULTS)
+	return NRF24_BRIDGE_TOO_LONG;
+    *resultLen = results;
+    return NRF24_BRIDGE_OK;
+}
+
+void NRF24Bridge::run()
+{
+    uint8_t i = 0;
+    while (i < _len)
+    {
+	uint8_t command = _frame[i];
+	uint8_t len = _frame[i + 1];
+	switch (command)
+	{
+	case NRF24_BRIDGE_CE:
+	    setChipEnable(len);
+	    Serial.write((uint8_t)0);
+	    i += 2;
+	    break;
+
+	case NRF24_BRIDGE_WAIT:
+	{
+	    uint8_t mask = len;
+	    unsigned long timeout = (unsigned long)_frame[i + 2] * 100;
+	    unsigned long start = micros();
+	    uint8_t status;
+	    while (!((status = statusRead()) & mask) && micros() - start < timeout)
+		;
+	    Serial.write(status);
+	    i += 3;
+	    break;
+	}
+
+	case NRF24_BRIDGE_DELAY:
+	    delayMicroseconds(len | (_frame[i + 2] << 8));
+	    Serial.write((uint8_t)0);
+	    i += 3;
+	    break;
+
+	default:
+	{
+	    // The SPI transaction, with each octet read sent on as soon as it arrives
+	    boolean read = isRead(command);
+	    const uint8_t* src = &_frame[i + 2];
+	    uint8_t j;
+	    spiStreamBegin(command);
+	    for (j = 0; j < len; j++)
+	    {
+		uint8_t in = spiStreamWrite(read ? 0 : src[j]);
+		if (j == 0 || read)
+		    Serial.write(in);
+	    }
+	    uint8_t in = spiStreamEnd();
+	    if (len == 0 || read)
+		Serial.write(in);
+	    i += 2 + (read ? 0 : len);
+	    break;
+	}
+	}
+    }
+}
@@ -0,0 +1,129 @@
+// NRF24Bridge.h
+//
+/// \class NRF24Bridge NRF24Bridge.h <NRF24Bridge.h>
+/// \brief Drive the nRF24L01 from a host computer over Serial.
+///
+/// This subclass of NRF24 turns the Arduino into a serial to nRF24 bridge, so that
+/// radio protocols can be run and prototyped on a PC, without reflashing.
+/// The host sends request frames of radio operations, and the bridge runs them in order
+/// and sends back a reply frame with their results.
+///
+/// A request frame is:
+/// \code
+///   NRF24_BRIDGE_REQUEST
+///   seq    any value, echoed in the reply
+///   len    number of octets of operations that follow, up to NRF24_BRIDGE_MAX_FRAME
+///   operations
+/// \endcode
+/// and the reply to it is:
+/// \code
+///   NRF24_BRIDGE_REPLY
+///   seq    from the request
+///   result NRF24_BRIDGE_OK, or why the request was rejected
+///   len    number of octets of results that follow
+///   results
+/// \endcode
+/// Each operation is an SPI command octet, a length (up to NRF24_MAX_MESSAGE_LEN),
+/// and for commands that write, that many octets to write. Each gives a result of the
+/// STATUS clocked out with the command, and for commands that read (R_REGISTER,
+/// R_RX_PAYLOAD and R_RX_PL_WID) the octets read. So a register write is 3 octets and
+/// returns 1, a 32 octet payload write is 34 octets and returns 1, and a status poll is
+/// NRF24_COMMAND_NOP with length 0. Three more operations, on command octets the nRF24 does
+/// not use, are done by the bridge itself, each with a result of one octet:
+/// \code
+///   NRF24_BRIDGE_CE    level           Sets CE to level (0 or 1). Result 0
+///   NRF24_BRIDGE_WAIT  mask timeout    Polls STATUS until a bit in mask is set, or for timeout * 100
+///                                      microsecs. Result the last STATUS
+///   NRF24_BRIDGE_DELAY lsb msb         Waits that many microsecs. Result 0
+/// \endcode
+/// so that a whole exchange, such as write a payload, pulse CE, wait for TX_DS or MAX_RT,
+/// clear STATUS and read an ACK payload, takes one round trip. A request that is malformed,
+/// or whose results would not fit in 255 octets, is rejected whole, with nothing done.
+///
+/// The bridge reads one request while the previous one runs, so the host can send
+/// requests ahead of the replies (pipelining), hiding the USB latency of each round trip.
+/// It must not send more than 63 octets beyond the request the bridge is running, or the
+/// Arduino serial receive buffer overflows. A request that stops part way is dropped after
+/// NRF24_BRIDGE_FRAME_TIMEOUT millisecs. tools/bridge has a Linux client for this protocol.
+#ifndef NRF24Bridge_h
+#define NRF24Bridge_h
+
+#include <NRF24.h>
+
+// Serial speed. 1Mbaud is exact on a 16MHz Arduino
+#define NRF24_BRIDGE_BAUD           1000000
+
+// First octets of request and reply frames
+#define NRF24_BRIDGE_REQUEST        0xa5
+#define NRF24_BRIDGE_REPLY          0x5a
+#define NRF24_BRIDGE_REQUEST_HEADER_LEN 3
+#define NRF24_BRIDGE_REPLY_HEADER_LEN   4
+
+// Largest operations field in a request
+#define NRF24_BRIDGE_MAX_FRAME      128
+
+// Largest results field in a reply
+#define NRF24_BRIDGE_MAX_RESULTS    255
+
+// Millisecs between octets of a request before it is dropped
+#define NRF24_BRIDGE_FRAME_TIMEOUT  20
+
+// Operations done by the bridge, on command octets the nRF24 does not use
+#define NRF24_BRIDGE_CE             0xf0
+#define NRF24_BRIDGE_WAIT           0xf1
+#define NRF24_BRIDGE_DELAY          0xf2
+
+// Reply results
+#define NRF24_BRIDGE_OK             0
+#define NRF24_BRIDGE_BAD_FRAME      1  // An operation is unknown, too long or cut short
+#define NRF24_BRIDGE_TOO_LONG       2  // The results would not fit in a reply
+
+/////////////////////////////////////////////////////////////////////
+class NRF24Bridge : public NRF24
+{
+public:
+    /// Constructor. See NRF24::NRF24()
+    /// \param[in] chipEnablePin the Arduino pin to use to enable the chip for transmit/receive
+    /// \param[in] chipSelectPin the Arduino pin number of the output to use to select the NRF24 before
+    /// accessing it
+    NRF24Bridge(uint8_t chipEnablePin = 8, uint8_t chipSelectPin = SS);
+
+    /// Starts Serial for the bridge. Call after init().
+    /// \param[in] baud The serial speed. The host must use the same
+    void           begin(unsigned long baud = NRF24_BRIDGE_BAUD);
+
+    /// Reads any request octets waiting on Serial, and runs the request and replies
+    /// once it is complete. Call it from loop() as often as possible.
+    void           poll();
+
+    /// \return The number of requests run since begin()
+    uint16_t       requestCount() { return _requests; }
+
+    /// \return The number of requests rejected or dropped part way since begin()
+    uint16_t       errorCount() { return _errors; }
+
+protected:
+    /// Checks the operations in the request, and works out the length of the results
+    /// \param[out] resultLen Set to the length of the results
+    /// \return NRF24_BRIDGE_OK, or why the request must be rejected
+    uint8_t        check(uint8_t* resultLen);
+
+    /// Runs the operations in the request, writing their results to Serial as they come
+    void           run();
+
+private:
+    uint8_t             _state;       // Octets of the request received so far, up to the end of the header
+    uint8_t             _seq;
+    uint8_t             _len;
+    uint8_t             _received;    // Octets of the operations received so far
+    unsigned long       _lastOctet;   // millis() when the last octet of the request arrived
+    uint16_t            _requests;
+    uint16_t            _errors;
+    uint8_t             _frame[NRF24_BRIDGE_MAX_FRAME];
+};
+
+/// @example nrf24_bridge.ino
+/// Example sketch showing how to drive the radio from a host computer with the
+/// NRF24Bridge class. tools/bridge has the Linux client and a benchmark.
+
+#endif
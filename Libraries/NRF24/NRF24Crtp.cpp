@@ -0,0 +1,245 @@
+// NRF24Crtp.cpp
+//
+
+#include <NRF24Crtp.h>
+
+// The default Crazyflie address
+static uint8_t crtpDefaultAddress[] = { 0xe7, 0xe7, 0xe7, 0xe7, 0xe7 };
+
+// Link echo, acknowledged by a Crazyflie on any channel it listens on
+static uint8_t crtpEcho[] = { CRTP_HEADER(CRTP_PORT_LINK, 3) };
+
+// Commander setpoint, as the Crazyflie expects it
+#pragma pack(1)
+typedef struct
+{
+    float    roll;
+    float    pitch;
+    float    yaw;
+    uint16_t thrust;
+} CrtpCommander;
+#pragma pack()
+
+NRF24Crtp::NRF24Crtp(uint8_t chipEnablePin, uint8_t chipSelectPin)
+    : NRF24(chipEnablePin, chipSelectPin)
+{
+    memset(_handlers, 0, sizeof(_handlers));
+    _setpointLen = 0;
+    _setpointInterval = NRF24_CRTP_SETPOINT_INTERVAL;
+    _lastSetpoint = 0;
+    _pollInterval = NRF24_CRTP_POLL_INTERVAL;
+    _lastPoll = 0;
+    _downlinkPending = false;
+    _queueHead = 0;
+    _queueTail = 0;
+    _inFlight = NRF24CrtpIdle;
+    _failures = 0;
+    resetStats();
+}
+
+boolean NRF24Crtp::init()
+{
+    if (!NRF24::init())
+	return false;
+    // Be compatible with Crazyflie: No interrupts, 2 bytes CRC
+    setConfiguration(NRF24_MASK_RX_DR | NRF24_MASK_TX_DS | NRF24_MASK_MAX_RT | NRF24_EN_CRC | NRF24_CRCO);
+    spiWriteRegister(NRF24_REG_1D_FEATURE, NRF24_EN_DPL | NRF24_EN_ACK_PAY);   // Dynamic size payload + ack
+    spiWriteRegister(NRF24_REG_1C_DYNPD, NRF24_DPL_P0);     // Dynamic payload on pipe 0
+    setLink(13, NRF24DataRate250kbps);
+    setTransmitAddress(crtpDefaultAddress, sizeof(crtpDefaultAddress));
+    return powerUpTx();
+}
+
+boolean NRF24Crtp::setLink(uint8_t channel, uint8_t dataRate)
+{
+    setChannel(channel);
+    setRF(dataRate, NRF24TransmitPower0dBm);
+    // Long enough for a 32 octet ACK payload: 1500us at 250kbps, else 500us
+    return setRetry(dataRate == NRF24DataRate250kbps ? 5 : 1, 3);
+}
+
+boolean NRF24Crtp::scan(uint8_t* channel)
+{
+    uint8_t c;
+
+    // Let anything in flight finish, so it does not answer for the new channel
+    while (_inFlight != NRF24CrtpIdle)
+	run();
+    for (c = 0; c < 126; c++)
+    {
+	setChannel(c);
+	NRF24::send(crtpEcho, sizeof(crtpEcho));
+	if (waitPacketSent())
+	{
+	    flushRx(); // No payload expected
+	    *channel = c;
+	    _failures = 0;
+	    return true;
+	}
+    }
+    return false;
+}
+
+void NRF24Crtp::setHandler(uint8_t port, NRF24CrtpHandler handler)
+{
+    _handlers[port & 0xf] = handler;
+}
+
+void NRF24Crtp::setSetpoint(uint8_t header, const uint8_t* data, uint8_t len)
+{
+    if (len > CRTP_MAX_DATA_LEN)
+	return;
+    _setpoint[0] = header;
+    memcpy(_setpoint + 1, data, len);
+    _setpointLen = len + 1;
+}
+
+void NRF24Crtp::setCommander(float roll, float pitch, float yaw, uint16_t thrust)
+{
+    CrtpCommander commander;
+    commander.roll = roll;
+    commander.pitch = pitch;
+    commander.yaw = yaw;
+    commander.thrust = thrust;
+    setSetpoint(CRTP_HEADER(CRTP_PORT_COMMANDER, 0), (uint8_t*)&commander, sizeof(commander));
+}
+
+void NRF24Crtp::clearSetpoint()
+{
+    _setpointLen = 0;
+}
+
+void NRF24Crtp::setSetpointInterval(uint32_t interval)
+{
+    _setpointInterval = interval;
+}
+
+void NRF24Crtp::setPollInterval(uint32_t interval)
+{
+    _pollInterval = interval;
+}
+
+boolean NRF24Crtp::queue(uint8_t port, uint8_t channel, const uint8_t* data, uint8_t len)
+{
+    uint8_t next = (_queueHead + 1) % NRF24_CRTP_QUEUE_LEN;
+    if (len > CRTP_MAX_DATA_LEN || next == _queueTail)
+	return false;
+    _queue[_queueHead][0] = CRTP_HEADER(port, channel);
+    memcpy(_queue[_queueHead] + 1, data, len);
+    _queueLen[_queueHead] = len + 1;
+    _queueHead = next;
+    return true;
+}
+
+void NRF24Crtp::startPacket(const uint8_t* packet, uint8_t len, uint8_t inFlight)
+{
+    NRF24::send((uint8_t*)packet, len);
+    _inFlight = inFlight;
+}
+
+void NRF24Crtp::receiveAckPayloads()
+{
+    uint8_t buf[NRF24_MAX_MESSAGE_LEN];
+    uint8_t len;
+
+    while (available())
+    {
+	len = sizeof(buf);
+	if (!recv(buf, &len) || len == 0)
+	    continue;
+	// A null packet: the copter had nothing to say
+	if (CRTP_HEADER_PORT(buf[0]) == CRTP_PORT_LINK && CRTP_HEADER_CHANNEL(buf[0]) == 3)
+	    continue;
+	_downlinkPending = true;
+	_stats.downlink++;
+	_stats.downlinkOctets += len;
+	NRF24CrtpHandler handler = _handlers[CRTP_HEADER_PORT(buf[0])];
+	if (handler)
+	    handler(CRTP_HEADER_CHANNEL(buf[0]), buf + 1, len - 1);
+    }
+}
+
+boolean NRF24Crtp::run()
+{
+    // Finish with the packet in flight, if it is done
+    if (_inFlight != NRF24CrtpIdle)
+    {
+	uint8_t status = statusRead();
+	if (!(status & (NRF24_TX_DS | NRF24_MAX_RT)))
+	    return linkUp(); // Still going
+
+	// Must clear NRF24_MAX_RT if it is set, else no further comm. Flush the
+	// failed packet first, else the radio starts sending it again
+	if (status & NRF24_MAX_RT)
+	    flushTx();
+	spiWriteRegister(NRF24_REG_07_STATUS, NRF24_TX_DS | NRF24_MAX_RT);
+	if (status & NRF24_TX_DS)
+	{
+	    _failures = 0;
+	    _stats.packets++;
+	    if (_inFlight == NRF24CrtpSetpoint)
+		_stats.setpoints++;
+	    else if (_inFlight == NRF24CrtpQueued)
+		_queueTail = (_queueTail + 1) % NRF24_CRTP_QUEUE_LEN;
+	    // An empty ACK means the copter has nothing more to send for now
+	    _downlinkPending = false;
+	    if (status & NRF24_RX_DR)
+		receiveAckPayloads();
+	}
+	else
+	{
+	    _stats.failures++;
+	    if (_failures < NRF24_CRTP_MAX_FAILURES)
+		_failures++;
+	}
+	_inFlight = NRF24CrtpIdle;
+    }
+
+    // Start the next one
+    unsigned long now = micros();
+    if (_setpointLen && now - _lastSetpoint >= _setpointInterval)
+    {
+	// Keep to the interval on average, unless we have fallen well behind
+	if (now - _lastSetpoint < 2 * _setpointInterval)
+	    _lastSetpoint += _setpointInterval;
+	else
+	    _lastSetpoint = now;
+	startPacket(_setpoint, _setpointLen, NRF24CrtpSetpoint);
+    }
+    else if (_queueHead != _queueTail)
+	startPacket(_queue[_queueTail], _queueLen[_queueTail], NRF24CrtpQueued);
+    else if (_downlinkPending || now - _lastPoll >= _pollInterval)
+    {
+	static const uint8_t poll = CRTP_NULL_HEADER;
+	_lastPoll = now;
+	_stats.polls++;
+	startPacket(&poll, sizeof(poll), NRF24CrtpPoll);
+    }
+    return linkUp();
+}
+
+boolean NRF24Crtp::flush(uint16_t timeout)
+{
+    unsigned long start = millis();
+    while (_queueHead != _queueTail)
+    {
+	if (!run() || millis() - start >= timeout)
+	    return false;
+    }
+    return true;
+}
+
+boolean NRF24Crtp::linkUp()
+{
+    return _failures < NRF24_CRTP_MAX_FAILURES;
+}
+
+const NRF24CrtpStats& NRF24Crtp::stats()
+{
+    return _stats;
+}
+
+void NRF24Crtp::resetStats()
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
@@ -0,0 +1,215 @@
+// NRF24Crtp.h
+//
+/// \class NRF24Crtp NRF24Crtp.h <NRF24Crtp.h>
+/// \brief Client (transmitter) end of the Crazyflie CRTP radio link.
+///
+/// This subclass of NRF24 talks to a Crazyflie quadcopter http://www.bitcraze.se/
+/// using the CRTP radiolink protocol:
+/// http://wiki.bitcraze.se/projects:crazyflie:firmware:comm_protocol
+///
+/// CRTP packets carry a header octet with a port (what the packet is for: commander,
+/// log, param, console etc) and a channel within the port, followed by up to 31 octets of data.
+/// The client sends packets to the copter, and the copter can only reply in the ACK payload of a
+/// packet from the client. So the client keeps sending: setpoints (commander packets) at a
+/// fixed rate, packets queued by the sketch, and when there is nothing else to send and the copter
+/// has more to say, empty packets just to collect the replies.
+///
+/// run() must be called frequently from loop(). It never waits for the radio: each call
+/// checks the packet in flight, if any, dispatches any ACK payload to the handler
+/// registered for its port with setHandler(), and starts the next packet:
+/// - the setpoint, if the setpoint interval has passed since the last one was sent;
+/// - else the oldest packet queued by queue();
+/// - else an empty packet, if the last ACK payload suggested the copter has more
+///   to send, or the poll interval has passed.
+///
+/// Packets queued by queue() are retried until acknowledged (or the link is lost),
+/// setpoints are not: a fresh one will soon follow. The link is considered lost after
+/// NRF24_CRTP_MAX_FAILURES packets in a row are not acknowledged.
+///
+/// Counts of packets, setpoints and downlink octets are kept in a NRF24CrtpStats, see stats().
+#ifndef NRF24Crtp_h
+#define NRF24Crtp_h
+
+#include <NRF24.h>
+
+// CRTP header octet
+#define CRTP_HEADER(port, channel) (((port & 0x0F) << 4) | (channel & 0x0F))
+#define CRTP_HEADER_PORT(h) ((h >> 4) & 0xf)
+#define CRTP_HEADER_CHANNEL(h) (h & 0x3)
+
+// Ports
+#define CRTP_PORT_CONSOLE       0x00
+#define CRTP_PORT_PARAM         0x02
+#define CRTP_PORT_COMMANDER     0x03
+#define CRTP_PORT_LOG           0x05
+#define CRTP_PORT_LINK          0x0F
+#define CRTP_PORTS              16
+
+// Empty packet, sent to collect downlink packets from the copter
+#define CRTP_NULL_HEADER        0xff
+
+// Largest CRTP payload, after the header
+#define CRTP_MAX_DATA_LEN       (NRF24_MAX_MESSAGE_LEN - 1)
+
+// Number of packets queue() can hold
+#ifndef NRF24_CRTP_QUEUE_LEN
+#define NRF24_CRTP_QUEUE_LEN    4
+#endif
+
+// Packets in a row without an acknowledgement before the link is considered lost
+#define NRF24_CRTP_MAX_FAILURES 50
+
+// Default intervals, in microsecs
+#define NRF24_CRTP_SETPOINT_INTERVAL 10000  // 100 per sec
+#define NRF24_CRTP_POLL_INTERVAL     20000  // Downlink poll when the copter seems to have nothing to send
+
+/// \brief Called by NRF24Crtp::run() with each packet received from the copter
+/// \param[in] channel The channel within the port the handler was registered for
+/// \param[in] data The data after the header
+/// \param[in] len Number of octets of data
+typedef void (*NRF24CrtpHandler)(uint8_t channel, uint8_t* data, uint8_t len);
+
+/// \brief Link statistics kept by NRF24Crtp
+typedef struct
+{
+    uint32_t packets;        ///< Packets sent and acknowledged, of all kinds
+    uint32_t failures;       ///< Packets not acknowledged after all retries
+    uint32_t setpoints;      ///< Setpoints acknowledged
+    uint32_t polls;          ///< Empty packets sent to collect downlink packets
+    uint32_t downlink;       ///< ACK payloads received (not counting empty ones)
+    uint32_t downlinkOctets; ///< Octets in them, including the headers
+} NRF24CrtpStats;
+
+/////////////////////////////////////////////////////////////////////
+class NRF24Crtp : public NRF24
+{
+public:
+    /// Constructor. See NRF24::NRF24()
+    /// \param[in] chipEnablePin the Arduino pin to use to enable the chip for transmit/receive
+    /// \param[in] chipSelectPin the Arduino pin number of the output to use to select the NRF24 before
+    /// accessing it
+    NRF24Crtp(uint8_t chipEnablePin = 8, uint8_t chipSelectPin = SS);
+
+    /// Initialises this instance and the radio module connected to it, as NRF24::init(),
+    /// and configures it to be Crazyflie radiolink compatible: no interrupts, 2 octet CRC,
+    /// dynamic payloads and ACK payloads on pipe 0, channel 13 at 250kbps,
+    /// and the default Crazyflie address 0xe7e7e7e7e7.
+    /// \return  true if everything was successful
+    boolean        init();
+
+    /// Sets the radio channel and data rate, with a retry delay long enough for
+    /// a full size ACK payload at that rate (500 microsecs at 1 or 2Mbps, 1500 at 250kbps)
+    /// \param[in] channel The radio channel, 0 to 125
+    /// \param[in] dataRate One of NRF24::NRF24DataRate
+    /// \return true if successful
+    boolean        setLink(uint8_t channel, uint8_t dataRate);
+
+    /// Looks for a copter on each radio channel in turn at the current data rate, by
+    /// sending it a link echo packet, and stays on the first channel where one is acknowledged.
+    /// Blocks until it has been round all channels.
+    /// \param[out] channel Set to the channel the copter answered on
+    /// \return true if a copter answered
+    boolean        scan(uint8_t* channel);
+
+    /// Registers a function to be called with each packet the copter sends on a port
+    /// \param[in] port The CRTP port, 0 to 15
+    /// \param[in] handler The function to call, or NULL to discard packets on that port
+    void           setHandler(uint8_t port, NRF24CrtpHandler handler);
+
+    /// Sets the setpoint sent every setpoint interval. The latest one is always sent:
+    /// setpoints are not queued.
+    /// \param[in] header The CRTP header, usually CRTP_HEADER(CRTP_PORT_COMMANDER, 0)
+    /// \param[in] data The setpoint data
+    /// \param[in] len Number of octets of data, up to CRTP_MAX_DATA_LEN
+    void           setSetpoint(uint8_t header, const uint8_t* data, uint8_t len);
+
+    /// Sets a commander (roll, pitch, yaw, thrust) setpoint, sent on CRTP_PORT_COMMANDER channel 0
+    /// \param[in] roll Roll angle in degrees
+    /// \param[in] pitch Pitch angle in degrees
+    /// \param[in] yaw Yaw rate in degrees per sec
+    /// \param[in] thrust Thrust, 0 to 65535
+    void           setCommander(float roll, float pitch, float yaw, uint16_t thrust);
+
+    /// Stops sending setpoints, until the next setSetpoint() or setCommander()
+    void           clearSetpoint();
+
+    /// Sets the interval between setpoints. 0 sends them as fast as the link allows.
+    /// \param[in] interval Microsecs between setpoints
+    void           setSetpointInterval(uint32_t interval);
+
+    /// Sets the interval between empty packets sent to collect downlink packets when
+    /// the copter does not seem to have anything to send. 0 polls whenever the link
+    /// is otherwise idle.
+    /// \param[in] interval Microsecs between polls
+    void           setPollInterval(uint32_t interval);
+
+    /// Queues a packet to send to the copter. It is sent by run(), after any setpoint
+    /// that is due and the packets queued before it, and retried until it is acknowledged.
+    /// \param[in] port The CRTP port
+    /// \param[in] channel The channel within the port
+    /// \param[in] data The data to send after the header
+    /// \param[in] len Number of octets of data, up to CRTP_MAX_DATA_LEN
+    /// \return true if the packet was queued, false if the queue is full or len too long
+    boolean        queue(uint8_t port, uint8_t channel, const uint8_t* data, uint8_t len);
+
+    /// Runs the link, without waiting. Call it frequently from loop().
+    /// \return true if the link is up: fewer than NRF24_CRTP_MAX_FAILURES packets in a row
+    /// have failed
+    boolean        run();
+
+    /// Waits until all packets queued by queue() have been acknowledged, running the link
+    /// meanwhile, or the timeout expires or the link is lost
+    /// \param[in] timeout Maximum millisecs to wait
+    /// \return true if the queue is empty
+    boolean        flush(uint16_t timeout);
+
+    /// \return true if the link is up
+    boolean        linkUp();
+
+    /// \return the link statistics since the last resetStats()
+    const NRF24CrtpStats& stats();
+
+    /// Sets all the link statistics to 0
+    void           resetStats();
+
+protected:
+    /// Writes a packet to the TX FIFO, and notes it as in flight
+    /// \param[in] packet The CRTP header and data
+    /// \param[in] len Number of octets in packet
+    /// \param[in] inFlight What kind of packet it is
+    void           startPacket(const uint8_t* packet, uint8_t len, uint8_t inFlight);
+
+    /// Reads and dispatches the ACK payloads in the RX FIFO
+    void           receiveAckPayloads();
+
+private:
+    /// What is in flight
+    typedef enum
+    {
+	NRF24CrtpIdle = 0,
+	NRF24CrtpSetpoint,
+	NRF24CrtpQueued,
+	NRF24CrtpPoll
+    } NRF24CrtpInFlight;
+
+    NRF24CrtpHandler    _handlers[CRTP_PORTS];
+
+    uint8_t             _setpoint[NRF24_MAX_MESSAGE_LEN];  // Header and data
+    uint8_t             _setpointLen;                      // 0 if none
+    uint32_t            _setpointInterval;
+    unsigned long       _lastSetpoint;
+    uint32_t            _pollInterval;
+    unsigned long       _lastPoll;
+    boolean             _downlinkPending;  // The last ACK carried a payload, the copter may have more
+
+    uint8_t             _queue[NRF24_CRTP_QUEUE_LEN][NRF24_MAX_MESSAGE_LEN];
+    uint8_t             _queueLen[NRF24_CRTP_QUEUE_LEN];
+    uint8_t             _queueHead;
+    uint8_t             _queueTail;
+
+    uint8_t             _inFlight;
+    uint8_t             _failures;   // In a row
+    NRF24CrtpStats      _stats;
+};
+
+#endif
@@ -0,0 +1,225 @@
+// NRF24Sniffer.cpp
+//
+
+#include <NRF24Sniffer.h>
+
+// Octet i of a frame's payload (and after it, its CRC): the payload starts 9 bits in,
+// after the packet control field
+static inline uint8_t shifted(const uint8_t* raw, uint8_t i)
+{
+    return (raw[i + 1] << 1) | (raw[i + 2] >> 7);
+}
+
+// Runs bits of an octet, MSB first, through a CRC kept in the top of 16 bits, so that
+// the nRF24's CRC-8 (polynomial 0x07) and CRC-16 (polynomial 0x1021) share the code
+static uint16_t crcUpdate(uint16_t crc, uint16_t poly, uint8_t data, uint8_t bits)
+{
+    while (bits--)
+    {
+	boolean bit = ((crc >> 8) ^ data) & 0x80;
+	crc <<= 1;
+	if (bit)
+	    crc ^= poly;
+	data <<= 1;
+    }
+    return crc;
+}
+
+NRF24Sniffer::NRF24Sniffer(uint8_t chipEnablePin, uint8_t chipSelectPin)
+    : NRF24(chipEnablePin, chipSelectPin)
+{
+    _addressLen = 5;
+    _crcLen = NRF24_SNIFFER_CRC_NONE;
+    _window = NRF24_MAX_MESSAGE_LEN;
+    _head = 0;
+    _tail = 0;
+    _frames = 0;
+    _valid = 0;
+    _overruns = 0;
+    _unreported = 0;
+}
+
+void NRF24Sniffer::begin(unsigned long baud)
+{
+    Serial.begin(baud);
+    Serial.write(NRF24_SNIFFER_MAGIC);
+}
+
+boolean NRF24Sniffer::listen(uint8_t channel, uint8_t dataRate, uint8_t addressLen, uint8_t crcLen, uint8_t window)
+{
+    if (addressLen < 3 || addressLen > 5 || crcLen < NRF24_SNIFFER_CRC_1 || crcLen > NRF24_SNIFFER_CRC_2
+	|| window > NRF24_MAX_MESSAGE_LEN || window < crcLen + 2)
+	return false;
+    _addressLen = addressLen;
+    _crcLen = crcLen;
+    _window = window;
+
+    // Fixed width, no CRC check, no ACKs: the radio hands over whatever follows the address.
+    // Powered up first, so that it is out of standby by the end
+    setChipEnable(false);
+    setConfiguration(0);
+    spiWriteRegister(NRF24_REG_00_CONFIG, NRF24_PWR_UP | NRF24_PRIM_RX);
+    spiWriteRegister(NRF24_REG_01_EN_AA, 0);
+    spiWriteRegister(NRF24_REG_02_EN_RXADDR, 0);
+    spiWriteRegister(NRF24_REG_03_SETUP_AW, addressLen - 2);
+    spiWriteRegister(NRF24_REG_1C_DYNPD, 0);
+    spiWriteRegister(NRF24_REG_1D_FEATURE, 0);
+    spiWriteRegister(NRF24_REG_11_RX_PW_P0, window);
+    spiWriteRegister(NRF24_REG_12_RX_PW_P1, window);
+    setChannel(channel);
+    setRF(dataRate, NRF24TransmitPower0dBm);
+    flushRx();
+    spiWriteRegister(NRF24_REG_07_STATUS, NRF24_RX_DR | NRF24_TX_DS | NRF24_MAX_RT);
+    _head = _tail = 0;
+    return powerUpRx();
+}
+
+boolean NRF24Sniffer::listenPromiscuous(uint8_t channel, uint8_t dataRate)
+{
+    // The nRF24 takes an address width of 0 to be 2 octets. Noise before the preamble is
+    // often 0x00, so 0x00 then the preamble (0xaa or 0x55, by the first address bit)
+    // matches most frames. On air the address goes MSB first
+    static const uint8_t preamble[2][2] = { { 0xaa, 0x00 }, { 0x55, 0x00 } };
+
+    if (!listen(channel, dataRate, 3, NRF24_SNIFFER_CRC_1, NRF24_MAX_MESSAGE_LEN))
+	return false;
+    setChipEnable(false);
+    spiWriteRegister(NRF24_REG_03_SETUP_AW, 0);
+    setPipeAddress(0, (uint8_t*)preamble[0], 2);
+    setPipeAddress(1, (uint8_t*)preamble[1], 2);
+    spiWriteRegister(NRF24_REG_02_EN_RXADDR, NRF24_ERX_P0 | NRF24_ERX_P1);
+    _crcLen = NRF24_SNIFFER_CRC_NONE;
+    setChipEnable(true);
+    return true;
+}
+
+boolean NRF24Sniffer::setAddress(uint8_t pipe, const uint8_t* address)
+{
+    if (pipe > 1)
+	return false;
+    memcpy(_address[pipe], address, _addressLen);
+    setPipeAddress(pipe, _address[pipe], _addressLen);
+    spiWriteRegister(NRF24_REG_02_EN_RXADDR, spiReadRegister(NRF24_REG_02_EN_RXADDR) | (1 << pipe));
+    return true;
+}
+
+uint8_t NRF24Sniffer::poll()
+{
+    uint8_t count = 0;
+
+    while (true)
+    {
+	// The STATUS clocked out with a NOP gives the pipe of the frame at the head of the
+	// RX FIFO, or 7 if it is empty. R_RX_PAYLOAD is only sent for a frame known to be there,
+	// as one that arrives while it is being sent could be lost
+	uint8_t pipe = (spiCommand(NRF24_COMMAND_NOP) & NRF24_RX_P_NO) >> 1;
+	if (pipe > 5)
+	    break;
+	uint8_t next = (_head + 1) % NRF24_SNIFFER_RING;
+	if (next == _tail)
+	{
+	    // No room, the frame stays in the radio
+	    _overruns++;
+	    if (_unreported < 0xff)
+		_unreported++;
+	    break;
+	}
+
+	NRF24SnifferFrame* frame = &_ring[_head];
+	uint8_t* dest = frame->data;
+	uint8_t len = _window;
+	spiStreamBegin(NRF24_COMMAND_R_RX_PAYLOAD);
+	spiStreamWrite(0);
+	while (--len)
+	    *dest++ = spiStreamWrite(0);
+	*dest = spiStreamEnd();
+
+	frame->flags = pipe;
+	frame->time = micros();
+	frame->len = _window;
+	_frames++;
+	if (decode(frame))
+	    _valid++;
+	_head = next;
+	count++;
+    }
+    // Frames are found by the pipe number, but clear RX_DR so that IRQ follows
+    if (count)
+	spiWriteRegister(NRF24_REG_07_STATUS, NRF24_RX_DR);
+    return count;
+}
+
+boolean NRF24Sniffer::decode(NRF24SnifferFrame* frame)
+{
+    uint8_t pipe = frame->flags & NRF24_SNIFFER_PIPE;
+    uint8_t* raw = frame->data;
+    uint8_t len = raw[0] >> 2;
+    uint8_t i;
+
+    if (_crcLen == NRF24_SNIFFER_CRC_NONE || pipe > 1 || len + _crcLen > _window - 2)
+	return false;
+
+    // The CRC covers the address, MSB first, the packet control field and the payload
+    uint16_t poly = _crcLen == NRF24_SNIFFER_CRC_1 ? 0x0700 : 0x1021;
+    uint16_t crc = _crcLen == NRF24_SNIFFER_CRC_1 ? 0xff00 : 0xffff;
+    for (i = _addressLen; i--; )
+	crc = crcUpdate(crc, poly, _address[pipe][i], 8);
+    crc = crcUpdate(crc, poly, raw[0], 8);
+    crc = crcUpdate(crc, poly, raw[1], 1);
+    for (i = 0; i < len; i++)
+	crc = crcUpdate(crc, poly, shifted(raw, i), 8);
+    uint16_t received = shifted(raw, len) << 8;
+    if (_crcLen == NRF24_SNIFFER_CRC_2)
+	received |= shifted(raw, len + 1);
+    if (crc != received)
+	return false;
+
+    // Each payload octet is made from the raw ones at and after it, so it can go in place
+    frame->flags = pipe | NRF24_SNIFFER_VALID | ((raw[0] << NRF24_SNIFFER_PID_SHIFT) & NRF24_SNIFFER_PID)
+	| ((raw[1] & 0x80) ? NRF24_SNIFFER_NO_ACK : 0);
+    for (i = 0; i < len; i++)
+	raw[i] = shifted(raw, i);
+    frame->len = len;
+    return true;
+}
+
+NRF24SnifferFrame* NRF24Sniffer::peek()
+{
+    return _head == _tail ? NULL : &_ring[_tail];
+}
+
+void NRF24Sniffer::pop()
+{
+    if (_head != _tail)
+	_tail = (_tail + 1) % NRF24_SNIFFER_RING;
+}
+
+// Writes the header of a record
+static void writeHeader(uint8_t flags, unsigned long time, uint8_t len)
+{
+    uint8_t header[NRF24_SNIFFER_HEADER_LEN] = { flags, (uint8_t)time, (uint8_t)(time >> 8),
+						 (uint8_t)(time >> 16), (uint8_t)(time >> 24), len };
+    Serial.write(header, sizeof(header));
+}
+
+void NRF24Sniffer::write(const NRF24SnifferFrame* frame)
+{
+    if (_unreported)
+    {
+	writeHeader(NRF24_SNIFFER_OVERRUN, frame->time, 1);
+	Serial.write(_unreported);
+	_unreported = 0;
+    }
+    writeHeader(frame->flags, frame->time, frame->len);
+    Serial.write(frame->data, frame->len);
+}
+
+void NRF24Sniffer::dump()
+{
+    NRF24SnifferFrame* frame;
+    while ((frame = peek()))
+    {
+	write(frame);
+	pop();
+    }
+}
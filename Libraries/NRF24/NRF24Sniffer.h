@@ -0,0 +1,169 @@
+// NRF24Sniffer.h
+//
+/// \class NRF24Sniffer NRF24Sniffer.h <NRF24Sniffer.h>
+/// \brief Capture raw Enhanced ShockBurst frames, including ACKs, for link debugging.
+///
+/// This subclass of NRF24 listens on a channel without taking part in the link, and
+/// captures every frame sent to up to two addresses: packets, retransmissions and the
+/// receiver's ACKs alike, which an ordinary receiver hides. The radio is set up with auto
+/// ACK, dynamic payloads and its own CRC check off, and a fixed payload width (the
+/// window), so the octets it hands over are the frame as it was on air after the address:
+/// the 9 bit packet control field (6 bits of length, 2 of PID and the NO_ACK bit), the
+/// payload and the CRC, not aligned to octets. poll() reads them from the RX FIFO into a
+/// ring buffer, stamped with micros(), and checks the CRC in software, keeping the
+/// payload of those that pass and the raw window of those that do not.
+///
+/// The window must hold the longest frame of interest: 2 octets more than its payload and
+/// CRC. It should not be much longer, or a frame that follows closely (an ACK comes about
+/// 130 microsecs after the packet it acknowledges) starts while the radio is still
+/// clocking in the one before, and is missed.
+///
+/// listenPromiscuous() uses a 2 octet address that matches the preamble, and no CRC, so
+/// that frames to any address are captured, at the cost of many false ones from noise. The
+/// radio cannot know where such frames start, so they are all kept raw, for a PC to search,
+/// and the whole 32 octet window is needed, so ACKs are mostly missed.
+///
+/// write() sends a frame to Serial in a compact binary record. The stream is
+/// NRF24_SNIFFER_MAGIC (sent by begin()), then records:
+/// \code
+///   flags   NRF24_SNIFFER_PIPE, and NRF24_SNIFFER_VALID with the NO_ACK bit and PID of a
+///           frame that passed its CRC check, or NRF24_SNIFFER_OVERRUN
+///   time    micros() when the frame was read, 4 octets LSB first
+///   len     number of octets that follow
+///   data    the payload of a valid frame, else the raw window. For an overrun record,
+///           the number of times frames were left in the radio since the last record
+/// \endcode
+/// tools/cx10_sniff decodes such captures.
+#ifndef NRF24Sniffer_h
+#define NRF24Sniffer_h
+
+#include <NRF24.h>
+
+// Serial speed for captures. 1Mbaud is exact on a 16MHz Arduino
+#define NRF24_SNIFFER_BAUD          1000000
+
+// Frames in the ring buffer. It holds one less than this
+#define NRF24_SNIFFER_RING          8
+
+// Written once by begin(), ahead of the records
+#define NRF24_SNIFFER_MAGIC         "NRF24SN1"
+
+// Octets of each record before its data: flags, time and len
+#define NRF24_SNIFFER_HEADER_LEN    6
+
+// Record flags
+#define NRF24_SNIFFER_PIPE          0x07
+#define NRF24_SNIFFER_VALID         0x08  // CRC passed, data is the payload
+#define NRF24_SNIFFER_NO_ACK        0x10
+#define NRF24_SNIFFER_PID           0x60
+#define NRF24_SNIFFER_PID_SHIFT     5
+#define NRF24_SNIFFER_OVERRUN       0x80  // Not a frame: frames were left in the radio's RX FIFO
+
+// CRC lengths for listen()
+#define NRF24_SNIFFER_CRC_NONE      0
+#define NRF24_SNIFFER_CRC_1         1
+#define NRF24_SNIFFER_CRC_2         2
+
+/////////////////////////////////////////////////////////////////////
+/// \struct NRF24SnifferFrame NRF24Sniffer.h <NRF24Sniffer.h>
+/// \brief A captured frame, as held in the NRF24Sniffer ring buffer
+typedef struct
+{
+    uint8_t          flags;    ///< As the record flags: NRF24_SNIFFER_PIPE, NRF24_SNIFFER_VALID etc
+    unsigned long    time;     ///< micros() when it was read from the RX FIFO
+    uint8_t          len;      ///< Number of octets in data
+    uint8_t          data[NRF24_MAX_MESSAGE_LEN]; ///< The payload if valid, else the raw window
+} NRF24SnifferFrame;
+
+/////////////////////////////////////////////////////////////////////
+class NRF24Sniffer : public NRF24
+{
+public:
+    /// Constructor. See NRF24::NRF24()
+    /// \param[in] chipEnablePin the Arduino pin to use to enable the chip for transmit/receive
+    /// \param[in] chipSelectPin the Arduino pin number of the output to use to select the NRF24 before
+    /// accessing it
+    NRF24Sniffer(uint8_t chipEnablePin = 8, uint8_t chipSelectPin = SS);
+
+    /// Starts Serial for write(), and writes NRF24_SNIFFER_MAGIC.
+    /// \param[in] baud The serial speed
+    void           begin(unsigned long baud = NRF24_SNIFFER_BAUD);
+
+    /// Sets the radio up to capture frames, and turns the receiver on. Call after init().
+    /// No pipe is enabled until setAddress().
+    /// \param[in] channel The channel to listen on
+    /// \param[in] dataRate One of NRF24DataRate
+    /// \param[in] addressLen Length of the addresses, 3 to 5 octets
+    /// \param[in] crcLen The CRC length of the link: NRF24_SNIFFER_CRC_1 or NRF24_SNIFFER_CRC_2
+    /// \param[in] window Octets to capture after the address, up to NRF24_MAX_MESSAGE_LEN
+    /// \return true on success
+    boolean        listen(uint8_t channel, uint8_t dataRate, uint8_t addressLen, uint8_t crcLen, uint8_t window);
+
+    /// Sets the radio up to capture frames to any address, and turns the receiver on.
+    /// All frames are kept raw, with the whole NRF24_MAX_MESSAGE_LEN window.
+    /// \param[in] channel The channel to listen on
+    /// \param[in] dataRate One of NRF24DataRate
+    /// \return true on success
+    boolean        listenPromiscuous(uint8_t channel, uint8_t dataRate);
+
+    /// Sets the address captured on pipe 0 or 1, and enables that pipe. Can be called while
+    /// listening, to follow a link to a new address.
+    /// \param[in] pipe 0 or 1
+    /// \param[in] address The address, LSB first as for setPipeAddress(), of the length given to listen()
+    /// \return true on success
+    boolean        setAddress(uint8_t pipe, const uint8_t* address);
+
+    /// Moves every frame waiting in the RX FIFO into the ring buffer, and checks their CRCs.
+    /// Call it from loop() often enough that the 3 deep RX FIFO does not fill.
+    /// \return the number of frames moved
+    uint8_t        poll();
+
+    /// \return the oldest frame in the ring buffer, or NULL if it is empty.
+    /// The frame stays valid until pop()
+    NRF24SnifferFrame* peek();
+
+    /// Removes the oldest frame from the ring buffer
+    void           pop();
+
+    /// Writes a frame to Serial as a record, preceded by an overrun record if frames have
+    /// been left in the radio since the last one
+    /// \param[in] frame The frame
+    void           write(const NRF24SnifferFrame* frame);
+
+    /// Writes every frame in the ring buffer to Serial, and removes them
+    void           dump();
+
+    /// \return The number of frames captured, and of those that passed their CRC check
+    uint32_t       frameCount() { return _frames; }
+    uint32_t       validCount() { return _valid; }
+
+    /// \return The number of times poll() left frames in the radio because the ring buffer
+    /// was full. The radio drops frames that arrive while its RX FIFO is full, unseen
+    uint32_t       overrunCount() { return _overruns; }
+
+protected:
+    /// Checks the CRC of a raw frame, and if it passes, replaces the raw window
+    /// with the payload and sets NRF24_SNIFFER_VALID, the NO_ACK bit and PID
+    /// \param[in,out] frame The frame
+    /// \return true if the frame is valid
+    boolean        decode(NRF24SnifferFrame* frame);
+
+private:
+    uint8_t             _addressLen;
+    uint8_t             _crcLen;
+    uint8_t             _window;
+    uint8_t             _address[2][5];
+    NRF24SnifferFrame   _ring[NRF24_SNIFFER_RING];
+    uint8_t             _head;
+    uint8_t             _tail;
+    uint32_t            _frames;
+    uint32_t            _valid;
+    uint32_t            _overruns;
+    uint8_t             _unreported;   // Overruns not yet written in a record
+};
+
+/// @example cx10_sniffer.ino
+/// Example sketch showing how to capture a CX-10 link with the NRF24Sniffer class,
+/// including the ACKs from the quad, for tools/cx10_sniff to decode.
+
+#endif
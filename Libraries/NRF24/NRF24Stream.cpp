@@ -0,0 +1,252 @@
+// NRF24Stream.cpp
+//
+
+#include <NRF24Stream.h>
+
+NRF24Stream::NRF24Stream(uint8_t chipEnablePin, uint8_t chipSelectPin)
+    : NRF24(chipEnablePin, chipSelectPin)
+{
+    _txId = 0;
+    _rxId = 0;
+    _rxActive = false;
+    _rxComplete = false;
+    _rxFragments = 0;
+    _rxLen = 0;
+}
+
+boolean NRF24Stream::init()
+{
+    if (!NRF24::init())
+	return false;
+    // Dynamic payloads, ACK payloads and NOACK on pipes 0 and 1
+    spiWriteRegister(NRF24_REG_1D_FEATURE, NRF24_EN_DPL | NRF24_EN_ACK_PAY | NRF24_EN_DYN_ACK);
+    spiWriteRegister(NRF24_REG_1C_DYNPD, NRF24_DPL_P0 | NRF24_DPL_P1);
+    // Make it unlikely that a restarted sender reuses the number of the
+    // transfer the receiver last completed
+    _txId = micros();
+    return true;
+}
+
+boolean NRF24Stream::waitTxFifo(unsigned long start, uint16_t timeout, boolean empty)
+{
+    do
+    {
+	uint8_t status = statusRead();
+	if (status & NRF24_RX_DR)
+	{
+	    // ACK payloads to acknowledged fragments carry nothing the sender needs
+	    flushRx();
+	    spiWriteRegister(NRF24_REG_07_STATUS, NRF24_RX_DR);
+	}
+	if (status & NRF24_MAX_RT)
+	{
+	    // Flush before clearing MAX_RT, else the radio retries the same packet
+	    flushTx();
+	    spiWriteRegister(NRF24_REG_07_STATUS, NRF24_MAX_RT);
+	}
+	if (empty ? (spiReadRegister(NRF24_REG_17_FIFO_STATUS) & NRF24_TX_EMPTY)
+	    : !(status & NRF24_STATUS_TX_FULL))
+	    return true;
+    } while (millis() - start < timeout);
+    return false;
+}
+
+void NRF24Stream::queueFragment(uint8_t index, boolean noack)
+{
+    uint16_t offset = (uint16_t)index * NRF24_STREAM_FRAGMENT_LEN;
+    uint16_t len = _txLen - offset;
+    if (len > NRF24_STREAM_FRAGMENT_LEN)
+	len = NRF24_STREAM_FRAGMENT_LEN;
+
+    // Straight from the caller's buffer, without copying
+    spiStreamBegin(noack ? NRF24_COMMAND_W_TX_PAYLOAD_NOACK : NRF24_COMMAND_W_TX_PAYLOAD);
+    spiStreamWrite(NRF24_STREAM_DATA | (index == _txFragments - 1 ? NRF24_STREAM_LAST : 0));
+    spiStreamWrite(_txId);
+    spiStreamWrite(index);
+    while (len--)
+	spiStreamWrite(_txData[offset++]);
+    spiStreamEnd();
+}
+
+boolean NRF24Stream::poll()
+{
+    uint8_t frame[NRF24_STREAM_HEADER_LEN] = { NRF24_STREAM_POLL, _txId, 0 };
+    uint8_t status;
+    uint8_t len;
+    unsigned long start;
+
+    spiWriteRegister(NRF24_REG_07_STATUS, NRF24_TX_DS | NRF24_MAX_RT);
+    flushRx();
+    spiBurstWrite(NRF24_COMMAND_W_TX_PAYLOAD, frame, sizeof(frame));
+    start = millis();
+    while (!((status = statusRead()) & (NRF24_TX_DS | NRF24_MAX_RT)))
+	if (millis() - start >= NRF24_STREAM_POLL_TIMEOUT)
+	    break;
+    if (!(status & NRF24_TX_DS))
+    {
+	// Lost, or never finished. Flush before clearing MAX_RT, else the radio retries
+	// the poll we are giving up on
+	flushTx();
+	spiWriteRegister(NRF24_REG_07_STATUS, NRF24_TX_DS | NRF24_MAX_RT);
+	return false;
+    }
+    spiWriteRegister(NRF24_REG_07_STATUS, NRF24_TX_DS | NRF24_MAX_RT);
+
+    // The ACK payload, if any, is in the RX FIFO as soon as TX_DS is set
+    while (available())
+    {
+	len = sizeof(_status);
+	if (recv(_status, &len)
+	    && len == sizeof(_status)
+	    && (_status[0] & NRF24_STREAM_TYPE) == NRF24_STREAM_STATUS
+	    && _status[1] == _txId)
+	    return true;
+    }
+    return false;
+}
+
+boolean NRF24Stream::sendStream(const uint8_t* data, uint16_t len, boolean noack, uint16_t timeout)
+{
+    unsigned long start = millis();
+    uint16_t i;
+
+    if (len > NRF24_STREAM_MAX_LEN)
+	return false;
+    _txData = data;
+    _txLen = len;
+    _txFragments = len ? (len + NRF24_STREAM_FRAGMENT_LEN - 1) / NRF24_STREAM_FRAGMENT_LEN : 1;
+    _txId++;
+
+    powerUpTx();
+    for (i = 0; i < _txFragments; i++)
+    {
+	if (!waitTxFifo(start, timeout, false))
+	    return false;
+	queueFragment(i, noack);
+    }
+
+    while (millis() - start < timeout)
+    {
+	// Let the last fragments go before asking what arrived
+	if (!waitTxFifo(start, timeout, true))
+	    return false;
+	if (!poll())
+	{
+	    // Lost, or the receiver had not loaded its status yet
+	    delay(NRF24_STREAM_POLL_INTERVAL);
+	    continue;
+	}
+	if (_status[0] & NRF24_STREAM_COMPLETE)
+	    return true;
+
+	// Resend the fragments the receiver does not have. Those past the
+	// end of its bitmap are resent too, since they are not known to have arrived
+	uint8_t base = _status[2];
+	for (i = base; i < _txFragments; i++)
+	{
+	    uint16_t n = i - base;
+	    if (n < NRF24_STREAM_WINDOW
+		&& (_status[NRF24_STREAM_HEADER_LEN + n / 8] & (1 << (n % 8))))
+		continue;
+	    if (!waitTxFifo(start, timeout, false))
+		return false;
+	    queueFragment(i, noack);
+	}
+    }
+    return false;
+}
+
+uint16_t NRF24Stream::firstMissing()
+{
+    uint16_t i;
+    for (i = 0; i < sizeof(_rxBitmap) && _rxBitmap[i] == 0xff; i++)
+	;
+    i *= 8;
+    while (i < NRF24_STREAM_MAX_FRAGMENTS && (_rxBitmap[i / 8] & (1 << (i % 8))))
+	i++;
+    return i;
+}
+
+void NRF24Stream::loadStatus()
+{
+    uint8_t status[NRF24_MAX_MESSAGE_LEN];
+    // The bitmap starts on an octet boundary, so it can be copied as is
+    uint8_t base = firstMissing() / 8;
+    uint8_t n = sizeof(_rxBitmap) - base;
+
+    if (n > sizeof(status) - NRF24_STREAM_HEADER_LEN)
+	n = sizeof(status) - NRF24_STREAM_HEADER_LEN;
+    memset(status, 0, sizeof(status));
+    status[0] = NRF24_STREAM_STATUS | (_rxComplete ? NRF24_STREAM_COMPLETE : 0);
+    status[1] = _rxId;
+    status[2] = base * 8;
+    memcpy(status + NRF24_STREAM_HEADER_LEN, _rxBitmap + base, n);
+
+    // Replace the status loaded earlier, if it has not been sent
+    flushTx();
+    spiBurstWrite(NRF24_COMMAND_W_ACK_PAYLOAD(1), status, sizeof(status));
+}
+
+boolean NRF24Stream::recvStream(uint8_t* buf, uint16_t* len, uint16_t timeout)
+{
+    uint8_t frame[NRF24_MAX_MESSAGE_LEN];
+    uint8_t flen;
+    unsigned long start = millis();
+
+    powerUpRx();
+    do
+    {
+	while (available())
+	{
+	    flen = sizeof(frame);
+	    if (!recv(frame, &flen) || flen < NRF24_STREAM_HEADER_LEN)
+		continue;
+	    uint8_t type = frame[0] & NRF24_STREAM_TYPE;
+	    if (type != NRF24_STREAM_DATA && type != NRF24_STREAM_POLL)
+		continue;
+	    boolean done = false;
+
+	    if (frame[1] != _rxId || !(_rxActive || _rxComplete))
+	    {
+		// A new transfer. Any transfer in progress has been given up by the sender
+		_rxId = frame[1];
+		_rxActive = true;
+		_rxComplete = false;
+		_rxFragments = 0;
+		_rxLen = 0;
+		memset(_rxBitmap, 0, sizeof(_rxBitmap));
+	    }
+
+	    // Repeats of a completed transfer are only answered
+	    if (type == NRF24_STREAM_DATA && _rxActive)
+	    {
+		uint8_t index = frame[2];
+		uint16_t offset = (uint16_t)index * NRF24_STREAM_FRAGMENT_LEN;
+		flen -= NRF24_STREAM_HEADER_LEN;
+		if (offset + flen <= *len)
+		{
+		    memcpy(buf + offset, frame + NRF24_STREAM_HEADER_LEN, flen);
+		    _rxBitmap[index / 8] |= 1 << (index % 8);
+		    if (frame[0] & NRF24_STREAM_LAST)
+		    {
+			_rxFragments = index + 1;
+			_rxLen = offset + flen;
+		    }
+		}
+		if (_rxFragments && firstMissing() >= _rxFragments)
+		{
+		    _rxActive = false;
+		    _rxComplete = true;
+		    done = true;
+		}
+	    }
+	    loadStatus();
+	    if (done)
+	    {
+		*len = _rxLen;
+		return true;
+	    }
+	}
+    } while (millis() - start < timeout);
+    return false;
+}
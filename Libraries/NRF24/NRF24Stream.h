@@ -0,0 +1,172 @@
+// NRF24Stream.h
+//
+/// \class NRF24Stream NRF24Stream.h <NRF24Stream.h>
+/// \brief Send and receive buffers larger than one nRF24L01 packet.
+///
+/// This subclass of NRF24 sends a buffer of up to NRF24_STREAM_MAX_LEN octets
+/// (configuration blobs, logs etc) as a series of fragments, and reassembles them
+/// in order at the receiver, however they arrive.
+///
+/// The sender keeps the 3 entry TX FIFO full, so the radio sends fragments back to back
+/// without waiting for the processor, sent NOACK by default (or acknowledged, with
+/// auto retransmit, if preferred). When all fragments have gone, the sender polls the receiver,
+/// and the receiver answers in the ACK payload of the poll with a bitmap of the fragments it has.
+/// The sender then resends only the missing fragments and polls again, until the receiver has
+/// the whole buffer or the timeout expires.
+///
+/// Each fragment carries a header of NRF24_STREAM_HEADER_LEN octets:
+/// \code
+///   type   NRF24_STREAM_DATA, with NRF24_STREAM_LAST set on the last fragment
+///   id     transfer number, incremented by the sender for each buffer
+///   index  fragment number, the fragment goes at index * NRF24_STREAM_FRAGMENT_LEN
+/// \endcode
+/// followed by up to NRF24_STREAM_FRAGMENT_LEN octets of data. A poll is a
+/// NRF24_STREAM_POLL header, always acknowledged, with 0 in the index field.
+/// The receiver's status is a NRF24_STREAM_STATUS header (with NRF24_STREAM_COMPLETE set
+/// when it has everything), with the first missing fragment rounded down to a multiple of 8
+/// in the index field, followed by a bitmap of the NRF24_STREAM_WINDOW fragments from that
+/// one on: bit n of the bitmap is set if fragment index + n has arrived. The receiver
+/// reloads its status after every frame it receives, so a poll sent after the last
+/// fragment finds it up to date.
+///
+/// Both ends must be initialised with NRF24Stream::init(), which enables dynamic payloads,
+/// ACK payloads and NOACK on pipes 0 and 1, and must have each other's addresses as
+/// transmit and this address. The status is a 32 octet ACK payload, which needs an
+/// auto retransmit delay of at least 500 microsecs at 1 or 2Mbps and 1500 at 250kbps:
+/// call setRetry() after setRF(), which sets 250 microsecs.
+/// The receiver must call recvStream() often enough to keep up with the sender:
+/// at 2Mbps a fragment arrives about every 300 microsecs, and the RX FIFO holds only 3.
+///
+/// Goodput is limited by the 130 microsec PLL settling time before every packet (even
+/// back to back from the FIFO in Standby-II), the packet overhead and the 3 octet header:
+/// about 90 kbytes per sec at 2Mbps without loss, compared to about 12 kbytes per sec
+/// for one acknowledged 32 octet send() at a time.
+#ifndef NRF24Stream_h
+#define NRF24Stream_h
+
+#include <NRF24.h>
+
+// Fragment header: type, transfer id, fragment index
+#define NRF24_STREAM_HEADER_LEN     3
+#define NRF24_STREAM_FRAGMENT_LEN   (NRF24_MAX_MESSAGE_LEN - NRF24_STREAM_HEADER_LEN)
+
+// The fragment index is one octet
+#define NRF24_STREAM_MAX_FRAGMENTS  256
+#define NRF24_STREAM_MAX_LEN        ((uint16_t)NRF24_STREAM_MAX_FRAGMENTS * NRF24_STREAM_FRAGMENT_LEN)
+
+// Number of fragments reported in each status
+#define NRF24_STREAM_WINDOW         ((NRF24_MAX_MESSAGE_LEN - NRF24_STREAM_HEADER_LEN) * 8)
+
+// Frame types, in the first octet of the header
+#define NRF24_STREAM_TYPE           0xf0
+#define NRF24_STREAM_DATA           0x10
+#define NRF24_STREAM_POLL           0x20
+#define NRF24_STREAM_STATUS         0x30
+// Flags in the first octet
+#define NRF24_STREAM_LAST           0x01  // DATA: this is the last fragment
+#define NRF24_STREAM_COMPLETE       0x01  // STATUS: all fragments have arrived
+
+// Millisecs to wait before polling again when the receiver has no status ready
+#define NRF24_STREAM_POLL_INTERVAL  2
+
+// Millisecs to wait for a poll to end in TX_DS or MAX_RT. 15 retries at the longest
+// auto retransmit delay of 4000 microsecs take about 62, so this is only reached
+// if the radio has stopped, for example after a reset
+#define NRF24_STREAM_POLL_TIMEOUT   70
+
+/////////////////////////////////////////////////////////////////////
+class NRF24Stream : public NRF24
+{
+public:
+    /// Constructor. See NRF24::NRF24()
+    /// \param[in] chipEnablePin the Arduino pin to use to enable the chip for transmit/receive
+    /// \param[in] chipSelectPin the Arduino pin number of the output to use to select the NRF24 before
+    /// accessing it
+    NRF24Stream(uint8_t chipEnablePin = 8, uint8_t chipSelectPin = SS);
+
+    /// Initialises this instance and the radio module connected to it, as NRF24::init(),
+    /// and enables dynamic payloads, ACK payloads and NOACK on pipes 0 and 1.
+    /// \return  true if everything was successful
+    boolean        init();
+
+    /// Sends a buffer to the transmit address, and waits until the receiver
+    /// has all of it. The radio is left in TX mode.
+    /// \param[in] data The buffer to send
+    /// \param[in] len Number of octets to send, up to NRF24_STREAM_MAX_LEN
+    /// \param[in] noack Send fragments NOACK (the default), else acknowledged and retried by the
+    /// radio, which costs air time but loses fewer fragments on a poor link
+    /// \param[in] timeout Maximum millisecs to wait for the receiver to have the whole buffer
+    /// \return true if the receiver reported the whole buffer received
+    boolean        sendStream(const uint8_t* data, uint16_t len, boolean noack = true, uint16_t timeout = 1000);
+
+    /// Receives fragments into buf until a whole buffer has arrived or the timeout expires.
+    /// A buffer partly received when the timeout expires is carried on with at the next call,
+    /// so this can be called repeatedly from loop() with a short timeout.
+    /// The same buf and size must be passed until a buffer is complete.
+    /// Fragments that would not fit in buf are discarded, so a buffer larger than
+    /// size never completes.
+    /// \param[in] buf Location to reassemble the buffer
+    /// \param[in,out] len Pointer to available space in buf. Set to the length of the
+    /// buffer received, if one was.
+    /// \param[in] timeout Maximum millisecs to wait
+    /// \return true if a whole buffer was received
+    boolean        recvStream(uint8_t* buf, uint16_t* len, uint16_t timeout = 1000);
+
+protected:
+    /// Waits until the TX FIFO has room for another fragment. A packet that reaches
+    /// its maximum retries is flushed with the rest of the TX FIFO: the receiver will
+    /// report the fragments missing.
+    /// \param[in] start millis() at the start of the transfer
+    /// \param[in] timeout Maximum millisecs since start
+    /// \param[in] empty Wait for the TX FIFO to be empty, rather than not full
+    /// \return false if the timeout expired
+    boolean        waitTxFifo(unsigned long start, uint16_t timeout, boolean empty);
+
+    /// Queues one fragment of _txData in the TX FIFO, which must have room
+    /// \param[in] index The fragment number
+    /// \param[in] noack Send NOACK
+    void           queueFragment(uint8_t index, boolean noack);
+
+    /// Sends a poll and reads the receiver's status from its ACK payload into _status.
+    /// A poll that has not ended after NRF24_STREAM_POLL_TIMEOUT millisecs is flushed
+    /// and counts as lost
+    /// \return true if a status for the current transfer was received
+    boolean        poll();
+
+    /// Loads the receiver's current status as the ACK payload for the next packet
+    /// received on pipe 1, in place of any status loaded earlier
+    void           loadStatus();
+
+    /// \return the number of the first fragment of the current transfer
+    /// not yet received, or NRF24_STREAM_MAX_FRAGMENTS if all have been
+    uint16_t       firstMissing();
+
+private:
+    // Sender
+    const uint8_t*      _txData;
+    uint16_t            _txLen;
+    uint16_t            _txFragments;
+    uint8_t             _txId;
+    uint8_t             _status[NRF24_MAX_MESSAGE_LEN];
+
+    // Receiver
+    uint8_t             _rxId;
+    boolean             _rxActive;    // Fragments of transfer _rxId are arriving
+    boolean             _rxComplete;  // Transfer _rxId is complete
+    uint16_t            _rxFragments; // Number of fragments, once the last has arrived, else 0
+    uint16_t            _rxLen;
+    uint8_t             _rxBitmap[NRF24_STREAM_MAX_FRAGMENTS / 8];
+};
+
+/// @example nrf24_stream_client.ino
+/// Example sketch showing how to send buffers larger than one packet
+/// with the NRF24Stream class.
+/// Sends a 1024 octet test buffer once a second and prints the goodput.
+/// It is designed to work with the example nrf24_stream_server
+
+/// @example nrf24_stream_server.ino
+/// Example sketch showing how to receive buffers larger than one packet
+/// with the NRF24Stream class.
+/// It is designed to work with the example nrf24_stream_client
+
+#endif
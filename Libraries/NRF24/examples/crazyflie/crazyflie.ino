@@ -5,28 +5,42 @@
 // using the CRTP radiolink protocol:
 // http://wiki.bitcraze.se/projects:crazyflie:firmware:comm_protocol
 //
-// Requires 
+// Requires
 // - NRF24 radio module such as the sparkfun WRL-00691 http://www.sparkfun.com/products/691
 // - Arduino such as Uno
 // - A Crazyflie transmitter, such as the Carzyflie PC client+CrazyRadio module
 // or
 // the NRF24 crazyflie client part of the NRF24 library
 //
-// Uses NRF24 library to comunicate with the Crazyflie, 
+// Uses NRF24 library to comunicate with the Crazyflie,
 // http://www.airspayce.com/mikem/arduino/NRF24
 //
-// Receives and decodes varion message types from teh Crazyflie transmitter, although
-// only the link echo and commander messages are fully implemented
+// Receives and decodes varion message types from teh Crazyflie transmitter: link echo,
+// commander, a token parameter TOC, and the log port, so a client can read the log TOC,
+// create log blocks of the variables in it, and have them streamed back:
+// http://wiki.bitcraze.se/projects:crazyflie:crtp:log
+//
+// Everything the copter sends goes in ACK payloads, so it can only send as fast as the
+// client sends it packets. Started log blocks are sampled on their period into a queue
+// of log packets, and loop() keeps the radio's 3 deep ACK FIFO topped up from it, so
+// every packet from the client collects one. A block started with a period of 0 is
+// sampled whenever the FIFO has room and nothing else is waiting, so it streams at the
+// highest rate the link allows; use it to load the downlink when benchmarking.
+// Replies on the log control and TOC channels go ahead of log data. A sample that finds
+// the queue full, or a period missed because loop() was busy, is dropped and counted
+// against its block, and in the log.drops variable, so the client can log the drops too.
+// tools/crazyflie_bench runs this sketch against the nRF24 model with a client that does.
 //
 // Author: Mike McCauley
 // Copyright (C) 2012 Mike McCauley
 
 #include <NRF24.h>
 #include <SPI.h>
+#include <SpscQueue.h>
 
 // Structure of Crazyflie commander messages
-#pragma pack(1);
-typedef struct 
+#pragma pack(1)
+typedef struct
 {
   float roll;
   float pitch;
@@ -53,6 +67,39 @@ typedef struct
 #define LOG_MAX_OPS 64
 #define LOG_MAX_BLOCKS 8
 
+// Log control commands
+#define LOG_CREATE_BLOCK 0
+#define LOG_APPEND_BLOCK 1
+#define LOG_DELETE_BLOCK 2
+#define LOG_START_BLOCK 3
+#define LOG_STOP_BLOCK 4
+#define LOG_RESET 5
+
+// Log control error codes, as errno
+#define LOG_ENOENT 2   // No such block or variable
+#define LOG_E2BIG 7    // Block longer than a log packet
+#define LOG_ENOEXEC 8  // Unknown type
+#define LOG_ENOMEM 12  // No block or op left
+#define LOG_EEXIST 17  // Block already exists
+
+// Log variable types
+#define LOG_UINT8 1
+#define LOG_UINT16 2
+#define LOG_UINT32 3
+#define LOG_INT8 4
+#define LOG_INT16 5
+#define LOG_INT32 6
+#define LOG_FLOAT 7
+#define LOG_FP16 8
+
+// A log packet is the header, the block id and a 3 octet timestamp in ms, then the data
+#define LOG_DATA_OFFSET 5
+#define LOG_MAX_DATA (NRF24_MAX_MESSAGE_LEN - LOG_DATA_OFFSET)
+
+// Log packets waiting for room in the ACK FIFO, and replies. Powers of 2
+#define LOG_QUEUE_LEN 4
+#define REPLY_QUEUE_LEN 4
+
 // Port definitions
 typedef enum {
   CRTP_PORT_CONSOLE     = 0x00,
@@ -74,7 +121,93 @@ NRF24 nrf24;
 // The address to use for this Crazyflie
 uint8_t address[] = { 0xe7, 0xe7, 0xe7, 0xe7, 0xe7 };
 
-void setup() 
+// A packet for the ACK FIFO
+typedef struct
+{
+  uint8_t len;
+  uint8_t data[NRF24_MAX_MESSAGE_LEN];
+} AckPacket;
+
+SpscQueue<AckPacket, REPLY_QUEUE_LEN> replies;
+SpscQueue<AckPacket, LOG_QUEUE_LEN> logPackets;
+
+// The values that can be logged
+CommanderCrtpValues setpoint;
+float vbat = 4.2;
+uint32_t tick;          // millis() when the block was sampled
+uint32_t rxCount;       // Packets received
+uint32_t ackCount;      // ACK payloads loaded
+uint32_t logCount;      // Log packets loaded
+uint32_t logSamples;    // Blocks sampled
+uint32_t logDrops;      // Samples dropped
+
+// The log TOC: type, group and name, and where the value is. Ids are the index
+typedef struct
+{
+  uint8_t type;
+  char name[14];        // Group, 0, name, 0
+  void* value;
+} LogVariable;
+
+const LogVariable logToc[] PROGMEM = {
+  { LOG_FLOAT,  "pm\0vbat",       &vbat },
+  { LOG_FLOAT,  "stab\0roll",     &setpoint.roll },
+  { LOG_FLOAT,  "stab\0pitch",    &setpoint.pitch },
+  { LOG_FLOAT,  "stab\0yaw",      &setpoint.yaw },
+  { LOG_UINT16, "stab\0thrust",   &setpoint.thrust },
+  { LOG_UINT32, "sys\0tick",      &tick },
+  { LOG_UINT32, "radio\0rx",      &rxCount },
+  { LOG_UINT32, "radio\0acks",    &ackCount },
+  { LOG_UINT32, "log\0packets",   &logCount },
+  { LOG_UINT32, "log\0samples",   &logSamples },
+  { LOG_UINT32, "log\0drops",     &logDrops },
+};
+#define LOG_TOC_LEN (sizeof(logToc) / sizeof(logToc[0]))
+
+uint32_t logTocCrc;
+
+// Log blocks, and the ops that say what goes in them: each op is a variable of a block,
+// and the data of a block is its ops in the order they were added
+typedef struct
+{
+  uint8_t id;
+  boolean used;
+  boolean started;
+  uint8_t period;       // 10ms units, 0 to stream as fast as the link allows
+  uint8_t len;          // Octets of data
+  uint32_t due;         // millis() of the next sample
+  uint16_t drops;
+} LogBlock;
+
+typedef struct
+{
+  uint8_t block;        // Index in logBlocks, or LOG_OP_FREE
+  uint8_t variable;
+  uint8_t type;         // Type sent as
+} LogOp;
+#define LOG_OP_FREE 0xff
+
+LogBlock logBlocks[LOG_MAX_BLOCKS];
+LogOp logOps[LOG_MAX_OPS];
+uint8_t logNextPaced;   // Where the round of link paced blocks starts next
+
+const uint8_t logTypeSize[] = { 0, 1, 2, 4, 1, 2, 4, 4, 2 };
+
+uint8_t logFind(uint8_t id);
+void logReset();
+boolean logPaced();
+
+// The Crazyflie PC client only fetches the TOC items again if the CRC changes, so it
+// is worked out from the TOC itself
+uint32_t crc32(uint32_t crc, uint8_t c)
+{
+  crc ^= c;
+  for (uint8_t i = 0; i < 8; i++)
+    crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+  return crc;
+}
+
+void setup()
 {
   Serial.begin(115200);
   while (!Serial)
@@ -90,16 +223,30 @@ void setup()
      Serial.println("setChannel failed");
   // Set data rate to 250k and low power
   if (!nrf24.setRF(NRF24::NRF24DataRate250kbps, NRF24::NRF24TransmitPower0dBm))
-     Serial.println("setRF failed");  
+     Serial.println("setRF failed");
   if (!nrf24.setPipeAddress(0, address, sizeof(address)))
-     Serial.println("setPipeAddress failed");  
+     Serial.println("setPipeAddress failed");
   // Be compatible with Crazyflie: No interrupts, 2 bytes CRC
   nrf24.setConfiguration(NRF24_MASK_RX_DR | NRF24_MASK_TX_DS | NRF24_MASK_MAX_RT | NRF24_EN_CRC | NRF24_CRCO);
   nrf24.spiWriteRegister(NRF24_REG_1D_FEATURE, NRF24_EN_DPL | NRF24_EN_ACK_PAY);   // Dynamic size payload + ack
   nrf24.spiWriteRegister(NRF24_REG_1C_DYNPD, NRF24_DPL_P0);     // Dynamic payload on pipe 0
   if (!nrf24.setRetry(6, 3)) // 1500us and 3 retries
-     Serial.println("setRetry failed");  
+     Serial.println("setRetry failed");
+
+  uint32_t crc = 0xffffffff;
+  for (uint8_t i = 0; i < LOG_TOC_LEN; i++)
+  {
+    LogVariable v;
+    memcpy_P(&v, &logToc[i], sizeof(v));
+    crc = crc32(crc, v.type);
+    for (uint8_t j = 0; j < sizeof(v.name); j++)
+      crc = crc32(crc, v.name[j]);
+  }
+  logTocCrc = ~crc;
+  logReset();
 
+  // Receive from here on; replies and log data go out in ACK payloads
+  nrf24.powerUpRx();
   Serial.println("initialised");
 }
 
@@ -107,7 +254,7 @@ void setup()
 void dump(char* prompt, uint8_t* data, uint8_t len)
 {
   Serial.print(prompt);
-  Serial.print(": ");	
+  Serial.print(": ");
   for (int i = 0; i < len; i++)
   {
     Serial.print(data[i], HEX);
@@ -116,44 +263,308 @@ void dump(char* prompt, uint8_t* data, uint8_t len)
   Serial.println("");
 }
 
-// Send an ACK with a payload on pipe 0
+// Queue a reply, to go in the ACK of a later packet from the client, ahead of log data
 void sendAckPayload(uint8_t* data, uint8_t len)
+{
+  AckPacket* p = replies.back();
+  if (!p)
+    return; // The client will ask again
+  memcpy(p->data, data, len);
+  p->len = len;
+  replies.push();
+}
+
+// Load a packet into the ACK FIFO, to go with the ACK of the next packet from the client
+void loadAckPayload(uint8_t* data, uint8_t len)
 {
   nrf24.spiBurstWrite(NRF24_COMMAND_W_ACK_PAYLOAD(0), data, len);
-  nrf24.waitPacketSent();
+  ackCount++;
 }
 
-// ACK with no payload on pipe 0
-void sendAck()
+// Top up the ACK FIFO: replies first, then queued log packets, then link paced blocks
+void fillAckFifo()
 {
-  sendAckPayload(0, 0);
+  while (!(nrf24.statusRead() & NRF24_STATUS_TX_FULL))
+  {
+    AckPacket* p;
+    if ((p = replies.front()))
+    {
+      loadAckPayload(p->data, p->len);
+      replies.pop();
+    }
+    else if ((p = logPackets.front()))
+    {
+      // A packet of a block deleted since it was sampled is not sent
+      if (logFind(p->data[1]) < LOG_MAX_BLOCKS)
+      {
+        loadAckPayload(p->data, p->len);
+        logCount++;
+      }
+      logPackets.pop();
+    }
+    else if (!logPaced())
+      return;
+  }
+}
+
+// Index in logBlocks of the block with the given id, or LOG_MAX_BLOCKS if none
+uint8_t logFind(uint8_t id)
+{
+  for (uint8_t i = 0; i < LOG_MAX_BLOCKS; i++)
+    if (logBlocks[i].used && logBlocks[i].id == id)
+      return i;
+  return LOG_MAX_BLOCKS;
+}
+
+void logReset()
+{
+  memset(logBlocks, 0, sizeof(logBlocks));
+  for (uint8_t i = 0; i < LOG_MAX_OPS; i++)
+    logOps[i].block = LOG_OP_FREE;
+  logPackets.clear();
+}
+
+void logDelete(uint8_t b)
+{
+  for (uint8_t i = 0; i < LOG_MAX_OPS; i++)
+    if (logOps[i].block == b)
+      logOps[i].block = LOG_OP_FREE;
+  logBlocks[b].used = false;
+}
+
+// Add the ops in a create or append command to a block
+// \return 0, or an error code, with none of them added
+uint8_t logAppend(uint8_t b, uint8_t* ops, uint8_t len)
+{
+  uint8_t count = len / 2;
+  uint8_t blockLen = logBlocks[b].len;
+  uint8_t spare = 0;
+  uint8_t i;
+
+  for (i = 0; i < count; i++)
+  {
+    uint8_t type = ops[2 * i] & 0x0f; // The high nibble is the type stored, which the TOC gives
+    if (ops[2 * i + 1] >= LOG_TOC_LEN)
+      return LOG_ENOENT;
+    if (type < LOG_UINT8 || type > LOG_FP16)
+      return LOG_ENOEXEC;
+    blockLen += logTypeSize[type];
+  }
+  if (blockLen > LOG_MAX_DATA)
+    return LOG_E2BIG;
+  for (i = 0; i < LOG_MAX_OPS; i++)
+    if (logOps[i].block == LOG_OP_FREE)
+      spare++;
+  if (spare < count)
+    return LOG_ENOMEM;
+
+  for (i = 0; i < LOG_MAX_OPS && count; i++)
+  {
+    if (logOps[i].block == LOG_OP_FREE)
+    {
+      logOps[i].block = b;
+      logOps[i].type = *ops++ & 0x0f;
+      logOps[i].variable = *ops++;
+      count--;
+    }
+  }
+  logBlocks[b].len = blockLen;
+  return 0;
+}
+
+// Handle a command on the log control channel, and reply with the command, block id
+// and an error code
+void logControl(uint8_t* buf, uint8_t len)
+{
+  uint8_t reply[] = { CRTP_HEADER(CRTP_PORT_LOG, LOG_CONTROL_CH), buf[1], buf[2], 0 };
+  uint8_t b = logFind(buf[2]);
+
+  if (len < 2)
+    return;
+  if (buf[1] == LOG_RESET)
+  {
+    logReset();
+    reply[2] = 0;
+  }
+  else if (len < 3)
+    reply[3] = LOG_ENOENT;
+  else if (buf[1] == LOG_CREATE_BLOCK)
+  {
+    if (b < LOG_MAX_BLOCKS)
+      reply[3] = LOG_EEXIST;
+    else
+    {
+      for (b = 0; b < LOG_MAX_BLOCKS && logBlocks[b].used; b++)
+        ;
+      if (b == LOG_MAX_BLOCKS)
+        reply[3] = LOG_ENOMEM;
+      else
+      {
+        memset(&logBlocks[b], 0, sizeof(logBlocks[b]));
+        logBlocks[b].id = buf[2];
+        logBlocks[b].used = true;
+        reply[3] = logAppend(b, buf + 3, len - 3);
+        if (reply[3])
+          logBlocks[b].used = false;
+      }
+    }
+  }
+  else if (b == LOG_MAX_BLOCKS)
+    reply[3] = LOG_ENOENT;
+  else if (buf[1] == LOG_APPEND_BLOCK)
+    reply[3] = logAppend(b, buf + 3, len - 3);
+  else if (buf[1] == LOG_DELETE_BLOCK)
+    logDelete(b);
+  else if (buf[1] == LOG_START_BLOCK)
+  {
+    logBlocks[b].period = len > 3 ? buf[3] : 0;
+    logBlocks[b].due = millis();
+    logBlocks[b].started = true;
+  }
+  else if (buf[1] == LOG_STOP_BLOCK)
+    logBlocks[b].started = false;
+  else
+    reply[3] = LOG_ENOEXEC;
+  sendAckPayload(reply, sizeof(reply));
+}
+
+// Convert a float to FP16, truncating
+uint16_t logHalf(float f)
+{
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  uint16_t sign = (bits >> 16) & 0x8000;
+  int16_t exp = ((bits >> 23) & 0xff) - 127 + 15;
+  if (exp <= 0)
+    return sign;
+  if (exp >= 31)
+    return sign | 0x7c00;
+  return sign | (exp << 10) | ((bits >> 13) & 0x3ff);
+}
+
+// Sample a block into a log packet
+void logSample(uint8_t b, uint8_t* packet, uint32_t now)
+{
+  uint8_t* data = packet + LOG_DATA_OFFSET;
+
+  tick = now;
+  packet[0] = CRTP_HEADER(CRTP_PORT_LOG, LOG_LOG_CH);
+  packet[1] = logBlocks[b].id;
+  packet[2] = now;
+  packet[3] = now >> 8;
+  packet[4] = now >> 16;
+  for (uint8_t i = 0; i < LOG_MAX_OPS; i++)
+  {
+    if (logOps[i].block != b)
+      continue;
+    LogVariable v;
+    memcpy_P(&v, &logToc[logOps[i].variable], sizeof(v));
+    // Read as stored, then convert to the type asked for
+    int32_t n = 0;
+    float f;
+    switch (v.type)
+    {
+      case LOG_UINT8:  n = *(uint8_t*)v.value; break;
+      case LOG_UINT16: n = *(uint16_t*)v.value; break;
+      case LOG_UINT32: n = *(uint32_t*)v.value; break;
+      case LOG_INT8:   n = *(int8_t*)v.value; break;
+      case LOG_INT16:  n = *(int16_t*)v.value; break;
+      case LOG_INT32:  n = *(int32_t*)v.value; break;
+    }
+    f = v.type == LOG_FLOAT ? *(float*)v.value : (float)n;
+    if (v.type == LOG_FLOAT)
+      n = (int32_t)f;
+    if (logOps[i].type == LOG_FLOAT)
+      memcpy(data, &f, sizeof(f));
+    else if (logOps[i].type == LOG_FP16)
+    {
+      uint16_t h = logHalf(f);
+      memcpy(data, &h, sizeof(h));
+    }
+    else
+      memcpy(data, &n, logTypeSize[logOps[i].type]); // Little endian, as AVR
+    data += logTypeSize[logOps[i].type];
+  }
+  logSamples++;
+}
+
+// Sample the started blocks that are due into logPackets. Blocks due together are
+// sampled together, with the same timestamp
+void logRun()
+{
+  uint32_t now = millis();
+  for (uint8_t b = 0; b < LOG_MAX_BLOCKS; b++)
+  {
+    LogBlock* block = &logBlocks[b];
+    if (!block->used || !block->started || !block->period || (int32_t)(now - block->due) < 0)
+      continue;
+    uint32_t period = block->period * 10UL;
+    block->due += period;
+    // Periods missed while loop() was busy
+    while ((int32_t)(now - block->due) >= 0)
+    {
+      block->due += period;
+      block->drops++;
+      logDrops++;
+    }
+    AckPacket* p = logPackets.back();
+    if (!p)
+    {
+      block->drops++;
+      logDrops++;
+      continue;
+    }
+    logSample(b, p->data, now);
+    p->len = LOG_DATA_OFFSET + block->len;
+    logPackets.push();
+  }
+}
+
+// Load a sample of the next link paced block straight into the ACK FIFO
+// \return false if there are none
+boolean logPaced()
+{
+  for (uint8_t i = 0; i < LOG_MAX_BLOCKS; i++)
+  {
+    uint8_t b = (logNextPaced + i) % LOG_MAX_BLOCKS;
+    if (logBlocks[b].used && logBlocks[b].started && !logBlocks[b].period)
+    {
+      uint8_t packet[NRF24_MAX_MESSAGE_LEN];
+      logSample(b, packet, millis());
+      loadAckPayload(packet, LOG_DATA_OFFSET + logBlocks[b].len);
+      logCount++;
+      logNextPaced = b + 1;
+      return true;
+    }
+  }
+  return false;
 }
 
 void loop()
 {
   uint8_t buf[100];
-  uint8_t buflen = sizeof(buf);
+  uint8_t buflen;
   static uint32_t last_second = 0;
-  
-  // enable receiver again, after transmit and wait for a message
-  nrf24.waitAvailable();
-  if (nrf24.recv(buf, &buflen))
+  static uint32_t last_count = 0;
+
+  while (nrf24.available())
   {
+    buflen = sizeof(buf);
+    if (!nrf24.recv(buf, &buflen) || !buflen)
+      continue;
+    rxCount++;
     // Decode incoming messages from client based on port number in the header byte
  //   dump("msg", buf, buflen);
     if (CRTP_HEADER_PORT(buf[0]) == CRTP_PORT_LINK) // Link Echo
     {
-      sendAck(); // Just ack, no payload
+      // Just ack, with whatever is waiting
     }
     else if (CRTP_HEADER_PORT(buf[0]) == CRTP_PORT_COMMANDER) // Commander
     {
       // Commander message to set control positions
-      CommanderCrtpValues *p = (CommanderCrtpValues*)(buf+1);
-      Serial.println(p->roll); // -30.0 to 30.0
-      Serial.println(p->pitch); // -28.0 to 32.0
-      Serial.println(p->yaw); // -200.0 to 200.0
-      Serial.println(p->thrust); // 0 to 45755
-      sendAck(); // Just ack, no payload
+      // roll -30.0 to 30.0, pitch -28.0 to 32.0, yaw -200.0 to 200.0, thrust 0 to 45755
+      if (buflen >= 1 + sizeof(setpoint))
+        memcpy(&setpoint, buf + 1, sizeof(setpoint));
 //      dump("commander", buf, buflen);
     }
     else if (CRTP_HEADER_PORT(buf[0]) == CRTP_PORT_PARAM) // Parameter
@@ -167,7 +578,7 @@ void loop()
         sendAckPayload(reply, sizeof(reply));
       }
       else if (buf[1] == CMD_GET_ITEM) // Param GET_ITEM
-      { 
+      {
         // Set up a fax param as item 0
         uint8_t reply[] = { CRTP_HEADER(CRTP_PORT_PARAM, PARAM_TOC_CH), CMD_GET_ITEM, 0, 1, 'x', 0, 'y', 0}; // bogus item 0 uint8_t param
         sendAckPayload(reply, sizeof(reply));
@@ -179,22 +590,35 @@ void loop()
       }
  //     dump("param", buf, buflen);
     }
-    else if (buf[0] == CRTP_HEADER_PORT(buf[0]) == CRTP_PORT_PARAM) // Log
+    else if (CRTP_HEADER_PORT(buf[0]) == CRTP_PORT_LOG) // Log
     {
-      // http://wiki.bitcraze.se/projects:crazyflie:crtp:log
-      if (buf[1] == CMD_GET_INFO) // Log GET_INFO
+      if (CRTP_HEADER_CHANNEL(buf[0]) == LOG_CONTROL_CH)
+        logControl(buf, buflen);
+      else if (buf[1] == CMD_GET_INFO) // Log GET_INFO
       {
-        // pc client only fetches item data if the CRC changes
-        // If you change the contents of your TOC, you must change the CRC
-        // Crazyflie PC client doesnt relaly believe it if you say there are no TOC entries
-       uint8_t reply[] = { CRTP_HEADER(CRTP_PORT_LOG, LOG_TOC_CH), CMD_GET_INFO, 1, 0, 0, 2, 1, 8, 64}; // 1 log item in toc
+        // Number of items, CRC, most blocks and ops
+        uint8_t reply[] = { CRTP_HEADER(CRTP_PORT_LOG, LOG_TOC_CH), CMD_GET_INFO, LOG_TOC_LEN,
+                            (uint8_t)logTocCrc, (uint8_t)(logTocCrc >> 8), (uint8_t)(logTocCrc >> 16), (uint8_t)(logTocCrc >> 24),
+                            LOG_MAX_BLOCKS, LOG_MAX_OPS };
         sendAckPayload(reply, sizeof(reply));
-      }   
+      }
       else if (buf[1] == CMD_GET_ITEM) // Log GET_ITEM
       {
-        // Set up a fake battery voltage as item 0
-        uint8_t reply[] = { CRTP_HEADER(CRTP_PORT_LOG, LOG_TOC_CH), CMD_GET_ITEM, 0, 7, 'p', 'm', 0, 'v', 'b', 'a', 't', 0}; // item 0 float pm.vbat
-        sendAckPayload(reply, sizeof(reply));
+        // The item's id, type, group and name. Past the end, just the command
+        uint8_t reply[4 + sizeof(logToc[0].name)] = { CRTP_HEADER(CRTP_PORT_LOG, LOG_TOC_CH), CMD_GET_ITEM };
+        uint8_t len = 2;
+        if (buflen > 2 && buf[2] < LOG_TOC_LEN)
+        {
+          LogVariable v;
+          memcpy_P(&v, &logToc[buf[2]], sizeof(v));
+          reply[len++] = buf[2];
+          reply[len++] = v.type;
+          uint8_t n = strlen(v.name) + 1;
+          n += strlen(v.name + n) + 1;
+          memcpy(reply + len, v.name, n);
+          len += n;
+        }
+        sendAckPayload(reply, len);
       }
 //      dump("log", buf, buflen);
     }
@@ -204,18 +628,24 @@ void loop()
  //     dump("unknown", buf, buflen);
     }
   }
-  
+
+  logRun();
+  fillAckFifo();
+
   // Do once per second tasks
   uint32_t this_second = millis() / 1000;
   if (this_second != last_second)
   {
-    // This is how you would send value data for a log block
-    // with current real-time data
-    // if a log block has ben set up by the client
-//    uint8_t msg[] = {CRTP_HEADER(CRTP_PORT_LOG, LOG_LOG_CH), 0, 0, 0, 0, 11, 11, 11, 11};
-//    sendAckPayload(msg, sizeof(msg));
-
+    // A battery that runs down, for something to log
+    vbat = vbat > 3.0 ? vbat - 0.001 : 4.2;
+    if (logCount != last_count)
+    {
+      Serial.print("log packets/s ");
+      Serial.print(logCount - last_count);
+      Serial.print(" drops ");
+      Serial.println(logDrops);
+    }
+    last_count = logCount;
     last_second = this_second;
   }
 }
-
@@ -0,0 +1,83 @@
+// cx10_sniffer.ino
+// -*- mode: C++ -*-
+// Example sketch showing how to capture a link with the NRF24Sniffer class: here
+// a Cheerson CX-10 and its transmitter (such as cx10_redtx), on channel 0x3c at 1Mbps
+// with a 1 octet CRC. Every frame on the bind address and on the command address is
+// captured, including retransmissions and the ACKs from the quad, so that the link can be
+// seen from outside: which packets the quad acknowledges, and how soon.
+//
+// The command address is taken from the bind packets as they go by, so start this before
+// the transmitter binds, or set COMMAND_ADDRESS. The capture is streamed as binary over the
+// USB serial port at NRF24_SNIFFER_BAUD. Capture it to a file, eg:
+//   stty -F /dev/ttyACM0 1000000 raw; cat /dev/ttyACM0 > cx10.bin
+// and decode it with tools/cx10_sniff:
+//   cx10_sniff cx10.bin
+// Set PROMISCUOUS to 1 to capture frames to any address on the channel instead, for
+// tools/cx10_sniff -p to search.
+// Each frame takes a few hundred microsecs to read, check and write, so this keeps up
+// with a packet and its ACK every 8ms with lots to spare.
+
+#include <NRF24Sniffer.h>
+#include <SPI.h>
+
+#ifndef PROMISCUOUS
+#define PROMISCUOUS   0
+#endif
+#define CHANNEL       0x3c
+#define PAYLOADSIZE   9
+#define WINDOW        (PAYLOADSIZE + NRF24_SNIFFER_CRC_1 + 2)  // Ends before the ACK starts
+#define BIND_PIPE     0
+#define COMMAND_PIPE  1
+
+// Singleton instance of the radio
+NRF24Sniffer nrf24;
+// NRF24Sniffer nrf24(8, 7); // use this to be electrically compatible with Mirf
+// NRF24Sniffer nrf24(8, 10);// For Leonardo, need explicit SS pin
+
+const uint8_t bindAddress[5] = { 0x65, 0x65, 0x65, 0x65, 0x65 };
+
+// The CX-10 fixes the last octet of the command address itself
+uint8_t commandAddress[5] = { 0xc1, 0xc1, 0xc1, 0xc1, 0xc1 };
+
+// A bind packet is the first 4 octets of the command address, a fixed tail, and a checksum
+boolean isBind(const NRF24SnifferFrame* frame)
+{
+  if ((frame->flags & (NRF24_SNIFFER_VALID | NRF24_SNIFFER_PIPE)) != (NRF24_SNIFFER_VALID | BIND_PIPE)
+      || frame->len != PAYLOADSIZE)
+    return false;
+  uint8_t sum = 0;
+  for (uint8_t i = 0; i < PAYLOADSIZE - 1; i++)
+    sum += frame->data[i];
+  return frame->data[PAYLOADSIZE - 1] == (uint8_t)~sum;
+}
+
+void setup()
+{
+  nrf24.init();
+  nrf24.begin();
+#if PROMISCUOUS
+  nrf24.listenPromiscuous(CHANNEL, NRF24::NRF24DataRate1Mbps);
+#else
+  nrf24.listen(CHANNEL, NRF24::NRF24DataRate1Mbps, 5, NRF24_SNIFFER_CRC_1, WINDOW);
+  nrf24.setAddress(BIND_PIPE, bindAddress);
+  nrf24.setAddress(COMMAND_PIPE, commandAddress);
+#endif
+}
+
+void loop()
+{
+  NRF24SnifferFrame* frame;
+
+  nrf24.poll();
+  while ((frame = nrf24.peek()))
+  {
+    // Follow the transmitter to the command address it binds with
+    if (isBind(frame) && memcmp(frame->data, commandAddress, 4))
+    {
+      memcpy(commandAddress, frame->data, 4);
+      nrf24.setAddress(COMMAND_PIPE, commandAddress);
+    }
+    nrf24.write(frame);
+    nrf24.pop();
+  }
+}
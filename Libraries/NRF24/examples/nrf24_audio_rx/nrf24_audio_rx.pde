@@ -1,91 +1,129 @@
 // nrf24_audio_rx.pde
 // -*- mode: C++ -*-
 // Example sketch showing how to create an audio digital receiver
-// with the NRF24 class. 
+// with the NRF24 class.
 // Works with the nrf24_audio_tx sample transmitter
-// Connect audio output to pin 6, through a low pass filter consisting of a 1k resister and series followed by a 
+// Connect audio output to pin 3, through a low pass filter consisting of a 1k resister and series followed by a
 // 0.0033 microfarad capacitor to ground (48kHz filter).
-// The audio quality is poor: dont expect hi-fi!
-// We have to change the PWM frequency to 62 kHz so we can get bandwidth reasonable 
-// audio out through the low pass filter
+// Pin 3 is driven by timer2 at 62.5kHz PWM, which leaves timer0 (and so millis()) alone.
+//
+// Received packets are drained from the RX FIFO with recvAll() and decoded (IMA
+// ADPCM if AUDIO_ADPCM is set, which must match the transmitter) into a jitter
+// buffer, and a timer interrupt plays them out at AUDIO_SAMPLE_RATE, so playback
+// does not depend on loop() or packet timing. Playback starts once AUDIO_PREFILL
+// samples are buffered, and starts again the same way after an underrun.
+//
+// Once a second the achieved sample rate, underruns, packets received, packets lost
+// (from gaps in the sequence numbers) and packets dropped because the buffer was full
+// are printed at 115200 baud.
 // Tested on UNO
 
 #include <NRF24.h>
 #include <SPI.h>
+#include <avr/pgmspace.h>
 
+// Codec: 1 for 4 bit IMA ADPCM at 16kHz, 0 for 8 bit PCM at 8kHz
+#define AUDIO_ADPCM 1
+
+// Packet: sequence number, ADPCM state at the first sample (predictor low, high and
+// step index, unused for PCM), then the samples
+#define AUDIO_PAYLOAD 32
+#define AUDIO_HEADER  4
+#define AUDIO_DATA    (AUDIO_PAYLOAD - AUDIO_HEADER)
+#if AUDIO_ADPCM
+#define AUDIO_SAMPLE_RATE 16000
+#define AUDIO_SAMPLES     (AUDIO_DATA * 2)
+#else
+#define AUDIO_SAMPLE_RATE 8000
+#define AUDIO_SAMPLES     AUDIO_DATA
+#endif
+
+// Samples buffered before playback starts: enough to ride out a lost packet
+#define AUDIO_PREFILL (2 * AUDIO_SAMPLES)
 
 // Singleton instance of the radio
 NRF24 nrf24;
 // NRF24 nrf24(8, 7); // use this to be electrically compatible with Mirf
 // NRF24 nrf24(8, 10);// For Leonardo, need explicit SS pin
 
-/**
- * Divides a given PWM pin frequency by a divisor.
- *
- * The resulting frequency is equal to the base frequency divided by
- * the given divisor:
- *   - Base frequencies:
- *      o The base frequency for pins 3, 9, 10, and 11 is 31250 Hz.
- *      o The base frequency for pins 5 and 6 is 62500 Hz.
- *   - Divisors:
- *      o The divisors available on pins 5, 6, 9 and 10 are: 1, 8, 64,
- *        256, and 1024.
- *      o The divisors available on pins 3 and 11 are: 1, 8, 32, 64,
- *        128, 256, and 1024.
- *
- * PWM frequencies are tied together in pairs of pins. If one in a
- * pair is changed, the other is also changed to match:
- *   - Pins 5 and 6 are paired on timer0
- *   - Pins 9 and 10 are paired on timer1
- *   - Pins 3 and 11 are paired on timer2
- *
- * Note that this function will have side effects on anything else
- * that uses timers:
- *   - Changes on pins 3, 5, 6, or 11 may cause the delay() and
- *     millis() functions to stop working. Other timing-related
- *     functions may also be affected.
- *   - Changes on pins 9 or 10 will cause the Servo library to function
- *     incorrectly.
- *
- * Thanks to macegr of the Arduino forums for his documentation of the
- * PWM frequency divisors. His post can be viewed at:
- *   http://www.arduino.cc/cgi-bin/yabb2/YaBB.pl?num=1235060559/0#4
- */
-void setPwmFrequency(int pin, int divisor) {
-  byte mode;
-  if(pin == 5 || pin == 6 || pin == 9 || pin == 10) {
-    switch(divisor) {
-      case 1: mode = 0x01; break;
-      case 8: mode = 0x02; break;
-      case 64: mode = 0x03; break;
-      case 256: mode = 0x04; break;
-      case 1024: mode = 0x05; break;
-      default: return;
-    }
-    if(pin == 5 || pin == 6) {
-      TCCR0B = TCCR0B & 0b11111000 | mode;
-    } else {
-      TCCR1B = TCCR1B & 0b11111000 | mode;
-    }
-  } else if(pin == 3 || pin == 11) {
-    switch(divisor) {
-      case 1: mode = 0x01; break;
-      case 8: mode = 0x02; break;
-      case 32: mode = 0x03; break;
-      case 64: mode = 0x04; break;
-      case 128: mode = 0x05; break;
-      case 256: mode = 0x06; break;
-      case 1024: mode = 0x7; break;
-      default: return;
-    }
-    TCCR2B = TCCR2B & 0b11111000 | mode;
+// Jitter buffer, written by loop() and played out by the timer interrupt.
+// 256 bytes so the 8 bit indices wrap by themselves
+uint8_t playback[256];
+volatile uint8_t playHead = 0;
+volatile uint8_t playTail = 0;
+volatile boolean playing = false;
+
+// Statistics since the last report
+volatile uint16_t played = 0;
+volatile uint16_t underruns = 0;
+uint16_t packets = 0;
+uint16_t lost = 0;
+uint16_t overruns = 0;
+uint8_t nextSequence;
+// Packets drained from the RX FIFO, 3 at most at a time
+NRF24Packet received[4];
+uint8_t receivedHead = 0;
+uint8_t receivedTail = 0;
+boolean synced = false;
+unsigned long lastReport = 0;
+
+// IMA ADPCM
+static const int16_t imaStep[89] PROGMEM = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+  12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+static const int8_t imaIndex[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+int16_t adpcmPredictor = 0;
+int8_t  adpcmIndex = 0;
+
+// Decode one 4 bit code to an 8 bit sample
+uint8_t adpcmDecode(uint8_t code)
+{
+  int16_t step = pgm_read_word(&imaStep[adpcmIndex]);
+  int32_t delta = step >> 3;
+
+  if (code & 4)
+    delta += step;
+  if (code & 2)
+    delta += step >> 1;
+  if (code & 1)
+    delta += step >> 2;
+
+  int32_t predictor = (code & 8) ? adpcmPredictor - delta : adpcmPredictor + delta;
+  adpcmPredictor = constrain(predictor, -32768, 32767);
+  adpcmIndex = constrain(adpcmIndex + imaIndex[code & 7], 0, 88);
+  return (adpcmPredictor >> 8) + 128;
+}
+
+// Sample clock: play the next sample, or hold the last one if the buffer is empty
+ISR(TIMER1_COMPA_vect)
+{
+  uint8_t tail = playTail;
+  if (!playing)
+  {
+    if ((uint8_t)(playHead - tail) >= AUDIO_PREFILL)
+      playing = true;
+    return;
+  }
+  if (tail == playHead)
+  {
+    playing = false;
+    underruns++;
+    return;
   }
+  OCR2B = playback[tail];
+  playTail = tail + 1;
+  played++;
 }
 
-void setup() 
+void setup()
 {
-  Serial.begin(9600);
-  while (!Serial) 
+  Serial.begin(115200);
+  while (!Serial)
     ; // wait for serial port to connect. Needed for Leonardo only
   if (!nrf24.init())
     Serial.println("NRF24 init failed");
@@ -94,34 +132,90 @@ void setup()
   if (!nrf24.setThisAddress((uint8_t*)"aurx1", 5))
     Serial.println("setThisAddress failed");
 
-  if (!nrf24.setPayloadSize(32))
+  if (!nrf24.setPayloadSize(AUDIO_PAYLOAD))
     Serial.println("setPayloadSize failed");
   if (!nrf24.setRF(NRF24::NRF24DataRate2Mbps, NRF24::NRF24TransmitPower0dBm))
-    Serial.println("setRF failed");    
+    Serial.println("setRF failed");
   if (!nrf24.powerUpRx())
-      Serial.println("powerOnRx failed");    
-  // Here we change the PWM frequency so we can render audio with better quality
-  setPwmFrequency(6, 1); // PWM output on pin 6 is 62 khz
+    Serial.println("powerOnRx failed");
+
+  // Fast PWM on pin 3 (OC2B), no prescaler: 62.5kHz
+  pinMode(3, OUTPUT);
+  TCCR2A = _BV(COM2B1) | _BV(WGM21) | _BV(WGM20);
+  TCCR2B = _BV(CS20);
+  OCR2B = 128;
+
+  // Timer1 in CTC mode interrupts at the sample rate
+  noInterrupts();
+  TCCR1A = 0;
+  TCCR1B = _BV(WGM12) | _BV(CS10);
+  OCR1A = F_CPU / AUDIO_SAMPLE_RATE - 1;
+  TIMSK1 = _BV(OCIE1A);
+  interrupts();
   Serial.println("initialised");
 }
 
-unsigned long count = 0;
 void loop()
 {
-  uint8_t buf[32];
-  uint8_t len = sizeof(buf);
-
-  nrf24.waitAvailable();
-  if (nrf24.recv(buf, &len)) // 140 microsecs
+  // Whatever is waiting in the RX FIFO that fits in the ring, in 2 SPI transactions
+  // per packet. Each packet is consumed by advancing the tail past it
+  nrf24.recvAll(received, 4, &receivedHead, receivedTail);
+  for (; receivedTail != receivedHead; receivedTail = (receivedTail + 1) % 4)
   {
-    uint8_t i;
-    for (i = 0; i < 32; i++)
+    uint8_t* buf = received[receivedTail].data;
+    if (received[receivedTail].len != AUDIO_PAYLOAD)
+      continue;
+    packets++;
+    if (synced)
+      lost += (uint8_t)(buf[0] - nextSequence);
+    nextSequence = buf[0] + 1;
+    synced = true;
+
+    // Drop the packet if the jitter buffer has no room for it
+    uint8_t head = playHead;
+    if ((uint8_t)(playTail - head - 1) < AUDIO_SAMPLES)
+      overruns++;
+    else
     {
-      analogWrite(6, buf[i]); // 15 microsecs
-      // This delay was established experimentally to make sure the
-      // buffer was exhausted just in time for the next packet to arrive     
-      delayMicroseconds(65);
+      uint8_t i;
+#if AUDIO_ADPCM
+      // Each packet carries the decoder state, so a lost packet only costs its own samples
+      adpcmPredictor = (int16_t)(buf[1] | ((uint16_t)buf[2] << 8));
+      adpcmIndex = constrain(buf[3], 0, 88);
+      for (i = 0; i < AUDIO_DATA; i++)
+      {
+        playback[head++] = adpcmDecode(buf[AUDIO_HEADER + i] & 0x0f);
+        playback[head++] = adpcmDecode(buf[AUDIO_HEADER + i] >> 4);
+      }
+#else
+      for (i = 0; i < AUDIO_DATA; i++)
+        playback[head++] = buf[AUDIO_HEADER + i];
+#endif
+      playHead = head;
     }
   }
-}
 
+  if (millis() - lastReport >= 1000)
+  {
+    lastReport = millis();
+    noInterrupts();
+    uint16_t rate = played;
+    uint16_t empty = underruns;
+    played = 0;
+    underruns = 0;
+    interrupts();
+    Serial.print("rate ");
+    Serial.print(rate);
+    Serial.print(" underruns ");
+    Serial.print(empty);
+    Serial.print(" packets ");
+    Serial.print(packets);
+    Serial.print(" lost ");
+    Serial.print(lost);
+    Serial.print(" overruns ");
+    Serial.println(overruns);
+    packets = 0;
+    lost = 0;
+    overruns = 0;
+  }
+}
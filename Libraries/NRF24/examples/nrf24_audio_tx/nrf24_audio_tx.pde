@@ -1,64 +1,211 @@
 // nrf24_audio_tx.pde
 // -*- mode: C++ -*-
-// Example sketch showing how to create an audio digital transmitter 
-// with the NRF24 class. 
-// Connect a 1Vp-p audio sigal to analog input 0, connected through a 1uF capacitor
+// Example sketch showing how to create an audio digital transmitter
+// with the NRF24 class.
+// Connect a 1Vp-p audio sigal to analog input 0, connected through a 1uF capacitor,
+// and bias the input to about 0.55V (half the internal reference) with a pair of resistors
 // Works with the nrf24_audio_rx sample receiver
-// The audio quality is poor: dont expect hi-fi!
 //
-// This code sends about 250 messages per second, each with 32 8 bit samples from analog input 0
-// It uses the NRF4 in NOACK mode. The receiver never acknowledges or replies
+// Samples are taken by a timer interrupt at AUDIO_SAMPLE_RATE and queued in a ring buffer.
+// loop() packs them into 32 byte packets, IMA ADPCM compressed if AUDIO_ADPCM is set, and
+// writes them to the TX FIFO whenever there is room, so the NRF24 sends one packet while
+// the next is being prepared. Packets are sent NOACK at 2Mbps: the receiver never
+// acknowledges or replies. About 286 packets per second are sent, giving 8kHz 8 bit PCM
+// or 16kHz ADPCM. AUDIO_ADPCM must be the same in the receiver.
+//
+// Once a second the achieved sample rate, packets sent and samples lost because
+// the buffer was full are printed at 115200 baud.
 // Tested on UNO
 
 #include <NRF24.h>
 #include <SPI.h>
+#include <avr/pgmspace.h>
+
+// Codec: 1 for 4 bit IMA ADPCM at 16kHz, 0 for 8 bit PCM at 8kHz
+#define AUDIO_ADPCM 1
 
+// Packet: sequence number, ADPCM state at the first sample (predictor low, high and
+// step index, unused for PCM), then the samples
+#define AUDIO_PAYLOAD 32
+#define AUDIO_HEADER  4
+#define AUDIO_DATA    (AUDIO_PAYLOAD - AUDIO_HEADER)
+#if AUDIO_ADPCM
+#define AUDIO_SAMPLE_RATE 16000
+#define AUDIO_SAMPLES     (AUDIO_DATA * 2)
+#else
+#define AUDIO_SAMPLE_RATE 8000
+#define AUDIO_SAMPLES     AUDIO_DATA
+#endif
 
 // Singleton instance of the radio
 NRF24 nrf24;
 // NRF24 nrf24(8, 7); // use this to be electrically compatible with Mirf
 // NRF24 nrf24(8, 10);// For Leonardo, need explicit SS pin
 
-void setup() 
+// Sample ring buffer, written by the timer interrupt and read by loop().
+// 256 bytes so the 8 bit indices wrap by themselves
+uint8_t samples[256];
+volatile uint8_t sampleHead = 0;
+volatile uint8_t sampleTail = 0;
+
+// Statistics since the last report
+volatile uint16_t sampled = 0;
+volatile uint16_t overruns = 0;
+uint16_t packets = 0;
+uint8_t sequence = 0;
+unsigned long lastReport = 0;
+
+// IMA ADPCM
+static const int16_t imaStep[89] PROGMEM = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+  12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+static const int8_t imaIndex[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+int16_t adpcmPredictor = 0;
+int8_t  adpcmIndex = 0;
+
+// Encode one 16 bit sample to a 4 bit code, and update the predictor the same
+// way the decoder will
+uint8_t adpcmEncode(int16_t sample)
 {
-  Serial.begin(9600);
-  while (!Serial) 
+  int16_t step = pgm_read_word(&imaStep[adpcmIndex]);
+  int32_t diff = (int32_t)sample - adpcmPredictor;
+  int32_t delta = step >> 3;
+  uint8_t code = 0;
+
+  if (diff < 0)
+  {
+    code = 8;
+    diff = -diff;
+  }
+  if (diff >= step)
+  {
+    code |= 4;
+    diff -= step;
+    delta += step;
+  }
+  step >>= 1;
+  if (diff >= step)
+  {
+    code |= 2;
+    diff -= step;
+    delta += step;
+  }
+  step >>= 1;
+  if (diff >= step)
+  {
+    code |= 1;
+    delta += step;
+  }
+
+  int32_t predictor = (code & 8) ? adpcmPredictor - delta : adpcmPredictor + delta;
+  adpcmPredictor = constrain(predictor, -32768, 32767);
+  adpcmIndex = constrain(adpcmIndex + imaIndex[code & 7], 0, 88);
+  return code;
+}
+
+// Sample clock: collect the last conversion and start the next
+ISR(TIMER1_COMPA_vect)
+{
+  uint8_t head = sampleHead;
+  uint8_t sample = ADCH;
+  ADCSRA |= _BV(ADSC);
+  sampled++;
+  if ((uint8_t)(head + 1) == sampleTail)
+  {
+    overruns++;
+    return;
+  }
+  samples[head] = sample;
+  sampleHead = head + 1;
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  while (!Serial)
     ; // wait for serial port to connect. Needed for Leonardo only
   if (!nrf24.init())
     Serial.println("NRF24 init failed");
   if (!nrf24.setChannel(1))
     Serial.println("setChannel failed");
-  if (!nrf24.setPayloadSize(32))
+  if (!nrf24.setPayloadSize(AUDIO_PAYLOAD))
     Serial.println("setPayloadSize failed");
   if (!nrf24.setRF(NRF24::NRF24DataRate2Mbps, NRF24::NRF24TransmitPower0dBm))
-    Serial.println("setRF failed");    
+    Serial.println("setRF failed");
   // Enable the EN_DYN_ACK feature so we can use noack
   nrf24.spiWriteRegister(NRF24_REG_1D_FEATURE, NRF24_EN_DYN_ACK);
-  analogReference(INTERNAL); // So we can read 1Vp-p signals
+  if (!nrf24.setTransmitAddress((uint8_t*)"aurx1", 5))
+    Serial.println("setTransmitAddress failed");
+  // Stay in TX mode: the NRF24 sends whatever is in the TX FIFO
+  if (!nrf24.powerUpTx())
+    Serial.println("powerUpTx failed");
+
+  // ADC on analog input 0 against the internal 1.1V reference, left adjusted so the
+  // top 8 bits can be read from ADCH, with a 1MHz ADC clock (13 microsecs per conversion)
+  ADMUX = _BV(REFS1) | _BV(REFS0) | _BV(ADLAR);
+  ADCSRA = _BV(ADEN) | _BV(ADPS2);
+  ADCSRA |= _BV(ADSC);
+
+  // Timer1 in CTC mode interrupts at the sample rate
+  noInterrupts();
+  TCCR1A = 0;
+  TCCR1B = _BV(WGM12) | _BV(CS10);
+  OCR1A = F_CPU / AUDIO_SAMPLE_RATE - 1;
+  TIMSK1 = _BV(OCIE1A);
+  interrupts();
   Serial.println("initialised");
 }
-  
+
 void loop()
 {
-  uint8_t buf[32];
-  uint8_t i;
-  
-  // Collect 32 audio samples. At 109 microsecs per sample, we can achieve about 250
-  // 32 byte packets transmitted per second: 6.4kHz sample rate
-  for (i = 0; i < 32; i++)
-    buf[i] = analogRead(0); // 0 - 1023 becomes 0 - 255, top 2 bits clipped. approx 109 microsecs per sample
-
-  // Now send the samples NOACK (EN_DYN_ACK must be enabled first)
-  // With 2Mbps, NOACK and 32 byte payload, can send about 1900 messages per sec
-  if (!nrf24.setTransmitAddress((uint8_t*)"aurx1", 5))
-   Serial.println("setTransmitAddress failed");
-  // Send the data  
-  if (!nrf24.send(buf, sizeof(buf), true)) // NOACK, 110 microsecs
-     Serial.println("send failed");  
-  // Transmission takes about 300 microsecs, of which about 130microsecs is transmitter startup time
-  // and 160 microsecs is transmit time for 32 bytes+8 bytes overhead @ 2Mbps
-  if (!nrf24.waitPacketSent())
-     Serial.println("waitPacketSent failed");  
-    digitalWrite(3, LOW);
-}
+  // Send a packet as soon as there are enough samples and room in the TX FIFO
+  uint8_t tail = sampleTail;
+  if ((uint8_t)(sampleHead - tail) >= AUDIO_SAMPLES
+      && !(nrf24.spiReadRegister(NRF24_REG_17_FIFO_STATUS) & NRF24_TX_FULL))
+  {
+    uint8_t buf[AUDIO_PAYLOAD];
+    uint8_t i;
 
+    buf[0] = sequence++;
+    buf[1] = adpcmPredictor & 0xff;
+    buf[2] = adpcmPredictor >> 8;
+    buf[3] = adpcmIndex;
+    for (i = 0; i < AUDIO_DATA; i++)
+    {
+#if AUDIO_ADPCM
+      // Two samples per byte, first in the low nibble
+      uint8_t code = adpcmEncode((samples[tail++] - 128) * 256);
+      buf[AUDIO_HEADER + i] = code | (adpcmEncode((samples[tail++] - 128) * 256) << 4);
+#else
+      buf[AUDIO_HEADER + i] = samples[tail++];
+#endif
+    }
+    sampleTail = tail;
+    // NOACK, written straight to the FIFO (EN_DYN_ACK must be enabled first)
+    nrf24.spiBurstWrite(NRF24_COMMAND_W_TX_PAYLOAD_NOACK, buf, sizeof(buf));
+    packets++;
+  }
+
+  if (millis() - lastReport >= 1000)
+  {
+    lastReport = millis();
+    noInterrupts();
+    uint16_t rate = sampled;
+    uint16_t lost = overruns;
+    sampled = 0;
+    overruns = 0;
+    interrupts();
+    Serial.print("rate ");
+    Serial.print(rate);
+    Serial.print(" packets ");
+    Serial.print(packets);
+    Serial.print(" overruns ");
+    Serial.println(lost);
+    packets = 0;
+  }
+}
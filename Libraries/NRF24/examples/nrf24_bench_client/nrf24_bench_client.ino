@@ -0,0 +1,290 @@
+// nrf24_bench_client.ino
+// -*- mode: C++ -*-
+// Example sketch showing how to benchmark a link with the NRF24 class.
+// It is designed to work with the example nrf24_bench_server, which must have
+// the same case tables. It can also be run against the nRF24 model on a PC,
+// see tools/nrf24_bench.cpp.
+//
+// For every combination of data rate, payload size, mode and retry setting in the
+// tables below (a case), the client measures the round trip time of BENCH_PINGS
+// pings echoed by the server, then sends packets as fast as it can for BENCH_BURST_MS
+// and asks the server how many arrived. Each case is announced to the server on the
+// base configuration (1Mbps, 500 microsecs and 15 retries), then both ends switch to it,
+// and both go back to the base configuration afterwards.
+//
+// Modes:
+//   0 ACK     acknowledged pings and replies, each reply a separate packet
+//   1 NOACK   pings and replies sent NOACK, data queued in the TX FIFO back to back
+//   2 ACKPAY  replies carried in the acknowledgements (ACK payloads)
+//
+// Results are printed at 115200 baud as CSV, one line per case, after a header line:
+//   case,rate_kbps,payload,mode,ard_us,arc,pings,lost,rtt_min,rtt_p50,rtt_p90,rtt_p99,
+//   rtt_max,rtt_mean,sent,delivered,retries,goodput
+// Round trip times are in microsecs, goodput in payload bytes per second delivered.
+// Lines starting with # are comments. Send any character to run the sweep again.
+
+#include <NRF24.h>
+#include <SPI.h>
+
+#define BENCH_CHANNEL   1
+#define BENCH_PINGS     100
+#define BENCH_TIMEOUT   20    // millisecs to wait for a reply
+#define BENCH_BURST_MS  500
+#define BENCH_IDLE_MS   1000  // the server goes back to the base configuration after this long idle
+
+// Message types, the first byte of every payload
+#define BENCH_CASE      1     // Case number follows, sent on the base configuration
+#define BENCH_PING      2     // Sequence number follows, echoed by the server
+#define BENCH_DATA      3     // Counted by the server
+#define BENCH_STATS     4     // Server replies with the number of BENCH_DATA received
+#define BENCH_ACKPAY    5     // ACK payload from the server
+
+#define BENCH_MODE_ACK    0
+#define BENCH_MODE_NOACK  1
+#define BENCH_MODE_ACKPAY 2
+#define BENCH_MODES       3
+
+// Case tables. Case numbers count through retries fastest, then modes, sizes and rates
+const uint8_t  benchRates[]    = { NRF24::NRF24DataRate250kbps, NRF24::NRF24DataRate1Mbps, NRF24::NRF24DataRate2Mbps };
+const uint16_t benchRateKbps[] = { 250, 1000, 2000 };
+const uint8_t  benchSizes[]    = { 4, 16, 32 };
+const uint8_t  benchArd[]      = { 1, 5 };   // Retry delay in 250 microsec steps, less 1
+const uint8_t  benchArc[]      = { 3, 15 };  // Retry count
+#define BENCH_RETRIES sizeof(benchArd)
+#define BENCH_CASES   (sizeof(benchRates) * sizeof(benchSizes) * BENCH_MODES * BENCH_RETRIES)
+
+// Singleton instance of the radio
+NRF24 nrf24;
+// NRF24 nrf24(8, 7); // use this to be electrically compatible with Mirf
+// NRF24 nrf24(8, 10);// For Leonardo, need explicit SS pin
+
+uint8_t caseRate, caseSize, caseMode, caseRetry;
+uint16_t rtts[BENCH_PINGS];
+
+// Split a case number into its table indexes
+void benchDecode(uint8_t c)
+{
+  caseRetry = c % BENCH_RETRIES;
+  c /= BENCH_RETRIES;
+  caseMode = c % BENCH_MODES;
+  c /= BENCH_MODES;
+  caseSize = c % sizeof(benchSizes);
+  caseRate = c / sizeof(benchSizes);
+}
+
+void benchConfigure(uint8_t rate, uint8_t ard, uint8_t arc)
+{
+  nrf24.setRF(rate, NRF24::NRF24TransmitPower0dBm);
+  nrf24.setRetry(ard, arc);
+}
+
+void benchBase()
+{
+  benchConfigure(NRF24::NRF24DataRate1Mbps, 1, 15);
+}
+
+// Send a packet and wait until it has gone
+// Returns true if it was acknowledged (or sent, for noack)
+boolean benchSend(uint8_t* buf, uint8_t len, boolean noack)
+{
+  nrf24.send(buf, len, noack);
+  return nrf24.waitPacketSent();
+}
+
+// Wait up to timeout millisecs for a reply of the given type, discarding anything else.
+// Echoed pings must also have the given sequence number
+// Returns the length of the reply, or 0 if none
+uint8_t benchReply(uint8_t type, uint8_t seq, uint8_t* reply, uint16_t timeout)
+{
+  unsigned long start = millis();
+  nrf24.powerUpRx();
+  do
+  {
+    if (nrf24.available())
+    {
+      uint8_t len = NRF24_MAX_MESSAGE_LEN;
+      if (nrf24.recv(reply, &len) && len >= 2 && reply[0] == type && (type != BENCH_PING || reply[1] == seq))
+        return len;
+    }
+  } while (millis() - start < timeout);
+  return 0;
+}
+
+// Tell the server which case is next, on the base configuration
+boolean benchAnnounce(uint8_t c)
+{
+  uint8_t buf[2] = { BENCH_CASE, c };
+  uint8_t i;
+
+  benchBase();
+  for (i = 0; i < 10; i++)
+  {
+    if (benchSend(buf, sizeof(buf), false))
+      return true;
+    delay(100);
+  }
+  return false;
+}
+
+void benchPrint(uint32_t val)
+{
+  Serial.print(val);
+  Serial.print(',');
+}
+
+void benchRun(uint8_t c)
+{
+  uint8_t buf[NRF24_MAX_MESSAGE_LEN];
+  uint8_t reply[NRF24_MAX_MESSAGE_LEN];
+  uint8_t size, n = 0, i;
+  uint32_t sum = 0;
+
+  benchDecode(c);
+  size = benchSizes[caseSize];
+  if (!benchAnnounce(c))
+  {
+    Serial.print("# case ");
+    Serial.print(c);
+    Serial.println(": no reply from server");
+    return;
+  }
+  benchConfigure(benchRates[caseRate], benchArd[caseRetry], benchArc[caseRetry]);
+  delay(2); // Let the server switch
+  memset(buf, 0, sizeof(buf));
+
+  // Round trip times
+  for (i = 0; i < BENCH_PINGS; i++)
+  {
+    buf[0] = BENCH_PING;
+    buf[1] = i;
+    unsigned long start = micros();
+    if (!benchSend(buf, size, caseMode == BENCH_MODE_NOACK))
+      continue;
+    // An ACK payload is already in the RX FIFO when the send completes
+    if (caseMode == BENCH_MODE_ACKPAY ? benchReply(BENCH_ACKPAY, i, reply, 0)
+        : benchReply(BENCH_PING, i, reply, BENCH_TIMEOUT))
+    {
+      uint16_t rtt = micros() - start;
+      uint8_t j;
+      // Insertion sort, for the percentiles
+      for (j = n; j > 0 && rtts[j - 1] > rtt; j--)
+        rtts[j] = rtts[j - 1];
+      rtts[j] = rtt;
+      sum += rtt;
+      n++;
+    }
+  }
+
+  // Goodput
+  uint32_t sent = 0, retries = 0, delivered = 0;
+  buf[0] = BENCH_DATA;
+  unsigned long start = millis();
+  if (caseMode == BENCH_MODE_NOACK)
+  {
+    // Keep the TX FIFO topped up, the NRF24 sends back to back
+    nrf24.powerUpTx();
+    while (millis() - start < BENCH_BURST_MS)
+    {
+      if (!(nrf24.spiReadRegister(NRF24_REG_17_FIFO_STATUS) & NRF24_TX_FULL))
+      {
+        buf[1] = sent++;
+        nrf24.spiBurstWrite(NRF24_COMMAND_W_TX_PAYLOAD_NOACK, buf, size);
+      }
+    }
+    while (!(nrf24.spiReadRegister(NRF24_REG_17_FIFO_STATUS) & NRF24_TX_EMPTY))
+      ;
+    nrf24.spiWriteRegister(NRF24_REG_07_STATUS, NRF24_TX_DS);
+  }
+  else
+  {
+    while (millis() - start < BENCH_BURST_MS)
+    {
+      buf[1] = sent++;
+      if (benchSend(buf, size, false))
+        retries += nrf24.spiReadRegister(NRF24_REG_08_OBSERVE_TX) & NRF24_ARC_CNT;
+      if (caseMode == BENCH_MODE_ACKPAY)
+        nrf24.flushRx(); // Discard the ACK payloads
+    }
+  }
+  unsigned long elapsed = millis() - start;
+
+  // Ask the server how many arrived
+  buf[0] = BENCH_STATS;
+  for (i = 0; i < 3; i++)
+  {
+    if (benchSend(buf, 2, false) && benchReply(BENCH_STATS, 0, reply, BENCH_TIMEOUT) >= 4)
+    {
+      delivered = reply[2] | ((uint16_t)reply[3] << 8);
+      break;
+    }
+  }
+  benchBase();
+  if (i == 3)
+    delay(BENCH_IDLE_MS); // Server will go back to base by itself
+
+  benchPrint(c);
+  benchPrint(benchRateKbps[caseRate]);
+  benchPrint(size);
+  benchPrint(caseMode);
+  benchPrint((benchArd[caseRetry] + 1) * 250);
+  benchPrint(benchArc[caseRetry]);
+  benchPrint(BENCH_PINGS);
+  benchPrint(BENCH_PINGS - n);
+  benchPrint(n ? rtts[0] : 0);
+  benchPrint(n ? rtts[(n - 1) * 50 / 100] : 0);
+  benchPrint(n ? rtts[(n - 1) * 90 / 100] : 0);
+  benchPrint(n ? rtts[(n - 1) * 99 / 100] : 0);
+  benchPrint(n ? rtts[n - 1] : 0);
+  benchPrint(n ? sum / n : 0);
+  benchPrint(sent);
+  benchPrint(delivered);
+  benchPrint(retries);
+  Serial.println(elapsed ? delivered * size * 1000 / elapsed : 0);
+}
+
+void benchSweep()
+{
+  uint8_t c;
+
+  Serial.println("case,rate_kbps,payload,mode,ard_us,arc,pings,lost,rtt_min,rtt_p50,rtt_p90,rtt_p99,rtt_max,rtt_mean,sent,delivered,retries,goodput");
+  for (c = 0; c < BENCH_CASES; c++)
+  {
+    // Retry settings make no difference without acknowledgements
+    benchDecode(c);
+    if (caseMode == BENCH_MODE_NOACK && caseRetry)
+      continue;
+    benchRun(c);
+  }
+  Serial.println("# done");
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  while (!Serial)
+    ; // wait for serial port to connect. Needed for Leonardo only
+  if (!nrf24.init())
+    Serial.println("# NRF24 init failed");
+  if (!nrf24.setChannel(BENCH_CHANNEL))
+    Serial.println("# setChannel failed");
+  if (!nrf24.setThisAddress((uint8_t*)"clie1", 5))
+    Serial.println("# setThisAddress failed");
+  if (!nrf24.setTransmitAddress((uint8_t*)"serv1", 5))
+    Serial.println("# setTransmitAddress failed");
+  // Dynamic payloads, ACK payloads and NOACK on pipes 0 and 1
+  nrf24.spiWriteRegister(NRF24_REG_1D_FEATURE, NRF24_EN_DPL | NRF24_EN_ACK_PAY | NRF24_EN_DYN_ACK);
+  nrf24.spiWriteRegister(NRF24_REG_1C_DYNPD, NRF24_DPL_P0 | NRF24_DPL_P1);
+  benchBase();
+  Serial.println("# initialised");
+  benchSweep();
+}
+
+void loop()
+{
+  if (Serial.available())
+  {
+    while (Serial.available())
+      Serial.read();
+    benchSweep();
+  }
+}
@@ -0,0 +1,165 @@
+// nrf24_bench_server.ino
+// -*- mode: C++ -*-
+// Example sketch showing how to create the server end of a link benchmark
+// with the NRF24 class.
+// It is designed to work with the example nrf24_bench_client, which drives the
+// benchmark and prints the results. The case tables and message types must be
+// the same in both.
+//
+// The server waits on the base configuration (1Mbps, 500 microsecs and 15 retries)
+// for the client to announce a case, switches to that case's configuration, echoes
+// pings (or preloads ACK payloads, in ACKPAY mode), counts data packets, and reports
+// the count when asked. It then goes back to the base configuration, and also does so
+// after BENCH_IDLE_MS without a packet, in case the client has given up.
+
+#include <NRF24.h>
+#include <SPI.h>
+
+#define BENCH_CHANNEL   1
+#define BENCH_IDLE_MS   1000  // Go back to the base configuration after this long idle
+
+// Message types, the first byte of every payload
+#define BENCH_CASE      1     // Case number follows, sent on the base configuration
+#define BENCH_PING      2     // Sequence number follows, echoed by the server
+#define BENCH_DATA      3     // Counted by the server
+#define BENCH_STATS     4     // Server replies with the number of BENCH_DATA received
+#define BENCH_ACKPAY    5     // ACK payload from the server
+
+#define BENCH_MODE_ACK    0
+#define BENCH_MODE_NOACK  1
+#define BENCH_MODE_ACKPAY 2
+#define BENCH_MODES       3
+
+// Case tables. Case numbers count through retries fastest, then modes, sizes and rates
+const uint8_t  benchRates[]    = { NRF24::NRF24DataRate250kbps, NRF24::NRF24DataRate1Mbps, NRF24::NRF24DataRate2Mbps };
+const uint8_t  benchSizes[]    = { 4, 16, 32 };
+const uint8_t  benchArd[]      = { 1, 5 };   // Retry delay in 250 microsec steps, less 1
+const uint8_t  benchArc[]      = { 3, 15 };  // Retry count
+#define BENCH_RETRIES sizeof(benchArd)
+
+// Singleton instance of the radio
+NRF24 nrf24;
+// NRF24 nrf24(8, 7); // use this to be electrically compatible with Mirf
+// NRF24 nrf24(8, 10);// For Leonardo, need explicit SS pin
+
+uint8_t caseRate, caseSize, caseMode, caseRetry;
+boolean inCase = false;
+uint16_t received = 0;
+
+// Split a case number into its table indexes
+void benchDecode(uint8_t c)
+{
+  caseRetry = c % BENCH_RETRIES;
+  c /= BENCH_RETRIES;
+  caseMode = c % BENCH_MODES;
+  c /= BENCH_MODES;
+  caseSize = c % sizeof(benchSizes);
+  caseRate = c / sizeof(benchSizes);
+}
+
+void benchConfigure(uint8_t rate, uint8_t ard, uint8_t arc)
+{
+  nrf24.setRF(rate, NRF24::NRF24TransmitPower0dBm);
+  nrf24.setRetry(ard, arc);
+}
+
+void benchBase()
+{
+  benchConfigure(NRF24::NRF24DataRate1Mbps, 1, 15);
+  inCase = false;
+}
+
+// Queue the ACK payload for the next packet from the client
+void benchLoadAckPayload()
+{
+  uint8_t buf[NRF24_MAX_MESSAGE_LEN];
+  memset(buf, 0, sizeof(buf));
+  buf[0] = BENCH_ACKPAY;
+  nrf24.spiBurstWrite(NRF24_COMMAND_W_ACK_PAYLOAD(1), buf, benchSizes[caseSize]);
+}
+
+// Send a reply to the client and go back to receiving
+void benchReply(uint8_t* buf, uint8_t len, boolean noack)
+{
+  if (inCase && caseMode == BENCH_MODE_ACKPAY)
+    nrf24.flushTx(); // Else the unused ACK payload would be sent first
+  if (!nrf24.send(buf, len, noack))
+    Serial.println("send failed");
+  nrf24.waitPacketSent();
+  nrf24.powerUpRx();
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  while (!Serial)
+    ; // wait for serial port to connect. Needed for Leonardo only
+  if (!nrf24.init())
+    Serial.println("NRF24 init failed");
+  if (!nrf24.setChannel(BENCH_CHANNEL))
+    Serial.println("setChannel failed");
+  if (!nrf24.setThisAddress((uint8_t*)"serv1", 5))
+    Serial.println("setThisAddress failed");
+  if (!nrf24.setTransmitAddress((uint8_t*)"clie1", 5))
+    Serial.println("setTransmitAddress failed");
+  // Dynamic payloads, ACK payloads and NOACK on pipes 0 and 1
+  nrf24.spiWriteRegister(NRF24_REG_1D_FEATURE, NRF24_EN_DPL | NRF24_EN_ACK_PAY | NRF24_EN_DYN_ACK);
+  nrf24.spiWriteRegister(NRF24_REG_1C_DYNPD, NRF24_DPL_P0 | NRF24_DPL_P1);
+  benchBase();
+  Serial.println("initialised");
+}
+
+void loop()
+{
+  uint8_t buf[NRF24_MAX_MESSAGE_LEN];
+  uint8_t len = sizeof(buf);
+
+  if (!nrf24.waitAvailableTimeout(BENCH_IDLE_MS))
+  {
+    if (inCase)
+    {
+      nrf24.flushTx();
+      benchBase();
+      Serial.println("timed out");
+    }
+    return;
+  }
+  if (!nrf24.recv(buf, &len) || len < 2)
+    return;
+
+  switch (buf[0])
+  {
+  case BENCH_CASE:
+    // The acknowledgement has already gone, so switch straight away
+    benchDecode(buf[1]);
+    benchConfigure(benchRates[caseRate], benchArd[caseRetry], benchArc[caseRetry]);
+    inCase = true;
+    received = 0;
+    nrf24.flushTx();
+    if (caseMode == BENCH_MODE_ACKPAY)
+      benchLoadAckPayload();
+    Serial.print("case ");
+    Serial.println(buf[1]);
+    break;
+
+  case BENCH_PING:
+    if (caseMode == BENCH_MODE_ACKPAY)
+      benchLoadAckPayload();
+    else
+      benchReply(buf, len, caseMode == BENCH_MODE_NOACK);
+    break;
+
+  case BENCH_DATA:
+    received++;
+    if (caseMode == BENCH_MODE_ACKPAY)
+      benchLoadAckPayload();
+    break;
+
+  case BENCH_STATS:
+    buf[2] = received & 0xff;
+    buf[3] = received >> 8;
+    benchReply(buf, 4, false);
+    benchBase();
+    break;
+  }
+}
@@ -0,0 +1,27 @@
+// nrf24_bridge.ino
+// -*- mode: C++ -*-
+// Example sketch showing how to drive the radio from a host computer with the
+// NRF24Bridge class. The radio is set up and run entirely by the program on the host,
+// over the USB serial port at NRF24_BRIDGE_BAUD, so protocols can be tried without
+// reflashing. tools/bridge has the Linux client library and a latency and throughput
+// benchmark:
+//   bridge_bench /dev/ttyACM0
+
+#include <NRF24Bridge.h>
+#include <SPI.h>
+
+// Singleton instance of the radio
+NRF24Bridge nrf24;
+// NRF24Bridge nrf24(8, 7); // use this to be electrically compatible with Mirf
+// NRF24Bridge nrf24(8, 10);// For Leonardo, need explicit SS pin
+
+void setup()
+{
+  nrf24.init();
+  nrf24.begin();
+}
+
+void loop()
+{
+  nrf24.poll();
+}
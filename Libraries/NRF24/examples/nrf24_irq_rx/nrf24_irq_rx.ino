@@ -0,0 +1,116 @@
+// nrf24_irq_rx.ino
+// -*- mode: C++ -*-
+// Example sketch showing how to receive with the interrupt driven receive queue
+// of the NRF24 class, instead of polling the radio with waitAvailable().
+// Works with the nrf24_audio_tx sample transmitter, which sends about 286 packets
+// per second, each with a sequence number in the first octet.
+// Connect the nRF24 IRQ output to pin D2 (interrupt 0 on Uno).
+//
+// The IRQ handler moves each packet from the RX FIFO to a queue as soon as it arrives,
+// and loop() takes them from the queue without touching the radio. loop() then spends
+// BUSY_MICROS on other work, to stand in for the rest of a real program: longer than
+// 3 packet times, it would overflow the RX FIFO if it polled.
+//
+// Once a second prints packets received, packets lost (from gaps in the sequence numbers),
+// queue overruns, IRQs deferred because the SPI bus was busy, and the min, mean and max
+// latency in microsecs from IRQ to loop(): the spread from min to max is the receive jitter.
+// Tested on UNO
+
+#include <NRF24.h>
+#include <SPI.h>
+
+#define RX_PAYLOAD    32
+#define RX_INTERRUPT  0     // D2 on Uno
+#define RX_QUEUE_LEN  8     // Holds 7 packets
+#define BUSY_MICROS   15000
+
+// Singleton instance of the radio
+NRF24 nrf24;
+// NRF24 nrf24(8, 7); // use this to be electrically compatible with Mirf
+// NRF24 nrf24(8, 10);// For Leonardo, need explicit SS pin
+
+NRF24Packet queue[RX_QUEUE_LEN];
+
+// Statistics since the last report
+uint16_t packets = 0;
+uint16_t lost = 0;
+uint8_t nextSequence;
+boolean synced = false;
+unsigned long latencyMin = 0xffffffff;
+unsigned long latencyMax = 0;
+unsigned long latencyTotal = 0;
+unsigned long lastReport = 0;
+
+void setup()
+{
+  Serial.begin(115200);
+  while (!Serial)
+    ; // wait for serial port to connect. Needed for Leonardo only
+  if (!nrf24.init())
+    Serial.println("NRF24 init failed");
+  if (!nrf24.setChannel(1))
+    Serial.println("setChannel failed");
+  if (!nrf24.setThisAddress((uint8_t*)"aurx1", 5))
+    Serial.println("setThisAddress failed");
+  if (!nrf24.setPayloadSize(RX_PAYLOAD))
+    Serial.println("setPayloadSize failed");
+  if (!nrf24.setRF(NRF24::NRF24DataRate2Mbps, NRF24::NRF24TransmitPower0dBm))
+    Serial.println("setRF failed");
+  if (!nrf24.enableRxInterrupt(RX_INTERRUPT, queue, RX_QUEUE_LEN))
+    Serial.println("enableRxInterrupt failed");
+  Serial.println("initialised");
+}
+
+void loop()
+{
+  NRF24Packet* packet;
+
+  while ((packet = nrf24.rxPeek()) != NULL)
+  {
+    unsigned long latency = micros() - packet->time;
+    if (latency < latencyMin)
+      latencyMin = latency;
+    if (latency > latencyMax)
+      latencyMax = latency;
+    latencyTotal += latency;
+    packets++;
+    if (synced)
+      lost += (uint8_t)(packet->data[0] - nextSequence);
+    nextSequence = packet->data[0] + 1;
+    synced = true;
+    nrf24.rxPop();
+  }
+
+  // The rest of the program
+  delayMicroseconds(BUSY_MICROS);
+
+  if (millis() - lastReport >= 1000)
+  {
+    lastReport = millis();
+    NRF24RxStats stats = nrf24.rxStats();
+    nrf24.resetRxStats();
+    Serial.print("packets ");
+    Serial.print(packets);
+    Serial.print(" lost ");
+    Serial.print(lost);
+    Serial.print(" overruns ");
+    Serial.print(stats.overruns);
+    Serial.print(" deferred ");
+    Serial.print(stats.deferred);
+    if (packets)
+    {
+      Serial.print(" latency ");
+      Serial.print(latencyMin);
+      Serial.print("/");
+      Serial.print(latencyTotal / packets);
+      Serial.print("/");
+      Serial.print(latencyMax);
+    }
+    Serial.println("");
+    packets = 0;
+    lost = 0;
+    latencyMin = 0xffffffff;
+    latencyMax = 0;
+    latencyTotal = 0;
+  }
+}
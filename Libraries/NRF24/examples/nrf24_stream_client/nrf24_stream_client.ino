@@ -0,0 +1,73 @@
+// nrf24_stream_client.ino
+// -*- mode: C++ -*-
+// Example sketch showing how to send buffers larger than one packet
+// with the NRF24Stream class.
+// It is designed to work with the example nrf24_stream_server.
+//
+// Once a second, sends a STREAM_LEN octet test buffer (a sequence number followed by
+// a pattern the server can check), and prints whether the server got all of it,
+// how long it took and the goodput in octets per second, at 115200 baud.
+
+#include <NRF24Stream.h>
+#include <SPI.h>
+
+#define STREAM_LEN     1024
+#define STREAM_TIMEOUT 500   // millisecs
+#define STREAM_NOACK   true  // Fragments NOACK, relying on retransmission after the poll
+
+// Singleton instance of the radio
+NRF24Stream nrf24;
+// NRF24Stream nrf24(8, 7); // use this to be electrically compatible with Mirf
+// NRF24Stream nrf24(8, 10);// For Leonardo, need explicit SS pin
+
+uint8_t buf[STREAM_LEN];
+uint8_t sequence = 0;
+
+void setup()
+{
+  Serial.begin(115200);
+  while (!Serial)
+    ; // wait for serial port to connect. Needed for Leonardo only
+  if (!nrf24.init())
+    Serial.println("NRF24 init failed");
+  if (!nrf24.setChannel(1))
+    Serial.println("setChannel failed");
+  if (!nrf24.setThisAddress((uint8_t*)"strc1", 5))
+    Serial.println("setThisAddress failed");
+  if (!nrf24.setTransmitAddress((uint8_t*)"strs1", 5))
+    Serial.println("setTransmitAddress failed");
+  if (!nrf24.setRF(NRF24::NRF24DataRate2Mbps, NRF24::NRF24TransmitPower0dBm))
+    Serial.println("setRF failed");
+  // The receiver's status is a 32 octet ACK payload, which needs 500 microsecs
+  if (!nrf24.setRetry(1, 15))
+    Serial.println("setRetry failed");
+  Serial.println("initialised");
+}
+
+void loop()
+{
+  uint16_t i;
+
+  buf[0] = sequence;
+  for (i = 1; i < sizeof(buf); i++)
+    buf[i] = sequence + i;
+
+  unsigned long start = micros();
+  boolean ok = nrf24.sendStream(buf, sizeof(buf), STREAM_NOACK, STREAM_TIMEOUT);
+  unsigned long elapsed = micros() - start;
+
+  Serial.print("buffer ");
+  Serial.print(sequence);
+  if (ok)
+  {
+    Serial.print(" sent in ");
+    Serial.print(elapsed);
+    Serial.print(" microsecs, ");
+    Serial.print(sizeof(buf) * 1000000UL / elapsed);
+    Serial.println(" octets per sec");
+  }
+  else
+    Serial.println(" failed");
+  sequence++;
+  delay(1000);
+}
@@ -0,0 +1,61 @@
+// nrf24_stream_server.ino
+// -*- mode: C++ -*-
+// Example sketch showing how to receive buffers larger than one packet
+// with the NRF24Stream class.
+// It is designed to work with the example nrf24_stream_client.
+//
+// Reassembles each buffer the client sends, checks the test pattern and prints
+// the result at 115200 baud. recvStream() is called with a short timeout, as it
+// would be from a loop() with other work to do: a partly received buffer is
+// carried on with at the next call.
+
+#include <NRF24Stream.h>
+#include <SPI.h>
+
+#define STREAM_LEN     1024
+
+// Singleton instance of the radio
+NRF24Stream nrf24;
+// NRF24Stream nrf24(8, 7); // use this to be electrically compatible with Mirf
+// NRF24Stream nrf24(8, 10);// For Leonardo, need explicit SS pin
+
+uint8_t buf[STREAM_LEN];
+
+void setup()
+{
+  Serial.begin(115200);
+  while (!Serial)
+    ; // wait for serial port to connect. Needed for Leonardo only
+  if (!nrf24.init())
+    Serial.println("NRF24 init failed");
+  if (!nrf24.setChannel(1))
+    Serial.println("setChannel failed");
+  if (!nrf24.setThisAddress((uint8_t*)"strs1", 5))
+    Serial.println("setThisAddress failed");
+  if (!nrf24.setTransmitAddress((uint8_t*)"strc1", 5))
+    Serial.println("setTransmitAddress failed");
+  if (!nrf24.setRF(NRF24::NRF24DataRate2Mbps, NRF24::NRF24TransmitPower0dBm))
+    Serial.println("setRF failed");
+  if (!nrf24.setRetry(1, 15))
+    Serial.println("setRetry failed");
+  Serial.println("initialised");
+}
+
+void loop()
+{
+  uint16_t len = sizeof(buf);
+  uint16_t i, errors = 0;
+
+  if (!nrf24.recvStream(buf, &len, 10))
+    return;
+
+  for (i = 1; i < len; i++)
+    if (buf[i] != (uint8_t)(buf[0] + i))
+      errors++;
+  Serial.print("buffer ");
+  Serial.print(buf[0]);
+  Serial.print(" length ");
+  Serial.print(len);
+  Serial.print(" errors ");
+  Serial.println(errors);
+}
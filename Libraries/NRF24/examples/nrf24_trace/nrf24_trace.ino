@@ -0,0 +1,87 @@
+// nrf24_trace.ino
+// -*- mode: C++ -*-
+// Example sketch showing how to trace SPI transactions with the NRF24 class.
+// Needs NRF24_TRACE set to 1 in NRF24.h, so the tracer is built in.
+// It is designed to work with the example nrf24_ping_server
+//
+// Tracing starts before init(), so the trace shows the whole radio setup, then a ping
+// is sent to the server every PING_INTERVAL ms. Send 'd' to dump the trace recorded
+// since the last dump, as binary, and 's' to stop or restart tracing. Capture the serial
+// output to a file, eg:
+//   stty -F /dev/ttyACM0 115200 raw; cat /dev/ttyACM0 > trace.bin
+// and decode it with tools/nrf24_trace:
+//   nrf24_trace trace.bin
+// The decoder skips the text lines between dumps.
+// The trace buffer holds NRF24_TRACE_LEN octets, about 20 pings: transactions that
+// do not fit are counted as lost in the next dump.
+
+#include <NRF24.h>
+#include <SPI.h>
+
+#if !NRF24_TRACE
+#error Set NRF24_TRACE to 1 in NRF24.h for this example
+#endif
+
+#define PING_INTERVAL 100
+
+// Singleton instance of the radio
+NRF24 nrf24;
+// NRF24 nrf24(8, 7); // use this to be electrically compatible with Mirf
+// NRF24 nrf24(8, 10);// For Leonardo, need explicit SS pin
+
+boolean tracing;
+unsigned long lastPing = 0;
+
+void setup()
+{
+  Serial.begin(115200);
+  while (!Serial)
+    ; // wait for serial port to connect. Needed for Leonardo only
+  nrf24.traceStart();
+  tracing = true;
+  if (!nrf24.init())
+    Serial.println("NRF24 init failed");
+  if (!nrf24.setChannel(1))
+    Serial.println("setChannel failed");
+  if (!nrf24.setThisAddress((uint8_t*)"clie1", 5))
+    Serial.println("setThisAddress failed");
+  if (!nrf24.setPayloadSize(sizeof(unsigned long)))
+    Serial.println("setPayloadSize failed");
+  if (!nrf24.setRF(NRF24::NRF24DataRate2Mbps, NRF24::NRF24TransmitPower0dBm))
+    Serial.println("setRF failed");
+  if (!nrf24.setTransmitAddress((uint8_t*)"serv1", 5))
+    Serial.println("setTransmitAddress failed");
+  Serial.println("initialised");
+}
+
+void loop()
+{
+  if (Serial.available())
+  {
+    char c = Serial.read();
+    if (c == 'd')
+      nrf24.traceDump();
+    else if (c == 's')
+    {
+      if (tracing)
+        nrf24.traceStop();
+      else
+        nrf24.traceStart();
+      tracing = !tracing;
+    }
+  }
+
+  if (millis() - lastPing >= PING_INTERVAL)
+  {
+    lastPing = millis();
+    // The server echoes the time back
+    unsigned long time = micros();
+    if (nrf24.send((uint8_t*)&time, sizeof(time)) && nrf24.waitPacketSent())
+    {
+      unsigned long data;
+      uint8_t len = sizeof(data);
+      if (nrf24.waitAvailableTimeout(10))
+        nrf24.recv((uint8_t*)&data, &len);
+    }
+  }
+}
@@ -0,0 +1,137 @@
+// RcPpmEncoder.cpp
+//
+// $Id:  $
+
+#include <RcPpmEncoder.h>
+
+// Compare output modes for OC1A in Timer1 normal mode
+#define RCPPMENCODER_SET   (_BV(COM1A1) | _BV(COM1A0))
+#define RCPPMENCODER_CLEAR _BV(COM1A1)
+
+RcPpmEncoder* RcPpmEncoder::_running = 0;
+
+RcPpmEncoder::RcPpmEncoder(uint8_t channels, uint16_t frameLength, boolean positive)
+{
+    uint8_t i;
+
+    _channelCount = constrain(channels, RCTRAINER_MIN_CHANNELS, RCTRAINER_MAX_CHANNELS);
+    _frameLength = frameLength > RCPPMENCODER_MAX_FRAME_LENGTH ? RCPPMENCODER_MAX_FRAME_LENGTH : frameLength;
+    _positive = positive;
+    for (i = 0; i < RCTRAINER_MAX_CHANNELS; i++)
+	_next[i] = _frame[i] = 1500;
+    _gap = 0;
+    _edge = 0;
+    _changed = false;
+    _changeTime = 0;
+    _frameCount = 0;
+}
+
+void RcPpmEncoder::begin()
+{
+    noInterrupts();
+    _running = this;
+    TIMSK1 &= ~_BV(OCIE1A);
+    TCCR1B = _BV(CS11);  // Normal mode, prescaler 8
+    // Force OC1A to the idle level before the pin becomes an output
+    TCCR1A = _positive ? RCPPMENCODER_CLEAR : RCPPMENCODER_SET;
+    TCCR1C = _BV(FOC1A);
+    pinMode(RCPPMENCODER_PIN, OUTPUT);
+
+    // The first compare starts the first frame, which reports as a change
+    TCCR1A = _positive ? RCPPMENCODER_SET : RCPPMENCODER_CLEAR;
+    _edge = 0;
+    _changed = true;
+    _frameCount = 0;
+    OCR1A = TCNT1 + RCPPMENCODER_PULSE * RCPPMENCODER_TICKS_PER_US;
+    TIFR1 = _BV(OCF1A);  // Clear any stale match, by writing 1
+    TIMSK1 |= _BV(OCIE1A);
+    interrupts();
+}
+
+void RcPpmEncoder::end()
+{
+    noInterrupts();
+    TIMSK1 &= ~_BV(OCIE1A);
+    // Disconnect OC1A, leaving the pin to the port at the idle level
+    digitalWrite(RCPPMENCODER_PIN, _positive ? LOW : HIGH);
+    TCCR1A = 0;
+    _running = 0;
+    interrupts();
+}
+
+void RcPpmEncoder::setChannel(uint8_t channel, uint16_t value)
+{
+    if (channel >= _channelCount)
+	return;
+    value = constrain(value, RCTRAINER_MIN_PULSE, RCTRAINER_MAX_PULSE);
+    noInterrupts();
+    _next[channel] = value;
+    _changed = true;
+    interrupts();
+}
+
+boolean RcPpmEncoder::changeTime(uint32_t* time)
+{
+    noInterrupts();
+    boolean changed = _changed;
+    *time = _changeTime;
+    interrupts();
+    return !changed;
+}
+
+uint16_t RcPpmEncoder::frameCount()
+{
+    noInterrupts();
+    uint16_t count = _frameCount;
+    interrupts();
+    return count;
+}
+
+void RcPpmEncoder::timerInterrupt()
+{
+    if (_running)
+	_running->nextEdge();
+}
+
+// Edges in a frame: the start and end of each of _channelCount + 1 pulses. Even
+// numbered edges start pulses, edge 0 starts the frame.
+void RcPpmEncoder::nextEdge()
+{
+    uint16_t interval;
+
+    if (_edge == 0)
+    {
+	// Start of a frame, latch the values it carries
+	uint8_t i;
+	uint16_t sum = 0;
+	for (i = 0; i < _channelCount; i++)
+	    sum += _frame[i] = _next[i];
+	_gap = (_frameLength > sum + RCTRAINER_MIN_INTERFRAME_INTERVAL + RCPPMENCODER_PULSE)
+	    ? _frameLength - sum : RCTRAINER_MIN_INTERFRAME_INTERVAL + RCPPMENCODER_PULSE;
+	if (_changed)
+	{
+	    // The edge was made by the hardware, this far back
+	    uint16_t late = TCNT1 - OCR1A;
+	    _changeTime = micros() - late / RCPPMENCODER_TICKS_PER_US;
+	    _changed = false;
+	}
+	_frameCount++;
+    }
+
+    if (_edge & 1)
+    {
+	// End of a pulse, the next pulse starts one channel value (or the sync gap)
+	// after this one did
+	uint8_t pulse = _edge >> 1;
+	interval = (pulse < _channelCount ? _frame[pulse] : _gap) - RCPPMENCODER_PULSE;
+	TCCR1A = _positive ? RCPPMENCODER_SET : RCPPMENCODER_CLEAR;
+	_edge = pulse < _channelCount ? _edge + 1 : 0;
+    }
+    else
+    {
+	interval = RCPPMENCODER_PULSE;
+	TCCR1A = _positive ? RCPPMENCODER_CLEAR : RCPPMENCODER_SET;
+	_edge++;
+    }
+    OCR1A = OCR1A + interval * RCPPMENCODER_TICKS_PER_US;
+}
@@ -0,0 +1,112 @@
+// RcPpmEncoder.h
+//
+/// \class RcPpmEncoder RcPpmEncoder.h <RcPpmEncoder.h>
+/// \brief Generate a PPM signal, like an RC transmitter's trainer output, with Timer1
+///
+/// This class generates the PPM signal RcTrainer decodes, for testing without a
+/// transmitter: on the same Arduino, with the output wired to the RcTrainer input,
+/// or on a second one wired to it in place of the transmitter.
+///
+/// Each channel starts with a RCPPMENCODER_PULSE microsec pulse, and lasts its channel value,
+/// so the pulses start one channel value apart. One more pulse ends the last channel, and the
+/// frame is filled out to the frame length with the sync gap. Pulses are high (positive polarity)
+/// or low (negative polarity), and the signal idles at the other level between them.
+///
+/// Edges are generated by the Timer1 output compare A hardware, on the OC1A pin (D9 on Uno,
+/// D11 on Mega), so interrupt latency does not affect their timing. Timer1 runs free at
+/// a 2MHz count (prescaler 8, on a 16MHz Arduino), and cannot be used for anything else meanwhile,
+/// including PWM on pins 9 and 10 on Uno. The sketch must route the Timer1 compare A interrupt
+/// to timerInterrupt():
+/// \code
+/// ISR(TIMER1_COMPA_vect)
+/// {
+///     RcPpmEncoder::timerInterrupt();
+/// }
+/// \endcode
+///
+/// Channel values set with setChannel() are latched at the start of each frame, so a frame
+/// never carries a mix of old and new values. changeTime() reports when the first frame
+/// carrying the latest change started, which is the reference for measuring latency from
+/// stick to radio.
+#ifndef RcPpmEncoder_h
+#define RcPpmEncoder_h
+
+#include <RcTrainer.h>
+
+/// Length of the pulse that starts each channel, in microseconds
+#define RCPPMENCODER_PULSE 300
+/// Default frame length in microseconds, as most transmitters
+#define RCPPMENCODER_FRAME_LENGTH 22500
+/// Longest frame, in microseconds, so the sync gap fits in the 16 bit Timer1 count
+#define RCPPMENCODER_MAX_FRAME_LENGTH 32000
+/// Timer1 counts per microsecond, with prescaler 8
+#define RCPPMENCODER_TICKS_PER_US (F_CPU / 8000000L)
+
+/// The OC1A pin the signal comes out on
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+#define RCPPMENCODER_PIN 11
+#else
+#define RCPPMENCODER_PIN 9
+#endif
+
+/////////////////////////////////////////////////////////////////////
+class RcPpmEncoder
+{
+public:
+    /// Constructor. All channels start at 1500 microseconds.
+    /// \param[in] channels Number of channels in each frame, RCTRAINER_MIN_CHANNELS to RCTRAINER_MAX_CHANNELS
+    /// \param[in] frameLength Frame length in microseconds, up to RCPPMENCODER_MAX_FRAME_LENGTH.
+    /// If the channels do not leave room for a sync gap longer than RCTRAINER_MIN_INTERFRAME_INTERVAL,
+    /// the frame is stretched
+    /// \param[in] positive true for high pulses on a low idle level, false for low pulses
+    RcPpmEncoder(uint8_t channels = 6, uint16_t frameLength = RCPPMENCODER_FRAME_LENGTH, boolean positive = true);
+
+    /// Takes over Timer1 and starts generating frames on OC1A. Only one RcPpmEncoder
+    /// can run at a time.
+    void     begin();
+
+    /// Stops generating frames, and leaves OC1A at the idle level
+    void     end();
+
+    /// Sets the value of a channel, from the next frame on
+    /// \param[in] channel The channel number
+    /// \param[in] value The channel value in microseconds, constrained to RCTRAINER_MIN_PULSE
+    /// to RCTRAINER_MAX_PULSE
+    void     setChannel(uint8_t channel, uint16_t value);
+
+    /// Reports when the first frame carrying the latest setChannel() value started
+    /// \param[out] time Set to micros() at the start of that frame
+    /// \return true if that frame has started, false if it is still to come
+    boolean  changeTime(uint32_t* time);
+
+    /// \return The number of frames started since begin(), modulo 65536
+    uint16_t frameCount();
+
+    /// Timer1 compare A interrupt handler. Call it from ISR(TIMER1_COMPA_vect) in the sketch.
+    static void timerInterrupt();
+
+private:
+    /// Schedules the edge after the one that just happened
+    void     nextEdge();
+
+    static RcPpmEncoder* _running;
+
+    uint8_t  _channelCount;
+    uint16_t _frameLength;
+    boolean  _positive;
+    uint16_t _next[RCTRAINER_MAX_CHANNELS];   // Set by setChannel()
+    uint16_t _frame[RCTRAINER_MAX_CHANNELS];  // Latched for the frame being sent
+    uint16_t _gap;                            // Sync gap after the last pulse of this frame
+    uint8_t  _edge;                           // Edge the compare in progress will make
+
+    // Shared with the sketch
+    volatile boolean  _changed;               // setChannel() since the last latch
+    volatile uint32_t _changeTime;
+    volatile uint16_t _frameCount;
+};
+
+/// @example ppm_loopback.ino
+/// Generate a PPM signal with RcPpmEncoder, read it back with RcTrainer on the same board,
+/// and print the values sent and received and the latency
+
+#endif
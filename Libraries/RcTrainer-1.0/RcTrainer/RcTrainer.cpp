@@ -11,6 +11,21 @@
 #define MAX_INTERRUPTS 6
 RcTrainer* RcTrainer::_RcTrainerForInterrupt[MAX_INTERRUPTS];
 
+RcTrainerBase::RcTrainerBase()
+{
+    _nextChannelNumber = 0;
+    _lastChannelCount = 0;
+    _frameBad = false;
+    _frameHeld = false;
+    _frameChannels = 0;
+    _frameCount = 0;
+    _badFrameCount = 0;
+#if RCTRAINER_FRAME_QUEUE
+    _frameOverruns = 0;
+#endif
+    _edgeHook = 0;
+}
+
 RcTrainer::RcTrainer(uint8_t interrupt)
 {
     if (interrupt < MAX_INTERRUPTS)
@@ -40,13 +55,25 @@ RcTrainer::RcTrainer(uint8_t interrupt)
     }
 }
 
-int16_t RcTrainer::getChannelRaw(uint16_t channel)
+// Publishes a frame held at its last channel, once the longest pulse has gone by
+// without another edge, so it cannot have a channel too many. Call with interrupts off
+void RcTrainerBase::confirmFrame()
+{
+    if (_frameHeld && micros() - _lastInterruptTime > RCTRAINER_MAX_PULSE)
+	commitFrame(_lastInterruptTime);
+}
+
+int16_t RcTrainerBase::getChannelRaw(uint16_t channel)
 {
     if (channel >= RCTRAINER_MAX_CHANNELS)
 	return 0;
-    return  _channels[channel];
+    // 16 bit read must not be torn by the interrupt handler
+    noInterrupts();
+    uint16_t val = _channels[channel];
+    interrupts();
+    return val;
 }
-int16_t RcTrainer::getChannel(int16_t channel, int16_t mapFromLow, int16_t mapFromHigh, int16_t mapToLow, int16_t mapToHigh)
+int16_t RcTrainerBase::getChannel(int16_t channel, int16_t mapFromLow, int16_t mapFromHigh, int16_t mapToLow, int16_t mapToHigh)
 {
     int16_t val = getChannelRaw(channel);
     val = map(val, mapFromLow, mapFromHigh, mapToLow, mapToHigh);
@@ -54,36 +81,65 @@ int16_t RcTrainer::getChannel(int16_t channel, int16_t mapFromLow, int16_t mapFr
     return val;
 }
 
+uint16_t RcTrainerBase::frameCount()
+{
+    noInterrupts();
+    confirmFrame();
+    uint16_t count = _frameCount;
+    interrupts();
+    return count;
+}
+
+uint16_t RcTrainerBase::badFrameCount()
+{
+    noInterrupts();
+    uint16_t count = _badFrameCount;
+    interrupts();
+    return count;
+}
+
+uint8_t RcTrainerBase::channelCount()
+{
+    return _frameChannels;
+}
+
+uint32_t RcTrainerBase::frameAge()
+{
+    noInterrupts();
+    confirmFrame();
+    uint32_t lastFrameTime = _lastFrameTime;
+    interrupts();
+    if (!_frameChannels)
+	return 0xffffffff;
+    return micros() - lastFrameTime;
+}
+
+#if RCTRAINER_FRAME_QUEUE
+boolean RcTrainerBase::readFrame(RcTrainerFrame* frame)
+{
+    noInterrupts();
+    confirmFrame();
+    interrupts();
+    return _frames.pop(*frame);
+}
+
+uint16_t RcTrainerBase::frameOverruns()
+{
+    noInterrupts();
+    uint16_t count = _frameOverruns;
+    interrupts();
+    return count;
+}
+#endif
+
+void RcTrainerBase::setEdgeHook(void (*hook)(uint32_t time))
+{
+    _edgeHook = hook;
+}
+
 void RcTrainer::interruptHandler()
-{  
-    uint32_t interruptTime = micros();
-    uint32_t pulse_width =  interruptTime - _lastInterruptTime;
-    
-    if (pulse_width > RCTRAINER_MIN_INTERFRAME_INTERVAL) 
-    {
-	// Start of a new frame of channels
-	_nextChannelNumber = 0;
-    }
-    else
-    {
-	// End of a variable width channel value, use the elapsed time
-	// since the last transition, which is a measurement of the analog
-	// channel value
-	// For my Spektrum DX6i, the min is about 1096, and the max is about 1916
-	// Centre of range is about 1512
-	// gear is 1096 to 1932
-	// If flap is configured, it goes between 1096 and 1512
-	// Channels are:
-	// 0 throttle
-	// 1 aileron
-	// 2 elevator
-	// 3 rudder
-	// 4 gear
-	// 5 flap/gyro
-	if (_nextChannelNumber < RCTRAINER_MAX_CHANNELS)
-	    _channels[_nextChannelNumber++] = pulse_width;
-    }
-    _lastInterruptTime = interruptTime;
+{
+    handleEdge();
 }
 
 void RcTrainer::interruptHandler0()
@@ -110,3 +166,51 @@ void  RcTrainer::interruptHandler5()
 {
     _RcTrainerForInterrupt[5]->interruptHandler();
 }
+
+RcTrainerBuddy::RcTrainerBuddy(RcTrainerBase& instructor, RcTrainerBase& student, uint8_t switchChannel, uint16_t studentChannels)
+    : _instructor(instructor), _student(student)
+{
+    _switchChannel = switchChannel;
+    _studentChannels = studentChannels;
+}
+
+boolean RcTrainerBuddy::studentInControl()
+{
+    return _instructor.getChannelRaw(_switchChannel) > RCTRAINER_BUDDY_SWITCH_THRESHOLD
+	&& _student.frameAge() < RCTRAINER_BUDDY_TIMEOUT;
+}
+
+int16_t RcTrainerBuddy::getChannelRaw(uint16_t channel)
+{
+    if (channel < 16 && (_studentChannels & (1 << channel)) && studentInControl())
+	return _student.getChannelRaw(channel);
+    return _instructor.getChannelRaw(channel);
+}
+
+int16_t RcTrainerBuddy::getChannel(int16_t channel, int16_t mapFromLow, int16_t mapFromHigh, int16_t mapToLow, int16_t mapToHigh)
+{
+    int16_t val = getChannelRaw(channel);
+    val = map(val, mapFromLow, mapFromHigh, mapToLow, mapToHigh);
+    val = constrain(val, mapToLow, mapToHigh);
+    return val;
+}
+
+uint16_t RcTrainerBuddy::frameCount()
+{
+    return studentInControl() ? _student.frameCount() : _instructor.frameCount();
+}
+
+uint16_t RcTrainerBuddy::badFrameCount()
+{
+    return _instructor.badFrameCount() + _student.badFrameCount();
+}
+
+uint8_t RcTrainerBuddy::channelCount()
+{
+    return _instructor.channelCount();
+}
+
+void RcTrainerBuddy::setEdgeHook(void (*hook)(uint32_t time))
+{
+    _instructor.setEdgeHook(hook);
+}
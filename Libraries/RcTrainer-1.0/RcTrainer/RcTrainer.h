@@ -89,33 +89,60 @@
 #include <wiring.h>
 #endif
 
+// Set to 1 to queue every valid frame whole for RcTrainerBase::readFrame(). At 0 (the
+// default) readFrame() and frameOverruns() are not built, and an instance carries no
+// queue, which is RCTRAINER_FRAME_QUEUE_LEN frames of RAM.
+#ifndef RCTRAINER_FRAME_QUEUE
+#define RCTRAINER_FRAME_QUEUE 0
+#endif
+
+#if RCTRAINER_FRAME_QUEUE
+#include <SpscQueue.h>
+#endif
+
 // These defs cause trouble on some versions of Arduino
 #undef round
 #undef double
 
-/////////////////////////////////////////////////////////////////////
-/// \class RcTrainer RcTrainer.h <RcTrainer.h>
-/// \brief Read servo positions from RC Transmitter in Trainer mode
-///
-/// This class provides the ability to read servo positions from a PPM encoded
-/// digital signal, such as the one emitted by an RC traansmitter in Trainer mode.
-class RcTrainer
-{
-public:
 /// Maximum number of permitted channels.
 #define RCTRAINER_MAX_CHANNELS 10
 /// Minimum interfame interval in microseconds
 #define RCTRAINER_MIN_INTERFRAME_INTERVAL 3000
+/// Shortest channel pulse accepted as valid, in microseconds
+#define RCTRAINER_MIN_PULSE 700
+/// Longest channel pulse accepted as valid, in microseconds
+#define RCTRAINER_MAX_PULSE 2300
+/// Fewest channels a frame must carry to be accepted
+#define RCTRAINER_MIN_CHANNELS 4
+/// Raw value above which RcTrainerBuddy's takeover switch is on, in microseconds
+#define RCTRAINER_BUDDY_SWITCH_THRESHOLD 1500
+/// Age of the student's last frame, in microseconds, after which RcTrainerBuddy gives
+/// control back to the instructor
+#define RCTRAINER_BUDDY_TIMEOUT 100000
+/// Valid frames held for readFrame(), a power of two
+#define RCTRAINER_FRAME_QUEUE_LEN 2
 
-    /// Constructor
-    /// Creates a new RcTrainer. You have multiple RcTrainer instances connected to
-    /// different inputs. If the interrupt number is out of 
-    /// range for your processor, RcTrainer will silently fail to work correctly. 
-    /// \param[in] interrupt This is the number of the interrupt pin (not the digital input pin number)
-    /// that is connected to the transmitter. The mapping from interrupt number to digital pin number 
-    /// depends on your Arduino. See http://arduino.cc/en/Reference/attachInterrupt for details
-    RcTrainer(uint8_t interrupt = 0);
+/////////////////////////////////////////////////////////////////////
+/// \struct RcTrainerFrame RcTrainer.h <RcTrainer.h>
+/// \brief A valid frame, as delivered by RcTrainerBase::readFrame()
+typedef struct
+{
+    uint32_t time;                            ///< micros() at the edge that completed the frame
+    uint8_t  channels;                        ///< Number of channels
+    uint16_t values[RCTRAINER_MAX_CHANNELS];  ///< Raw channel values in microseconds
+} RcTrainerFrame;
 
+/////////////////////////////////////////////////////////////////////
+/// \class RcTrainerBase RcTrainer.h <RcTrainer.h>
+/// \brief PPM decoder and channel values shared by RcTrainer and RcTrainerInt
+///
+/// This class decodes a PPM encoded digital signal, such as the one emitted by an RC
+/// transmitter in Trainer mode, one rising edge at a time, and holds the channel values
+/// of the last valid frame. It is not used directly: RcTrainer and RcTrainerInt
+/// route an interrupt to it.
+class RcTrainerBase
+{
+public:
     /// Read the raw channel value for the specified channel.
     /// The raw channel value is the length of the PPM pulse for that channel in microseconds
     /// The range of values seen will depend on your transmitter, and the position of the stick
@@ -144,13 +171,109 @@ public:
     /// transmitter, or if it is more than RCTRAINER_MAX_CHANNELS, returns 0 scaled as per the map arguments
     int16_t getChannel(int16_t channel, int16_t mapFromLow = 1096, int16_t mapFromHigh = 1916, int16_t mapToLow = 0, int16_t mapToHigh = 1023);
 
-private:
-    /// Array of instances connected to interrupts 0 to 6
-    static RcTrainer*        _RcTrainerForInterrupt[];
+    /// Returns the number of valid frames received so far. A frame is valid if every pulse
+    /// lies between RCTRAINER_MIN_PULSE and RCTRAINER_MAX_PULSE and it carries the same number
+    /// of channels as the frame before it. The channel values returned by getChannelRaw() only change
+    /// when a valid frame is received, so a sketch can detect loss of signal by watching for this 
+    /// count to stop changing. A frame is published once no channel can follow its last:
+    /// at the sync gap, or by this call (or frameAge() or readFrame()) once RCTRAINER_MAX_PULSE
+    /// has gone by, so a sketch that calls this before reading the channels gets them sooner.
+    /// \return The number of valid frames received, modulo 65536
+    uint16_t frameCount();
+
+    /// Returns the number of frames that have been rejected due to glitches, out of range pulses
+    /// or an unexpected number of channels.
+    /// \return The number of rejected frames, modulo 65536
+    uint16_t badFrameCount();
+
+    /// Returns the number of channels the decoder has locked on to. 
+    /// \return The number of channels in each valid frame, or 0 if no valid frame has been received yet
+    uint8_t  channelCount();
+
+    /// Returns the time since the last valid frame was received.
+    /// Caution: like micros(), this wraps after about 70 minutes.
+    /// \return The age of the current channel values in microseconds, or 0xffffffff if no valid frame
+    /// has been received yet
+    uint32_t frameAge();
+
+#if RCTRAINER_FRAME_QUEUE
+    /// Takes the oldest valid frame not yet read. Needs RCTRAINER_FRAME_QUEUE set to 1. Each valid frame is queued whole, as well
+    /// as setting the channel values, so a sketch that reads frames gets every one, as it
+    /// arrives, with all its channels from the same frame.
+    /// If the sketch falls RCTRAINER_FRAME_QUEUE_LEN frames behind, later frames are not
+    /// queued until it catches up, and are counted by frameOverruns(). A sketch that never
+    /// reads frames costs the interrupt handler nothing once the queue is full.
+    /// \param[out] frame Where to put the frame
+    /// \return true if there was a frame, false if none has arrived since the last
+    boolean  readFrame(RcTrainerFrame* frame);
 
+    /// \return The number of valid frames that were not queued for readFrame(), because
+    /// the queue was full, modulo 65536
+    uint16_t frameOverruns();
+#endif
+
+    /// Installs a function to be called from the interrupt handler on every edge,
+    /// with the edge time as measured by micros(). This allows the raw PPM signal to be
+    /// recorded for later analysis. The hook runs in interrupt context, so it must be short.
+    /// \param[in] hook The function to call, or 0 to remove the hook
+    void setEdgeHook(void (*hook)(uint32_t time));
+
+protected:
+    RcTrainerBase();
+
+    /// Decodes one rising edge of the PPM signal, timed by micros(). Called from
+    /// the interrupt handler of a subclass. Defined in this header, so that
+    /// RcTrainerInt can have it inlined into its interrupt handler.
+    void handleEdge();
+
+private:
     uint8_t  _nextChannelNumber;
-    uint16_t _channels[RCTRAINER_MAX_CHANNELS];
+    uint8_t  _lastChannelCount;
+    boolean  _frameBad;
+    volatile boolean _frameHeld;
+    uint16_t _pending[RCTRAINER_MAX_CHANNELS];
     uint32_t _lastInterruptTime;
+    void     (*_edgeHook)(uint32_t time);
+
+    // Only these are shared with the sketch, the rest belong to the interrupt handler
+    volatile uint8_t  _frameChannels;
+    volatile uint16_t _channels[RCTRAINER_MAX_CHANNELS];
+    volatile uint16_t _frameCount;
+    volatile uint16_t _badFrameCount;
+    volatile uint32_t _lastFrameTime;
+#if RCTRAINER_FRAME_QUEUE
+    volatile uint16_t _frameOverruns;
+    SpscQueue<RcTrainerFrame, RCTRAINER_FRAME_QUEUE_LEN> _frames;
+#endif
+
+    void commitFrame(uint32_t time);
+    void confirmFrame();
+};
+
+/////////////////////////////////////////////////////////////////////
+/// \class RcTrainer RcTrainer.h <RcTrainer.h>
+/// \brief Read servo positions from RC Transmitter in Trainer mode
+///
+/// This class provides the ability to read servo positions from a PPM encoded
+/// digital signal, such as the one emitted by an RC traansmitter in Trainer mode,
+/// on an interrupt chosen at run time. Each edge goes through a table of instances
+/// indexed by interrupt number: where the interrupt is known at compile time,
+/// RcTrainerInt avoids that.
+class RcTrainer : public RcTrainerBase
+{
+public:
+    /// Constructor
+    /// Creates a new RcTrainer. You have multiple RcTrainer instances connected to
+    /// different inputs. If the interrupt number is out of 
+    /// range for your processor, RcTrainer will silently fail to work correctly. 
+    /// \param[in] interrupt This is the number of the interrupt pin (not the digital input pin number)
+    /// that is connected to the transmitter. The mapping from interrupt number to digital pin number 
+    /// depends on your Arduino. See http://arduino.cc/en/Reference/attachInterrupt for details
+    RcTrainer(uint8_t interrupt = 0);
+
+private:
+    /// Array of instances connected to interrupts 0 to 6
+    static RcTrainer*        _RcTrainerForInterrupt[];
 
     void interruptHandler();
     static void interruptHandler0();
@@ -161,7 +284,198 @@ private:
     static void interruptHandler5();
 };
 
+/////////////////////////////////////////////////////////////////////
+/// \class RcTrainerInt RcTrainer.h <RcTrainer.h>
+/// \brief Read servo positions from RC Transmitter in Trainer mode, on an interrupt fixed at compile time
+///
+/// The same as RcTrainer, but the interrupt number is a template parameter, so each
+/// RcTrainerInt<INT> has its own interrupt handler with the decoder compiled into it:
+/// \code
+/// RcTrainerInt<0> tx; // D2 on Uno
+/// \endcode
+/// This saves the trampoline, the instance table lookup and a call on every edge.
+/// Only one instance per interrupt number may be created.
+template <uint8_t INT>
+class RcTrainerInt : public RcTrainerBase
+{
+public:
+    /// Constructor. Attaches the interrupt handler to interrupt INT
+    RcTrainerInt()
+    {
+	_instance = this;
+	attachInterrupt(INT, interruptHandler, RISING);
+    }
+
+private:
+    static RcTrainerInt* _instance;
+
+    static void interruptHandler()
+    {
+	_instance->handleEdge();
+    }
+};
+
+template <uint8_t INT>
+RcTrainerInt<INT>* RcTrainerInt<INT>::_instance;
+
+/////////////////////////////////////////////////////////////////////
+/// \class RcTrainerBuddy RcTrainer.h <RcTrainer.h>
+/// \brief Merge the channels of an instructor and a student transmitter, for buddy box training
+///
+/// Reads two PPM inputs, each through its own RcTrainer or RcTrainerInt: the instructor's
+/// and the student's. While the instructor holds the takeover switch on, the channels in
+/// the student mask are read from the student, and all others from the instructor.
+/// If the student's signal is lost (no valid frame for RCTRAINER_BUDDY_TIMEOUT), or the
+/// student's decoder is not locked on, control goes straight back to the instructor.
+///
+/// Channels are merged when they are read, from the last valid frame of each input, so
+/// switching adds no latency and neither input waits for the other.
+///
+/// The read functions match RcTrainerBase, so a sketch written for one input can use an
+/// RcTrainerBuddy in its place.
+class RcTrainerBuddy
+{
+public:
+    /// Constructor
+    /// \param[in] instructor The instructor's input, which always has the takeover switch
+    /// \param[in] student The student's input
+    /// \param[in] switchChannel The instructor's channel that hands control to the student when on
+    /// (above RCTRAINER_BUDDY_SWITCH_THRESHOLD)
+    /// \param[in] studentChannels Bit mask of the channels the student controls when the switch is on.
+    /// The default is channels 0 to 3, the sticks.
+    RcTrainerBuddy(RcTrainerBase& instructor, RcTrainerBase& student, uint8_t switchChannel, uint16_t studentChannels = 0x000f);
+
+    /// \return true if the takeover switch is on and the student's signal is good, so
+    /// the student's channels are read from the student
+    boolean  studentInControl();
+
+    /// Read the raw value of a channel, from the student or the instructor. See RcTrainerBase::getChannelRaw()
+    /// \param[in] channel The number of the channel to get.
+    /// \return The raw channel value in microseconds
+    int16_t  getChannelRaw(uint16_t channel);
+
+    /// Reads a scaled channel value, from the student or the instructor. See RcTrainerBase::getChannel()
+    int16_t  getChannel(int16_t channel, int16_t mapFromLow = 1096, int16_t mapFromHigh = 1916, int16_t mapToLow = 0, int16_t mapToHigh = 1023);
+
+    /// \return The valid frame count of the input in control of the student's channels,
+    /// so a sketch watching it for loss of signal sees the frames it is flying on
+    uint16_t frameCount();
+
+    /// \return The rejected frame counts of both inputs, added
+    uint16_t badFrameCount();
+
+    /// \return The number of channels the instructor's decoder has locked on to
+    uint8_t  channelCount();
+
+    /// Installs an edge hook on the instructor's input. See RcTrainerBase::setEdgeHook()
+    void     setEdgeHook(void (*hook)(uint32_t time));
+
+private:
+    RcTrainerBase& _instructor;
+    RcTrainerBase& _student;
+    uint8_t        _switchChannel;
+    uint16_t       _studentChannels;
+};
+
+inline void RcTrainerBase::commitFrame(uint32_t time)
+{
+    // Publish the pending frame as the current channel values, and queue it if there is room
+    uint8_t i;
+#if RCTRAINER_FRAME_QUEUE
+    RcTrainerFrame* frame = _frames.back();
+    if (frame)
+    {
+	for (i = 0; i < _nextChannelNumber; i++)
+	    _channels[i] = frame->values[i] = _pending[i];
+	frame->channels = _nextChannelNumber;
+	frame->time = time;
+	_frames.push();
+    }
+    else
+    {
+	for (i = 0; i < _nextChannelNumber; i++)
+	    _channels[i] = _pending[i];
+	_frameOverruns++;
+    }
+#else
+    for (i = 0; i < _nextChannelNumber; i++)
+	_channels[i] = _pending[i];
+#endif
+    _lastFrameTime = time;
+    _frameCount++;
+    _frameHeld = false;
+}
+
+inline void RcTrainerBase::handleEdge()
+{  
+    uint32_t interruptTime = micros();
+    uint32_t pulse_width =  interruptTime - _lastInterruptTime;
+    
+    if (pulse_width > RCTRAINER_MIN_INTERFRAME_INTERVAL) 
+    {
+	// Start of a new frame of channels. The previous frame is only accepted if it
+	// was clean and has the same channel count as the one before it, so a single
+	// frame cannot change the lock.
+	uint8_t count = _nextChannelNumber;
+	if (_frameHeld)
+	    commitFrame(_lastInterruptTime);
+	if (count != _frameChannels)
+	{
+	    if (!_frameBad && count >= RCTRAINER_MIN_CHANNELS && count == _lastChannelCount)
+	    {
+		// Relock on the new channel count
+		_frameChannels = count;
+		commitFrame(interruptTime);
+	    }
+	    else if (_frameChannels)
+		_frameBad = true;
+	}
+	if (_frameBad)
+	    _badFrameCount++;
+	_lastChannelCount = count;
+	_nextChannelNumber = 0;
+	_frameBad = false;
+    }
+    else if (pulse_width < RCTRAINER_MIN_PULSE || pulse_width > RCTRAINER_MAX_PULSE
+	     || _nextChannelNumber >= RCTRAINER_MAX_CHANNELS)
+    {
+	// Glitch, or a missing sync gap. Hold the last good values until the next clean frame
+	_frameBad = true;
+	_frameHeld = false;
+    }
+    else
+    {
+	// End of a variable width channel value, use the elapsed time
+	// since the last transition, which is a measurement of the analog
+	// channel value
+	// For my Spektrum DX6i, the min is about 1096, and the max is about 1916
+	// Centre of range is about 1512
+	// gear is 1096 to 1932
+	// If flap is configured, it goes between 1096 and 1512
+	// Channels are:
+	// 0 throttle
+	// 1 aileron
+	// 2 elevator
+	// 3 rudder
+	// 4 gear
+	// 5 flap/gyro
+	_pending[_nextChannelNumber++] = pulse_width;
+	// Once locked, a clean frame is held when its last channel ends. A glitch that
+	// splits a pulse in two adds a channel, so the frame is only published once no
+	// further channel can end: at the sync gap, or when frameCount() finds
+	// RCTRAINER_MAX_PULSE gone by with no edge, whichever comes first
+	_frameHeld = !_frameBad && _nextChannelNumber == _frameChannels;
+    }
+    _lastInterruptTime = interruptTime;
+    if (_edgeHook)
+	_edgeHook(interruptTime);
+}
+
 /// @example dx6i.ino 
 /// Print out servo positions from a Spektrum DX6i in trainer mode
 
+/// @example buddy.ino
+/// Buddy box: merge an instructor's and a student's transmitters with RcTrainerBuddy,
+/// and print who is in control and the merged servo positions
+
 #endif
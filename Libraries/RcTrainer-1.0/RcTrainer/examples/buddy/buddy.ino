@@ -0,0 +1,30 @@
+// buddy.ino
+//
+// Buddy box: read an instructor's transmitter on D2 and a student's on D3, both
+// in trainer mode, and print who is in control and the merged servo positions.
+// While the instructor holds channel 5 on, channels 0 to 3 (the sticks) come from
+// the student.
+
+#include <RcTrainer.h>
+
+// Interrupt 0 is digital input pin D2, interrupt 1 is D3 on Uno
+RcTrainerInt<0> instructor;
+RcTrainerInt<1> student;
+RcTrainerBuddy tx(instructor, student, 5);
+
+void setup()
+{
+    Serial.begin(115200);	
+}
+
+void loop()
+{
+    Serial.println("----------------------");
+    Serial.println(tx.studentInControl() ? "student" : "instructor");
+    // Default mapping is used, suitable for DX6i, which has 6 channels
+    uint8_t i;
+    for (i = 0; i < 6; i++)
+	Serial.println(tx.getChannel(i));
+    
+    delay(1000);
+}
@@ -0,0 +1,66 @@
+// ppm_loopback.ino
+//
+// Generate a PPM signal with RcPpmEncoder and read it back with RcTrainer on the
+// same board: wire D9 (D11 on Mega) to D2. Channel 0 sweeps from 1000 to 2000
+// microseconds, the others hold fixed values, and each second the values sent and
+// read back are printed, with the latency from the start of the first frame carrying
+// the latest sweep value to it being read back.
+// The encoder works just as well on a second board, wired to the D2 input of this one.
+
+#include <RcTrainer.h>
+#include <RcPpmEncoder.h>
+
+#define CHANNELS 6
+
+// Interrupt 0 is digital input pin D2 on Uno
+RcTrainerInt<0> rx;
+RcPpmEncoder ppm(CHANNELS);
+
+// Timer1 compare, make the next PPM edge
+ISR(TIMER1_COMPA_vect)
+{
+    RcPpmEncoder::timerInterrupt();
+}
+
+uint16_t sweep = 1000;
+uint16_t sent[CHANNELS];
+
+void setup()
+{
+    Serial.begin(115200);
+    uint8_t i;
+    for (i = 0; i < CHANNELS; i++)
+    {
+	sent[i] = 1100 + i * 150;
+	ppm.setChannel(i, sent[i]);
+    }
+    ppm.begin();
+}
+
+void loop()
+{
+    uint32_t change;
+    uint8_t i;
+
+    // Wait for the sweep value to arrive, unless D9 is not wired to D2
+    sent[0] = sweep;
+    ppm.setChannel(0, sweep);
+    unsigned long start = millis();
+    while (abs(rx.getChannelRaw(0) - sweep) > 8 && millis() - start < 100)
+	;
+    if (ppm.changeTime(&change) && abs(rx.getChannelRaw(0) - sweep) <= 8)
+    {
+	Serial.print("latency us ");
+	Serial.println(micros() - change);
+    }
+    for (i = 0; i < CHANNELS; i++)
+    {
+	Serial.print(sent[i]);
+	Serial.print(" ");
+	Serial.println(rx.getChannelRaw(i));
+    }
+    Serial.println("----------------------");
+
+    sweep = sweep >= 2000 ? 1000 : sweep + 100;
+    delay(1000);
+}
@@ -0,0 +1,125 @@
+// SpscQueue.h
+//
+/// \class SpscQueue SpscQueue.h <SpscQueue.h>
+/// \brief Fixed size queue for handing items between an interrupt handler and the main program
+///
+/// A single producer, single consumer queue of up to N items of type T, with no locks:
+/// one side (say an interrupt handler) only adds items, and the other (say loop()) only
+/// takes them, so neither has to turn interrupts off. It is header only, and the storage
+/// is part of the object, so there is no allocation.
+///
+/// N must be a power of two, up to 128. The head and tail are 8 bit counts that run freely
+/// and wrap, so they are read and written in a single instruction on AVR, the number of
+/// items is their difference, and all N slots can be used. Each is written by one side
+/// only, as volatile, and after the item it publishes or frees: a compiler barrier on
+/// AVR, which has one core, and a memory fence elsewhere, so the same queue can be used
+/// between two threads on a PC.
+///
+/// Items can be added and taken whole, with push(T) and pop(T), or in place: the producer
+/// fills back() and then push()es it, and the consumer works on front() and then pop()s
+/// it, which saves copying a large item, and lets the consumer keep using an item until
+/// it is done with it. An interrupt handler should not call the consumer side of a queue
+/// it produces for, nor the other way round.
+///
+/// \code
+/// SpscQueue<uint16_t, 8> edges;
+/// ISR: if (!edges.push(TCNT1)) overruns++;
+/// loop(): uint16_t t; while (edges.pop(t)) ...
+/// \endcode
+#ifndef SpscQueue_h
+#define SpscQueue_h
+
+#include <stdint.h>
+
+// Ordering of the item with respect to the index that publishes or frees it
+#ifdef __AVR__
+#define SPSC_QUEUE_RELEASE() __asm__ __volatile__("" ::: "memory")
+#define SPSC_QUEUE_ACQUIRE() __asm__ __volatile__("" ::: "memory")
+#else
+#define SPSC_QUEUE_RELEASE() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define SPSC_QUEUE_ACQUIRE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#endif
+
+template <typename T, uint8_t N>
+class SpscQueue
+{
+public:
+    static_assert(N > 0 && N <= 128 && (N & (N - 1)) == 0, "SpscQueue size must be a power of two up to 128");
+
+    SpscQueue() : _head(0), _tail(0) {}
+
+    /// \return The number of items in the queue. Exact on the consumer side, at least
+    /// that many on the producer side, as the consumer may take some meanwhile
+    uint8_t        count() const { return (uint8_t)(_head - _tail); }
+    bool           empty() const { return _head == _tail; }
+    bool           full() const { return count() == N; }
+    static uint8_t capacity() { return N; }
+
+    /// Producer. \return The slot the next item goes in, to fill before push(), or NULL if the queue is full
+    T* back()
+    {
+	uint8_t head = _head;
+	if ((uint8_t)(head - _tail) == N)
+	    return 0;
+	SPSC_QUEUE_ACQUIRE();
+	return &_items[head & (N - 1)];
+    }
+
+    /// Producer. Adds the item filled in at back(), which must not be NULL
+    void push()
+    {
+	SPSC_QUEUE_RELEASE();
+	_head = _head + 1;
+    }
+
+    /// Producer. Adds a copy of an item
+    /// \return false, with nothing added, if the queue is full
+    bool push(const T& item)
+    {
+	T* slot = back();
+	if (!slot)
+	    return false;
+	*slot = item;
+	push();
+	return true;
+    }
+
+    /// Consumer. \return The oldest item, which stays valid until pop(), or NULL if the queue is empty
+    T* front()
+    {
+	uint8_t tail = _tail;
+	if (_head == tail)
+	    return 0;
+	SPSC_QUEUE_ACQUIRE();
+	return &_items[tail & (N - 1)];
+    }
+
+    /// Consumer. Removes the oldest item, which must be there (front() not NULL)
+    void pop()
+    {
+	SPSC_QUEUE_RELEASE();
+	_tail = _tail + 1;
+    }
+
+    /// Consumer. Takes a copy of the oldest item and removes it
+    /// \return false, with item unchanged, if the queue is empty
+    bool pop(T& item)
+    {
+	T* slot = front();
+	if (!slot)
+	    return false;
+	item = *slot;
+	pop();
+	return true;
+    }
+
+    /// Consumer. Removes every item
+    void clear() { _tail = _head; }
+
+private:
+    T                _items[N];
+    volatile uint8_t _head;      // Items added, written by the producer only
+    volatile uint8_t _tail;      // Items removed, written by the consumer only
+};
+
+#endif
@@ -33,14 +33,34 @@
 */
 
 #include <RcTrainer.h>
+#include <RcPpmEncoder.h>
 #include <NRF24.h>
+#include <NRF24Bridge.h>
 #include <SPI.h>
+#include <EEPROM.h>
 
 // Function prototypes
 void send_packet( bool );
-void write_payload(uint8_t *data, uint8_t len, bool noack);
+uint8_t command_field( uint8_t );
+uint8_t bind_field( uint8_t );
+void radio_init( const uint8_t (*table)[2], uint8_t count );
+void radio_setup( void );
+bool radio_healthy( bool );
+void radio_restore( bool );
+void radio_fault( uint8_t, bool );
+void radio_ok( void );
+void power_set( uint8_t );
+void power_packet( uint8_t );
+void event_wait( void );
 void set_cmmd_addr( void );
 void set_bind_addr( void );
+int packwait( void );
+void mix_init( void );
+void telemetry_update( void );
+void bind( void );
+bool bind_load( void );
+void bind_store( void );
+void bind_gesture( uint8_t aux1 );
 
 // Radio and register defines
 #define RF_CHANNEL      0x3C  // Stock TX fixed frequency
@@ -58,6 +78,181 @@ void set_bind_addr( void );
 #define CHAN_MAX_VALUE 1000
 #define CHAN_MIN_VALUE -1000
 #define chval(chin) (uint8_t) (((chin * 0xFF / CHAN_MAX_VALUE) + 0x100) >> 1);
+
+// Packet timing and failsafe. If no valid PPM frame has been decoded for
+// FAILSAFE_PACKETS consecutive packets (about FAILSAFE_TIMEOUT ms) the failsafe
+// values are sent in place of the last received stick positions. The check is 
+// made once per packet, so the failsafe packet is guaranteed to be sent no later 
+// than FAILSAFE_PACKETS packets after the last good frame.
+#define PACKET_PERIOD       8     // ms between data packets
+#define FAILSAFE_TIMEOUT    100   // ms without a valid frame before failsafe
+#define FAILSAFE_PACKETS    ((FAILSAFE_TIMEOUT + PACKET_PERIOD - 1) / PACKET_PERIOD)
+#define FAILSAFE_THROTTLE   0x00
+#define FAILSAFE_STICK      0x80  // Centre
+
+// Telemetry carried in ACK payloads. Stock firmware sends none; firmware that
+// does puts a type in the first byte. Other types are kept as raw bytes.
+#define TELEM_STATUS        0x01  // Battery in 20mV steps, then flags
+#define TELEM_ARMED         0x01  // TELEM_STATUS flag: motors armed
+#define TELEM_MAX_LEN       32
+
+// Radio fault recovery. packwait() gives up on a packet that has neither been sent
+// nor run out of retries after PACKWAIT_TIMEOUT_US, about twice the longest 11 tries
+// can take, and does not wait at all if CONFIG reads anything but RADIO_CONFIG: the
+// radio has been reset, by a brown-out say, or lost its settings. Every
+// HEALTH_CHECK_MS the channel and address are read back as well. radio_fault() then
+// flushes the packet and pulses CE, and if any register is wrong writes them all
+// again, with the bind or command address in use, but neither resets the radio nor
+// binds again. Failed packets go on being sent every PACKET_PERIOD until one
+// completes, and the time from the first fault to that packet is kept in radio_faults.
+#define RADIO_CONFIG        (NRF24_EN_CRC | NRF24_PWR_UP)
+#define PACKWAIT_TIMEOUT_US 15000
+#define HEALTH_CHECK_MS     1000
+
+// Mixer. Each stick is shaped by a 17 point piecewise linear curve, built by 
+// mix_init() from the settings below, then scaled about centre by the selected rate.
+// The defaults give the plain linear response.
+#define MIX_TRIM_FOLLOW     0     // Trims follow half the stick, for full scale response in stock firmware
+#define MIX_TRIM_CENTRE     1     // Trims held at centre
+
+#define MIX_EXPO_AILERON    0     // Expo, percent: 0 is linear, 100 is fully cubic
+#define MIX_EXPO_ELEVATOR   0
+#define MIX_EXPO_RUDDER     0
+#define MIX_RATE_HIGH       100   // Stick throw, percent of full scale
+#define MIX_RATE_LOW        70
+#define MIX_RATE_CHANNEL    0xFF  // PPM channel selecting high rate when high, 0xFF for high rate always
+#define MIX_THROTTLE_CURVE  {0, 25, 50, 75, 100}  // Throttle percent at 0, 25, 50, 75, 100% stick
+#define MIX_TRIM            MIX_TRIM_FOLLOW
+
+#define MIX_POINTS          17
+#define MIX_RATE_Q7(pct)    ((uint8_t) (((pct) * 128 + 50) / 100))
+#define MIX_TRIM_CENTRE_VAL 0x40
+
+// Trace capture. When enabled, the raw PPM edge times and every packet sent (with
+// its outcome) are recorded in a ring buffer and streamed over Serial at 115200 baud,
+// for replay on a PC with tools/cx10_replay. Stream format (all little endian):
+//   "CX10CAP1"                          header, sent once at startup
+//   0x01 t[2]                           PPM edge at micros() t (low 16 bits)
+//   0x02 t[2] bind result polls pkt[9]  packet written at t, packwait() result and status polls
+//   0x03 n                              n records lost due to buffer overflow
+#ifndef CX10_CAPTURE
+#define CX10_CAPTURE 0
+#endif
+
+// Profiling. When enabled, the time loop() spends before its delay and the time 
+// spent in the PPM interrupt handler (from its call to micros() to the edge hook)
+// are measured on the target and reported over Serial at 115200 baud once a second.
+#ifndef CX10_PROFILE
+#define CX10_PROFILE 0
+#endif
+
+// Buddy box. When enabled, a second (student) transmitter's trainer output is read
+// on D3 as well as the instructor's on D2. While the instructor holds the takeover
+// switch on, the sticks come from the student; the flags, rate switch and binding
+// stay with the instructor. Control returns to the instructor if the student's
+// signal is lost. Capture records the instructor's PPM only.
+#ifndef CX10_BUDDY
+#define CX10_BUDDY 0
+#endif
+#define BUDDY_SWITCH_CHANNEL 5     // Instructor's channel that hands the sticks to the student
+
+// Latency test. When enabled, the PPM signal is generated on this board by an
+// RcPpmEncoder: wire its output, D9 (D11 on Mega), to D2 in place of the transmitter.
+// Aux1 is held high so binding goes ahead, and the throttle steps between LATENCY_LOW
+// and LATENCY_HIGH every LATENCY_STEP_MS. Each step is timed from the start of the
+// first PPM frame carrying it to the end of the first packet carrying it (TX_DS or
+// MAX_RT), and the min, mean and max are reported over Serial at 115200 baud once a
+// second. This is the stick to air latency, less the transmitter's own: PPM frame
+// time, decoding, waiting for the next packet and the packet itself.
+#ifndef CX10_LATENCY
+#define CX10_LATENCY 0
+#endif
+#define LATENCY_STEP_MS     100   // ms between throttle steps
+#define LATENCY_LOW         1200  // Throttle steps between these, in microseconds
+#define LATENCY_HIGH        1800
+#define LATENCY_CHANNELS    6
+
+// Bind state. When enabled, each bind stores the command address in EEPROM, for
+// BIND_MODEL, and after a watchdog, brown-out or reset button reset (but not at power
+// on, when the quad has most likely been powered up too and listens only on the bind
+// address) setup() looks for a bind for that model. If there is one, it skips binding
+// and sends command packets (the failsafe, until the PPM signal locks) within
+// milliseconds, without waiting for the radio's power on reset unless it was a
+// brown-out, so a reset of the transmitter in flight does not leave the quad
+// uncontrolled for long. If the quad was not listening after all, hold throttle
+// low and rudder full left, with AUX1 low, for BIND_GESTURE_MS to bind again: this
+// works only until the first command packet is acknowledged, so never in flight. The
+// reset cause is read from MCUSR, or from r2 where optiboot leaves it after clearing
+// MCUSR; a bootloader that clears it without passing it on needs CX10_BIND_STORE 0.
+// Binds go round a ring of BIND_SLOTS slots, for wear levelling, each with a sequence
+// number to find the newest and a checksum so that one cut short by a reset is
+// ignored. The last BIND_SLOTS binds are kept, and a bind the same as the newest for
+// its model is not written again.
+#ifndef CX10_BIND_STORE
+#define CX10_BIND_STORE 1
+#endif
+#define BIND_MODEL          0     // Model number, to keep the binds of several quads apart
+#define BIND_RANDOM_ADDRESS 0     // Pick a new command address at each bind, else use rx_tx_cmmd as is
+#define BIND_GESTURE_MS     2000
+#define BIND_GESTURE_LOW    1100  // Throttle and rudder below this, in microseconds
+#define BIND_EEPROM_BASE    0
+#define BIND_SLOTS          16
+#define BIND_SLOT_SIZE      8     // Sequence, model, address[5], checksum
+#define BIND_ANY_MODEL      0xFF
+
+// Transmit power control. When enabled, the PA level steps between the nRF24's four
+// (-18, -12, -6 and 0dBm) by how the link did over each POWER_WINDOW command packets:
+// up a level at once if more than POWER_UP_LOST went unacknowledged or the retries
+// came to more than POWER_UP_RETRIES, down a level only after power_needed windows in
+// a row with none lost and at most POWER_DOWN_RETRIES retries. Levels change only
+// between windows, 256ms or some 10 PPM frames apart, and the gap between the up and
+// down thresholds keeps a level that only just works from being left. If a step down
+// has to be undone, the next needs twice as many clean windows, up to POWER_HOLD_MAX.
+// Without ACKs (a quad that is off, or does not acknowledge) there is nothing to go
+// by, so a window with none goes to the POWER_FALLBACK profile, as does binding.
+#ifndef CX10_POWER_CONTROL
+#define CX10_POWER_CONTROL 0
+#endif
+#define POWER_WINDOW        32    // Packets per decision
+#define POWER_UP_LOST       1     // Packets lost, and retries, in a window to step up
+#define POWER_UP_RETRIES    16
+#define POWER_DOWN_RETRIES  2     // Retries in a clean window, to step down
+#define POWER_DOWN_WINDOWS  4     // Clean windows to step down, at first
+#define POWER_HOLD_MAX      64
+#define POWER_FALLBACK      NRF24::NRF24TransmitPower0dBm
+
+// Event driven transmit. When enabled, loop() watches for new PPM frames while it
+// waits out PACKET_PERIOD, and if one moves a stick past its EVENT_THRESHOLD_* from
+// the value in the last packet sent, sends a packet at once instead of at the end of
+// the wait. Thresholds are in packet units (0 to 0xFF, after the mixer). The regular
+// packets keep their schedule. An extra packet goes at least EVENT_MIN_GAP_US after
+// the one before it, and there is at most one between two regular packets, so the
+// quad never gets more than twice the regular rate. event_tx counts the extra packets
+// and the time they saved: how much sooner each went than the next regular packet.
+#ifndef CX10_EVENT_TX
+#define CX10_EVENT_TX 0
+#endif
+#define EVENT_THRESHOLD_THROTTLE  8
+#define EVENT_THRESHOLD_RUDDER    6
+#define EVENT_THRESHOLD_ELEVATOR  6
+#define EVENT_THRESHOLD_AILERON   6
+#define EVENT_MIN_GAP_US          2000
+
+// Serial bridge. When enabled, this is different firmware: nothing is flown, and the
+// radio is driven by a program on a PC over the USB serial port, at NRF24_BRIDGE_BAUD,
+// with the protocol of the NRF24Bridge class. tools/bridge has the Linux client. The
+// PPM input is not read.
+#ifndef CX10_BRIDGE
+#define CX10_BRIDGE 0
+#endif
+
+#if CX10_CAPTURE + CX10_PROFILE + CX10_LATENCY + CX10_BRIDGE > 1
+#error "Only one of CX10_CAPTURE, CX10_PROFILE, CX10_LATENCY and CX10_BRIDGE can use the serial port"
+#endif
+
+#define CAPTURE_EDGE    0x01
+#define CAPTURE_PACKET  0x02
+#define CAPTURE_LOST    0x03
  
 // Packet state enumeration
 enum packet_state_t {
@@ -69,57 +264,604 @@ enum packet_state_t {
 };
 
 // Singleton instance of the radio and PPM receiver
+#if CX10_BRIDGE
+NRF24Bridge nrf24;
+#else
 NRF24 nrf24;
-RcTrainer tx;
+#endif
+#if CX10_BUDDY
+RcTrainerInt<0> instructor;
+RcTrainerInt<1> student;
+RcTrainerBuddy tx(instructor, student, BUDDY_SWITCH_CHANNEL);
+#else
+RcTrainerInt<0> tx;
+#endif
+#if CX10_LATENCY
+RcPpmEncoder ppm(LATENCY_CHANNELS);
+#endif
 
-// Command and bind addresses (command address should be generated from random number)
+// Command and bind addresses (command address should be generated from random number).
+// The bind address is fixed, so it stays in flash
 uint8_t rx_tx_cmmd[5] = {0xC1, 0xC1, 0xC1, 0xC1, 0xC1};
-uint8_t rx_tx_bind[5] = {0x65, 0x65, 0x65, 0x65, 0x65};
+const uint8_t rx_tx_bind[5] PROGMEM = {0x65, 0x65, 0x65, 0x65, 0x65};
+
+// Radio initialisation from Deviation, as command and value pairs for spiWrite(), 
+// kept in flash. setRF() goes between the two parts
+#define W_REG(reg) (NRF24_COMMAND_W_REGISTER | (reg))
+const uint8_t radio_init_head[][2] PROGMEM = {
+  { W_REG(NRF24_REG_00_CONFIG),      NRF24_EN_CRC | NRF24_PWR_UP },  // Power up with CRC enabled
+  { W_REG(NRF24_REG_01_EN_AA),       NRF24_ENAA_PA },                // Auto ACK on all pipes
+  { W_REG(NRF24_REG_02_EN_RXADDR),   NRF24_ERX_PA },                 // Enable all pipes
+  { W_REG(NRF24_REG_03_SETUP_AW),    NRF24_AW_5_BYTES },             // 5-byte TX/RX address
+};
+
+const uint8_t radio_init_tail[][2] PROGMEM = {
+  { W_REG(NRF24_REG_04_SETUP_RETR),  0x1A },                         // 500uS timeout, 10 retries
+  { W_REG(NRF24_REG_05_RF_CH),       RF_CHANNEL },                   // Channel 0x3C
+  { W_REG(NRF24_REG_07_STATUS),      NRF_STATUS_CLEAR },             // Clear status
+  { W_REG(NRF24_REG_11_RX_PW_P0),    PAYLOADSIZE },                  // Set payload size on all RX pipes
+  { W_REG(NRF24_REG_12_RX_PW_P1),    PAYLOADSIZE },
+  { W_REG(NRF24_REG_13_RX_PW_P2),    PAYLOADSIZE },
+  { W_REG(NRF24_REG_14_RX_PW_P3),    PAYLOADSIZE },
+  { W_REG(NRF24_REG_15_RX_PW_P4),    PAYLOADSIZE },
+  { W_REG(NRF24_REG_16_RX_PW_P5),    PAYLOADSIZE },
+  { W_REG(NRF24_REG_17_FIFO_STATUS), 0x00 },                         // Clear FIFO bits (unnesseary)
+  { W_REG(NRF24_REG_1C_DYNPD),       0x3F },                         // Enable dynamic payload (all pipes)
+  { W_REG(NRF24_REG_1D_FEATURE),     0x07 },                         // Payloads with ACK, noack command
+  { ACTIVATE_CMD,                    ACTIVATE_DATA },                // Activate feature registers
+  { W_REG(NRF24_REG_1C_DYNPD),       0x3F },                         // Enable dynamic payload (all pipes)
+  { W_REG(NRF24_REG_1D_FEATURE),     0x07 },                         // Payloads with ACK, noack command
+};
 
 // Data packet buffer
 uint8_t packet[PAYLOADSIZE];
 
-// CX-10 scaled commands
-uint8_t throttle, rudder, elevator, aileron, rudder_trim, elevator_trim, aileron_trim, flags;
+// Command packet layout
+#define PKT_THROTTLE       0
+#define PKT_RUDDER         1
+#define PKT_RUDDER_TRIM    2
+#define PKT_ELEVATOR       3
+#define PKT_AILERON        4
+#define PKT_ELEVATOR_TRIM  5
+#define PKT_AILERON_TRIM   6
+#define PKT_FLAGS          7
+#define PKT_CHECKSUM       8
+
+// PPM channels (TAER)
+#define PPM_THROTTLE  0
+#define PPM_AILERON   1
+#define PPM_ELEVATOR  2
+#define PPM_RUDDER    3
+#define PPM_AUX1      4
+
+// ppm_scale converts a raw PPM pulse of 1000-2000us to the range 0x00 to 0xFF.
+// Same result as map() and constrain(), but multiplies by 0xFF/1000 in 16.16 
+// fixed point instead of dividing.
+static inline uint8_t ppm_scale( uint16_t raw )
+{
+    if (raw <= 1000) return 0x00;
+    if (raw >= 2000) return 0xFF;
+    return ((uint32_t) (raw - 1000) * 16712) >> 16;
+}
+
+// Mixer curves, from mix_init(). Entry i is the output (0 to 256) for a stick 
+// value of 16 * i, with straight lines in between.
+int16_t mix_throttle_lut[MIX_POINTS];
+int16_t mix_aileron_lut[MIX_POINTS];
+int16_t mix_elevator_lut[MIX_POINTS];
+int16_t mix_rudder_lut[MIX_POINTS];
+
+// Current rate, as a fraction of full throw in 1.7 fixed point
+uint8_t mix_rate = MIX_RATE_Q7(MIX_RATE_HIGH);
+
+// mix_curve looks up a scaled stick (0x00 to 0xFF) in a mixer curve. It and
+// mix_stick run per packet field, so they use a table lookup, 16 bit multiplies and
+// shifts, with no division; ppm_scale() takes one 32 bit multiply. CX10_PROFILE
+// measures the whole loop on the target.
+static inline int16_t mix_curve( uint8_t v, const int16_t *lut )
+{
+    uint8_t i = v >> 4;
+    int16_t a = lut[i];
+    return a + (((lut[i + 1] - a) * (v & 0x0F)) >> 4);
+}
+
+static inline uint8_t mix_clip( int16_t v )
+{
+    return v < 0 ? 0x00 : (v > 0xFF ? 0xFF : v);
+}
+
+static inline uint8_t mix_throttle( uint8_t v )
+{
+    return mix_clip(mix_curve(v, mix_throttle_lut));
+}
+
+// Sticks are shaped, then scaled about centre by the current rate
+static inline uint8_t mix_stick( uint8_t v, const int16_t *lut )
+{
+    int16_t c = mix_curve(v, lut) - 0x80;
+    return mix_clip(0x80 + ((c * mix_rate) >> 7));
+}
+
+static inline uint8_t mix_trim( uint8_t stick )
+{
+#if MIX_TRIM == MIX_TRIM_FOLLOW
+    return stick >> 1;
+#else
+    (void) stick;
+    return MIX_TRIM_CENTRE_VAL;
+#endif
+}
+
+// Fixed tail of the bind packet
+const uint8_t bind_tail[4] PROGMEM = {0x56, 0xAA, 0x32, 0x00};
+
+// CX-10 flags, and whether the failsafe is being sent in place of the sticks
+uint8_t flags;
+bool failsafe = true;
+
+// PPM signal monitoring for failsafe
+uint16_t last_frame_count = 0;
+uint8_t stale_packets = FAILSAFE_PACKETS;
+
+// Status polls made by the last packwait(), and micros() when it started
+uint8_t packwait_polls;
+uint32_t packwait_start;
+
+// micros() when the first command packet was sent: the time from reset to control
+uint32_t first_command_time = 0;
+
+// Radio faults since reset. A fault lasts from the first packet that fails, or is
+// sent before a failed health check, to the next that completes, however many fail between
+struct {
+  uint16_t count;             // Packets and health checks that failed
+  uint16_t restores;          // Times the registers were written again
+  uint16_t recoveries;        // Faults recovered from
+  uint16_t last_ms;           // Time to recover, of the last fault
+  uint16_t max_ms;
+  uint32_t downtime_ms;       // Total time to recover
+} radio_faults;
+bool radio_down = false;
+uint32_t radio_down_start;    // packwait_start of the first failed packet
+uint32_t health_check_time = 0;
+
+#if CX10_BIND_STORE
+// Rebind gesture, held since bind_gesture_start, and allowed until a command packet is acked
+bool bind_gesture_held = false;
+uint32_t bind_gesture_start;
+bool bind_gesture_armed = true;
+
+// MCUSR, as optiboot passes it to the sketch in r2, saved before the C runtime starts
+#if defined(__AVR__)
+uint8_t reset_flags __attribute__ ((section (".noinit")));
+void reset_flags_save( void ) __attribute__ ((naked, used, section (".init0")));
+void reset_flags_save( void )
+{
+  __asm__ __volatile__ ("sts %0, r2" : "=m" (reset_flags));
+}
+#else
+uint8_t reset_flags = 0;
+#endif
+#endif
+
+// Radio housekeeping once each packet is done with: clear the status flags and
+// the TX FIFO, in the background while loop() reads the next PPM frame. Each
+// transfer starts out done, with no status and no callback.
+const uint8_t status_clear = NRF_STATUS_CLEAR;
+NRF24Transfer clear_status = { NRF24_COMMAND_W_REGISTER | NRF24_REG_07_STATUS, &status_clear, NULL, 1, 0, true, NULL, 0 };
+NRF24Transfer clear_tx = { NRF24_COMMAND_FLUSH_TX, NULL, NULL, 0, 0, true, NULL, 0 };
+NRF24Transfer clear_rx = { NRF24_COMMAND_FLUSH_RX, NULL, NULL, 0, 0, true, NULL, 0 };
+
+// Telemetry from the last ACK payload, for the sketch to use. The payload is read
+// into telem_buf in the background with the housekeeping above, and parsed by
+// telemetry_update() once it is in.
+struct telemetry_t {
+  uint16_t count;                 // ACK payloads received
+  uint8_t  len;                   // Length of raw, 0 until the first ACK payload
+  uint8_t  raw[TELEM_MAX_LEN];
+  bool     known;                 // raw is a TELEM_STATUS payload: battery and armed are valid
+  uint8_t  battery;               // 20mV steps
+  bool     armed;
+} telemetry;
+uint8_t telem_buf[TELEM_MAX_LEN];
+NRF24Transfer telem_read = { NRF24_COMMAND_R_RX_PAYLOAD, NULL, telem_buf, 0, 0, true, NULL, 0 };
+bool telem_pending = false;
+
+// SPI transfer complete, run the next byte of the radio's transfer queue
+ISR(SPI_STC_vect)
+{
+  NRF24::spiInterrupt();
+}
+
+#if CX10_CAPTURE
+// Capture ring buffer, 256 bytes so that the 8 bit indices wrap by themselves.
+// Written by the PPM interrupt and by loop() (with interrupts disabled), read by capture_flush()
+uint8_t capture_buf[256];
+volatile uint8_t capture_head = 0;
+volatile uint8_t capture_tail = 0;
+uint8_t capture_lost = 0;
+uint32_t capture_packet_time;
+
+// Append a record to the capture buffer, interrupts must be disabled
+void capture_put( uint8_t *rec, uint8_t len )
+{
+  uint8_t head = capture_head;
+  
+  // Note any records dropped before this one, if there is room
+  if (capture_lost && (uint8_t)(capture_tail - head - 1) >= len + 2) {
+    capture_buf[head++] = CAPTURE_LOST;
+    capture_buf[head++] = capture_lost;
+    capture_lost = 0;
+  }
+  
+  if ((uint8_t)(capture_tail - head - 1) < len) {
+    if (capture_lost < 0xFF) capture_lost++;
+  }
+  else {
+    while (len--) capture_buf[head++] = *rec++;
+  }
+  capture_head = head;
+}
+
+// PPM edge hook, called by RcTrainer in interrupt context
+void capture_edge( uint32_t time )
+{
+  uint8_t rec[3] = { CAPTURE_EDGE, (uint8_t) time, (uint8_t) (time >> 8) };
+  capture_put(rec, sizeof(rec));
+}
+
+// Record the packet just sent, and what became of it
+void capture_packet( bool bind, uint8_t result )
+{
+  uint8_t rec[6 + PAYLOADSIZE] = { CAPTURE_PACKET, (uint8_t) capture_packet_time, 
+                                   (uint8_t) (capture_packet_time >> 8), bind, result, packwait_polls };
+  memcpy(rec + 6, packet, PAYLOADSIZE);
+  noInterrupts();
+  capture_put(rec, sizeof(rec));
+  interrupts();
+}
+
+// Send as much of the capture buffer as the serial port will take without blocking
+void capture_flush( void )
+{
+  uint8_t tail = capture_tail;
+  int room = Serial.availableForWrite();
+  
+  while (room-- > 0 && tail != capture_head) Serial.write(capture_buf[tail++]);
+  capture_tail = tail;
+}
+#endif
+
+#if CX10_LATENCY
+// Timer1 compare, make the next PPM edge
+ISR(TIMER1_COMPA_vect)
+{
+  RcPpmEncoder::timerInterrupt();
+}
+
+// Step in progress, and latencies in microseconds since the last report
+bool latency_high = false;
+bool latency_pending = false;
+uint8_t latency_mid;              // Packet throttle half way between the steps
+uint32_t latency_step_time = 0;
+uint32_t latency_total = 0;
+uint32_t latency_min = 0xFFFFFFFF;
+uint32_t latency_max = 0;
+uint16_t latency_count = 0;
+uint32_t latency_last_report = 0;
+
+// Start the PPM signal, with aux1 high to bind
+void latency_init( void )
+{
+  Serial.begin(115200);
+  latency_mid = mix_throttle(ppm_scale((LATENCY_LOW + LATENCY_HIGH) / 2));
+  ppm.setChannel(PPM_THROTTLE, LATENCY_LOW);
+  ppm.setChannel(PPM_AUX1, 2000);
+  ppm.begin();
+}
+
+// Called with each data packet just sent: time the step it completes, if any, 
+// start the next step when due, and report once a second
+void latency_packet( void )
+{
+  uint32_t now = micros();
+  uint32_t change;
+  
+  if (latency_pending && (packet[PKT_THROTTLE] >= latency_mid) == latency_high && ppm.changeTime(&change)) {
+    uint32_t latency = now - change;
+    latency_total += latency;
+    latency_count++;
+    if (latency < latency_min) latency_min = latency;
+    if (latency > latency_max) latency_max = latency;
+    latency_pending = false;
+  }
+  
+  if (!latency_pending && millis() - latency_step_time >= LATENCY_STEP_MS) {
+    latency_step_time = millis();
+    latency_high = !latency_high;
+    ppm.setChannel(PPM_THROTTLE, latency_high ? LATENCY_HIGH : LATENCY_LOW);
+    latency_pending = true;
+  }
+  
+  if (millis() - latency_last_report >= 1000) {
+    latency_last_report = millis();
+    Serial.print(F("latency us"));
+    if (latency_count) {
+      Serial.print(F(" min "));
+      Serial.print(latency_min);
+      Serial.print(F(" mean "));
+      Serial.print(latency_total / latency_count);
+      Serial.print(F(" max "));
+      Serial.print(latency_max);
+    }
+    Serial.print(F(", steps "));
+    Serial.println(latency_count);
+    latency_total = 0;
+    latency_min = 0xFFFFFFFF;
+    latency_max = 0;
+    latency_count = 0;
+  }
+}
+#endif
+
+// PA level, one of NRF24TransmitPower. Fixed at POWER_FALLBACK without power control
+uint8_t power_level = POWER_FALLBACK;
+
+#if CX10_POWER_CONTROL
+// Link statistics for the current window. Retries are read from OBSERVE_TX in the 
+// background once each acknowledged packet is done with, and counted at the next
+uint8_t power_packets = 0;
+uint8_t power_acked = 0;
+uint16_t power_retries = 0;
+uint8_t power_observe;
+bool power_observe_pending = false;
+NRF24Transfer observe_read = { NRF24_COMMAND_R_REGISTER | NRF24_REG_08_OBSERVE_TX, NULL, &power_observe, 1, 0, true, NULL, 0 };
+
+uint8_t power_clean = 0;                    // Clean windows in a row
+uint8_t power_needed = POWER_DOWN_WINDOWS;  // Clean windows to step down
+bool power_stepped_down = false;            // At the end of the last window
+uint16_t power_changes = 0;
+
+// power_window decides the level for the next window
+void power_window( void )
+{
+  uint8_t lost = POWER_WINDOW - power_acked;
+  uint8_t level = power_level;
+  
+  if (!power_acked) {
+    level = POWER_FALLBACK;
+    power_clean = 0;
+  }
+  else if (lost > POWER_UP_LOST || power_retries > POWER_UP_RETRIES) {
+    if (level < NRF24::NRF24TransmitPower0dBm) level++;
+    if (power_stepped_down && power_needed < POWER_HOLD_MAX) power_needed *= 2;
+    power_clean = 0;
+  }
+  else if (!lost && power_retries <= POWER_DOWN_RETRIES) {
+    if (++power_clean >= power_needed && level > NRF24::NRF24TransmitPowerm18dBm) {
+      level--;
+      power_clean = 0;
+    }
+  }
+  else {
+    power_clean = 0;
+  }
+  
+  power_stepped_down = level < power_level;
+  if (level != power_level) {
+    power_set(level);
+    power_changes++;
+  }
+  power_packets = 0;
+  power_acked = 0;
+  power_retries = 0;
+}
+
+// power_packet counts a command packet, by its packwait() result
+void power_packet( uint8_t result )
+{
+  if (power_observe_pending && observe_read.done) {
+    power_retries += power_observe & NRF24_ARC_CNT;
+    power_observe_pending = false;
+  }
+  
+  switch (result) {
+   case PKT_ACK:
+     power_acked++;
+     // Behind packwait()'s housekeeping. If that has filled the queue, read it now
+     // rather than lose the retries: the read waits for the queue to drain
+     power_observe_pending = nrf24.queueTransfer(&observe_read);
+     if (!power_observe_pending)
+       power_retries += nrf24.spiReadRegister(NRF24_REG_08_OBSERVE_TX) & NRF24_ARC_CNT;
+     break;
+   case PKT_TIMEOUT:
+     power_retries += 10;
+     break;
+   default:
+     // The radio, not the link, so not counted
+     return;
+  }
+  if (++power_packets >= POWER_WINDOW)
+    power_window();
+}
+#endif
+
+// power_set sets the PA level, leaving the data rate at 1Mbps. setRF() would
+// set the retries as well
+void power_set( uint8_t level )
+{
+  power_level = level;
+  nrf24.spiWriteRegister(NRF24_REG_06_RF_SETUP, (level << 1) & NRF24_PWR);
+}
+
+#if CX10_EVENT_TX
+// Extra packets sent, and the time they saved in microseconds, since reset
+struct {
+  uint16_t packets;
+  uint32_t saved_us;
+} event_tx;
+bool event_extra = false;       // The last packet was an extra one
+uint32_t event_due;             // micros() the next regular packet is due
+uint16_t event_frames;          // tx.frameCount() when last looked at
+
+// Whether a packet field, as it would be sent now, is more than threshold from the last packet
+static inline bool event_past( uint8_t field, uint8_t threshold )
+{
+  uint8_t now = command_field(field);
+  uint8_t sent = packet[field];
+  return (now > sent ? now - sent : sent - now) > threshold;
+}
+
+// Wait for the next packet: the regular one, PACKET_PERIOD after the last regular one
+// was done with, or an extra one as soon as a new frame moves a stick far enough
+void event_wait( void )
+{
+  uint32_t now = micros();
+  
+  // Straight after an extra packet, only the regular one is left to wait for,
+  // and it keeps the gap too
+  if (event_extra) {
+    event_extra = false;
+    uint32_t until = packwait_start + EVENT_MIN_GAP_US;
+    if ((int32_t)(event_due - until) > 0)
+      until = event_due;
+    if ((int32_t)(until - now) > 0)
+      delayMicroseconds(until - now);
+    return;
+  }
+  
+  event_due = now + PACKET_PERIOD * 1000UL;
+  while ((int32_t)(event_due - now) > 0) {
+    uint16_t frames = tx.frameCount();
+    if (frames != event_frames && now - packwait_start >= EVENT_MIN_GAP_US) {
+      event_frames = frames;
+      if (!failsafe && (event_past(PKT_THROTTLE, EVENT_THRESHOLD_THROTTLE) ||
+                        event_past(PKT_RUDDER, EVENT_THRESHOLD_RUDDER) ||
+                        event_past(PKT_ELEVATOR, EVENT_THRESHOLD_ELEVATOR) ||
+                        event_past(PKT_AILERON, EVENT_THRESHOLD_AILERON))) {
+        event_tx.packets++;
+        event_tx.saved_us += event_due - micros();
+        event_extra = true;
+        return;
+      }
+    }
+    now = micros();
+  }
+}
+#endif
+
+#if CX10_PROFILE
+// Loop and interrupt handler timing, in microseconds, since the last report
+uint32_t profile_loop_total = 0;
+uint16_t profile_loop_count = 0;
+uint16_t profile_loop_max = 0;
+volatile uint16_t profile_isr_max = 0;
+uint32_t profile_last_report = 0;
+
+// PPM edge hook, called by RcTrainer at the end of its interrupt handler
+void profile_edge( uint32_t time )
+{
+  uint16_t elapsed = micros() - time;
+  if (elapsed > profile_isr_max) profile_isr_max = elapsed;
+}
+
+// Account for one pass of loop(), and report once a second
+void profile_loop( uint32_t loop_start )
+{
+  uint16_t elapsed = micros() - loop_start;
+  profile_loop_total += elapsed;
+  profile_loop_count++;
+  if (elapsed > profile_loop_max) profile_loop_max = elapsed;
+  
+  if (millis() - profile_last_report >= 1000) {
+    profile_last_report = millis();
+    noInterrupts();
+    uint16_t isr_max = profile_isr_max;
+    profile_isr_max = 0;
+    interrupts();
+    Serial.print(F("loop us avg "));
+    Serial.print(profile_loop_total / profile_loop_count);
+    Serial.print(F(" max "));
+    Serial.print(profile_loop_max);
+    Serial.print(F(", ppm isr us max "));
+    Serial.print(isr_max);
+    Serial.print(F(", frames "));
+    Serial.print(tx.frameCount());
+    Serial.print(F(" bad "));
+    Serial.print(tx.badFrameCount());
+    Serial.print(F(", reset to first command us "));
+    Serial.print(first_command_time);
+    Serial.print(F(", radio faults "));
+    Serial.print(radio_faults.count);
+    Serial.print(F(" restores "));
+    Serial.print(radio_faults.restores);
+    Serial.print(F(" down ms "));
+    Serial.print(radio_faults.downtime_ms);
+    Serial.print(F(" max "));
+    Serial.print(radio_faults.max_ms);
+#if CX10_POWER_CONTROL
+    Serial.print(F(", power level "));
+    Serial.print(power_level);
+    Serial.print(F(" changes "));
+    Serial.print(power_changes);
+#endif
+#if CX10_EVENT_TX
+    Serial.print(F(", event packets "));
+    Serial.print(event_tx.packets);
+    Serial.print(F(" saved ms "));
+    Serial.print(event_tx.saved_us / 1000);
+#endif
+    Serial.println();
+    profile_loop_total = 0;
+    profile_loop_count = 0;
+    profile_loop_max = 0;
+  }
+}
+#endif
 
 // setup initalises nrf24, attempts to bind, then moves on
 void setup() 
 {
- 
+#if CX10_BRIDGE
+  // The program on the PC sets the radio up itself
+  nrf24.init();
+  nrf24.begin();
+  return;
+#endif
+#if CX10_CAPTURE
+  Serial.begin(115200);
+  Serial.write("CX10CAP1");
+  tx.setEdgeHook(capture_edge);
+#endif
+#if CX10_PROFILE
+  Serial.begin(115200);
+  tx.setEdgeHook(profile_edge);
+#endif
+  
+  // Build the mixer curves
+  mix_init();
+#if CX10_LATENCY
+  latency_init();
+#endif
   
   // Initialise SPI bus and activate radio in RX mode
+#if CX10_BIND_STORE
+  // Only a reset of the transmitter alone can find the quad still on the command
+  // address, and the radio still powered and out of power on reset
+  uint8_t reset_cause = MCUSR ? MCUSR : reset_flags;
+  MCUSR = 0;
+  nrf24.init(reset_cause & (_BV(PORF) | _BV(BORF)));
+#else
   nrf24.init();
+#endif
   nrf24.setConfiguration( NRF24_EN_CRC );
   
   // Initialisation from Deviation
-  nrf24.spiWriteRegister( NRF24_REG_00_CONFIG,     (NRF24_EN_CRC | NRF24_PWR_UP));  // Power up with CRC enabled
-  nrf24.spiWriteRegister( NRF24_REG_01_EN_AA,      NRF24_ENAA_PA);                  // Auto ACK on all pipes
-  nrf24.spiWriteRegister( NRF24_REG_02_EN_RXADDR,  NRF24_ERX_PA);                   // Enable all pipes
-  nrf24.spiWriteRegister( NRF24_REG_03_SETUP_AW,   NRF24_AW_5_BYTES);               // 5-byte TX/RX address
-
-  // Set RF power and data rate, then override REG_04/05 which it sets
-  nrf24.setRF( nrf24.NRF24DataRate1Mbps, nrf24.NRF24TransmitPower0dBm);
-  nrf24.spiWriteRegister( NRF24_REG_04_SETUP_RETR, 0x1A);                           // 500uS timeout, 10 retries
-  nrf24.spiWriteRegister( NRF24_REG_05_RF_CH, RF_CHANNEL);                          // Channel 0x3C
-  nrf24.spiWriteRegister( NRF24_REG_07_STATUS, NRF_STATUS_CLEAR);                   // Clear status
-    
-  nrf24.spiWriteRegister( NRF24_REG_11_RX_PW_P0, PAYLOADSIZE);                      // Set payload size on all RX pipes
-  nrf24.spiWriteRegister( NRF24_REG_12_RX_PW_P1, PAYLOADSIZE);
-  nrf24.spiWriteRegister( NRF24_REG_13_RX_PW_P2, PAYLOADSIZE);
-  nrf24.spiWriteRegister( NRF24_REG_14_RX_PW_P3, PAYLOADSIZE);
-  nrf24.spiWriteRegister( NRF24_REG_15_RX_PW_P4, PAYLOADSIZE);
-  nrf24.spiWriteRegister( NRF24_REG_16_RX_PW_P5, PAYLOADSIZE);
- 
-  nrf24.spiWriteRegister( NRF24_REG_17_FIFO_STATUS, 0x00);                          // Clear FIFO bits (unnesseary) 
-
-  nrf24.spiWriteRegister( NRF24_REG_1C_DYNPD, 0x3F);                                // Enable dynamic payload (all pipes)
-  nrf24.spiWriteRegister( NRF24_REG_1D_FEATURE, 0x07);                              // Payloads with ACK, noack command
-  
-  nrf24.spiWrite(ACTIVATE_CMD, ACTIVATE_DATA);                                      // Activate feature registers
-  nrf24.spiWriteRegister( NRF24_REG_1C_DYNPD, 0x3F);                                // Enable dynamic payload (all pipes)
-  nrf24.spiWriteRegister( NRF24_REG_1D_FEATURE, 0x07);                              // Payloads with ACK, noack command
+  radio_setup();
 
-  // Set command address
+  // Set command address, the stored one if this model has been bound before
+#if CX10_BIND_STORE
+  bool resume = (reset_cause & (_BV(WDRF) | _BV(BORF) | _BV(EXTRF))) && !(reset_cause & _BV(PORF)) && bind_load();
+#endif
   set_cmmd_addr();
   
   // Power up
@@ -129,54 +871,57 @@ void setup()
   nrf24.flushRx();
   nrf24.spiWriteRegister(NRF24_REG_07_STATUS, NRF_STATUS_CLEAR);
   
-  // White for aux1 high before binding
-  while(tx.getChannel(4, 1000, 2000, 0x00, 0xFF ) < 0x40);
-  
-  
-  set_bind_addr();
+#if CX10_BIND_STORE
+  // Already bound, carry on where we left off
+  if (resume)
+    return;
+#endif
 
-  for(int packno = 0; packno < 60; packno++)
-  {
-    send_packet(true);
-    
-    switch(packwait()) 
-    {
-     case PKT_ERROR:
-       while(1);
-       break;
-     
-     case PKT_ACK: 
-       break;
-     
-     case PKT_TIMEOUT:
-       break;
-    }
+  // White for aux1 high before binding
+  while(tx.getChannel(4, 1000, 2000, 0x00, 0xFF ) < 0x40) {
+#if CX10_CAPTURE
+    capture_flush();
+#endif
   }
-    
-  set_cmmd_addr();
-  
   
+  bind();
 }
 
 
 // loop repeatedly sends data read by PPM to the device, every 8ms
 void loop()
 {
+#if CX10_BRIDGE
+  nrf24.poll();
+  return;
+#endif
   uint8_t aux1 = 0;
+#if CX10_PROFILE
+  uint32_t loop_start = micros();
+#endif
   
-  // Get RX values by PPM, convert to range 0x00 to 0xFF
-  throttle = (uint8_t) (tx.getChannel(0, 1000, 2000, 0x00, 0xFF ));
-  aileron  = (uint8_t) (tx.getChannel(1, 1000, 2000, 0x00, 0xFF ));
-  elevator = (uint8_t) (tx.getChannel(2, 1000, 2000, 0x00, 0xFF ));
-  rudder   = (uint8_t) (tx.getChannel(3, 1000, 2000, 0x00, 0xFF ));
-  aux1     = (uint8_t) (tx.getChannel(4, 1000, 2000, 0x00, 0xFF ));
+  // Pick up the ACK payload read in the background after the last packet
+  telemetry_update();
   
-  // Add command values to trim to get real full scale response 
-  // in original CX-10 firmware (FN firmware ignores the trims, so
-  // no problems).
-  rudder_trim = rudder >> 1;
-  aileron_trim = aileron >> 1;
-  elevator_trim = elevator >> 1;
+  // Count packets sent since the last valid PPM frame
+  uint16_t frame_count = tx.frameCount();
+  if (frame_count != last_frame_count) {
+    last_frame_count = frame_count;
+    stale_packets = 0;
+  }
+  else if (stale_packets < FAILSAFE_PACKETS) {
+    stale_packets++;
+  }
+  
+  // Signal lost (or never acquired), fly the failsafe. The sticks themselves
+  // are read as the packet is sent.
+  failsafe = (stale_packets >= FAILSAFE_PACKETS);
+  if (!failsafe) {
+    aux1 = ppm_scale(tx.getChannelRaw(PPM_AUX1));
+#if MIX_RATE_CHANNEL != 0xFF
+    mix_rate = ppm_scale(tx.getChannelRaw(MIX_RATE_CHANNEL)) > 0x80 ? MIX_RATE_Q7(MIX_RATE_HIGH) : MIX_RATE_Q7(MIX_RATE_LOW);
+#endif
+  }
   
   // If the AUX1 is high, we set the flags, allowing flips in original
   // firmware, or arming (via elevator) in FN firmware
@@ -188,91 +933,204 @@ void loop()
   }
    
   
+#if CX10_BIND_STORE
+  bind_gesture(aux1);
+#endif
+  
   // Send a data packet and find out what happens
   send_packet(false);
-  switch(packwait()) 
+  if (!first_command_time)
+    first_command_time = micros();
+  
+  uint8_t result = packwait();
+#if CX10_CAPTURE
+  capture_packet(false, result);
+  capture_flush();
+#endif
+#if CX10_LATENCY
+  latency_packet();
+#endif
+#if CX10_POWER_CONTROL
+  power_packet(result);
+#endif
+  switch(result) 
   {
-   // Device not in TX mode, how did this happen?
+   // Radio reset or stuck, put it right for the next packet
+   case PKT_ERROR:
    case PKT_ERROR_IN_RX:
-     while(1);
+     radio_fault(result, false);
      break;
      
     // Packet ACKed, move on
    case PKT_ACK: 
+     radio_ok();
+#if CX10_BIND_STORE
+     bind_gesture_armed = false;
+#endif
      break;
      
-   // No ACK received, and we tried hard, so time out. 
+   // No ACK received, and we tried hard, so time out. The radio is fine
    case PKT_TIMEOUT:
+     radio_ok();
      break;
   }
   
+  // Check now and then that the radio still has its settings, as a radio
+  // left on the wrong channel or address would only time out
+  if (millis() - health_check_time >= HEALTH_CHECK_MS) {
+    health_check_time = millis();
+    if (!radio_healthy(false))
+      radio_fault(PKT_ERROR_IN_RX, false);
+  }
+  
+#if CX10_PROFILE
+  profile_loop(loop_start);
+#endif
+
+#if CX10_EVENT_TX
+  // Wait for 8ms, or a stick to move, before sending next data
+  event_wait();
+#else
   // Wait for 8ms, before sending next data
-  delay(8);
+  delay(PACKET_PERIOD);
+#endif
   
 }
 
-// send_packet constructs a packet and dispatches to radio
-void send_packet( bool bind )
+// mix_expo fills a stick curve, blending linear and cubic responses by expo percent
+void mix_expo( int16_t *lut, int32_t expo )
 {
-    // bind: send first four bytes of command address in the packet
-    //       the final byte is set automatically to 0xC1 by CX-10.
-    if (bind) {
-        packet[0]= rx_tx_cmmd[0];
-        packet[1]= rx_tx_cmmd[1];
-        packet[2]= rx_tx_cmmd[2];
-        packet[3]= rx_tx_cmmd[3];
-        packet[4] = 0x56;
-        packet[5] = 0xAA;
-        packet[6] = 0x32;
-        packet[7] = 0x00;
-    }
-    // cmnd: send RX commands present in the global variables 
-    else {
-        
-        packet[0] = throttle;
-        packet[1] = rudder;
-        packet[3] = elevator;
-        packet[4] = aileron;
-        packet[2] = rudder_trim;
-        packet[5] = elevator_trim;
-        packet[6] = aileron_trim;
-        packet[7] = flags;
+    for (uint8_t i = 0; i < MIX_POINTS; i++) {
+      int32_t x = (int16_t) (i * 16) - 0x80;
+      lut[i] = 0x80 + (x * (100 - expo) + x * x * x * expo / 0x4000) / 100;
     }
+}
 
-    // clear packet status bits and TX FIFO
-    nrf24.spiWriteRegister( NRF24_REG_07_STATUS, NRF_STATUS_CLEAR );
-    nrf24.flushTx();
+// mix_init builds the mixer curves from the MIX_* settings
+void mix_init( void )
+{
+    const uint8_t curve[5] = MIX_THROTTLE_CURVE;
     
-    // Form checksum (my modified CX-10 firmware doesnt care)
-    packet[8] = packet[0];  
-    for(uint8_t i=1; i < 8; i++) packet[8] += packet[i];
-    packet[8] = ~packet[8];
+    // Throttle curve points are a quarter of the stick range apart, 4 table entries
+    for (uint8_t i = 0; i < MIX_POINTS; i++) {
+      uint8_t j = i >> 2;
+      int16_t a = (int16_t) curve[j] * 256 / 100;
+      mix_throttle_lut[i] = a;
+      if (i & 3) {
+        int16_t b = (int16_t) curve[j + 1] * 256 / 100;
+        mix_throttle_lut[i] += (b - a) * (i & 3) / 4;
+      }
+    }
+    
+    mix_expo(mix_aileron_lut, MIX_EXPO_AILERON);
+    mix_expo(mix_elevator_lut, MIX_EXPO_ELEVATOR);
+    mix_expo(mix_rudder_lut, MIX_EXPO_RUDDER);
+}
 
-    // Transmit, requesting acknowledgement
-    write_payload(packet, 9, false);
+// bind_field returns byte i of the bind packet: the first four bytes of the 
+// command address (the final byte is set automatically to 0xC1 by CX-10), 
+// then a fixed tail.
+uint8_t bind_field( uint8_t i )
+{
+    return i < 4 ? rx_tx_cmmd[i] : pgm_read_byte(&bind_tail[i - 4]);
+}
 
+// command_field returns byte i of a command packet, read and scaled from the 
+// latest PPM frame (or the failsafe). Trims come after their stick in the 
+// packet, so are derived from the bytes already sent.
+uint8_t command_field( uint8_t i )
+{
+    switch (i) {
+      case PKT_THROTTLE:
+        return failsafe ? FAILSAFE_THROTTLE : mix_throttle(ppm_scale(tx.getChannelRaw(PPM_THROTTLE)));
+      case PKT_RUDDER:
+        return failsafe ? FAILSAFE_STICK : mix_stick(ppm_scale(tx.getChannelRaw(PPM_RUDDER)), mix_rudder_lut);
+      case PKT_ELEVATOR:
+        return failsafe ? FAILSAFE_STICK : mix_stick(ppm_scale(tx.getChannelRaw(PPM_ELEVATOR)), mix_elevator_lut);
+      case PKT_AILERON:
+        return failsafe ? FAILSAFE_STICK : mix_stick(ppm_scale(tx.getChannelRaw(PPM_AILERON)), mix_aileron_lut);
+        
+      // With MIX_TRIM_FOLLOW, add command values to trim to get real full 
+      // scale response in original CX-10 firmware (FN firmware ignores the 
+      // trims, so no problems).
+      case PKT_RUDDER_TRIM:
+        return mix_trim(packet[PKT_RUDDER]);
+      case PKT_ELEVATOR_TRIM:
+        return mix_trim(packet[PKT_ELEVATOR]);
+      case PKT_AILERON_TRIM:
+        return mix_trim(packet[PKT_AILERON]);
+        
+      default:
+        return flags;
+    }
 }
 
-// write_payload issues the send command to the nrf24 library
-void write_payload(uint8_t *data, uint8_t len, bool noack)
+// send_packet builds a bind or command packet and streams it to the radio. 
+// Each field is computed, and added to the checksum, while the previous byte
+// is being shifted out over SPI, so the payload reaches the radio as soon as
+// the last field is known. The status bits and TX FIFO have already been 
+// cleared, by setup() or the previous packwait().
+void send_packet( bool bind )
 {
-  nrf24.spiBurstWrite(noack ? NRF24_COMMAND_W_TX_PAYLOAD_NOACK : NRF24_COMMAND_W_TX_PAYLOAD, data, len);
+#if CX10_CAPTURE
+    capture_packet_time = micros();
+#endif
+
+    // Transmit, requesting acknowledgement
+    nrf24.spiStreamBegin(NRF24_COMMAND_W_TX_PAYLOAD);
+    uint8_t sum = 0;
+    for (uint8_t i = 0; i < PKT_CHECKSUM; i++) {
+        uint8_t field = bind ? bind_field(i) : command_field(i);
+        packet[i] = field;
+        sum += field;
+        nrf24.spiStreamWrite(field);
+    }
+    
+    // Checksum (my modified CX-10 firmware doesnt care)
+    packet[PKT_CHECKSUM] = ~sum;
+    nrf24.spiStreamWrite(packet[PKT_CHECKSUM]);
+    nrf24.spiStreamEnd();
 }
 
 // packwait polls the nrf24 to determine what's happened to our data
 int packwait()
 {
-    // If we are currently in receive mode, then there is no packet to wait for
-    if (nrf24.spiReadRegister(NRF24_REG_00_CONFIG) & NRF24_PRIM_RX)
+    packwait_start = micros();
+    
+    // If the radio is in receive mode, or not set up at all, there is no packet to wait for
+    if (nrf24.spiReadRegister(NRF24_REG_00_CONFIG) != RADIO_CONFIG)
 	return PKT_ERROR_IN_RX;
 
     // Wait for either the Data Sent or Max ReTries flag, signalling the 
-    // end of transmission
+    // end of transmission, but not for ever
     uint8_t status;
     
-    while (!((status = nrf24.statusRead()) & (NRF24_TX_DS | NRF24_MAX_RT)));
+    packwait_polls = 0;
+    while (!((status = nrf24.statusRead()) & (NRF24_TX_DS | NRF24_MAX_RT))) {
+      if (packwait_polls < 0xFF) packwait_polls++;
+      if (micros() - packwait_start > PACKWAIT_TIMEOUT_US)
+        return PKT_ERROR;
+    }
     
-    nrf24.spiWriteRegister(NRF24_REG_07_STATUS, NRF24_TX_DS | NRF24_MAX_RT);
+    // An ACK payload arrives with TX_DS. Only its width is read here, the
+    // payload itself is read in the background ahead of the housekeeping
+    if (status & NRF24_RX_DR) {
+      uint8_t len = nrf24.spiRead(NRF24_COMMAND_R_RX_PL_WID);
+      telemetry_update();                      // Last one, if loop() has not had it
+      if (len > TELEM_MAX_LEN) {
+        nrf24.queueTransfer(&clear_rx);        // Corrupt, the manual says to discard it
+      }
+      else {
+        telem_read.len = len;
+        nrf24.queueTransfer(&telem_read);
+        telem_pending = true;
+      }
+    }
+    
+    // Clear the status (including RX_DR) and TX FIFO ready for the next packet, 
+    // without waiting
+    nrf24.queueTransfer(&clear_status);
+    nrf24.queueTransfer(&clear_tx);
     
     switch(status &  (NRF24_TX_DS | NRF24_MAX_RT)) {
     
@@ -281,7 +1139,6 @@ int packwait()
       break;
     
     case NRF24_MAX_RT:
-      nrf24.flushTx();
       return PKT_TIMEOUT;
       break;
     }
@@ -290,7 +1147,98 @@ int packwait()
    return PKT_ERROR;
 }
 
+// telemetry_update parses the ACK payload read by packwait(), once it is in
+void telemetry_update( void )
+{
+    if (!telem_pending || !telem_read.done)
+      return;
+    telem_pending = false;
+    
+    uint8_t len = telem_read.len;
+    memcpy(telemetry.raw, telem_buf, len);
+    telemetry.len = len;
+    telemetry.count++;
+    telemetry.known = (len >= 3 && telem_buf[0] == TELEM_STATUS);
+    if (telemetry.known) {
+      telemetry.battery = telem_buf[1];
+      telemetry.armed = telem_buf[2] & TELEM_ARMED;
+    }
+}
  
+void radio_init( const uint8_t (*table)[2], uint8_t count )
+{
+  for (uint8_t i = 0; i < count; i++)
+    nrf24.spiWrite(pgm_read_byte(&table[i][0]), pgm_read_byte(&table[i][1]));
+}
+
+// radio_setup writes every register setup() sets, bar the address
+void radio_setup( void )
+{
+  radio_init(radio_init_head, sizeof(radio_init_head) / 2);
+
+  // Set RF power and data rate, then override REG_04/05 which it sets
+  nrf24.setRF( nrf24.NRF24DataRate1Mbps, power_level);
+  radio_init(radio_init_tail, sizeof(radio_init_tail) / 2);
+}
+
+// radio_healthy reads back the registers a reset or glitch would show in, and
+// returns false if any is not as set up for binding or for commands
+bool radio_healthy( bool binding )
+{
+  uint8_t addr[5];
+  
+  if (nrf24.spiReadRegister(NRF24_REG_00_CONFIG) != RADIO_CONFIG
+      || nrf24.spiReadRegister(NRF24_REG_05_RF_CH) != RF_CHANNEL
+      || nrf24.spiReadRegister(NRF24_REG_03_SETUP_AW) != NRF24_AW_5_BYTES)
+    return false;
+  nrf24.spiBurstReadRegister(NRF24_REG_10_TX_ADDR, addr, 5);
+  return binding ? !memcmp_P(addr, rx_tx_bind, 5) : !memcmp(addr, rx_tx_cmmd, 5);
+}
+
+// radio_restore sets the radio up again as setup() left it, with the bind or command
+// address. Unlike setup() there is no wait for power on reset, and no bind
+void radio_restore( bool binding )
+{
+  radio_setup();
+  if (binding)
+    set_bind_addr();
+  else
+    set_cmmd_addr();
+  nrf24.flushRx();
+}
+
+// radio_fault recovers from a packet that failed. Flushing it, clearing the status
+// and pulsing CE is all a stuck packet needs; a radio that is not as it was set up is
+// restored first
+void radio_fault( uint8_t result, bool binding )
+{
+  if (!radio_down) {
+    radio_down = true;
+    radio_down_start = packwait_start;
+  }
+  radio_faults.count++;
+  if (result == PKT_ERROR_IN_RX || !radio_healthy(binding)) {
+    radio_restore(binding);
+    radio_faults.restores++;
+  }
+  nrf24.flushTx();
+  nrf24.spiWriteRegister(NRF24_REG_07_STATUS, NRF_STATUS_CLEAR);
+  nrf24.powerUpTx();
+}
+
+// radio_ok notes a packet that completed, which ends any fault
+void radio_ok( void )
+{
+  if (!radio_down)
+    return;
+  radio_down = false;
+  uint32_t down = (micros() - radio_down_start) / 1000;
+  radio_faults.recoveries++;
+  radio_faults.last_ms = down > 0xFFFF ? 0xFFFF : down;
+  if (radio_faults.last_ms > radio_faults.max_ms) radio_faults.max_ms = radio_faults.last_ms;
+  radio_faults.downtime_ms += down;
+}
+
 void set_cmmd_addr( void )
 {
   nrf24.spiBurstWriteRegister( NRF24_REG_0A_RX_ADDR_P0,  rx_tx_cmmd, 5); 
@@ -300,7 +1248,147 @@ void set_cmmd_addr( void )
 
 void set_bind_addr( void )
 {
-  nrf24.spiBurstWriteRegister( NRF24_REG_0A_RX_ADDR_P0,  rx_tx_bind, 5);
-  nrf24.spiBurstWriteRegister( NRF24_REG_10_TX_ADDR, rx_tx_bind, 5);                // Set command address  
+  nrf24.spiBurstWriteRegister_P( NRF24_REG_0A_RX_ADDR_P0,  rx_tx_bind, 5);
+  nrf24.spiBurstWriteRegister_P( NRF24_REG_10_TX_ADDR, rx_tx_bind, 5);              // Set bind address  
+}
+
+// bind sends the bind packets, then moves to the command address and stores it
+void bind( void )
+{
+#if BIND_RANDOM_ADDRESS
+  // The CX-10 fixes the last byte of the address itself
+  randomSeed(micros() ^ analogRead(0));
+  for (uint8_t i = 0; i < 4; i++) rx_tx_cmmd[i] = random(0x100);
+#endif
+  set_bind_addr();
+#if CX10_POWER_CONTROL
+  // From the profile, and a fresh start for the command packets after
+  if (power_level != POWER_FALLBACK) power_set(POWER_FALLBACK);
+  power_packets = power_acked = power_retries = 0;
+  power_clean = 0;
+  power_needed = POWER_DOWN_WINDOWS;
+#endif
+
+  for(int packno = 0; packno < 60; packno++)
+  {
+    send_packet(true);
+    
+    uint8_t result = packwait();
+#if CX10_CAPTURE
+    capture_packet(true, result);
+    capture_flush();
+#endif
+    switch(result) 
+    {
+     case PKT_ERROR:
+     case PKT_ERROR_IN_RX:
+       radio_fault(result, true);
+       break;
+     
+     case PKT_ACK: 
+     case PKT_TIMEOUT:
+       radio_ok();
+       break;
+    }
+  }
+    
+  set_cmmd_addr();
+#if CX10_BIND_STORE
+  bind_store();
+#endif
+}
+
+#if CX10_BIND_STORE
+// bind_slot_address returns the EEPROM address of a bind slot
+static inline int bind_slot_address( uint8_t slot )
+{
+  return BIND_EEPROM_BASE + slot * BIND_SLOT_SIZE;
+}
+
+// bind_checksum sums a bind record, less its checksum byte. Erased EEPROM does
+// not pass: the sum of seven 0xFF is 0xF9.
+static uint8_t bind_checksum( int a )
+{
+  uint8_t sum = 0;
+  for (uint8_t i = 0; i < BIND_SLOT_SIZE - 1; i++) sum += EEPROM.read(a + i);
+  return ~sum;
 }
 
+// bind_find returns the slot of the newest stored bind for a model (or for any 
+// model, with BIND_ANY_MODEL), or -1 if there is none. Sequence numbers are 8 bit, 
+// but all valid slots are within BIND_SLOTS of each other, so the difference 
+// tells which is newer.
+int8_t bind_find( uint8_t model )
+{
+  int8_t newest = -1;
+  uint8_t newest_seq = 0;
+  
+  for (uint8_t slot = 0; slot < BIND_SLOTS; slot++) {
+    int a = bind_slot_address(slot);
+    if (EEPROM.read(a + BIND_SLOT_SIZE - 1) != bind_checksum(a)) continue;
+    if (model != BIND_ANY_MODEL && EEPROM.read(a + 1) != model) continue;
+    uint8_t seq = EEPROM.read(a);
+    if (newest < 0 || (int8_t) (seq - newest_seq) > 0) {
+      newest = slot;
+      newest_seq = seq;
+    }
+  }
+  return newest;
+}
+
+// bind_load sets the command address to the newest stored bind for BIND_MODEL,
+// and returns false if there is none
+bool bind_load( void )
+{
+  int8_t slot = bind_find(BIND_MODEL);
+  if (slot < 0) return false;
+  for (uint8_t i = 0; i < 5; i++) rx_tx_cmmd[i] = EEPROM.read(bind_slot_address(slot) + 2 + i);
+  return true;
+}
+
+// bind_store writes the command address for BIND_MODEL to the slot after the
+// newest, unless the newest for this model already holds it. The checksum goes
+// last, so a write cut short leaves the slot invalid.
+void bind_store( void )
+{
+  int8_t slot = bind_find(BIND_MODEL);
+  if (slot >= 0) {
+    uint8_t i;
+    for (i = 0; i < 5 && EEPROM.read(bind_slot_address(slot) + 2 + i) == rx_tx_cmmd[i]; i++);
+    if (i == 5) return;
+  }
+  
+  int8_t last = bind_find(BIND_ANY_MODEL);
+  uint8_t seq = last < 0 ? 0 : EEPROM.read(bind_slot_address(last)) + 1;
+  int a = bind_slot_address(last < 0 ? 0 : (last + 1) % BIND_SLOTS);
+  uint8_t sum = seq + BIND_MODEL;
+  EEPROM.update(a, seq);
+  EEPROM.update(a + 1, BIND_MODEL);
+  for (uint8_t i = 0; i < 5; i++) {
+    EEPROM.update(a + 2 + i, rx_tx_cmmd[i]);
+    sum += rx_tx_cmmd[i];
+  }
+  EEPROM.update(a + BIND_SLOT_SIZE - 1, ~sum);
+}
+
+// bind_gesture binds again once throttle low and rudder full left have been held
+// for BIND_GESTURE_MS with aux1 low, if no command packet has been acked since reset
+void bind_gesture( uint8_t aux1 )
+{
+  int16_t throttle = tx.getChannelRaw(PPM_THROTTLE);
+  int16_t rudder = tx.getChannelRaw(PPM_RUDDER);
+  
+  if (!bind_gesture_armed || failsafe || aux1 > 0x80 ||
+      throttle > BIND_GESTURE_LOW || rudder > BIND_GESTURE_LOW) {
+    bind_gesture_held = false;
+  }
+  else if (!bind_gesture_held) {
+    bind_gesture_held = true;
+    bind_gesture_start = millis();
+  }
+  else if (millis() - bind_gesture_start >= BIND_GESTURE_MS) {
+    bind_gesture_held = false;
+    bind();
+  }
+}
+#endif
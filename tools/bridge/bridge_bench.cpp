@@ -0,0 +1,247 @@
+// bridge_bench.cpp
+//
+// Latency and throughput of the NRF24Bridge serial bridge, through the client in
+// bridge_client.cpp: the round trip time of a status poll, then register writes and
+// 32 octet NOACK packets per second, one request at a time and pipelined. Each packet is
+// one request: write the payload, pulse CE, wait for TX_DS and clear STATUS.
+//
+// Runs against a bridge on a serial port, or with -s against cx10_redtx built with
+// CX10_BRIDGE 1 on the host models, over a modelled serial link: octets take 10 bit times
+// at NRF24_BRIDGE_BAUD, plus the given USB latency each way. The simulation also checks
+// that pipelining never overflows the Arduino's 64 octet serial receive buffer.
+//
+// Build (from the top of the repository):
+//   g++ -O2 -DARDUINO=100 -Itools/host -ILibraries/SpscQueue -ILibraries/NRF24 -ILibraries/RcTrainer-1.0/RcTrainer
+//       -o bridge_bench tools/bridge/bridge_bench.cpp tools/bridge/bridge_client.cpp
+//       tools/host/host.cpp Libraries/NRF24/*.cpp Libraries/RcTrainer-1.0/RcTrainer/*.cpp
+//
+// Usage:
+//   bridge_bench [-n count] /dev/ttyACM0
+//   bridge_bench -s [-u usb_latency_us] [-n count]
+
+#include <host.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "bridge_client.h"
+
+// The firmware, for simulation
+#define CX10_BRIDGE 1
+#include "../../cx10_redtx.ino"
+
+// Serial receive buffer of the Arduino core
+#define SIM_RX_BUFFER 64
+
+// The bridge on the host models, over a modelled USB serial link
+class SimTransport : public BridgeTransport
+{
+public:
+    SimTransport(uint32_t latency) : _latency(latency), _inFree(0), _outFree(0), overflows(0)
+    {
+	host_serial_sink([this](uint8_t c) {
+	    _outFree = (_outFree > host_now ? _outFree : host_now) + BYTE_US;
+	    _out.push_back(std::make_pair(_outFree + _latency, c));
+	});
+    }
+
+    bool write(const uint8_t* data, size_t len)
+    {
+	uint32_t t = host_now + _latency;
+	while (len--)
+	{
+	    uint8_t c = *data++;
+	    _inFree = (_inFree > t ? _inFree : t) + BYTE_US;
+	    host_at(_inFree, [this, c]() {
+		host_serial_input(&c, 1);
+		if (Serial.available() > SIM_RX_BUFFER)
+		    overflows++;
+	    });
+	}
+	return true;
+    }
+
+    int read(uint8_t* data, size_t len, int timeout)
+    {
+	uint32_t deadline = host_now + timeout * 1000;
+	while (true)
+	{
+	    size_t n = 0;
+	    while (n < len && !_out.empty() && _out.front().first <= host_now)
+	    {
+		data[n++] = _out.front().second;
+		_out.pop_front();
+	    }
+	    if (n)
+		return n;
+	    if (host_now > deadline)
+		return 0;
+	    // Run the bridge, and let time pass if it is idle
+	    uint32_t before = host_now;
+	    loop();
+	    if (host_now == before)
+		host_advance(1);
+	}
+    }
+
+    static const uint32_t BYTE_US = 10000000 / NRF24_BRIDGE_BAUD;
+    uint32_t _latency;
+    uint32_t _inFree;
+    uint32_t _outFree;
+    std::deque<std::pair<uint32_t, uint8_t> > _out;
+    uint32_t overflows;
+};
+
+static bool simulated = false;
+
+static uint64_t now()
+{
+    if (simulated)
+	return host_now;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static BridgeClient* bridge;
+
+static void fail(const char* what)
+{
+    fprintf(stderr, "%s: %s\n", what, bridge->error().c_str());
+    exit(1);
+}
+
+// Runs count copies of request, one at a time or pipelined, and returns the rate per second
+static double rate(BridgeRequest* requests, uint32_t count, bool pipelined)
+{
+    uint64_t start = now();
+    uint32_t i;
+    for (i = 0; i < count; i++)
+    {
+	if (pipelined ? !bridge->submit(requests[i % 8]) : !bridge->transact(requests[i % 8]))
+	    fail("request");
+    }
+    while (bridge->pending())
+	if (!bridge->complete())
+	    fail("reply");
+    return count * 1000000.0 / (now() - start);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t latency = 1000, count = 1000;
+    int opt;
+    while ((opt = getopt(argc, argv, "su:n:")) != -1)
+    {
+	switch (opt)
+	{
+	case 's':
+	    simulated = true;
+	    break;
+	case 'u':
+	    latency = atoi(optarg);
+	    break;
+	case 'n':
+	    count = atoi(optarg);
+	    break;
+	default:
+	    fprintf(stderr, "usage: %s [-n count] port | -s [-u usb_latency_us] [-n count]\n", argv[0]);
+	    return 2;
+	}
+    }
+    if (simulated == (optind < argc))
+    {
+	fprintf(stderr, "usage: %s [-n count] port | -s [-u usb_latency_us] [-n count]\n", argv[0]);
+	return 2;
+    }
+
+    SimTransport* sim = NULL;
+    BridgeSerial port;
+    BridgeTransport* transport;
+    if (simulated)
+    {
+	transport = sim = new SimTransport(latency);
+	setup();
+	printf("link: simulated, %u baud, %uus USB latency each way\n", NRF24_BRIDGE_BAUD, latency);
+    }
+    else
+    {
+	if (!port.open(argv[optind]))
+	{
+	    perror(argv[optind]);
+	    return 1;
+	}
+	transport = &port;
+	printf("link: %s\n", argv[optind]);
+    }
+    bridge = new BridgeClient(*transport);
+
+    // Transmitter at 2Mbps, NOACK allowed
+    uint8_t address[5] = { 'b', 'e', 'n', 'c', 'h' };
+    BridgeRequest init;
+    init.ce(false);
+    init.writeRegister(NRF24_REG_00_CONFIG, NRF24_EN_CRC | NRF24_PWR_UP);
+    init.writeRegister(NRF24_REG_05_RF_CH, 0x3c);
+    init.writeRegister(NRF24_REG_06_RF_SETUP, NRF24_RF_DR_HIGH | NRF24_PWR_0dBm);
+    init.writeRegisters(NRF24_REG_10_TX_ADDR, address, sizeof(address));
+    init.writeRegister(NRF24_REG_1D_FEATURE, NRF24_EN_DYN_ACK);
+    init.writeRegister(NRF24_REG_07_STATUS, NRF24_RX_DR | NRF24_TX_DS | NRF24_MAX_RT);
+    init.command(NRF24_COMMAND_FLUSH_TX);
+    size_t check = init.readRegister(NRF24_REG_05_RF_CH);
+    if (!bridge->transact(init))
+	fail("init");
+    if (init.result(check)[1] != 0x3c)
+    {
+	fprintf(stderr, "init: RF_CH reads back as 0x%02x, is the radio connected?\n", init.result(check)[1]);
+	return 1;
+    }
+
+    // Round trip
+    BridgeRequest poll;
+    poll.status();
+    uint64_t total = 0, best = ~0ULL, worst = 0;
+    uint32_t i;
+    for (i = 0; i < count; i++)
+    {
+	uint64_t start = now();
+	if (!bridge->transact(poll))
+	    fail("status");
+	uint64_t t = now() - start;
+	total += t;
+	best = t < best ? t : best;
+	worst = t > worst ? t : worst;
+    }
+    printf("status poll round trip (us): min %llu mean %llu max %llu\n",
+	   (unsigned long long)best, (unsigned long long)(total / count), (unsigned long long)worst);
+
+    // Register writes. Several requests are in flight when pipelined, each needs its own
+    BridgeRequest writes[8];
+    for (i = 0; i < 8; i++)
+	writes[i].writeRegister(NRF24_REG_05_RF_CH, 0x3c);
+    printf("register writes per sec: one at a time %.0f, pipelined %.0f\n",
+	   rate(writes, count, false), rate(writes, count, true));
+
+    // Packets
+    BridgeRequest packets[8];
+    uint8_t payload[NRF24_MAX_MESSAGE_LEN] = { 0 };
+    for (i = 0; i < 8; i++)
+    {
+	packets[i].writePayload(payload, sizeof(payload), true);
+	packets[i].ce(true);
+	packets[i].wait(NRF24_TX_DS | NRF24_MAX_RT, 1000);
+	packets[i].ce(false);
+	packets[i].writeRegister(NRF24_REG_07_STATUS, NRF24_TX_DS | NRF24_MAX_RT);
+    }
+    double single = rate(packets, count, false);
+    double pipelined = rate(packets, count, true);
+    printf("32 octet NOACK packets per sec: one at a time %.0f, pipelined %.0f (%.1f kbytes/sec)\n",
+	   single, pipelined, pipelined * sizeof(payload) / 1000);
+
+    if (sim)
+    {
+	printf("bridge: %u requests, %u errors, %u receive buffer overflows\n",
+	       nrf24.requestCount(), nrf24.errorCount(), sim->overflows);
+	if (sim->overflows || nrf24.errorCount())
+	    return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,260 @@
+// bridge_client.cpp
+//
+// See bridge_client.h
+
+#include "bridge_client.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <stdio.h>
+
+// The Arduino serial receive buffer holds this many octets, beyond the request
+// the bridge is running
+#define BRIDGE_RX_WINDOW 63
+
+static speed_t speed(unsigned long baud)
+{
+    switch (baud)
+    {
+    case 9600:    return B9600;
+    case 57600:   return B57600;
+    case 115200:  return B115200;
+    case 230400:  return B230400;
+    case 500000:  return B500000;
+    case 1000000: return B1000000;
+    case 2000000: return B2000000;
+    }
+    return B0;
+}
+
+BridgeSerial::~BridgeSerial()
+{
+    if (_fd >= 0)
+	close(_fd);
+}
+
+bool BridgeSerial::open(const char* path, unsigned long baud, int resetDelay)
+{
+    struct termios tio;
+    speed_t s = speed(baud);
+    if (s == B0)
+	return false;
+    _fd = ::open(path, O_RDWR | O_NOCTTY);
+    if (_fd < 0 || tcgetattr(_fd, &tio) < 0)
+	return false;
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, s);
+    cfsetospeed(&tio, s);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (tcsetattr(_fd, TCSANOW, &tio) < 0)
+	return false;
+    usleep(resetDelay * 1000);
+    tcflush(_fd, TCIOFLUSH);
+    return true;
+}
+
+bool BridgeSerial::write(const uint8_t* data, size_t len)
+{
+    while (len)
+    {
+	ssize_t n = ::write(_fd, data, len);
+	if (n <= 0)
+	    return false;
+	data += n;
+	len -= n;
+    }
+    return true;
+}
+
+int BridgeSerial::read(uint8_t* data, size_t len, int timeout)
+{
+    struct pollfd p = { _fd, POLLIN, 0 };
+    int r = ::poll(&p, 1, timeout);
+    if (r <= 0)
+	return r;
+    return ::read(_fd, data, len);
+}
+
+void BridgeRequest::clear()
+{
+    _ops.clear();
+    _offsets.clear();
+    _resultLen = 0;
+    _reply = NRF24_BRIDGE_OK;
+}
+
+size_t BridgeRequest::add(size_t resultLen)
+{
+    _offsets.push_back(_resultLen);
+    _resultLen += resultLen;
+    return _offsets.size() - 1;
+}
+
+size_t BridgeRequest::command(uint8_t command, const uint8_t* data, uint8_t len)
+{
+    _ops.push_back(command);
+    _ops.push_back(len);
+    _ops.insert(_ops.end(), data, data + len);
+    return add(1);
+}
+
+size_t BridgeRequest::read(uint8_t command, uint8_t len)
+{
+    _ops.push_back(command);
+    _ops.push_back(len);
+    return add(1 + len);
+}
+
+size_t BridgeRequest::writeRegister(uint8_t reg, uint8_t value)
+{
+    return command(NRF24_COMMAND_W_REGISTER | (reg & NRF24_REGISTER_MASK), &value, 1);
+}
+
+size_t BridgeRequest::writeRegisters(uint8_t reg, const uint8_t* values, uint8_t len)
+{
+    return command(NRF24_COMMAND_W_REGISTER | (reg & NRF24_REGISTER_MASK), values, len);
+}
+
+size_t BridgeRequest::readRegister(uint8_t reg)
+{
+    return read(NRF24_COMMAND_R_REGISTER | (reg & NRF24_REGISTER_MASK), 1);
+}
+
+size_t BridgeRequest::writePayload(const uint8_t* data, uint8_t len, bool noack)
+{
+    return command(noack ? NRF24_COMMAND_W_TX_PAYLOAD_NOACK : NRF24_COMMAND_W_TX_PAYLOAD, data, len);
+}
+
+size_t BridgeRequest::readPayload(uint8_t len)
+{
+    return read(NRF24_COMMAND_R_RX_PAYLOAD, len);
+}
+
+size_t BridgeRequest::ce(bool level)
+{
+    _ops.push_back(NRF24_BRIDGE_CE);
+    _ops.push_back(level);
+    return add(1);
+}
+
+size_t BridgeRequest::wait(uint8_t mask, uint32_t timeoutUs)
+{
+    uint32_t t = (timeoutUs + 99) / 100;
+    _ops.push_back(NRF24_BRIDGE_WAIT);
+    _ops.push_back(mask);
+    _ops.push_back(t > 0xff ? 0xff : t);
+    return add(1);
+}
+
+size_t BridgeRequest::delay(uint16_t us)
+{
+    _ops.push_back(NRF24_BRIDGE_DELAY);
+    _ops.push_back(us & 0xff);
+    _ops.push_back(us >> 8);
+    return add(1);
+}
+
+BridgeClient::BridgeClient(BridgeTransport& transport, int timeout)
+    : _transport(transport), _timeout(timeout), _seq(0), _pendingOctets(0)
+{
+}
+
+bool BridgeClient::submit(BridgeRequest& request)
+{
+    size_t len = request._ops.size();
+    if (len > NRF24_BRIDGE_MAX_FRAME || request._resultLen > NRF24_BRIDGE_MAX_RESULTS)
+    {
+	_error = "request too large";
+	return false;
+    }
+    size_t size = request.requestSize();
+
+    // Room beyond the oldest request, which the bridge has taken in or is taking in
+    while (!_pending.empty()
+	   && _pendingOctets - _pending.front()->requestSize() + size > BRIDGE_RX_WINDOW)
+	if (!complete())
+	    return false;
+
+    std::vector<uint8_t> frame;
+    frame.reserve(size);
+    frame.push_back(NRF24_BRIDGE_REQUEST);
+    frame.push_back(_seq);
+    frame.push_back(len);
+    frame.insert(frame.end(), request._ops.begin(), request._ops.end());
+    if (!_transport.write(&frame[0], frame.size()))
+    {
+	_error = "write failed";
+	return false;
+    }
+    _pending.push_back(&request);
+    _pendingSeq.push_back(_seq++);
+    _pendingOctets += size;
+    return true;
+}
+
+bool BridgeClient::readFully(uint8_t* data, size_t len)
+{
+    while (len)
+    {
+	int n = _transport.read(data, len, _timeout);
+	if (n <= 0)
+	{
+	    _error = n ? "read failed" : "timeout";
+	    return false;
+	}
+	data += n;
+	len -= n;
+    }
+    return true;
+}
+
+BridgeRequest* BridgeClient::complete()
+{
+    if (_pending.empty())
+    {
+	_error = "nothing pending";
+	return NULL;
+    }
+    BridgeRequest* request = _pending.front();
+    uint8_t seq = _pendingSeq.front();
+    _pending.pop_front();
+    _pendingSeq.pop_front();
+    _pendingOctets -= request->requestSize();
+
+    // Skip anything before the reply, such as output from a sketch starting up
+    uint8_t header[NRF24_BRIDGE_REPLY_HEADER_LEN];
+    do
+    {
+	if (!readFully(header, 1))
+	    return NULL;
+    } while (header[0] != NRF24_BRIDGE_REPLY);
+    if (!readFully(header + 1, sizeof(header) - 1))
+	return NULL;
+    if (header[1] != seq)
+    {
+	_error = "reply out of sequence";
+	return NULL;
+    }
+    request->_reply = header[2];
+    request->_results.resize(header[3]);
+    if (header[3] && !readFully(&request->_results[0], header[3]))
+	return NULL;
+    if (request->_reply == NRF24_BRIDGE_OK && header[3] != request->_resultLen)
+    {
+	_error = "reply has the wrong length";
+	return NULL;
+    }
+    return request;
+}
+
+bool BridgeClient::transact(BridgeRequest& request)
+{
+    if (!submit(request))
+	return false;
+    while (!_pending.empty())
+	if (!complete())
+	    return false;
+    return request.reply() == NRF24_BRIDGE_OK;
+}
@@ -0,0 +1,128 @@
+// bridge_client.h
+//
+// Linux client for the NRF24Bridge serial protocol (see NRF24Bridge.h), run by the
+// nrf24_bridge example, or by cx10_redtx built with CX10_BRIDGE 1.
+//
+// Operations are collected in a BridgeRequest, which is sent whole and comes back
+// with the results of each operation. submit() sends a request without waiting for
+// its reply, so several can be on their way at once, as far as the bridge's serial
+// receive buffer allows; complete() waits for the oldest reply. transact() does both,
+// for one request at a time.
+//
+//   BridgeSerial port;
+//   port.open("/dev/ttyACM0");
+//   BridgeClient bridge(port);
+//   BridgeRequest r;
+//   r.writeRegister(NRF24_REG_05_RF_CH, 0x3c);
+//   size_t ch = r.readRegister(NRF24_REG_05_RF_CH);
+//   if (bridge.transact(r))
+//       printf("channel %u\n", r.result(ch)[1]);
+
+#ifndef BRIDGE_CLIENT_h
+#define BRIDGE_CLIENT_h
+
+#include <NRF24Bridge.h>
+#include <stddef.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Moves octets to and from the bridge
+class BridgeTransport
+{
+public:
+    virtual ~BridgeTransport() {}
+    virtual bool   write(const uint8_t* data, size_t len) = 0;
+    // Reads up to len octets, waiting up to timeout millisecs for the first.
+    // Returns the number read, 0 on timeout, -1 on error
+    virtual int    read(uint8_t* data, size_t len, int timeout) = 0;
+};
+
+// A serial port, raw, at NRF24_BRIDGE_BAUD by default
+class BridgeSerial : public BridgeTransport
+{
+public:
+    BridgeSerial() : _fd(-1) {}
+    ~BridgeSerial();
+    // Opening the port resets most Arduinos, so this waits for the bootloader to finish
+    bool           open(const char* path, unsigned long baud = NRF24_BRIDGE_BAUD, int resetDelay = 2000);
+    bool           write(const uint8_t* data, size_t len);
+    int            read(uint8_t* data, size_t len, int timeout);
+private:
+    int            _fd;
+};
+
+// The operations of one request, and once it is complete, their results.
+// Each add function returns the index of the operation, for result()
+class BridgeRequest
+{
+public:
+    BridgeRequest() { clear(); }
+    void           clear();
+
+    size_t         command(uint8_t command, const uint8_t* data = NULL, uint8_t len = 0);
+    size_t         read(uint8_t command, uint8_t len);
+    size_t         writeRegister(uint8_t reg, uint8_t value);
+    size_t         writeRegisters(uint8_t reg, const uint8_t* values, uint8_t len);
+    size_t         readRegister(uint8_t reg);
+    size_t         writePayload(const uint8_t* data, uint8_t len, bool noack = false);
+    size_t         readPayload(uint8_t len);
+    size_t         status() { return command(NRF24_COMMAND_NOP); }
+    size_t         ce(bool level);
+    size_t         wait(uint8_t mask, uint32_t timeoutUs);
+    size_t         delay(uint16_t us);
+
+    // Octets in the request frame and in its reply frame
+    size_t         requestSize() const { return NRF24_BRIDGE_REQUEST_HEADER_LEN + _ops.size(); }
+    size_t         replySize() const { return NRF24_BRIDGE_REPLY_HEADER_LEN + _resultLen; }
+    size_t         count() const { return _offsets.size(); }
+
+    // After completion: NRF24_BRIDGE_OK or why the bridge rejected the request,
+    // and the results of operation i: STATUS (or 0), then any octets read
+    uint8_t        reply() const { return _reply; }
+    const uint8_t* result(size_t i) const { return &_results[_offsets[i]]; }
+
+private:
+    friend class BridgeClient;
+    size_t         add(size_t resultLen);
+
+    std::vector<uint8_t> _ops;
+    std::vector<size_t>  _offsets;
+    size_t               _resultLen;
+    uint8_t              _reply;
+    std::vector<uint8_t> _results;
+};
+
+class BridgeClient
+{
+public:
+    BridgeClient(BridgeTransport& transport, int timeout = 1000);
+
+    // Sends a request without waiting for its reply, after waiting for earlier replies
+    // if the bridge has no room for it yet. The request must stay in place until complete()
+    // returns it. Returns false if the request is too large or the transport failed
+    bool           submit(BridgeRequest& request);
+
+    // Waits for the reply to the oldest request submitted, and returns it, or NULL on
+    // error or timeout. The request's reply() says whether the bridge ran it
+    BridgeRequest* complete();
+
+    // Submits a request and waits for it, and everything before it
+    bool           transact(BridgeRequest& request);
+
+    size_t         pending() const { return _pending.size(); }
+    const std::string& error() const { return _error; }
+
+private:
+    bool           readFully(uint8_t* data, size_t len);
+
+    BridgeTransport&           _transport;
+    int                        _timeout;
+    uint8_t                    _seq;
+    std::deque<BridgeRequest*> _pending;
+    std::deque<uint8_t>        _pendingSeq;
+    size_t                     _pendingOctets;
+    std::string                _error;
+};
+
+#endif
@@ -0,0 +1,322 @@
+// crazyflie_bench.cpp
+//
+// Runs the crazyflie example, the copter end of the CRTP link, against the nRF24 model
+// in host/, with the far end played by a client that reads the log TOC, creates three
+// log blocks and starts them: one streamed as fast as the link allows (period 0), one
+// every 10ms and one every 100ms. It sends a commander setpoint every 10ms and an empty
+// packet whenever nothing else is due, back to back, as a CrazyRadio does, so every
+// packet it sends can collect a log packet in its ACK. This loads the copter's receive
+// and ACK payload paths as hard as the link can.
+//
+// The link model: no loss, the copter ACKs 130us after a packet ends, and the client
+// sends its next packet 130us after the ACK ends plus the given gap, which stands for
+// its own turnaround (a CrazyRadio on USB takes a few hundred microseconds).
+//
+// Prints the downlink rate, and per block the packets received, their rate, samples the
+// client saw missing from the periodic blocks (by timestamp) and samples the copter
+// counted as dropped. The exit status is 1 if a control reply is wrong or missing, a
+// periodic block misses or drops a sample, or a sample's sys.tick does not match its
+// timestamp, so the same run serves as a regression test for the log engine.
+//
+// Build (from the top of the repository):
+//   g++ -O2 -DARDUINO=100 -Itools/host -ILibraries/SpscQueue -ILibraries/NRF24
+//       -o crazyflie_bench tools/crazyflie_bench.cpp tools/host/host.cpp Libraries/NRF24/NRF24.cpp
+//
+// Usage:
+//   crazyflie_bench [-v] [-r 250k|1M|2M] [-d seconds] [-g gap_us]
+
+#include <host.h>
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// The copter under test
+#include "../Libraries/NRF24/examples/crazyflie/crazyflie.ino"
+
+#define SETPOINT_PERIOD_US 10000
+#define TURNAROUND_US      130
+#define CLIENT_BLOCKS      3
+#define REQUEST_TIMEOUT_US 50000
+
+// The blocks the client creates: id, period (10ms units), and variables by name, sent
+// as the given types
+static const struct
+{
+    uint8_t     id;
+    uint8_t     period;
+    const char* vars[6];
+    uint8_t     types[6];
+} blocks[CLIENT_BLOCKS] = {
+    { 1, 0,  { "sys.tick", "stab.roll", "stab.pitch", "stab.yaw", "stab.thrust", "pm.vbat" },
+             { LOG_UINT32, LOG_FLOAT, LOG_FLOAT, LOG_FLOAT, LOG_UINT16, LOG_FP16 } },
+    { 2, 1,  { "sys.tick", "log.samples", "radio.rx" },
+             { LOG_UINT32, LOG_UINT32, LOG_UINT32 } },
+    { 3, 10, { "sys.tick", "log.drops", "log.packets", "radio.acks" },
+             { LOG_UINT32, LOG_UINT32, LOG_UINT32, LOG_UINT32 } },
+};
+
+// What the client received of each block
+static struct
+{
+    uint32_t packets;
+    uint32_t octets;
+    uint32_t missed;     // Samples missing between two received, by timestamp
+    uint32_t lastStamp;
+    bool     seen;
+} received[CLIENT_BLOCKS];
+
+static uint32_t gap = 0;
+static bool     failed = false;
+
+// The client: a script of requests, each sent once, then again if its reply has not
+// arrived in REQUEST_TIMEOUT_US
+static std::vector<std::vector<uint8_t> > requests;
+static size_t   request = 0;
+static bool     requestSent = false;
+static uint32_t requestTime;
+static std::vector<std::string> toc;
+static uint8_t  tocLen = 0;
+static bool     streaming = false;
+static uint32_t streamStart, streamEnd;
+static uint32_t nextSetpoint = 0;
+static uint32_t sent = 0, withPayload = 0, downlinkPackets = 0, downlinkOctets = 0, badTicks = 0;
+
+static std::vector<uint8_t> control(uint8_t cmd, uint8_t block)
+{
+    std::vector<uint8_t> p;
+    p.push_back(CRTP_HEADER(CRTP_PORT_LOG, LOG_CONTROL_CH));
+    p.push_back(cmd);
+    p.push_back(block);
+    return p;
+}
+
+// After the TOC is read: reset, then create and start the blocks. Creating block 1
+// again, and a block of a variable past the TOC, are refused
+static void logSetup()
+{
+    requests.push_back(control(LOG_RESET, 0));
+    for (uint8_t b = 0; b < CLIENT_BLOCKS; b++)
+    {
+	std::vector<uint8_t> p = control(LOG_CREATE_BLOCK, blocks[b].id);
+	for (uint8_t v = 0; v < 6 && blocks[b].vars[v]; v++)
+	{
+	    uint8_t id;
+	    for (id = 0; id < toc.size() && toc[id] != blocks[b].vars[v]; id++)
+		;
+	    p.push_back(blocks[b].types[v]);
+	    p.push_back(id);
+	}
+	requests.push_back(p);
+    }
+    requests.push_back(control(LOG_CREATE_BLOCK, 1));
+    std::vector<uint8_t> p = control(LOG_CREATE_BLOCK, 9);
+    p.push_back(LOG_UINT8);
+    p.push_back(tocLen);
+    requests.push_back(p);
+    for (uint8_t b = 0; b < CLIENT_BLOCKS; b++)
+    {
+	p = control(LOG_START_BLOCK, blocks[b].id);
+	p.push_back(blocks[b].period);
+	requests.push_back(p);
+    }
+}
+
+// Error code expected in the reply to a control request
+static uint8_t expected(const std::vector<uint8_t>& p)
+{
+    if (p[1] == LOG_CREATE_BLOCK && p[2] == 1 && p.size() == 3)
+	return LOG_EEXIST;
+    if (p[1] == LOG_CREATE_BLOCK && p[2] == 9)
+	return LOG_ENOENT;
+    return 0;
+}
+
+// A packet from the copter, in an ACK payload
+static void handle(const std::vector<uint8_t>& p)
+{
+    uint8_t header = p[0];
+    if (CRTP_HEADER_PORT(header) != CRTP_PORT_LOG)
+	return;
+    uint8_t channel = CRTP_HEADER_CHANNEL(header);
+    const std::vector<uint8_t>* r = request < requests.size() ? &requests[request] : 0;
+
+    if (channel == LOG_TOC_CH && r && (*r)[0] == header && p.size() > 2 && p[1] == (*r)[1])
+    {
+	if (p[1] == CMD_GET_INFO)
+	{
+	    tocLen = p[2];
+	    for (uint8_t i = 0; i < tocLen; i++)
+	    {
+		std::vector<uint8_t> q;
+		q.push_back(CRTP_HEADER(CRTP_PORT_LOG, LOG_TOC_CH));
+		q.push_back(CMD_GET_ITEM);
+		q.push_back(i);
+		requests.push_back(q);
+	    }
+	}
+	else if (p[2] == (*r)[2] && p.size() > 4)
+	{
+	    std::string group((const char*)&p[4]);
+	    std::string name((const char*)&p[5 + group.size()]);
+	    toc.push_back(group + "." + name);
+	    if (toc.size() == tocLen)
+		logSetup();
+	}
+	else
+	    return;
+	request++;
+	requestSent = false;
+    }
+    else if (channel == LOG_CONTROL_CH && r && p.size() == 4 && p[1] == (*r)[1] && p[2] == (*r)[2])
+    {
+	if (p[3] != expected(*r))
+	{
+	    printf("log control %u block %u: error %u, expected %u\n", p[1], p[2], p[3], expected(*r));
+	    failed = true;
+	}
+	requestSent = false;
+	if (++request == requests.size())
+	{
+	    streaming = true;
+	    streamStart = host_now;
+	}
+    }
+    else if (channel == LOG_LOG_CH && streaming && p.size() >= LOG_DATA_OFFSET)
+    {
+	uint8_t b;
+	for (b = 0; b < CLIENT_BLOCKS && blocks[b].id != p[1]; b++)
+	    ;
+	if (b == CLIENT_BLOCKS)
+	    return;
+	uint32_t stamp = p[2] | (p[3] << 8) | ((uint32_t)p[4] << 16);
+	uint32_t tick;
+	memcpy(&tick, &p[LOG_DATA_OFFSET], sizeof(tick));
+	if (tick != stamp)
+	    badTicks++;
+	// Samples are stamped when taken, up to a tick after they were due
+	uint32_t period = blocks[b].period * 10;
+	if (received[b].seen && period)
+	    received[b].missed += (stamp - received[b].lastStamp + period / 2) / period - 1;
+	received[b].seen = true;
+	received[b].lastStamp = stamp;
+	received[b].packets++;
+	received[b].octets += p.size();
+	downlinkPackets++;
+	downlinkOctets += p.size();
+    }
+}
+
+// One packet from the client and its ACK, then the next
+static void exchange()
+{
+    HostRadio& radio = host_radio();
+    std::vector<uint8_t> p;
+
+    if (streaming && (int32_t)(host_now - nextSetpoint) >= 0)
+    {
+	static uint32_t n = 0;
+	CommanderCrtpValues c = { 30 * (float)sin(n / 50.0), 0, 0, (uint16_t)n };
+	p.push_back(CRTP_HEADER(CRTP_PORT_COMMANDER, 0));
+	p.insert(p.end(), (uint8_t*)&c, (uint8_t*)&c + sizeof(c));
+	nextSetpoint += SETPOINT_PERIOD_US;
+	n++;
+    }
+    else if (request < requests.size() && (!requestSent || host_now - requestTime > REQUEST_TIMEOUT_US))
+    {
+	p = requests[request];
+	requestSent = true;
+	requestTime = host_now;
+    }
+    else
+	p.push_back(0xff);  // Empty packet, to collect what the copter has
+    if (!streaming)
+	nextSetpoint = host_now;
+
+    // The packet arrives, and the ACK takes whatever the copter has loaded
+    uint32_t t = host_now + radio.airTimeUs(p.size());
+    host_advance_to(t);
+    radio.inject(0, &p[0], p.size());
+    std::vector<uint8_t> ack;
+    if (radio.takeAckPayload(0, ack))
+	withPayload++;
+    sent++;
+    t += TURNAROUND_US + radio.airTimeUs(ack.size()) + TURNAROUND_US + gap;
+    if (!ack.empty())
+	handle(ack);
+    host_at(t, exchange);
+}
+
+int main(int argc, char** argv)
+{
+    bool verbose = false;
+    uint32_t seconds = 10;
+    uint8_t rate = NRF24::NRF24DataRate250kbps;
+    for (int a = 1; a < argc; a++)
+    {
+	if (!strcmp(argv[a], "-v"))
+	    verbose = true;
+	else if (!strcmp(argv[a], "-r") && a + 1 < argc)
+	{
+	    a++;
+	    if (!strcmp(argv[a], "2M"))
+		rate = NRF24::NRF24DataRate2Mbps;
+	    else if (!strcmp(argv[a], "1M"))
+		rate = NRF24::NRF24DataRate1Mbps;
+	}
+	else if (!strcmp(argv[a], "-d") && a + 1 < argc)
+	    seconds = atoi(argv[++a]);
+	else if (!strcmp(argv[a], "-g") && a + 1 < argc)
+	    gap = atoi(argv[++a]);
+	else
+	{
+	    fprintf(stderr, "usage: %s [-v] [-r 250k|1M|2M] [-d seconds] [-g gap_us]\n", argv[0]);
+	    return 2;
+	}
+    }
+
+    host_serial_sink([&](uint8_t c) { if (verbose && c != '\r') putchar(c); });
+    setup();
+    nrf24.setRF(rate, NRF24::NRF24TransmitPower0dBm);
+
+    std::vector<uint8_t> info;
+    info.push_back(CRTP_HEADER(CRTP_PORT_LOG, LOG_TOC_CH));
+    info.push_back(CMD_GET_INFO);
+    requests.push_back(info);
+    host_at(host_now + 1000, exchange);
+
+    uint32_t end = 0;
+    while (!streaming || host_now < end)
+    {
+	loop();
+	if (!streaming && host_now > 1000000)
+	{
+	    printf("log setup not done: request %u of %u\n", (unsigned)request, (unsigned)requests.size());
+	    return 1;
+	}
+	if (streaming && !end)
+	    end = streamStart + seconds * 1000000;
+    }
+    streamEnd = host_now;
+
+    double secs = (streamEnd - streamStart) / 1e6;
+    printf("%u log variables, %u packets sent, %.0f%% collected an ACK payload\n",
+	   tocLen, sent, 100.0 * withPayload / sent);
+    printf("log downlink %.0f packets/s, %.2f kbytes/s\n", downlinkPackets / secs, downlinkOctets / secs / 1000);
+    printf("block period  packets  rate/s  missed  dropped\n");
+    for (uint8_t b = 0; b < CLIENT_BLOCKS; b++)
+    {
+	uint8_t i = logFind(blocks[b].id);
+	uint16_t drops = i < LOG_MAX_BLOCKS ? logBlocks[i].drops : 0;
+	printf("%5u %4ums %8u %7.1f %7u %8u\n", blocks[b].id, blocks[b].period * 10,
+	       received[b].packets, received[b].packets / secs, received[b].missed, drops);
+	if (blocks[b].period && (received[b].missed || drops || !received[b].packets))
+	    failed = true;
+    }
+    if (badTicks)
+    {
+	printf("%u samples with sys.tick not their timestamp\n", badTicks);
+	failed = true;
+    }
+    return failed ? 1 : 0;
+}
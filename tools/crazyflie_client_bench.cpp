@@ -0,0 +1,178 @@
+// crazyflie_client_bench.cpp
+//
+// Runs the crazyflie_client example, the transmitter end of the CRTP link, against the
+// nRF24 model in host/, with the far end played by a model of a Crazyflie on channel
+// COPTER_CHANNEL that has a backlog of console output to send. The copter puts up to
+// 31 octets of console text in the ACK payload of every packet it acknowledges, other
+// than the scan's link echoes, and a null packet once the backlog is gone, as the
+// Crazyflie firmware does. The client finds the copter with its channel scan, then
+// streams setpoints and polls for the console text with empty packets.
+//
+// The link model: each attempt is lost independently with the given probability, an
+// attempt that gets through is acknowledged, and air times and retry delays follow
+// the radio's data rate and settings.
+//
+// Prints the setpoint rate, the console throughput and the link counters over the
+// session. The exit status is 1 if the copter is not found, the console text arrives
+// out of order or corrupted, or, without loss, fewer than 98% of the setpoints the
+// client is set to send are acknowledged.
+//
+// Build (from the top of the repository):
+//   g++ -O2 -DARDUINO=100 -Itools/host -ILibraries/SpscQueue -ILibraries/NRF24 -ILibraries/RcTrainer-1.0/RcTrainer
+//       -o crazyflie_client_bench tools/crazyflie_client_bench.cpp tools/host/host.cpp
+//       Libraries/NRF24/NRF24.cpp Libraries/NRF24/NRF24Crtp.cpp Libraries/RcTrainer-1.0/RcTrainer/RcTrainer.cpp
+//
+// Usage:
+//   crazyflie_client_bench [-v] [-l loss] [-d seconds] [-b backlog_octets] [-s seed]
+
+#include <host.h>
+#include <stdio.h>
+#include <random>
+
+// The client under test
+#include "../Libraries/NRF24/examples/crazyflie_client/crazyflie_client.ino"
+
+#define COPTER_CHANNEL 40
+
+static double       loss = 0.0;
+static std::mt19937 rng(1);
+static bool         verbose = false;
+static uint32_t     seconds = 10;
+
+// The copter's console: octet n of its output is 'A' + n % 26
+static uint32_t     backlog = 1000000;
+static uint32_t     consoleSent = 0;
+
+// What the client delivered
+static uint32_t     consoleReceived = 0;
+static uint32_t     consoleWrong = 0;
+static uint32_t     setpoints = 0;
+static uint32_t     sessionStart = 0;
+static bool         session = false;
+static std::string  line;
+
+static bool lost()
+{
+    return loss > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < loss;
+}
+
+static HostRadio::Result copter(const HostPayload& p)
+{
+    HostRadio& radio = host_radio();
+    HostRadio::Result r;
+    r.acked = false;
+    r.retries = 0;
+    if (radio.reg(NRF24_REG_05_RF_CH) != COPTER_CHANNEL || p.data.empty())
+	return r;
+
+    uint8_t arc = radio.reg(NRF24_REG_04_SETUP_RETR) & NRF24_ARC;
+    for (uint8_t i = 0; i <= arc && !r.acked; i++)
+    {
+	if (!lost())
+	{
+	    r.acked = true;
+	    r.retries = i;
+	}
+    }
+    if (!r.acked || p.data[0] == CRTP_HEADER(CRTP_PORT_LINK, 3))
+	return r;
+
+    // The first packet after the scan starts the session. loop() does not return
+    // while the link is up, so the session ends with a HostTimeout
+    if (!session)
+    {
+	session = true;
+	sessionStart = p.time;
+	host_end_time = sessionStart + seconds * 1000000;
+    }
+    if (p.data[0] == CRTP_HEADER(CRTP_PORT_COMMANDER, 0))
+	setpoints++;
+    if (consoleSent < backlog)
+    {
+	uint32_t n = backlog - consoleSent < CRTP_MAX_DATA_LEN ? backlog - consoleSent : CRTP_MAX_DATA_LEN;
+	r.ackPayload.push_back(CRTP_HEADER(CRTP_PORT_CONSOLE, 0));
+	while (n--)
+	    r.ackPayload.push_back('A' + consoleSent++ % 26);
+    }
+    else
+	r.ackPayload.push_back(CRTP_HEADER(CRTP_PORT_LINK, 3));
+    return r;
+}
+
+// The client's serial output: its reports, with the console text it received in among them
+static void serial(uint8_t c)
+{
+    if (session && c >= 'A' && c <= 'Z')
+    {
+	if (c != 'A' + consoleReceived % 26)
+	    consoleWrong++;
+	consoleReceived++;
+	return;
+    }
+    if (c == '\r')
+	return;
+    if (c != '\n')
+    {
+	line += c;
+	return;
+    }
+    if (verbose)
+	printf("%8.3f %s\n", host_now / 1e6, line.c_str());
+    line.clear();
+}
+
+int main(int argc, char** argv)
+{
+    for (int a = 1; a < argc; a++)
+    {
+	if (!strcmp(argv[a], "-v"))
+	    verbose = true;
+	else if (!strcmp(argv[a], "-l") && a + 1 < argc)
+	    loss = atof(argv[++a]);
+	else if (!strcmp(argv[a], "-d") && a + 1 < argc)
+	    seconds = atoi(argv[++a]);
+	else if (!strcmp(argv[a], "-b") && a + 1 < argc)
+	    backlog = atoi(argv[++a]);
+	else if (!strcmp(argv[a], "-s") && a + 1 < argc)
+	    rng.seed(atoi(argv[++a]));
+	else
+	{
+	    fprintf(stderr, "usage: %s [-v] [-l loss] [-d seconds] [-b backlog_octets] [-s seed]\n", argv[0]);
+	    return 2;
+	}
+    }
+
+    HostRadio& radio = host_radio();
+    radio.onTransmit = copter;
+    host_serial_sink(serial);
+    host_end_time = 2000000;
+    try
+    {
+	setup();
+	while (1)
+	    loop();
+    }
+    catch (HostTimeout&)
+    {
+    }
+    host_end_time = 0;
+    if (!session)
+    {
+	printf("copter not found on channel %u\n", COPTER_CHANNEL);
+	return 1;
+    }
+
+    uint32_t expected = seconds * CF_SETPOINT_RATE;
+    printf("channel %u at %.0f%% loss, %us\n", channel, loss * 100, seconds);
+    printf("setpoints %.1f/s (%.1f%% of %u/s)\n", (double)setpoints / seconds, 100.0 * setpoints / expected, CF_SETPOINT_RATE);
+    printf("console %.2f kbytes/s, %u of %u octets, %u wrong\n", consoleReceived / 1000.0 / seconds,
+	   consoleReceived, consoleSent, consoleWrong);
+
+    bool failed = consoleWrong || consoleReceived > consoleSent;
+    if (loss == 0 && setpoints < expected * 98 / 100)
+    {
+	printf("setpoint rate too low\n");
+	failed = true;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+// cx10_latency.cpp
+//
+// Stick to air latency of cx10_redtx, measured by the sketch itself built with
+// CX10_LATENCY 1, against the host models.
+//
+// The sketch's RcPpmEncoder drives the Timer1 model in host/, whose OC1A output is
+// wired to interrupt 0, where the real RcTrainer decoder reads it, just as with D9
+// wired to D2 on the target. The nRF24 model acknowledges every packet, after the
+// given number of retries. The sketch's once a second reports are printed as they
+// come, then the overall figures, and the time from reset to the first command
+// packet. With -e, the sketch starts with a bind for its model already stored in
+// EEPROM and the reset cause an external reset, as after a reset in flight, so it
+// resumes without binding. The exit status is 3 if the mean latency exceeds the
+// budget, so the same measurement serves as a regression test for changes to the PPM
+// decoder and packet loop.
+//
+// With -f, a radio fault is injected every given number of ms after the first
+// second, in turn: a reset of the radio alone (its registers to their power on values,
+// as after a brown-out of the radio's supply), CE lost (the packet in the TX FIFO is
+// never sent) and the channel register corrupted. The sketch's fault counts and
+// recovery times are printed at the end, and the exit status is 4 if a fault is still
+// unrecovered after the budget of MAX_RECOVERY_MS.
+//
+// Build (from the top of the repository):
+//   g++ -O2 -DARDUINO=100 -Itools/host -ILibraries/SpscQueue -ILibraries/NRF24 -ILibraries/RcTrainer-1.0/RcTrainer
+//       -o cx10_latency tools/cx10_latency.cpp tools/host/host.cpp
+//       Libraries/NRF24/NRF24.cpp Libraries/RcTrainer-1.0/RcTrainer/RcTrainer.cpp
+//       Libraries/RcTrainer-1.0/RcTrainer/RcPpmEncoder.cpp
+//
+// Add -DCX10_EVENT_TX=1 to measure the sketch with event driven transmit, which also
+// prints its extra packets and the time they saved.
+//
+// Usage:
+//   cx10_latency [-e] [-s seconds] [-r retries] [-b budget_us] [-f fault_period_ms]
+
+#include <host.h>
+#include <EEPROM.h>
+#include <stdio.h>
+
+// The sketch under test, measuring its own latency
+#define CX10_LATENCY 1
+#include "../cx10_redtx.ino"
+
+// Longest a fault may take to recover from: the packet timeout, then a packet
+// period and one more packet
+#define MAX_RECOVERY_MS ((PACKWAIT_TIMEOUT_US + 999) / 1000 + 2 * PACKET_PERIOD + 2)
+
+// Injects fault n, and the next one a period later
+static void fault(uint32_t n, uint32_t period)
+{
+    HostRadio& radio = host_radio();
+    switch (n % 3)
+    {
+    case 0:
+    {
+	// The transmitted log goes with the rest of the radio's state
+	std::vector<HostPayload> transmitted;
+	transmitted.swap(radio.transmitted);
+	bool ce = radio.chipEnabled();
+	radio.reset();
+	radio.setChipEnable(ce);
+	transmitted.swap(radio.transmitted);
+	break;
+    }
+    case 1:
+	radio.setChipEnable(false);
+	break;
+    case 2:
+	radio.poke(NRF24_REG_05_RF_CH, RF_CHANNEL + 1);
+	break;
+    }
+    host_at(host_now + period * 1000, [n, period]() { fault(n + 1, period); });
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t seconds = 10, budget = 0, faults = 0;
+    uint8_t retries = 0;
+    bool stored = false;
+    for (int a = 1; a < argc; a++)
+    {
+	if (!strcmp(argv[a], "-e"))
+	    stored = true;
+	else if (!strcmp(argv[a], "-s") && a + 1 < argc)
+	    seconds = atoi(argv[++a]);
+	else if (!strcmp(argv[a], "-r") && a + 1 < argc)
+	    retries = atoi(argv[++a]);
+	else if (!strcmp(argv[a], "-b") && a + 1 < argc)
+	    budget = atoi(argv[++a]);
+	else if (!strcmp(argv[a], "-f") && a + 1 < argc)
+	    faults = atoi(argv[++a]);
+	else
+	{
+	    fprintf(stderr, "usage: %s [-e] [-s seconds] [-r retries] [-b budget_us] [-f fault_period_ms]\n",
+		    argv[0]);
+	    return 2;
+	}
+    }
+
+    if (stored)
+    {
+	// As a previous run would have left it, then the reset button
+	bind_store();
+	host_now = 0;
+	MCUSR = _BV(EXTRF);
+    }
+
+    host_serial_sink([](uint8_t c) { if (c != '\r') putchar(c); });
+    host_wire(RCPPMENCODER_PIN, 0);
+
+    HostRadio& radio = host_radio();
+    radio.onTransmit = [&](const HostPayload& p) {
+	(void)p;
+	HostRadio::Result r;
+	r.acked = true;
+	r.retries = retries;
+	return r;
+    };
+
+    // Overall figures, from the same samples as the sketch's reports
+    uint32_t total = 0, count = 0, worst = 0, best = 0xffffffff;
+    host_end_time = seconds * 1000000;
+    if (faults)
+	host_at(1000000, [faults]() { fault(0, faults); });
+    try
+    {
+	setup();
+	uint32_t start = host_now;
+	while (true)
+	{
+	    uint16_t before = latency_count;
+	    uint32_t sum = latency_total;
+	    loop();
+	    // Not counted if loop() reported, and so reset them, meanwhile
+	    if (latency_count == before + 1 && host_now - start > 1000000)
+	    {
+		uint32_t latency = latency_total - sum;
+		total += latency;
+		count++;
+		if (latency > worst)
+		    worst = latency;
+		if (latency < best)
+		    best = latency;
+	    }
+	}
+    }
+    catch (HostTimeout&)
+    {
+    }
+    host_end_time = 0;
+
+    printf("ppm: %u frames sent, decoder %u valid, %u rejected, %u channels\n",
+	   ppm.frameCount(), tx.frameCount(), tx.badFrameCount(), tx.channelCount());
+    printf("radio: %zu packets sent\n", radio.transmitted.size());
+    printf("reset to first command (us): %u, %s\n", first_command_time, stored ? "resumed" : "bound");
+    bool unrecovered = radio_down && (micros() - radio_down_start) / 1000 > MAX_RECOVERY_MS;
+    if (faults)
+	printf("radio faults: %u packets failed, %u restores, %u of %u recovered from, "
+	       "recovery (ms) mean %u max %u%s\n",
+	       radio_faults.count, radio_faults.restores, radio_faults.recoveries,
+	       radio_faults.recoveries + radio_down, radio_faults.recoveries
+	       ? radio_faults.downtime_ms / radio_faults.recoveries : 0, radio_faults.max_ms,
+	       unrecovered ? ", one still down" : "");
+#if CX10_EVENT_TX
+    printf("event transmit: %u extra packets, %u us saved, mean %u\n", event_tx.packets,
+	   event_tx.saved_us, event_tx.packets ? event_tx.saved_us / event_tx.packets : 0);
+#endif
+    if (!count)
+    {
+	printf("no steps measured\n");
+	return 1;
+    }
+    printf("latency (us), %u steps after the first second: min %u mean %u max %u\n",
+	   count, best, total / count, worst);
+    if (budget && total / count > budget)
+    {
+	printf("latency budget of %uus exceeded\n", budget);
+	return 3;
+    }
+    if (unrecovered || radio_faults.max_ms > MAX_RECOVERY_MS)
+    {
+	printf("fault recovery budget of %ums exceeded\n", MAX_RECOVERY_MS);
+	return 4;
+    }
+    return 0;
+}
@@ -0,0 +1,174 @@
+// cx10_power.cpp
+//
+// Transmit power control in cx10_redtx, built with CX10_POWER_CONTROL 1, against the
+// nRF24 model in host/, over a modelled flight: close in, out to the edge of range
+// and back, then the quad switched off for a while and on again.
+//
+// The link model: the quad's link margin at 0dBm follows the flight, less 6dB for each
+// PA level below, and each attempt and its ACK get through with a probability that
+// rises from 1/2 at 0dB margin, 2dB to the e-fold. A quad that is off acknowledges
+// nothing. The sketch starts with a stored bind, after an external reset, so no PPM
+// signal is needed: it resumes and flies the failsafe, which is just as good a packet.
+//
+// Prints each change of level with -v, then the time spent at each level, the packets
+// lost, and the changes. The exit status is 1 if two changes are closer than a window,
+// the level is not at POWER_FALLBACK while the quad is off, or the level does not come
+// down close in, so the same run serves as a regression test for the controller.
+//
+// Build (from the top of the repository):
+//   g++ -O2 -DARDUINO=100 -Itools/host -ILibraries/SpscQueue -ILibraries/NRF24 -ILibraries/RcTrainer-1.0/RcTrainer
+//       -o cx10_power tools/cx10_power.cpp tools/host/host.cpp Libraries/NRF24/*.cpp
+//       Libraries/RcTrainer-1.0/RcTrainer/*.cpp
+//
+// Usage:
+//   cx10_power [-v] [-m range_margin_db] [-S seed]
+
+#include <host.h>
+#include <EEPROM.h>
+#include <math.h>
+#include <stdio.h>
+#include <random>
+
+// The sketch under test
+#define CX10_POWER_CONTROL 1
+#include "../cx10_redtx.ino"
+
+// The flight: link margin at 0dBm, in dB, at each time in seconds, with straight lines
+// between. Off marks the quad switched off
+#define OFF -100
+static const struct { double time, margin; } flight[] = {
+    { 0, 30 }, { 10, 30 }, { 20, 0 }, { 30, 0 }, { 40, 30 }, { 45, 30 },
+    { 45, OFF }, { 50, OFF }, { 50, 30 }, { 60, 30 },
+};
+#define FLIGHT_POINTS (sizeof(flight) / sizeof(flight[0]))
+
+static std::mt19937 rng(1);
+static double       range = 0;  // Added to the margin at the edge of range
+
+static double margin(double t)
+{
+    uint8_t i;
+    for (i = 1; i < FLIGHT_POINTS - 1 && flight[i].time <= t; i++)
+	;
+    if (flight[i - 1].margin == OFF || flight[i].margin == OFF)
+	return OFF;
+    double f = (t - flight[i - 1].time) / (flight[i].time - flight[i - 1].time);
+    f = f < 0 ? 0 : f > 1 ? 1 : f;
+    double m = flight[i - 1].margin + f * (flight[i].margin - flight[i - 1].margin);
+    return m + range * (1 - m / 30);
+}
+
+static bool through(double m)
+{
+    return std::uniform_real_distribution<double>(0, 1)(rng) < 1 / (1 + exp(-m / 2));
+}
+
+int main(int argc, char** argv)
+{
+    bool verbose = false;
+    for (int a = 1; a < argc; a++)
+    {
+	if (!strcmp(argv[a], "-v"))
+	    verbose = true;
+	else if (!strcmp(argv[a], "-m") && a + 1 < argc)
+	    range = atof(argv[++a]);
+	else if (!strcmp(argv[a], "-S") && a + 1 < argc)
+	    rng.seed(atoi(argv[++a]));
+	else
+	{
+	    fprintf(stderr, "usage: %s [-v] [-m range_margin_db] [-S seed]\n", argv[0]);
+	    return 2;
+	}
+    }
+
+    // As a previous run would have left it, then the reset button
+    bind_store();
+    host_now = 0;
+    MCUSR = _BV(EXTRF);
+
+    HostRadio& radio = host_radio();
+    uint32_t sent[4] = { 0 }, lost[4] = { 0 }, off = 0;
+    radio.onTransmit = [&](const HostPayload& p) {
+	(void)p;
+	uint8_t level = (radio.reg(NRF24_REG_06_RF_SETUP) & NRF24_PWR) >> 1;
+	double m = margin(host_now / 1e6);
+	HostRadio::Result r;
+	r.acked = false;
+	r.retries = radio.reg(NRF24_REG_04_SETUP_RETR) & NRF24_ARC;
+	if (m == OFF)
+	    off++;
+	else
+	{
+	    m -= 6 * (NRF24::NRF24TransmitPower0dBm - level);
+	    for (uint8_t i = 0; i <= r.retries && !r.acked; i++)
+		if (through(m) && through(m))
+		{
+		    r.acked = true;
+		    r.retries = i;
+		}
+	}
+	sent[level]++;
+	if (!r.acked)
+	    lost[level]++;
+	return r;
+    };
+
+    uint32_t last_change = 0, closest = 0xffffffff;
+    uint8_t level = power_level;
+    bool failed = false;
+    host_end_time = (uint32_t)(flight[FLIGHT_POINTS - 1].time * 1000000);
+    try
+    {
+	setup();
+	while (true)
+	{
+	    loop();
+	    if (power_level != level)
+	    {
+		if (verbose)
+		    printf("%7.3fs margin %5.1fdB: level %u to %u\n", host_now / 1e6,
+			   margin(host_now / 1e6), level, power_level);
+		if (host_now - last_change < closest)
+		    closest = host_now - last_change;
+		last_change = host_now;
+		level = power_level;
+	    }
+	    if (margin(host_now / 1e6) == OFF && host_now / 1e6 > flight[6].time + 1
+		&& power_level != POWER_FALLBACK)
+		failed = true;
+	}
+    }
+    catch (HostTimeout&)
+    {
+    }
+    host_end_time = 0;
+
+    static const char* names[4] = { "-18dBm", "-12dBm", "-6dBm", "0dBm" };
+    uint32_t total = 0, totalLost = 0;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+	printf("%-7s %6u packets (%5.1fs), %5u lost\n", names[i], sent[i],
+	       sent[i] * PACKET_PERIOD / 1000.0, lost[i]);
+	total += sent[i];
+	totalLost += lost[i];
+    }
+    printf("%u level changes, closest %ums apart; %u of %u packets lost while the quad was on\n",
+	   power_changes, closest / 1000, totalLost - off, total - off);
+
+    if (closest < (uint32_t)POWER_WINDOW * PACKET_PERIOD * 1000)
+    {
+	printf("levels changed within a window\n");
+	return 1;
+    }
+    if (failed)
+    {
+	printf("level not at the fallback while the quad was off\n");
+	return 1;
+    }
+    if (!sent[NRF24::NRF24TransmitPowerm18dBm])
+    {
+	printf("level never came down\n");
+	return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,265 @@
+// cx10_replay.cpp
+//
+// Deterministic replay of a trace captured by cx10_redtx built with CX10_CAPTURE 1.
+//
+// The captured PPM edges are fed, at their original times, to the real RcTrainer
+// interrupt handler, and the real sketch (setup() and loop()) runs against the 
+// nRF24 model in host/ with each packet given the outcome it had in the field.
+// Every payload the sketch writes is compared with the captured one, and the 
+// host CPU time of each stage is reported. The exit status is non-zero if any
+// packet differs, so a capture from a real flight serves as a regression test 
+// for changes to the PPM decoder and packet path. A budget can be set for the
+// worst case simulated loop() time (up to its delay()); the exit status is 3 if it
+// is exceeded. Simulated time comes from the SPI traffic and delays in the host 
+// model, so it is the same on every run and every machine, but it is not a count
+// of AVR cycles. The host times are for comparison between runs on one machine
+// only; CX10_PROFILE measures the interrupt handler on the target.
+//
+// Capture:
+//   stty -F /dev/ttyACM0 115200 raw && cat /dev/ttyACM0 > flight.cap
+//
+// Build (from the top of the repository):
+//   g++ -O2 -DARDUINO=100 -Itools/host -ILibraries/SpscQueue -ILibraries/NRF24 -ILibraries/RcTrainer-1.0/RcTrainer
+//       -o cx10_replay tools/cx10_replay.cpp tools/host/host.cpp
+//       Libraries/NRF24/NRF24.cpp Libraries/RcTrainer-1.0/RcTrainer/RcTrainer.cpp
+//
+// Usage:
+//   cx10_replay [-v] [-l loop_us] flight.cap
+
+#include <host.h>
+#include <stdio.h>
+#include <string>
+
+// The sketch under test, with capture turned off
+#define CX10_CAPTURE 0
+#include "../cx10_redtx.ino"
+
+struct CapturedPacket
+{
+    uint32_t time;
+    bool     bind;
+    uint8_t  result;
+    uint8_t  polls;
+    uint8_t  data[PAYLOADSIZE];
+};
+
+static std::vector<uint32_t>       captureEdges;
+static std::vector<CapturedPacket> capturePackets;
+static uint32_t                    captureLost = 0;
+
+// Parse a capture stream, unwrapping the 16 bit timestamps. A packet record is 
+// written after the edges that arrived while it was in flight, so records are not
+// quite in time order, but they are never more than 32ms apart since a packet is 
+// sent every few milliseconds.
+static bool parseCapture(const std::vector<uint8_t>& buf)
+{
+    static const char magic[] = "CX10CAP1";
+    std::string s(buf.begin(), buf.end());
+    size_t i = s.find(magic);
+    if (i == std::string::npos)
+	return false;
+    i += 8;
+
+    uint32_t time = 0;
+    uint16_t last = 0;
+    bool first = true;
+    while (i < buf.size())
+    {
+	uint8_t tag = buf[i];
+	size_t len = tag == CAPTURE_EDGE ? 3 : tag == CAPTURE_PACKET ? 6 + PAYLOADSIZE : tag == CAPTURE_LOST ? 2 : 0;
+	if (!len)
+	{
+	    fprintf(stderr, "bad record tag 0x%02x at offset %zu\n", tag, i);
+	    return false;
+	}
+	if (i + len > buf.size())
+	    break; // Truncated final record
+	if (tag == CAPTURE_LOST)
+	{
+	    captureLost += buf[i + 1];
+	    i += len;
+	    continue;
+	}
+	uint16_t t = buf[i + 1] | (buf[i + 2] << 8);
+	if (first)
+	    time = t; // micros() starts at reset, so the first record is within 65ms of it
+	else
+	    time += (int16_t)(t - last);
+	last = t;
+	first = false;
+	if (tag == CAPTURE_EDGE)
+	    captureEdges.push_back(time);
+	else
+	{
+	    CapturedPacket p;
+	    p.time = time;
+	    p.bind = buf[i + 3];
+	    p.result = buf[i + 4];
+	    p.polls = buf[i + 5];
+	    memcpy(p.data, &buf[i + 6], PAYLOADSIZE);
+	    capturePackets.push_back(p);
+	}
+	i += len;
+    }
+    return true;
+}
+
+static void printPacket(const uint8_t* data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+	printf(" %02x", data[i]);
+}
+
+static void printStage(const char* name, const HostStageStats& s)
+{
+    printf("  %-14s %8u %10.0f %10llu\n", name, s.calls, s.calls ? (double)s.total_ns / s.calls : 0.0, 
+	   (unsigned long long)s.max_ns);
+}
+
+int main(int argc, char** argv)
+{
+    bool verbose = false;
+    const char* path = 0;
+    uint32_t loopBudget = 0;
+    for (int a = 1; a < argc; a++)
+    {
+	if (!strcmp(argv[a], "-v"))
+	    verbose = true;
+	else if (!strcmp(argv[a], "-l") && a + 1 < argc)
+	    loopBudget = atoi(argv[++a]);
+	else
+	    path = argv[a];
+    }
+    if (!path)
+    {
+	fprintf(stderr, "usage: %s [-v] [-l loop_us] capture\n", argv[0]);
+	return 2;
+    }
+
+    FILE* f = fopen(path, "rb");
+    if (!f)
+    {
+	perror(path);
+	return 2;
+    }
+    std::vector<uint8_t> buf;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+	buf.insert(buf.end(), chunk, chunk + n);
+    fclose(f);
+    if (!parseCapture(buf) || capturePackets.empty())
+    {
+	fprintf(stderr, "%s: no capture data\n", path);
+	return 2;
+    }
+
+    for (size_t i = 0; i < captureEdges.size(); i++)
+	host_queue_edge(0, captureEdges[i]);
+
+    // Each payload gets the outcome it had in the field
+    HostRadio& radio = host_radio();
+    radio.onTransmit = [&](const HostPayload&) {
+	size_t k = radio.transmitted.size() - 1;
+	HostRadio::Result r;
+	r.acked = k >= capturePackets.size() || capturePackets[k].result != PKT_TIMEOUT;
+	r.retries = 0;
+	return r;
+    };
+
+    // Once flying, start each loop() at the time its packet was captured, less the
+    // time the sketch took to get from the start of loop() to starting to write the
+    // payload last time round
+    bool flying = false;
+    uint32_t lead = 0, delayStart = 0;
+    host_delay_hook = [&](unsigned long ms) {
+	size_t k = radio.transmitted.size();
+	delayStart = host_now;
+	if (flying && k < capturePackets.size())
+	    host_advance_to(capturePackets[k].time - lead);
+	else
+	    host_advance(ms * 1000);
+    };
+
+    host_end_time = capturePackets.back().time + 50000;
+    HostStageStats setupStats = HostStageStats(), loopStats = HostStageStats();
+    uint64_t busyTotal = 0, busyMax = 0;
+    try
+    {
+	uint64_t start = host_clock_ns();
+	setup();
+	setupStats.add(host_clock_ns() - start);
+	flying = true;
+	if (radio.transmitted.size() < capturePackets.size())
+	    host_advance_to(capturePackets[radio.transmitted.size()].time);
+	while (radio.transmitted.size() < capturePackets.size())
+	{
+	    uint32_t loopStart = host_now;
+	    uint64_t isrBefore = host_isr_stats.total_ns;
+	    size_t k = radio.transmitted.size();
+	    start = host_clock_ns();
+	    loop();
+	    loopStats.add(host_clock_ns() - start - (host_isr_stats.total_ns - isrBefore));
+	    if (radio.transmitted.size() > k)
+	    {
+		lead = radio.transmitted[k].start - loopStart;
+		uint32_t busy = delayStart - loopStart;
+		busyTotal += busy;
+		if (busy > busyMax)
+		    busyMax = busy;
+	    }
+	}
+    }
+    catch (HostTimeout&)
+    {
+	fprintf(stderr, "replay ran past the end of the capture\n");
+    }
+    host_end_time = 0;
+
+    // Compare what the sketch sent with what was captured
+    uint32_t diverged = 0;
+    size_t count = radio.transmitted.size() < capturePackets.size() ? radio.transmitted.size() : capturePackets.size();
+    for (size_t k = 0; k < count; k++)
+    {
+	const HostPayload& sent = radio.transmitted[k];
+	const CapturedPacket& cap = capturePackets[k];
+	if (sent.data.size() == PAYLOADSIZE && !memcmp(&sent.data[0], cap.data, PAYLOADSIZE))
+	    continue;
+	if (verbose || !diverged)
+	{
+	    printf("packet %zu at %.3fms differs\n  captured:", k, (cap.time - capturePackets[0].time) / 1000.0);
+	    printPacket(cap.data, PAYLOADSIZE);
+	    printf("\n  replayed:");
+	    printPacket(&sent.data[0], sent.data.size());
+	    printf("\n");
+	}
+	diverged++;
+    }
+
+    uint32_t binds = 0, timeouts = 0;
+    for (size_t k = 0; k < capturePackets.size(); k++)
+    {
+	binds += capturePackets[k].bind;
+	timeouts += capturePackets[k].result == PKT_TIMEOUT;
+    }
+    printf("capture: %zu edges, %zu packets (%u bind, %u timed out), %u records lost\n", 
+	   captureEdges.size(), capturePackets.size(), binds, timeouts, captureLost);
+    printf("decoder: %u valid frames, %u rejected, %u channels\n", tx.frameCount(), tx.badFrameCount(), tx.channelCount());
+    printf("replay:  %zu packets sent, %u differ from capture\n", radio.transmitted.size(), diverged);
+    printf("host time per stage (ns):\n  %-14s %8s %10s %10s\n", "stage", "calls", "mean", "max");
+    printStage("ppm isr", host_isr_stats);
+    printStage("setup", setupStats);
+    printStage("loop", loopStats);
+    if (loopStats.calls)
+	printf("simulated loop time excluding delay (us): mean %.1f, max %llu\n", 
+	       (double)busyTotal / loopStats.calls, (unsigned long long)busyMax);
+
+    if (diverged || count < capturePackets.size())
+	return 1;
+    if (loopBudget && busyMax > loopBudget)
+    {
+	printf("loop budget of %uus exceeded\n", loopBudget);
+	return 3;
+    }
+    return 0;
+}
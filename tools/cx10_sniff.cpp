@@ -0,0 +1,603 @@
+// cx10_sniff.cpp
+//
+// Decodes a capture from the cx10_sniffer example (NRF24Sniffer records, see
+// NRF24Sniffer.h) into CX-10 bind packets, command packets, retransmissions and ACKs,
+// verifying the CX-10 checksums, and sums up the link: how many packets the quad
+// acknowledged, how soon, how often the transmitter sent again, and the gaps between
+// packets. -v prints every frame. -p searches raw frames (from a PROMISCUOUS capture, or
+// any that failed their CRC) for a frame with a 5 octet address and a 1 or 2 octet CRC
+// at every bit offset.
+//
+// With -s it runs the cx10_sniffer example itself against the nRF24 model in host/,
+// listening to a modelled CX-10 link: 60 bind packets, then a command packet every 8ms,
+// each sent up to 11 times until the transmitter hears an ACK. The quad misses packets
+// and the transmitter misses ACKs with the given probabilities. The modelled radio gets a
+// frame only if the address matches a pipe and it is not still clocking in the window of
+// the one before, as a real one. The capture is then decoded as above, and the frames in
+// it compared with those the radio received: the exit status is 1 if any were dropped.
+//
+// Build (from the top of the repository):
+//   g++ -O2 -DARDUINO=100 -Itools/host -ILibraries/SpscQueue -ILibraries/NRF24
+//       -o cx10_sniff tools/cx10_sniff.cpp tools/host/host.cpp Libraries/NRF24/*.cpp
+// Add -DPROMISCUOUS=1 to simulate the example's promiscuous mode, and decode with -s -p.
+//
+// Usage:
+//   cx10_sniff [-v] [-p] capture.bin
+//   cx10_sniff -s [-v] [-t seconds] [-q quad_loss] [-a ack_loss] [-e bit_error_rate] [-S seed]
+
+#include <host.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <random>
+#include <string>
+#include <vector>
+
+// The sniffer, for simulation
+#include "../Libraries/NRF24/examples/cx10_sniffer/cx10_sniffer.ino"
+
+#define ACK_WINDOW_US   1000    // An ACK comes this soon after its packet
+#define PERIOD_US       8000    // CX-10 command packet period
+#define GAP_US          12000   // Longer than this between packets is a gap
+
+static bool verbose = false;
+static bool promiscuous = false;
+
+/////////////////////////////////////////////////////////////////////
+// Enhanced ShockBurst frames, as bits
+
+// The nRF24 CRC of bits, MSB first, kept in the top of 16 bits as NRF24Sniffer does
+static uint16_t crcBits(uint16_t crc, uint16_t poly, const std::vector<uint8_t>& bits, size_t from, size_t n)
+{
+    for (size_t i = from; i < from + n; i++)
+    {
+	bool bit = ((crc >> 15) & 1) ^ bits[i];
+	crc <<= 1;
+	if (bit)
+	    crc ^= poly;
+    }
+    return crc;
+}
+
+static void putBits(std::vector<uint8_t>& bits, uint32_t value, int n)
+{
+    while (n--)
+	bits.push_back((value >> n) & 1);
+}
+
+static uint32_t getBits(const std::vector<uint8_t>& bits, size_t from, int n)
+{
+    uint32_t value = 0;
+    while (n--)
+	value = (value << 1) | bits[from++];
+    return value;
+}
+
+static std::vector<uint8_t> toBits(const uint8_t* data, size_t len)
+{
+    std::vector<uint8_t> bits;
+    for (size_t i = 0; i < len; i++)
+	putBits(bits, data[i], 8);
+    return bits;
+}
+
+// The bits of a frame on air: address (MSB first), packet control field, payload and CRC
+static std::vector<uint8_t> encodeFrame(const uint8_t* address, const std::vector<uint8_t>& payload,
+					uint8_t pid, bool noAck, int crcLen)
+{
+    std::vector<uint8_t> bits;
+    for (int i = 4; i >= 0; i--)
+	putBits(bits, address[i], 8);
+    putBits(bits, (payload.size() << 3) | (pid << 1) | noAck, 9);
+    for (size_t i = 0; i < payload.size(); i++)
+	putBits(bits, payload[i], 8);
+    uint16_t crc = crcBits(crcLen == 1 ? 0xff00 : 0xffff, crcLen == 1 ? 0x0700 : 0x1021, bits, 0, bits.size());
+    putBits(bits, crc >> (16 - 8 * crcLen), 8 * crcLen);
+    return bits;
+}
+
+// A frame found in raw bits
+struct Frame
+{
+    uint8_t              address[5];
+    uint8_t              pid;
+    bool                 noAck;
+    std::vector<uint8_t> payload;
+};
+
+// Looks for a valid frame starting at a bit offset
+static bool decodeAt(const std::vector<uint8_t>& bits, size_t at, int crcLen, Frame& frame)
+{
+    if (at + 40 + 9 + 8 * crcLen > bits.size())
+	return false;
+    uint8_t len = getBits(bits, at + 40, 6);
+    size_t n = 40 + 9 + 8 * len;
+    if (len > NRF24_MAX_MESSAGE_LEN || at + n + 8 * crcLen > bits.size())
+	return false;
+    uint16_t crc = crcBits(crcLen == 1 ? 0xff00 : 0xffff, crcLen == 1 ? 0x0700 : 0x1021, bits, at, n);
+    if ((uint32_t)(crc >> (16 - 8 * crcLen)) != getBits(bits, at + n, 8 * crcLen))
+	return false;
+    for (int i = 0; i < 5; i++)
+	frame.address[4 - i] = getBits(bits, at + 8 * i, 8);
+    frame.pid = getBits(bits, at + 46, 2);
+    frame.noAck = bits[at + 48];
+    frame.payload.clear();
+    for (int i = 0; i < len; i++)
+	frame.payload.push_back(getBits(bits, at + 49 + 8 * i, 8));
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////
+// The decoder
+
+struct Stats
+{
+    uint32_t records = 0, frames = 0, valid = 0, crcErrors = 0, found = 0, overruns = 0;
+    uint32_t bindPackets = 0, bindAcks = 0, commandPackets = 0, retransmissions = 0;
+    uint32_t checksumErrors = 0, acks = 0, ackPayloads = 0, loneAcks = 0, acked = 0, other = 0;
+    uint64_t ackDelayTotal = 0;
+    uint32_t ackDelayMin = 0xffffffff, ackDelayMax = 0;
+    uint32_t intervals = 0, gaps = 0;
+    uint64_t intervalTotal = 0;
+    uint32_t intervalMin = 0xffffffff, intervalMax = 0;
+};
+
+// The last packet seen on a pipe, to tell new packets, retransmissions and ACKs apart
+struct PipeState
+{
+    bool                 seen = false;
+    uint64_t             first;       // When it was first sent
+    uint64_t             last;        // When it was last sent
+    uint8_t              pid;
+    std::vector<uint8_t> payload;
+    bool                 acked;
+};
+
+static Stats stats;
+static PipeState pipes[2];
+static bool haveBind = false;
+static uint8_t boundAddress[5];
+static uint64_t now64;
+
+static bool cx10Checksum(const std::vector<uint8_t>& p)
+{
+    uint8_t sum = 0;
+    for (size_t i = 0; i + 1 < p.size(); i++)
+	sum += p[i];
+    return p.size() == PAYLOADSIZE && p[PAYLOADSIZE - 1] == (uint8_t)~sum;
+}
+
+static std::string hex(const std::vector<uint8_t>& data)
+{
+    std::string s;
+    char buf[4];
+    for (size_t i = 0; i < data.size(); i++)
+    {
+	snprintf(buf, sizeof(buf), "%s%02x", i ? " " : "", data[i]);
+	s += buf;
+    }
+    return s;
+}
+
+// A valid frame on the bind (0) or command (1) address
+static void frame(uint8_t pipe, uint8_t pid, bool noAck, const std::vector<uint8_t>& payload)
+{
+    PipeState& s = pipes[pipe];
+    const char* kind;
+    char detail[160] = "";
+
+    if (s.seen && pid == s.pid && payload == s.payload)
+    {
+	kind = "retransmission";
+	stats.retransmissions++;
+	s.last = now64;
+    }
+    else if (s.seen && pid == s.pid && now64 - s.last < ACK_WINDOW_US && !noAck)
+    {
+	// From the receiver: the same PID, straight after the packet
+	uint32_t delay = now64 - s.last;
+	kind = "ack";
+	stats.acks++;
+	if (pipe == BIND_PIPE)
+	    stats.bindAcks++;
+	if (payload.size())
+	    stats.ackPayloads++;
+	if (!s.acked)
+	{
+	    s.acked = true;
+	    stats.acked++;
+	}
+	stats.ackDelayTotal += delay;
+	stats.ackDelayMin = std::min(stats.ackDelayMin, delay);
+	stats.ackDelayMax = std::max(stats.ackDelayMax, delay);
+	snprintf(detail, sizeof(detail), "%uus after the packet%s%s", delay,
+		 payload.size() ? ", payload " : "", hex(payload).c_str());
+    }
+    else if (payload.size() == PAYLOADSIZE)
+    {
+	bool ok = cx10Checksum(payload);
+	if (!ok)
+	    stats.checksumErrors++;
+	if (pipe == BIND_PIPE)
+	{
+	    kind = "bind";
+	    stats.bindPackets++;
+	    if (ok)
+	    {
+		memcpy(boundAddress, &payload[0], 4);
+		boundAddress[4] = 0xc1;
+		haveBind = true;
+	    }
+	    snprintf(detail, sizeof(detail), "address %02x %02x %02x %02x c1%s",
+		     payload[0], payload[1], payload[2], payload[3], ok ? "" : " BAD CHECKSUM");
+	}
+	else
+	{
+	    kind = "command";
+	    stats.commandPackets++;
+	    if (s.seen)
+	    {
+		uint32_t interval = now64 - s.first;
+		stats.intervals++;
+		stats.intervalTotal += interval;
+		stats.intervalMin = std::min(stats.intervalMin, interval);
+		stats.intervalMax = std::max(stats.intervalMax, interval);
+		if (interval > GAP_US)
+		    stats.gaps++;
+	    }
+	    snprintf(detail, sizeof(detail), "thr %3u rud %3u/%3u ele %3u/%3u ail %3u/%3u flags %02x%s",
+		     payload[0], payload[1], payload[2], payload[3], payload[5], payload[4], payload[6],
+		     payload[7], ok ? "" : " BAD CHECKSUM");
+	}
+	s.seen = true;
+	s.first = s.last = now64;
+	s.pid = pid;
+	s.payload = payload;
+	s.acked = false;
+    }
+    else if (payload.empty())
+    {
+	// CX-10 packets are never empty, so this is an ACK to a packet that was missed
+	kind = "ack";
+	stats.acks++;
+	stats.loneAcks++;
+	snprintf(detail, sizeof(detail), "to a packet not seen");
+    }
+    else
+    {
+	kind = "other";
+	stats.other++;
+	snprintf(detail, sizeof(detail), "%s", hex(payload).c_str());
+    }
+    if (verbose)
+	printf("%10.3f %-7s pid %u%s %-14s %s\n", now64 / 1000.0, pipe == BIND_PIPE ? "bind" : "command",
+	       pid, noAck ? " noack" : "", kind, detail);
+}
+
+// Searches a raw frame for valid frames to a known address (or any, with nothing bound yet)
+static bool search(const uint8_t* data, uint8_t len)
+{
+    std::vector<uint8_t> bits = toBits(data, len);
+    Frame f;
+    for (size_t at = 0; at + 57 <= bits.size(); at++)
+    {
+	for (int crcLen = 1; crcLen <= 2; crcLen++)
+	{
+	    if (!decodeAt(bits, at, crcLen, f))
+		continue;
+	    uint8_t pipe;
+	    if (!memcmp(f.address, bindAddress, 5))
+		pipe = BIND_PIPE;
+	    else if (!haveBind || !memcmp(f.address, boundAddress, 5))
+		pipe = COMMAND_PIPE;
+	    else
+		continue;
+	    stats.found++;
+	    if (verbose)
+		printf("%10.3f found at bit %u, CRC %d, address %02x %02x %02x %02x %02x\n", now64 / 1000.0,
+		       (unsigned)at, crcLen, f.address[4], f.address[3], f.address[2], f.address[1], f.address[0]);
+	    frame(pipe, f.pid, f.noAck, f.payload);
+	    return true;
+	}
+    }
+    return false;
+}
+
+// Decodes a capture. Returns false if there is no capture in it
+static bool decode(const std::vector<uint8_t>& capture)
+{
+    const char* magic = NRF24_SNIFFER_MAGIC;
+    size_t magicLen = strlen(magic);
+    size_t i = 0;
+    while (i + magicLen <= capture.size() && memcmp(&capture[i], magic, magicLen))
+	i++;
+    if (i + magicLen > capture.size())
+	return false;
+    i += magicLen;
+
+    uint32_t last = 0;
+    bool first = true;
+    now64 = 0;
+    while (i + NRF24_SNIFFER_HEADER_LEN <= capture.size())
+    {
+	uint8_t flags = capture[i];
+	uint32_t time = capture[i + 1] | (capture[i + 2] << 8) | (capture[i + 3] << 16) | ((uint32_t)capture[i + 4] << 24);
+	uint8_t len = capture[i + 5];
+	if (i + NRF24_SNIFFER_HEADER_LEN + len > capture.size())
+	    break;
+	const uint8_t* data = &capture[i + NRF24_SNIFFER_HEADER_LEN];
+	i += NRF24_SNIFFER_HEADER_LEN + len;
+	stats.records++;
+
+	// micros() wraps every 71 minutes
+	if (!first)
+	    now64 += (uint32_t)(time - last);
+	first = false;
+	last = time;
+
+	if (flags & NRF24_SNIFFER_OVERRUN)
+	{
+	    stats.overruns += len ? data[0] : 0;
+	    if (verbose)
+		printf("%10.3f overrun: frames left in the radio %u times\n", now64 / 1000.0, len ? data[0] : 0);
+	    continue;
+	}
+	stats.frames++;
+	uint8_t pipe = flags & NRF24_SNIFFER_PIPE;
+	if (flags & NRF24_SNIFFER_VALID)
+	{
+	    stats.valid++;
+	    if (pipe > 1)
+		continue;
+	    frame(pipe, (flags & NRF24_SNIFFER_PID) >> NRF24_SNIFFER_PID_SHIFT, flags & NRF24_SNIFFER_NO_ACK,
+		  std::vector<uint8_t>(data, data + len));
+	}
+	else if (!promiscuous || !search(data, len))
+	{
+	    stats.crcErrors++;
+	    if (verbose)
+		printf("%10.3f pipe %u raw: %s\n", now64 / 1000.0, pipe, hex(std::vector<uint8_t>(data, data + len)).c_str());
+	}
+    }
+    return true;
+}
+
+static void report()
+{
+    printf("records %u: frames %u, valid %u, CRC errors %u, found by search %u, overruns %u\n",
+	   stats.records, stats.frames, stats.valid, stats.crcErrors, stats.found, stats.overruns);
+    printf("bind packets %u, ACKs %u", stats.bindPackets, stats.bindAcks);
+    if (haveBind)
+	printf(", command address %02x %02x %02x %02x %02x", boundAddress[0], boundAddress[1],
+	       boundAddress[2], boundAddress[3], boundAddress[4]);
+    printf("\ncommand packets %u, retransmissions %u, checksum errors %u, other frames %u\n",
+	   stats.commandPackets, stats.retransmissions, stats.checksumErrors, stats.other);
+    uint32_t packets = stats.bindPackets + stats.commandPackets;
+    printf("ACKs %u (%u with payload, %u to packets not seen), packets acknowledged %u of %u (%.1f%%)",
+	   stats.acks, stats.ackPayloads, stats.loneAcks, stats.acked, packets, packets ? 100.0 * stats.acked / packets : 0.0);
+    if (stats.acks)
+	printf(", ACK delay us min %u mean %llu max %u", stats.ackDelayMin,
+	       (unsigned long long)(stats.ackDelayTotal / stats.acks), stats.ackDelayMax);
+    printf("\n");
+    if (stats.intervals)
+	printf("command packet interval us: min %u mean %llu max %u, gaps over %ums %u\n", stats.intervalMin,
+	       (unsigned long long)(stats.intervalTotal / stats.intervals), stats.intervalMax, GAP_US / 1000, stats.gaps);
+}
+
+/////////////////////////////////////////////////////////////////////
+// The modelled CX-10 link, for -s
+
+static std::mt19937 rng(1);
+static double quadLoss = 0.1;
+static double ackLoss = 0.5;
+static double bitErrors = 0.0;
+static uint32_t received = 0;        // Frames the sniffer's radio took in
+static uint32_t missed = 0;          // Frames it could not, while busy with the one before
+static uint32_t radioBusyUntil = 0;
+static uint8_t linkAddress[5] = { 0x12, 0x34, 0x56, 0x78, 0xc1 };
+static uint8_t pid = 0;
+static int bindLeft = 60;
+static uint8_t throttle = 0;
+
+static bool chance(double p)
+{
+    return p > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < p;
+}
+
+// Microsecs per bit at the data rate the sniffer has set
+static uint32_t bitTime(uint8_t rfSetup)
+{
+    return (rfSetup & NRF24_RF_DR_LOW) ? 4 : 1;
+}
+
+// Puts a frame on air, starting now, for the sniffer's radio to take in if it can
+static void air(const uint8_t* address, const std::vector<uint8_t>& payload, uint8_t framePid)
+{
+    HostRadio& radio = host_radio();
+    std::vector<uint8_t> bits = encodeFrame(address, payload, framePid, false, 1);
+    for (size_t i = 0; i < bits.size(); i++)
+	if (chance(bitErrors))
+	    bits[i] ^= 1;
+
+    // Listening, on a matching address, and done with the frame before
+    uint8_t config = radio.reg(NRF24_REG_00_CONFIG);
+    if (!radio.chipEnabled() || !(config & NRF24_PWR_UP) || !(config & NRF24_PRIM_RX))
+	return;
+    // With a 2 octet address (SETUP_AW 0), taken to match the preamble, 0xaa if the address
+    // starts with a 1, else 0x55, so the window starts at the address
+    bool preamble = radio.reg(NRF24_REG_03_SETUP_AW) == 0;
+    int pipe;
+    for (pipe = 0; pipe < 2; pipe++)
+	if ((radio.reg(NRF24_REG_02_EN_RXADDR) & (1 << pipe))
+	    && (preamble ? radio.regBytes(NRF24_REG_0A_RX_ADDR_P0 + pipe)[0] == (bits[0] ? 0xaa : 0x55)
+		: !memcmp(radio.regBytes(NRF24_REG_0A_RX_ADDR_P0 + pipe), address, 5)))
+	    break;
+    if (pipe == 2)
+	return;
+    size_t skip = preamble ? 0 : 40;
+    if ((int32_t)(host_now - radioBusyUntil) < 0)
+    {
+	missed++;
+	return;
+    }
+    uint8_t window = radio.reg(NRF24_REG_11_RX_PW_P0 + pipe);
+    uint32_t us = bitTime(radio.reg(NRF24_REG_06_RF_SETUP));
+    radioBusyUntil = host_now + (8 + skip + 8 * window) * us;
+
+    // The window holds what follows the address, padded with noise if the frame is shorter
+    std::vector<uint8_t> raw(window, 0);
+    for (size_t i = skip; i < bits.size() && i < skip + 8u * window; i++)
+	raw[(i - skip) / 8] |= bits[i] << (7 - (i - skip) % 8);
+    host_at(radioBusyUntil, [pipe, raw]() {
+	host_radio().inject(pipe, &raw[0], raw.size());
+	received++;
+    });
+}
+
+static uint32_t airTime(uint8_t len)
+{
+    return 8 + 40 + 9 + 8 * len + 8;
+}
+
+static void packet();
+
+// One attempt at sending the current packet, and the ACK if the quad hears it
+static void attempt(const uint8_t* address, std::vector<uint8_t> payload, int tries)
+{
+    air(address, payload, pid);
+    uint32_t end = host_now + airTime(payload.size());
+    bool acked = false;
+    if (!chance(quadLoss))
+    {
+	uint8_t framePid = pid;
+	host_at(end + 130, [address, framePid]() { air(address, std::vector<uint8_t>(), framePid); });
+	acked = !chance(ackLoss);
+    }
+    if (acked || tries == 10)
+	// The transmitter moves on: at once while binding, else after its 8ms delay
+	host_at(end + 130 + airTime(0) + (bindLeft ? 100 : PERIOD_US), packet);
+    else
+	host_at(host_now + 500, [address, payload, tries]() { attempt(address, payload, tries + 1); });
+}
+
+// The next packet from the transmitter: bind packets first
+static void packet()
+{
+    static const uint8_t bindTail[4] = { 0x56, 0xaa, 0x32, 0x00 };
+    std::vector<uint8_t> payload;
+    const uint8_t* address;
+    if (bindLeft)
+    {
+	bindLeft--;
+	payload.assign(linkAddress, linkAddress + 4);
+	payload.insert(payload.end(), bindTail, bindTail + 4);
+	address = bindAddress;
+    }
+    else
+    {
+	throttle++;
+	uint8_t p[8] = { throttle, 0x80, 0x40, 0x80, 0x80, 0x40, 0x40, 0x00 };
+	payload.assign(p, p + 8);
+	address = linkAddress;
+    }
+    uint8_t sum = 0;
+    for (size_t i = 0; i < payload.size(); i++)
+	sum += payload[i];
+    payload.push_back(~sum);
+    pid = (pid + 1) & 3;
+    attempt(address, payload, 0);
+}
+
+static int simulate(uint32_t seconds)
+{
+    std::vector<uint8_t> capture;
+    host_serial_sink([&capture](uint8_t c) { capture.push_back(c); });
+    setup();
+    host_at(host_now + 1000, packet);
+
+    uint32_t end = host_now + seconds * 1000000;
+    while ((int32_t)(host_now - end) < 0)
+    {
+	uint32_t before = host_now;
+	loop();
+	if (host_now == before)
+	    host_advance(1);
+    }
+    loop();
+
+    if (!decode(capture))
+    {
+	fprintf(stderr, "no capture\n");
+	return 1;
+    }
+    report();
+    printf("link model: %u frames received by the sniffer's radio, %u missed while it was busy, %u in the capture\n",
+	   received, missed, stats.frames);
+    return stats.frames == received ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    bool sim = false;
+    uint32_t seconds = 10;
+    int opt;
+    while ((opt = getopt(argc, argv, "vpst:q:a:e:S:")) != -1)
+    {
+	switch (opt)
+	{
+	case 'v':
+	    verbose = true;
+	    break;
+	case 'p':
+	    promiscuous = true;
+	    break;
+	case 's':
+	    sim = true;
+	    break;
+	case 't':
+	    seconds = atoi(optarg);
+	    break;
+	case 'q':
+	    quadLoss = atof(optarg);
+	    break;
+	case 'a':
+	    ackLoss = atof(optarg);
+	    break;
+	case 'e':
+	    bitErrors = atof(optarg);
+	    break;
+	case 'S':
+	    rng.seed(atoi(optarg));
+	    break;
+	default:
+	    fprintf(stderr, "usage: %s [-v] [-p] capture.bin | -s [-v] [-t seconds] [-q quad_loss] [-a ack_loss] [-e bit_error_rate] [-S seed]\n", argv[0]);
+	    return 2;
+	}
+    }
+    if (sim)
+	return simulate(seconds);
+    if (optind >= argc)
+    {
+	fprintf(stderr, "usage: %s [-v] [-p] capture.bin | -s [-v] [-t seconds] [-q quad_loss] [-a ack_loss] [-e bit_error_rate] [-S seed]\n", argv[0]);
+	return 2;
+    }
+
+    FILE* f = fopen(argv[optind], "rb");
+    if (!f)
+    {
+	perror(argv[optind]);
+	return 1;
+    }
+    std::vector<uint8_t> capture;
+    int c;
+    while ((c = getc(f)) != EOF)
+	capture.push_back(c);
+    fclose(f);
+    if (!decode(capture))
+    {
+	fprintf(stderr, "%s: no capture found\n", argv[optind]);
+	return 1;
+    }
+    report();
+    return 0;
+}
@@ -0,0 +1,116 @@
+#!/bin/sh
+# footprint.sh
+#
+# Flash and RAM footprint report for an AVR build, with budgets. Run by
+# "make footprint" at the top of the repository, which builds cx10_redtx with
+# arduino-cli and a linker map. Can also be run on any ELF and its map.
+#
+# Prints the totals, the flash and RAM taken by each module (object file, or
+# archive for the Arduino core and the C and gcc libraries), and the largest
+# symbols in flash and in RAM. Flash is .text (code and PROGMEM data) plus the
+# initial values of .data; RAM is .data, .bss and .noinit, before the stack and
+# heap. The exit status is 1 if either total is over its budget.
+#
+# Usage:
+#   footprint.sh elf map flash_budget ram_budget [symbols]
+
+if [ $# -lt 4 ]; then
+    echo "usage: $0 elf map flash_budget ram_budget [symbols]" >&2
+    exit 2
+fi
+ELF=$1
+MAP=$2
+FLASH_BUDGET=$3
+RAM_BUDGET=$4
+SYMBOLS=${5:-15}
+SIZE=${AVR_SIZE:-avr-size}
+NM=${AVR_NM:-avr-nm}
+
+# Totals, from the output sections of the ELF
+set -- $($SIZE -A "$ELF" | awk '
+    $1 == ".text"   { text = $2 }
+    $1 == ".data"   { data = $2 }
+    $1 == ".bss"    { bss = $2 }
+    $1 == ".noinit" { noinit = $2 }
+    END { print text + data, data + bss + noinit }')
+FLASH=$1
+RAM=$2
+printf "%-28s %8s %8s\n" "" "flash" "ram"
+printf "%-28s %8d %8d\n" "total" "$FLASH" "$RAM"
+printf "%-28s %8d %8d\n" "budget" "$FLASH_BUDGET" "$RAM_BUDGET"
+echo
+
+# Per module, from the input sections in the memory map. Long input section names
+# put the address, size and file on the next line
+awk '
+    /^Linker script and memory map/ { started = 1; next }
+    !started { next }
+    /^[^ ]/ {
+	out = ""
+	if ($1 ~ /^\.(text|data|bss|noinit)$/)
+	    out = substr($1, 2)
+	pending = 0
+	next
+    }
+    out == "" { next }
+    pending && $1 ~ /^0x/ { add($2, $3); pending = 0; next }
+    /^ (\.|COMMON)/ {
+	if (NF == 1)
+	    pending = 1
+	else if ($2 ~ /^0x/ && NF >= 4)
+	    add($3, $4)
+	next
+    }
+    function add(size, file,    module) {
+	size = hex(size)
+	if (!size)
+	    return
+	module = file
+	if (module ~ /\(/)
+	    sub(/\(.*/, "", module)      # Archive member: count it to the archive
+	sub(/.*\//, "", module)
+	sub(/\.o$/, "", module)
+	sub(/\.a$/, "", module)
+	if (out == "text" || out == "data")
+	    flash[module] += size
+	if (out != "text")
+	    ram[module] += size
+	modules[module] = 1
+    }
+    function hex(s,    i, n) {
+	s = tolower(s)
+	sub(/^0x/, "", s)
+	for (i = 1; i <= length(s); i++)
+	    n = n * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+	return n
+    }
+    END {
+	for (m in modules)
+	    printf "%-28s %8d %8d\n", m, flash[m], ram[m]
+    }' "$MAP" | sort -k2,2nr
+
+# Largest symbols
+HEX='function hex(s,    i, n) {
+	s = tolower(s)
+	for (i = 1; i <= length(s); i++)
+	    n = n * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+	return n
+    }'
+echo
+echo "largest symbols in flash:"
+$NM -C -S --size-sort -r "$ELF" | awk '$3 ~ /^[tTdDrRwW]$/' | head -n "$SYMBOLS" |
+    awk "$HEX"' { size = $2; $1 = $2 = $3 = ""; sub(/^ +/, ""); printf "  %6d %s\n", hex(size), $0 }'
+echo "largest symbols in ram:"
+$NM -C -S --size-sort -r "$ELF" | awk '$3 ~ /^[bBdD]$/' | head -n "$SYMBOLS" |
+    awk "$HEX"' { size = $2; $1 = $2 = $3 = ""; sub(/^ +/, ""); printf "  %6d %s\n", hex(size), $0 }'
+
+STATUS=0
+if [ "$FLASH" -gt "$FLASH_BUDGET" ]; then
+    echo "flash budget of $FLASH_BUDGET exceeded by $((FLASH - FLASH_BUDGET))" >&2
+    STATUS=1
+fi
+if [ "$RAM" -gt "$RAM_BUDGET" ]; then
+    echo "ram budget of $RAM_BUDGET exceeded by $((RAM - RAM_BUDGET))" >&2
+    STATUS=1
+fi
+exit $STATUS
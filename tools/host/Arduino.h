@@ -0,0 +1,165 @@
+// Arduino.h
+//
+// Host (Linux) stand-in for the Arduino core, so that the libraries and the
+// cx10_redtx sketch can be compiled unchanged with g++ and driven by the
+// tools in this directory. Time is simulated: it only advances when the
+// code under test waits, talks to the radio or re-enables interrupts.
+// See host.h for the simulation controls.
+
+#ifndef HOST_ARDUINO_h
+#define HOST_ARDUINO_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef bool    boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT  0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// Uno pin assignments
+#define SS   10
+#define MOSI 11
+#define MISO 12
+#define SCK  13
+
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define _BV(bit) (1 << (bit))
+
+void     pinMode(uint8_t pin, uint8_t mode);
+void     digitalWrite(uint8_t pin, uint8_t val);
+int      digitalRead(uint8_t pin);
+int      analogRead(uint8_t pin);
+void     analogWrite(uint8_t pin, int val);
+void     analogReference(uint8_t mode);
+#define  INTERNAL 3
+#define  DEFAULT 1
+
+uint32_t micros();
+uint32_t millis();
+void     delay(unsigned long ms);
+void     delayMicroseconds(unsigned int us);
+
+void     attachInterrupt(uint8_t interrupt, void (*handler)(), int mode);
+void     detachInterrupt(uint8_t interrupt);
+void     noInterrupts();
+void     interrupts();
+
+// Interrupt vectors the host can raise. Define them with ISR() as on the target
+#define ISR(vector)  void vector()
+#define SPI_STC_vect host_spi_stc_vect
+#define TIMER1_COMPA_vect host_timer1_compa_vect
+
+// Timer1, as much of it as RcPpmEncoder uses: normal mode, counting at F_CPU / 8,
+// with output compare A driving OC1A (pin 9). Other modes and prescalers are not modelled
+#define F_CPU 16000000L
+#define COM1A1 7
+#define COM1A0 6
+#define CS11   1
+#define FOC1A  7
+#define OCIE1A 1
+#define OCF1A  1
+
+class HostTCNT1
+{
+public:
+    operator uint16_t() const;
+};
+
+class HostOCR1A
+{
+public:
+    HostOCR1A& operator=(uint16_t value);
+    operator uint16_t() const { return _value; }
+private:
+    uint16_t _value;
+};
+
+// Writing FOC1A forces the compare output action
+class HostTCCR1C
+{
+public:
+    HostTCCR1C& operator=(uint8_t value);
+    operator uint8_t() const { return 0; }
+};
+
+extern uint8_t    TCCR1A;
+extern uint8_t    TCCR1B;
+extern HostTCCR1C TCCR1C;
+extern uint8_t    TIMSK1;
+extern uint8_t    TIFR1;
+extern HostTCNT1  TCNT1;
+extern HostOCR1A  OCR1A;
+
+// The reset cause, power on unless a tool sets it before setup()
+#define PORF  0
+#define EXTRF 1
+#define BORF  2
+#define WDRF  3
+extern uint8_t    MCUSR;
+
+// Program memory. The host has one address space, so PROGMEM data is read directly
+#define PROGMEM
+#define PGM_P                 const char*
+#define pgm_read_byte(addr)   (*(const uint8_t*)(addr))
+#define pgm_read_word(addr)   (*(const uint16_t*)(addr))
+#define memcpy_P              memcpy
+#define memcmp_P              memcmp
+class __FlashStringHelper;
+#define F(s)                  (reinterpret_cast<const __FlashStringHelper*>(s))
+
+long     map(long x, long in_min, long in_max, long out_min, long out_max);
+long     random(long howbig);
+long     random(long howsmall, long howbig);
+void     randomSeed(unsigned long seed);
+
+// Minimal Print/Serial. Output goes to the sink installed with host_serial_sink(),
+// input comes from host_serial_input(). Both default to nothing.
+class HostSerial
+{
+public:
+    void   begin(unsigned long baud) { (void)baud; }
+    void   end() {}
+    int    available();
+    int    read();
+    int    peek();
+    int    availableForWrite() { return 64; }
+    void   flush() {}
+    size_t write(uint8_t c);
+    size_t write(const uint8_t* buf, size_t len);
+    size_t write(const char* str) { return write((const uint8_t*)str, strlen(str)); }
+    size_t write(const char* buf, size_t len) { return write((const uint8_t*)buf, len); }
+    size_t print(const char* s) { return write(s); }
+    size_t print(const __FlashStringHelper* s) { return write((const char*)s); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(int n, int base = DEC) { return print((long)n, base); }
+    size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(double n, int digits = 2);
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(T v) { size_t n = print(v); return n + println(); }
+    template <typename T> size_t println(T v, int f) { size_t n = print(v, f); return n + println(); }
+    operator bool() { return true; }
+};
+extern HostSerial Serial;
+
+#endif
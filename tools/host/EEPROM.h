@@ -0,0 +1,28 @@
+// EEPROM.h
+//
+// Host stand-in for the Arduino EEPROM library: 1024 bytes, as on Uno, erased
+// (0xff) at startup. Each write takes HOST_EEPROM_WRITE_US of
+// simulated time, as the erase and write do on the target. Tools can preload
+// or inspect the contents through host_eeprom.
+
+#ifndef HOST_EEPROM_h
+#define HOST_EEPROM_h
+
+#include <Arduino.h>
+
+#define HOST_EEPROM_SIZE     1024
+#define HOST_EEPROM_WRITE_US 3400
+
+extern uint8_t host_eeprom[HOST_EEPROM_SIZE];
+
+class EEPROMClass
+{
+public:
+    uint8_t  read(int address);
+    void     write(int address, uint8_t value);
+    void     update(int address, uint8_t value) { if (read(address) != value) write(address, value); }
+    uint16_t length() { return HOST_EEPROM_SIZE; }
+};
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,57 @@
+// SPI.h
+//
+// Host stand-in for the Arduino SPI library. Every byte transferred is
+// passed to the simulated nRF24 (see HostRadio in host.h), with the chip
+// select framing taken from digitalWrite() on the SS pin.
+
+#ifndef HOST_SPI_h
+#define HOST_SPI_h
+
+#include <Arduino.h>
+
+#define SPI_CLOCK_DIV4   0x00
+#define SPI_CLOCK_DIV16  0x01
+#define SPI_CLOCK_DIV64  0x02
+#define SPI_CLOCK_DIV128 0x03
+#define SPI_CLOCK_DIV2   0x04
+#define SPI_CLOCK_DIV8   0x05
+#define SPI_CLOCK_DIV32  0x06
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+class SPIClass
+{
+public:
+    static void    begin() {}
+    static void    end() {}
+    static void    setBitOrder(uint8_t order) { (void)order; }
+    static void    setDataMode(uint8_t mode) { (void)mode; }
+    static void    setClockDivider(uint8_t div) { (void)div; }
+    static uint8_t transfer(uint8_t data);
+};
+extern SPIClass SPI;
+
+// The SPI data, status and control registers, for code that drives the hardware directly.
+// Writing SPDR transfers a byte at once, so SPIF always reads as set. If SPIE is set in
+// SPCR, ISR(SPI_STC_vect) is then called as soon as interrupts are enabled.
+class HostSPDR
+{
+public:
+    HostSPDR& operator=(uint8_t data);
+    operator uint8_t() const;
+private:
+    uint8_t _received;
+};
+extern HostSPDR SPDR;
+extern uint8_t  SPCR;
+#define SPSR 0x80
+#define SPIF 7
+#define SPIE 7
+
+#endif
@@ -0,0 +1,751 @@
+// host.cpp
+//
+// Host implementation of the Arduino core subset, the SPI library and the 
+// nRF24L01 model used by the tools in this directory.
+
+#include <host.h>
+#include <SPI.h>
+#include <EEPROM.h>
+#include <util/atomic.h>
+#include <NRF24.h>
+#include <stdio.h>
+#include <time.h>
+#include <map>
+
+HostSerial Serial;
+SPIClass   SPI;
+HostSPDR   SPDR;
+uint8_t    SPCR = 0;
+uint8_t    TCCR1A = 0;
+uint8_t    TCCR1B = 0;
+HostTCCR1C TCCR1C;
+uint8_t    TIMSK1 = 0;
+uint8_t    TIFR1 = 0;
+HostTCNT1  TCNT1;
+HostOCR1A  OCR1A;
+uint8_t    MCUSR = _BV(PORF);
+EEPROMClass EEPROM;
+uint8_t    host_eeprom[HOST_EEPROM_SIZE];
+
+uint32_t host_now = 0;
+uint32_t host_end_time = 0;
+std::function<void(unsigned long ms)> host_delay_hook;
+HostStageStats host_isr_stats;
+
+#define HOST_MAX_INTERRUPTS 6
+#define HOST_CE_PIN  8
+#define HOST_CSN_PIN SS
+#define HOST_OC1A_PIN 9
+#define HOST_TIMER1_TICKS_PER_US (F_CPU / 8000000L)
+
+static void (*interruptHandlers[HOST_MAX_INTERRUPTS])();
+static std::deque<std::pair<uint32_t, uint8_t> > edges;
+static std::multimap<uint32_t, std::function<void()> > events;
+static bool interruptsEnabled = true;
+static int interruptDepth = 0;       // Handlers running, more than 1 if one re-enabled interrupts
+static std::function<void(uint8_t)> serialSink;
+static std::deque<uint8_t> serialInput;
+static uint32_t randomState = 1;
+static bool spiPending = false;
+static bool timer1Armed = false;     // OCR1A has been written
+static uint32_t timer1Match;         // Time of the next compare match
+static bool oc1aLevel = false;
+static bool oc1aPort = false;        // Port level, on the pin while OC1A is disconnected
+static int oc1aInterrupt = -1;
+
+// Defined by ISR() in the code under test, if it uses the interrupt
+void SPI_STC_vect() __attribute__((weak));
+void TIMER1_COMPA_vect() __attribute__((weak));
+
+uint64_t host_clock_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Entered and left around every interrupt handler. As on the AVR, a handler starts with
+// interrupts disabled, and they are enabled again when it returns. One that enables them
+// itself can be interrupted in turn
+struct HostHandler
+{
+    HostHandler()  { interruptDepth++; interruptsEnabled = false; }
+    ~HostHandler() { interruptDepth--; interruptsEnabled = true; }
+};
+
+// Run the SPI interrupt handler for as long as it keeps the SPI busy
+static void host_service_spi()
+{
+    while (spiPending && interruptsEnabled && (SPCR & _BV(SPIE)) && SPI_STC_vect)
+    {
+	spiPending = false;
+	HostHandler handler;
+	SPI_STC_vect();
+    }
+}
+
+// Run the handler for a latched fall of the radio's IRQ output
+static void host_service_irq()
+{
+    HostRadio& radio = host_radio();
+    if (!interruptsEnabled || radio.irqInterrupt < 0 || radio.irqInterrupt >= HOST_MAX_INTERRUPTS
+	|| !radio.takeIrqEdge() || !interruptHandlers[radio.irqInterrupt])
+	return;
+    HostHandler handler;
+    uint64_t start = host_clock_ns();
+    interruptHandlers[radio.irqInterrupt]();
+    host_isr_stats.add(host_clock_ns() - start);
+}
+
+// Run the handler attached to an interrupt
+static void host_run_handler(int interrupt)
+{
+    if (interrupt < 0 || interrupt >= HOST_MAX_INTERRUPTS || !interruptHandlers[interrupt])
+	return;
+    HostHandler handler;
+    uint64_t start = host_clock_ns();
+    interruptHandlers[interrupt]();
+    host_isr_stats.add(host_clock_ns() - start);
+}
+
+// Apply the compare output mode in TCCR1A to OC1A. Returns true if it rose
+static bool host_oc1a_action()
+{
+    bool level = oc1aLevel;
+    switch (TCCR1A & (_BV(COM1A1) | _BV(COM1A0)))
+    {
+	case _BV(COM1A0):
+	    level = !level;
+	    break;
+	case _BV(COM1A1):
+	    level = false;
+	    break;
+	case _BV(COM1A1) | _BV(COM1A0):
+	    level = true;
+	    break;
+    }
+    bool rising = level && !oc1aLevel;
+    oc1aLevel = level;
+    return rising;
+}
+
+static bool host_timer1_due(uint32_t time)
+{
+    return timer1Armed && (TCCR1B & 7) && (int32_t)(timer1Match - time) <= 0;
+}
+
+// A compare match: OC1A changes, then the handler for any interrupt wired to it
+// runs, then the compare interrupt
+static void host_timer1_match()
+{
+    // The next match is a whole count later, unless OCR1A is written meanwhile
+    timer1Match += 0x10000 / HOST_TIMER1_TICKS_PER_US;
+    if (host_oc1a_action())
+	host_run_handler(oc1aInterrupt);
+    if ((TIMSK1 & _BV(OCIE1A)) && TIMER1_COMPA_vect)
+    {
+	HostHandler handler;
+	uint64_t start = host_clock_ns();
+	TIMER1_COMPA_vect();
+	host_isr_stats.add(host_clock_ns() - start);
+    }
+}
+
+// Deliver edges, compare matches, SPI interrupts and events that are due, in time order,
+// then move time on. Interrupts are delivered while they are enabled, also to a handler
+// that enabled them; events only outside interrupt handlers
+void host_advance_to(uint32_t time)
+{
+    host_service_spi();
+    host_service_irq();
+    while (true)
+    {
+	bool edgeDue = interruptsEnabled && !edges.empty() && (int32_t)(edges.front().first - time) <= 0;
+	bool matchDue = interruptsEnabled && host_timer1_due(time);
+	// Events are keyed by absolute time, so are not expected to span a wrap of host_now
+	bool eventDue = !interruptDepth && !events.empty() && (int32_t)(events.begin()->first - time) <= 0;
+	if (!edgeDue && !matchDue && !eventDue)
+	    break;
+	// An edge goes before a compare match at the same time, and both before an event
+	bool match = matchDue && (!edgeDue || (int32_t)(timer1Match - edges.front().first) < 0);
+	uint32_t next = match ? timer1Match : edgeDue ? edges.front().first : 0;
+	if (eventDue && ((!edgeDue && !matchDue) || (int32_t)(events.begin()->first - next) < 0))
+	{
+	    std::function<void()> fn = events.begin()->second;
+	    if ((int32_t)(events.begin()->first - host_now) > 0)
+		host_now = events.begin()->first;
+	    events.erase(events.begin());
+	    host_radio().advanceTo(host_now);
+	    fn();
+	    host_service_irq();
+	    continue;
+	}
+	if ((int32_t)(next - host_now) > 0)
+	    host_now = next;
+	host_radio().advanceTo(host_now);
+	if (match)
+	    host_timer1_match();
+	else
+	{
+	    uint8_t interrupt = edges.front().second;
+	    edges.pop_front();
+	    host_run_handler(interrupt);
+	}
+    }
+    if ((int32_t)(time - host_now) > 0)
+	host_now = time;
+    host_radio().advanceTo(host_now);
+    host_service_irq();
+    if (host_end_time && (int32_t)(host_now - host_end_time) > 0)
+	throw HostTimeout();
+}
+
+void host_advance(uint32_t us)
+{
+    host_advance_to(host_now + us);
+}
+
+void host_queue_edge(uint8_t interrupt, uint32_t time)
+{
+    edges.push_back(std::make_pair(time, interrupt));
+}
+
+size_t host_pending_edges()
+{
+    return edges.size();
+}
+
+void host_wire(uint8_t pin, int interrupt)
+{
+    if (pin == HOST_OC1A_PIN)
+	oc1aInterrupt = interrupt;
+}
+
+void host_at(uint32_t time, std::function<void()> fn)
+{
+    events.insert(std::make_pair(time, fn));
+}
+
+void host_serial_sink(std::function<void(uint8_t)> sink)
+{
+    serialSink = sink;
+}
+
+void host_serial_input(const uint8_t* data, size_t len)
+{
+    serialInput.insert(serialInput.end(), data, data + len);
+}
+
+/////////////////////////////////////////////////////////////////////
+// Arduino core
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin; (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    if (pin == HOST_CSN_PIN)
+    {
+	if (val)
+	    host_radio().deselect();
+	else
+	    host_radio().select();
+    }
+    else if (pin == HOST_CE_PIN)
+	host_radio().setChipEnable(val);
+    else if (pin == HOST_OC1A_PIN)
+	oc1aPort = val;
+}
+
+int digitalRead(uint8_t pin)
+{
+    if (pin == HOST_OC1A_PIN)
+	return (TCCR1A & (_BV(COM1A1) | _BV(COM1A0))) ? oc1aLevel : oc1aPort;
+    return LOW;
+}
+
+int analogRead(uint8_t pin)
+{
+    (void)pin;
+    return 512;
+}
+
+void analogWrite(uint8_t pin, int val)
+{
+    (void)pin; (void)val;
+}
+
+void analogReference(uint8_t mode)
+{
+    (void)mode;
+}
+
+uint32_t micros()
+{
+    return host_now;
+}
+
+uint32_t millis()
+{
+    return host_now / 1000;
+}
+
+void delay(unsigned long ms)
+{
+    if (host_delay_hook)
+	host_delay_hook(ms);
+    else
+	host_advance(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    host_advance(us);
+}
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode)
+{
+    (void)mode;
+    if (interrupt < HOST_MAX_INTERRUPTS)
+	interruptHandlers[interrupt] = handler;
+}
+
+void detachInterrupt(uint8_t interrupt)
+{
+    if (interrupt < HOST_MAX_INTERRUPTS)
+	interruptHandlers[interrupt] = 0;
+}
+
+void noInterrupts()
+{
+    interruptsEnabled = false;
+}
+
+void interrupts()
+{
+    interruptsEnabled = true;
+    if (!interruptDepth)
+	host_advance(HOST_TICK_US);
+}
+
+bool host_interrupts_enabled()
+{
+    return interruptsEnabled;
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+long random(long howbig)
+{
+    if (howbig <= 0)
+	return 0;
+    randomState = randomState * 1103515245 + 12345;
+    return (randomState >> 8) % howbig;
+}
+
+long random(long howsmall, long howbig)
+{
+    if (howsmall >= howbig)
+	return howsmall;
+    return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed)
+{
+    if (seed)
+	randomState = seed;
+}
+
+int HostSerial::available()
+{
+    return serialInput.size();
+}
+
+int HostSerial::read()
+{
+    if (serialInput.empty())
+	return -1;
+    uint8_t c = serialInput.front();
+    serialInput.pop_front();
+    return c;
+}
+
+int HostSerial::peek()
+{
+    return serialInput.empty() ? -1 : serialInput.front();
+}
+
+size_t HostSerial::write(uint8_t c)
+{
+    if (serialSink)
+	serialSink(c);
+    return 1;
+}
+
+size_t HostSerial::write(const uint8_t* buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+	write(buf[i]);
+    return len;
+}
+
+size_t HostSerial::print(long n, int base)
+{
+    if (n < 0 && base == DEC)
+    {
+	write('-');
+	return print((unsigned long)-n, base) + 1;
+    }
+    return print((unsigned long)n, base);
+}
+
+size_t HostSerial::print(unsigned long n, int base)
+{
+    char buf[8 * sizeof(long) + 1];
+    char* p = &buf[sizeof(buf) - 1];
+    *p = 0;
+    do
+    {
+	unsigned long digit = n % base;
+	*--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+	n /= base;
+    } while (n);
+    return write(p);
+}
+
+size_t HostSerial::print(double n, int digits)
+{
+    char buf[40];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return write(buf);
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+    host_advance(HOST_SPI_BYTE_US);
+    return host_radio().transfer(data);
+}
+
+HostSPDR& HostSPDR::operator=(uint8_t data)
+{
+    _received = SPIClass::transfer(data);
+    spiPending = true;
+    host_service_spi();
+    return *this;
+}
+
+// Reading the data register clears SPIF
+HostSPDR::operator uint8_t() const
+{
+    spiPending = false;
+    return _received;
+}
+
+HostTCNT1::operator uint16_t() const
+{
+    return host_now * HOST_TIMER1_TICKS_PER_US;
+}
+
+HostOCR1A& HostOCR1A::operator=(uint16_t value)
+{
+    uint16_t ticks = value - (uint16_t)TCNT1;
+    _value = value;
+    timer1Match = host_now + ((ticks ? ticks : 0x10000) + HOST_TIMER1_TICKS_PER_US - 1) / HOST_TIMER1_TICKS_PER_US;
+    timer1Armed = true;
+    return *this;
+}
+
+// A forced compare changes OC1A but raises no compare interrupt. Nor is an interrupt
+// wired to OC1A told: RcPpmEncoder only forces it to the idle level
+HostTCCR1C& HostTCCR1C::operator=(uint8_t value)
+{
+    if (value & _BV(FOC1A))
+	host_oc1a_action();
+    return *this;
+}
+
+// Erased, as a new part
+static struct HostEepromErase
+{
+    HostEepromErase() { memset(host_eeprom, 0xff, sizeof(host_eeprom)); }
+} hostEepromErase;
+
+uint8_t EEPROMClass::read(int address)
+{
+    return host_eeprom[address % HOST_EEPROM_SIZE];
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+    host_advance(HOST_EEPROM_WRITE_US);
+    host_eeprom[address % HOST_EEPROM_SIZE] = value;
+}
+
+/////////////////////////////////////////////////////////////////////
+// nRF24L01 model
+
+HostRadio& host_radio()
+{
+    static HostRadio radio;
+    return radio;
+}
+
+HostRadio::HostRadio()
+{
+    irqInterrupt = -1;
+    reset();
+}
+
+void HostRadio::reset()
+{
+    memset(_regs, 0, sizeof(_regs));
+    _regs[NRF24_REG_00_CONFIG][0]     = NRF24_EN_CRC;
+    _regs[NRF24_REG_01_EN_AA][0]      = 0x3f;
+    _regs[NRF24_REG_02_EN_RXADDR][0]  = NRF24_ERX_P0 | NRF24_ERX_P1;
+    _regs[NRF24_REG_03_SETUP_AW][0]   = NRF24_AW_5_BYTES;
+    _regs[NRF24_REG_04_SETUP_RETR][0] = 0x03;
+    _regs[NRF24_REG_05_RF_CH][0]      = 0x02;
+    _regs[NRF24_REG_06_RF_SETUP][0]   = NRF24_RF_DR_HIGH | NRF24_PWR_0dBm;
+    memset(_regs[NRF24_REG_0A_RX_ADDR_P0], 0xe7, 5);
+    memset(_regs[NRF24_REG_0B_RX_ADDR_P1], 0xc2, 5);
+    _regs[NRF24_REG_0C_RX_ADDR_P2][0] = 0xc3;
+    _regs[NRF24_REG_0D_RX_ADDR_P3][0] = 0xc4;
+    _regs[NRF24_REG_0E_RX_ADDR_P4][0] = 0xc5;
+    _regs[NRF24_REG_0F_RX_ADDR_P5][0] = 0xc6;
+    memset(_regs[NRF24_REG_10_TX_ADDR], 0xe7, 5);
+    _ce = false;
+    _selected = false;
+    _txBusy = false;
+    _txFifo.clear();
+    _ackFifo.clear();
+    _rxFifo.clear();
+    _irqLow = false;
+    _irqEdge = false;
+    transmitted.clear();
+}
+
+uint8_t HostRadio::status() const
+{
+    uint8_t s = _regs[NRF24_REG_07_STATUS][0] & (NRF24_RX_DR | NRF24_TX_DS | NRF24_MAX_RT);
+    s |= (_rxFifo.empty() ? 7 : _rxFifo.front().first) << 1;
+    if (_txFifo.size() + _ackFifo.size() >= 3)
+	s |= NRF24_STATUS_TX_FULL;
+    return s;
+}
+
+uint16_t HostRadio::airTimeUs(uint8_t len) const
+{
+    uint8_t rf = _regs[NRF24_REG_06_RF_SETUP][0];
+    uint16_t bits = 8 * (1 + (_regs[NRF24_REG_03_SETUP_AW][0] + 2) + len) + 9;
+    bits += (_regs[NRF24_REG_00_CONFIG][0] & NRF24_CRCO) ? 16 : 8;
+    if (rf & NRF24_RF_DR_LOW)
+	return bits * 4;
+    if (rf & NRF24_RF_DR_HIGH)
+	return bits / 2;
+    return bits;
+}
+
+void HostRadio::select()
+{
+    _selected = true;
+    _selectTime = host_now;
+    _index = 0;
+}
+
+void HostRadio::deselect()
+{
+    if (!_selected)
+	return;
+    _selected = false;
+    if (_index == 0)
+	return;
+    if (_command == NRF24_COMMAND_W_TX_PAYLOAD || _command == NRF24_COMMAND_W_TX_PAYLOAD_NOACK)
+    {
+	_building.start = _selectTime;
+	_building.time = host_now;
+	_building.noack = (_command == NRF24_COMMAND_W_TX_PAYLOAD_NOACK);
+	if (_txFifo.size() + _ackFifo.size() < 3)
+	    _txFifo.push_back(_building);
+    }
+    else if ((_command & ~7) == NRF24_COMMAND_W_ACK_PAYLOAD(0))
+    {
+	if (_txFifo.size() + _ackFifo.size() < 3)
+	    _ackFifo.push_back(std::make_pair(_command & 7, _building.data));
+    }
+    else if (_command == NRF24_COMMAND_R_RX_PAYLOAD && _index > 1 && !_rxFifo.empty())
+	_rxFifo.pop_front();
+    startTx();
+    updateIrq();
+}
+
+uint8_t HostRadio::transfer(uint8_t mosi)
+{
+    if (!_selected)
+	return 0xff;
+    uint8_t index = _index++;
+    if (index == 0)
+    {
+	_command = mosi;
+	uint8_t s = status();
+	if (_command == NRF24_COMMAND_FLUSH_TX)
+	{
+	    _txFifo.clear();
+	    _ackFifo.clear();
+	    _txBusy = false;
+	}
+	else if (_command == NRF24_COMMAND_FLUSH_RX)
+	    _rxFifo.clear();
+	else if (_command == NRF24_COMMAND_W_TX_PAYLOAD || _command == NRF24_COMMAND_W_TX_PAYLOAD_NOACK
+		 || (_command & ~7) == NRF24_COMMAND_W_ACK_PAYLOAD(0))
+	    _building.data.clear();
+	return s;
+    }
+
+    uint8_t r = _command & NRF24_REGISTER_MASK;
+    if (_command <= 0x1f)
+    {
+	// R_REGISTER
+	if (r == NRF24_REG_07_STATUS)
+	    return status();
+	if (r == NRF24_REG_17_FIFO_STATUS)
+	    return (_txFifo.empty() && _ackFifo.empty() ? NRF24_TX_EMPTY : 0)
+		| (_txFifo.size() + _ackFifo.size() >= 3 ? NRF24_TX_FULL : 0)
+		| (_rxFifo.empty() ? NRF24_RX_EMPTY : 0) | (_rxFifo.size() >= 3 ? NRF24_RX_FULL : 0);
+	return _regs[r][(index - 1) % 5];
+    }
+    if (_command <= 0x3f)
+    {
+	// W_REGISTER
+	if (r == NRF24_REG_07_STATUS)
+	{
+	    _regs[r][0] &= ~(mosi & (NRF24_RX_DR | NRF24_TX_DS | NRF24_MAX_RT));
+	    startTx();
+	}
+	else if (r != NRF24_REG_17_FIFO_STATUS)
+	    _regs[r][index <= 5 ? index - 1 : 4] = mosi;
+	return 0;
+    }
+    if (_command == NRF24_COMMAND_R_RX_PL_WID)
+	return _rxFifo.empty() ? 0 : _rxFifo.front().second.size();
+    if (_command == NRF24_COMMAND_R_RX_PAYLOAD)
+    {
+	if (_rxFifo.empty() || index > _rxFifo.front().second.size())
+	    return 0;
+	return _rxFifo.front().second[index - 1];
+    }
+    if (_command == NRF24_COMMAND_W_TX_PAYLOAD || _command == NRF24_COMMAND_W_TX_PAYLOAD_NOACK
+	|| (_command & ~7) == NRF24_COMMAND_W_ACK_PAYLOAD(0))
+    {
+	if (_building.data.size() < 32)
+	    _building.data.push_back(mosi);
+	return 0;
+    }
+    return 0;
+}
+
+void HostRadio::startTx()
+{
+    uint8_t config = _regs[NRF24_REG_00_CONFIG][0];
+    if (_txBusy || !_ce || !(config & NRF24_PWR_UP) || (config & NRF24_PRIM_RX) || _txFifo.empty()
+	|| (_regs[NRF24_REG_07_STATUS][0] & NRF24_MAX_RT))
+	return;
+    const HostPayload& p = _txFifo.front();
+    transmitted.push_back(p);
+    if (onTransmit)
+	_txResult = onTransmit(p);
+    if (p.noack || !onTransmit)
+    {
+	_txResult.acked = true;
+	_txResult.retries = 0;
+	_txResult.ackPayload.clear();
+    }
+    _txBusy = true;
+    _txDone = host_now + txDurationUs(p, _txResult);
+}
+
+uint32_t HostRadio::txDurationUs(const HostPayload& p, const Result& r) const
+{
+    uint8_t retr = _regs[NRF24_REG_04_SETUP_RETR][0];
+    uint8_t arc = retr & NRF24_ARC;
+    uint32_t ard = 250 * (((retr & NRF24_ARD) >> 4) + 1);
+    uint8_t attempts = 1 + (r.acked ? r.retries : arc);
+    uint32_t duration = 130 + airTimeUs(p.data.size());
+    if (!p.noack)
+	duration += (attempts - 1) * ard + airTimeUs(r.ackPayload.size());
+    return duration;
+}
+
+void HostRadio::advanceTo(uint32_t time)
+{
+    while (_txBusy && (int32_t)(_txDone - time) <= 0)
+    {
+	_txBusy = false;
+	uint8_t plos = _regs[NRF24_REG_08_OBSERVE_TX][0] & NRF24_PLOS_CNT;
+	if (onComplete)
+	    onComplete(_txFifo.front(), _txResult);
+	if (_txResult.acked)
+	{
+	    _txFifo.pop_front();
+	    _regs[NRF24_REG_07_STATUS][0] |= NRF24_TX_DS;
+	    _regs[NRF24_REG_08_OBSERVE_TX][0] = plos | (_txResult.retries & NRF24_ARC_CNT);
+	    if (!_txResult.ackPayload.empty())
+		inject(0, &_txResult.ackPayload[0], _txResult.ackPayload.size());
+	}
+	else
+	{
+	    // Payload stays in the FIFO until flushed, and nothing more is sent until MAX_RT is cleared
+	    if (plos != NRF24_PLOS_CNT)
+		plos += 0x10;
+	    _regs[NRF24_REG_07_STATUS][0] |= NRF24_MAX_RT;
+	    _regs[NRF24_REG_08_OBSERVE_TX][0] = plos | (_regs[NRF24_REG_04_SETUP_RETR][0] & NRF24_ARC);
+	}
+	startTx();
+    }
+    updateIrq();
+}
+
+void HostRadio::updateIrq()
+{
+    // The mask bits in CONFIG line up with the flags in STATUS
+    bool low = _regs[NRF24_REG_07_STATUS][0] & ~_regs[NRF24_REG_00_CONFIG][0]
+	& (NRF24_RX_DR | NRF24_TX_DS | NRF24_MAX_RT);
+    if (low && !_irqLow)
+	_irqEdge = true;
+    _irqLow = low;
+}
+
+bool HostRadio::takeIrqEdge()
+{
+    bool edge = _irqEdge;
+    _irqEdge = false;
+    return edge;
+}
+
+bool HostRadio::takeAckPayload(uint8_t pipe, std::vector<uint8_t>& payload)
+{
+    std::deque<std::pair<uint8_t, std::vector<uint8_t> > >::iterator i;
+    for (i = _ackFifo.begin(); i != _ackFifo.end(); ++i)
+    {
+	if (i->first == pipe)
+	{
+	    payload = i->second;
+	    _ackFifo.erase(i);
+	    return true;
+	}
+    }
+    return false;
+}
+
+void HostRadio::inject(uint8_t pipe, const uint8_t* data, uint8_t len)
+{
+    if (_rxFifo.size() >= 3)
+	return;
+    _rxFifo.push_back(std::make_pair(pipe, std::vector<uint8_t>(data, data + len)));
+    _regs[NRF24_REG_07_STATUS][0] |= NRF24_RX_DR;
+    updateIrq();
+}
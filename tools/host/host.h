@@ -0,0 +1,159 @@
+// host.h
+//
+// Simulation controls for the host build of the libraries and sketch.
+//
+// Simulated time (host_now, in microseconds) advances by HOST_SPI_BYTE_US for every
+// SPI byte, by HOST_TICK_US every time interrupts are re-enabled, and by the
+// requested amount in delay() and delayMicroseconds(). Whenever it advances, queued
+// PPM edges, Timer1 compare matches and host_at() events whose time has come are
+// delivered, in time order, to their interrupt handlers, and the radio model completes
+// any transmission in progress. As on the AVR, interrupt handlers run with interrupts
+// disabled, and one that enables them can itself be interrupted.
+
+#ifndef HOST_h
+#define HOST_h
+
+#include <Arduino.h>
+#include <deque>
+#include <vector>
+#include <functional>
+
+#define HOST_SPI_BYTE_US 1
+#define HOST_TICK_US     1
+
+// Thrown out of the code under test when simulated time passes host_end_time
+struct HostTimeout {};
+
+extern uint32_t host_now;
+extern uint32_t host_end_time;
+
+// Advance simulated time to the given absolute time
+void host_advance_to(uint32_t time);
+void host_advance(uint32_t us);
+
+// Queue an edge on the given interrupt at an absolute time. Edges must be queued in time order
+void host_queue_edge(uint8_t interrupt, uint32_t time);
+size_t host_pending_edges();
+
+// Wire an output pin to an interrupt input: rising edges the host makes on the pin
+// (only OC1A, pin 9, makes any) are delivered to the handler attached to the interrupt.
+// interrupt -1 disconnects the pin
+void host_wire(uint8_t pin, int interrupt);
+
+// Call fn when simulated time reaches the given absolute time, outside interrupt context.
+// Used to model the other end of a radio link. Events may be scheduled in any order
+void host_at(uint32_t time, std::function<void()> fn);
+
+// Called instead of the default time advance by delay(), if set
+extern std::function<void(unsigned long ms)> host_delay_hook;
+
+// Accumulated host CPU time spent in interrupt handlers, in nanoseconds
+struct HostStageStats
+{
+    uint32_t calls;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    void     add(uint64_t ns) { calls++; total_ns += ns; if (ns > max_ns) max_ns = ns; }
+};
+extern HostStageStats host_isr_stats;
+uint64_t host_clock_ns();
+
+// Serial plumbing
+void host_serial_sink(std::function<void(uint8_t)> sink);
+void host_serial_input(const uint8_t* data, size_t len);
+
+// A transmitted payload and what happened to it
+struct HostPayload
+{
+    uint32_t             start;   // When chip select fell for the write
+    uint32_t             time;    // When the payload was written to the TX FIFO
+    bool                 noack;
+    std::vector<uint8_t> data;
+};
+
+// Behavioural model of an nRF24L01+ on the SPI bus. It implements the commands
+// the libraries use, the register file, the 3 deep TX and RX FIFOs and Enhanced
+// ShockBurst completion (TX_DS or MAX_RT) after a modelled air time. What happens
+// to each transmitted payload is decided by the onTransmit callback.
+class HostRadio
+{
+public:
+    // Outcome of a transmission as decided by onTransmit
+    struct Result
+    {
+        bool                 acked;       // TX_DS, else MAX_RT
+        uint8_t              retries;     // Reported in OBSERVE_TX
+        std::vector<uint8_t> ackPayload;  // Delivered to RX FIFO pipe 0 with TX_DS
+    };
+
+    HostRadio();
+    void    reset();
+
+    // SPI interface, driven by the host SPI and digitalWrite
+    void    select();
+    void    deselect();
+    uint8_t transfer(uint8_t mosi);
+    void    setChipEnable(bool ce) { _ce = ce; }
+
+    // Simulation
+    void    advanceTo(uint32_t time);
+    void    inject(uint8_t pipe, const uint8_t* data, uint8_t len);   // Packet received over the air
+
+    // Takes the payload loaded with W_ACK_PAYLOAD for the given pipe, as the radio does when it
+    // acknowledges a packet received on that pipe. Returns false, with payload unchanged, if none
+    bool    takeAckPayload(uint8_t pipe, std::vector<uint8_t>& payload);
+
+    // Decides the fate of each payload. Default: always acked, no retries, no ACK payload.
+    // Also called for NOACK payloads, so the far end can see them, but the result is
+    // ignored: they always complete with TX_DS straight after their air time
+    std::function<Result(const HostPayload&)> onTransmit;
+
+    // Called when a transmission completes (TX_DS or MAX_RT), with the result onTransmit gave
+    // it. Not called for a transmission cut short by FLUSH_TX
+    std::function<void(const HostPayload&, const Result&)> onComplete;
+
+    // Every payload transmitted, in order
+    std::vector<HostPayload> transmitted;
+
+    // External interrupt the IRQ output is wired to, or -1 (the default) if not connected.
+    // IRQ follows the STATUS flags not masked in CONFIG, and its falling edge is latched
+    // and delivered to the handler attached to the interrupt once interrupts are enabled
+    int     irqInterrupt;
+    bool    takeIrqEdge();
+
+    uint8_t reg(uint8_t r) const { return _regs[r & 0x1f][0]; }
+    // Changes a register behind the SPI bus, as a glitch would
+    void    poke(uint8_t r, uint8_t value) { _regs[r & 0x1f][0] = value; }
+    // All 5 octets of a register, for the addresses
+    const uint8_t* regBytes(uint8_t r) const { return _regs[r & 0x1f]; }
+    bool    chipEnabled() const { return _ce; }
+    uint16_t airTimeUs(uint8_t len) const;
+
+    // Time from starting to send a payload to TX_DS or MAX_RT, with the current settings
+    uint32_t txDurationUs(const HostPayload& p, const Result& r) const;
+
+private:
+    uint8_t  status() const;
+    void     startTx();
+    void     updateIrq();
+
+    uint8_t  _regs[0x20][5];
+    bool     _ce;
+    bool     _selected;
+    uint32_t _selectTime;
+    uint8_t  _command;
+    uint8_t  _index;
+    HostPayload _building;
+    std::deque<HostPayload> _txFifo;
+    std::deque<std::pair<uint8_t, std::vector<uint8_t> > > _ackFifo;  // PRX: ACK payloads by pipe
+    std::deque<std::pair<uint8_t, std::vector<uint8_t> > > _rxFifo;
+    bool     _txBusy;
+    uint32_t _txDone;
+    Result   _txResult;
+    bool     _irqLow;
+    bool     _irqEdge;
+};
+
+HostRadio& host_radio();
+
+#endif
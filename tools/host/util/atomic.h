@@ -0,0 +1,28 @@
+// util/atomic.h
+//
+// Host stand-in for the avr-libc ATOMIC_BLOCK macro. The block runs with interrupts
+// disabled; at its end ATOMIC_RESTORESTATE puts them back as they were, and
+// ATOMIC_FORCEON enables them.
+
+#ifndef HOST_UTIL_ATOMIC_h
+#define HOST_UTIL_ATOMIC_h
+
+#include <Arduino.h>
+
+bool host_interrupts_enabled();
+
+class HostAtomic
+{
+public:
+    HostAtomic(bool enable) : _enable(enable) { noInterrupts(); }
+    ~HostAtomic() { if (_enable) interrupts(); }
+private:
+    bool _enable;
+};
+
+#define ATOMIC_RESTORESTATE host_interrupts_enabled()
+#define ATOMIC_FORCEON      true
+#define ATOMIC_BLOCK(type) \
+    for (HostAtomic host_atomic(type), *host_atomic_once = &host_atomic; host_atomic_once; host_atomic_once = 0)
+
+#endif
@@ -0,0 +1,173 @@
+// nrf24_bench.cpp
+//
+// Runs the nrf24_bench_client example against the nRF24 model in host/, with the
+// far end played by a model of nrf24_bench_server, and prints the client's CSV on
+// stdout. The client sketch is compiled unchanged, so its results can be set beside
+// a run on real hardware to compare configurations before flying them.
+//
+// The link model: each transmission (each attempt, each acknowledgement, each reply)
+// is lost independently with the given probability, the server starts a reply the
+// given turnaround time after a packet arrives, and air times follow the data rate and
+// payload size. Both ends are assumed to switch configuration together.
+//
+// Build (from the top of the repository):
+//   g++ -O2 -DARDUINO=100 -Itools/host -ILibraries/SpscQueue -ILibraries/NRF24
+//       -o nrf24_bench tools/nrf24_bench.cpp tools/host/host.cpp Libraries/NRF24/NRF24.cpp
+//
+// Usage:
+//   nrf24_bench [-l loss] [-t turnaround_us] [-s seed] > results.csv
+
+#include <host.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <random>
+
+// The client under test
+#include "../Libraries/NRF24/examples/nrf24_bench_client/nrf24_bench_client.ino"
+
+#define SERVER_PIPE 1  // Replies arrive on the client's own address
+
+static double       loss = 0.0;
+static uint32_t     turnaround = 250;
+static std::mt19937 rng(1);
+
+// State of the modelled server
+static bool         serverInCase = false;
+static uint8_t      serverMode;
+static uint8_t      serverSize;
+static uint16_t     serverReceived;
+static bool         serverGetsPacket; // Whether the transmission in progress will reach the server
+
+static bool lost()
+{
+    return loss > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < loss;
+}
+
+// Send a reply from the server, starting at the given time, with the retry settings
+// the client has (both ends are configured alike)
+static void serverSend(uint32_t start, const std::vector<uint8_t>& data, bool noack)
+{
+    HostRadio& radio = host_radio();
+    uint8_t retr = radio.reg(NRF24_REG_04_SETUP_RETR);
+    uint8_t attempts = noack ? 1 : 1 + (retr & NRF24_ARC);
+    uint32_t ard = 250 * (((retr & NRF24_ARD) >> 4) + 1);
+    uint8_t i;
+
+    for (i = 0; i < attempts; i++)
+    {
+	if (!lost())
+	{
+	    uint32_t arrival = start + 130 + radio.airTimeUs(data.size()) + i * ard;
+	    host_at(arrival, [data]() { host_radio().inject(SERVER_PIPE, &data[0], data.size()); });
+	    return;
+	}
+    }
+}
+
+// What the server does with a packet that reached it, once the client has finished sending it at done
+static void serverReceive(const HostPayload& p, uint32_t done)
+{
+    if (p.data.size() < 2)
+	return;
+    switch (p.data[0])
+    {
+    case BENCH_CASE:
+    {
+	uint8_t c = p.data[1] / BENCH_RETRIES;
+	serverMode = c % BENCH_MODES;
+	serverSize = benchSizes[(c / BENCH_MODES) % sizeof(benchSizes)];
+	serverInCase = true;
+	serverReceived = 0;
+	break;
+    }
+
+    case BENCH_PING:
+	if (serverInCase && serverMode != BENCH_MODE_ACKPAY)
+	    serverSend(done + turnaround, p.data, serverMode == BENCH_MODE_NOACK);
+	break;
+
+    case BENCH_DATA:
+	serverReceived++;
+	break;
+
+    case BENCH_STATS:
+    {
+	std::vector<uint8_t> reply(4);
+	reply[0] = BENCH_STATS;
+	reply[2] = serverReceived & 0xff;
+	reply[3] = serverReceived >> 8;
+	serverSend(done + turnaround, reply, false);
+	serverInCase = false;
+	break;
+    }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "l:t:s:")) != -1)
+    {
+	switch (opt)
+	{
+	case 'l':
+	    loss = atof(optarg);
+	    break;
+	case 't':
+	    turnaround = atoi(optarg);
+	    break;
+	case 's':
+	    rng.seed(atoi(optarg));
+	    break;
+	default:
+	    fprintf(stderr, "usage: %s [-l loss] [-t turnaround_us] [-s seed]\n", argv[0]);
+	    return 2;
+	}
+    }
+
+    HostRadio& radio = host_radio();
+    radio.onTransmit = [&](const HostPayload& p) {
+	HostRadio::Result r;
+	bool delivered = false;
+	r.acked = false;
+	r.retries = 0;
+
+	if (p.noack)
+	    delivered = !lost();
+	else
+	{
+	    // The server gets the packet on the first attempt that arrives, and the
+	    // client sees TX_DS on the first attempt whose acknowledgement arrives too
+	    uint8_t arc = radio.reg(NRF24_REG_04_SETUP_RETR) & NRF24_ARC;
+	    uint8_t i;
+	    for (i = 0; i <= arc && !r.acked; i++)
+	    {
+		if (lost())
+		    continue;
+		delivered = true;
+		if (!lost())
+		{
+		    r.acked = true;
+		    r.retries = i;
+		}
+	    }
+	    if (r.acked && serverInCase && serverMode == BENCH_MODE_ACKPAY)
+	    {
+		r.ackPayload.assign(serverSize, 0);
+		r.ackPayload[0] = BENCH_ACKPAY;
+	    }
+	}
+	serverGetsPacket = delivered;
+	return r;
+    };
+    radio.onComplete = [&](const HostPayload& p, const HostRadio::Result& r) {
+	(void)r;
+	if (serverGetsPacket)
+	    serverReceive(p, host_now);
+    };
+
+    host_serial_sink([](uint8_t c) { putchar(c); });
+    setup();
+    fflush(stdout);
+    return 0;
+}
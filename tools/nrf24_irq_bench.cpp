@@ -0,0 +1,186 @@
+// nrf24_irq_bench.cpp
+//
+// Runs the nrf24_irq_rx example, the interrupt driven receive queue, against the nRF24
+// model in host/, with its IRQ output wired to interrupt 0 as on D2.
+//
+// A modelled nrf24_audio_tx sends a 32 octet packet every TX_PERIOD_US (286 per sec),
+// with its sequence number in the first octet, and every SKIP_EVERY'th is lost on the
+// way, so the example's loss count can be checked. The example spends 15ms of each
+// loop() in a busy wait, longer than the 3 packet RX FIFO lasts, so every packet has to
+// be moved to the queue by the IRQ handler. Meanwhile a stream of edges, one every
+// EDGE_PERIOD_US as from a PPM signal, arrives on interrupt 1, and the time from each
+// edge to its handler is measured: the handler is held up only while interrupts are
+// disabled, as they were for the whole of a drain of the RX FIFO before the IRQ
+// handler learnt to enable them.
+//
+// Prints the example's once a second reports with -v, then the packets received and
+// lost against those sent and skipped, the queue counts and the edge latency. The exit
+// status is 1 if a packet is missing, the loss count is wrong or disableRxInterrupt()
+// does not put the IRQ masks back as they were, and 3 if the worst edge latency
+// exceeds the budget.
+//
+// Build (from the top of the repository):
+//   g++ -O2 -DARDUINO=100 -Itools/host -ILibraries/SpscQueue -ILibraries/NRF24
+//       -o nrf24_irq_bench tools/nrf24_irq_bench.cpp tools/host/host.cpp Libraries/NRF24/NRF24.cpp
+//
+// Usage:
+//   nrf24_irq_bench [-v] [-s seconds] [-b edge_budget_us]
+
+#include <host.h>
+#include <stdio.h>
+#include <deque>
+#include <string>
+
+// The receiver under test
+#include "../Libraries/NRF24/examples/nrf24_irq_rx/nrf24_irq_rx.ino"
+
+#define TX_PIPE        1
+#define TX_PERIOD_US   3497
+#define SKIP_EVERY     50
+#define EDGE_INTERRUPT 1
+#define EDGE_PERIOD_US 1013
+
+static bool     verbose = false;
+
+// The transmitter
+static uint8_t  txSequence = 0;
+static uint32_t txSent = 0;
+static uint32_t txSkipped = 0;
+static uint32_t txSkippedReported = 0; // Skipped before the last packet sent, so seen as a gap
+static uint32_t txEnd;
+
+// The example's reports, added up
+static uint32_t rxPackets = 0;
+static uint32_t rxLost = 0;
+static uint32_t rxOverruns = 0;
+static uint32_t rxDeferred = 0;
+static std::string line;
+
+// The edges, and how long each waited for its handler
+static std::deque<uint32_t> edgeTimes;
+static uint32_t edgeCount = 0;
+static uint64_t edgeTotal = 0;
+static uint32_t edgeMax = 0;
+
+static void transmit(uint32_t time)
+{
+    host_at(time, [time]() {
+	uint8_t data[RX_PAYLOAD];
+	memset(data, 0, sizeof(data));
+	data[0] = txSequence++;
+	if (data[0] % SKIP_EVERY == SKIP_EVERY - 1)
+	    txSkipped++;
+	else
+	{
+	    host_radio().inject(TX_PIPE, data, sizeof(data));
+	    txSent++;
+	    txSkippedReported = txSkipped;
+	}
+	if (time + TX_PERIOD_US < txEnd)
+	    transmit(time + TX_PERIOD_US);
+    });
+}
+
+static void edge()
+{
+    uint32_t latency = micros() - edgeTimes.front();
+    edgeTimes.pop_front();
+    edgeCount++;
+    edgeTotal += latency;
+    if (latency > edgeMax)
+	edgeMax = latency;
+}
+
+static void serial(uint8_t c)
+{
+    if (c == '\r')
+	return;
+    if (c != '\n')
+    {
+	line += c;
+	return;
+    }
+    unsigned p, l, o, d;
+    if (sscanf(line.c_str(), "packets %u lost %u overruns %u deferred %u", &p, &l, &o, &d) == 4)
+    {
+	rxPackets += p;
+	rxLost += l;
+	rxOverruns += o;
+	rxDeferred += d;
+    }
+    if (verbose)
+	printf("%s\n", line.c_str());
+    line.clear();
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t seconds = 10;
+    uint32_t budget = 10;
+    for (int a = 1; a < argc; a++)
+    {
+	if (!strcmp(argv[a], "-v"))
+	    verbose = true;
+	else if (!strcmp(argv[a], "-s") && a + 1 < argc)
+	    seconds = atoi(argv[++a]);
+	else if (!strcmp(argv[a], "-b") && a + 1 < argc)
+	    budget = atoi(argv[++a]);
+	else
+	{
+	    fprintf(stderr, "usage: %s [-v] [-s seconds] [-b edge_budget_us]\n", argv[0]);
+	    return 2;
+	}
+    }
+
+    host_radio().irqInterrupt = RX_INTERRUPT;
+    host_serial_sink(serial);
+    setup();
+    attachInterrupt(EDGE_INTERRUPT, edge, RISING);
+
+    uint32_t start = host_now + 1000;
+    uint32_t end = start + seconds * 1000000;
+    txEnd = end;
+    transmit(start);
+    for (uint32_t t = start; t < end; t += EDGE_PERIOD_US)
+    {
+	host_queue_edge(EDGE_INTERRUPT, t);
+	edgeTimes.push_back(t);
+    }
+
+    // Run a little past the last packet, so it is taken from the queue and counted
+    host_end_time = end + 2 * BUSY_MICROS;
+    try
+    {
+	while (true)
+	    loop();
+    }
+    catch (HostTimeout&)
+    {
+    }
+    host_end_time = 0;
+    rxPackets += packets;
+    rxLost += lost;
+    NRF24RxStats stats = nrf24.rxStats();
+    rxOverruns += stats.overruns;
+    rxDeferred += stats.deferred;
+
+    printf("packets %u of %u sent, lost %u of %u skipped, overruns %u, deferred %u\n",
+	   rxPackets, txSent, rxLost, txSkippedReported, rxOverruns, rxDeferred);
+    printf("edge latency (us): mean %.1f, max %u, over %u edges\n",
+	   edgeCount ? (double)edgeTotal / edgeCount : 0.0, edgeMax, edgeCount);
+
+    // Stopping the queue puts the IRQ masks back as the example had them: none
+    nrf24.disableRxInterrupt();
+    uint8_t masks = host_radio().reg(NRF24_REG_00_CONFIG) & (NRF24_MASK_RX_DR | NRF24_MASK_TX_DS | NRF24_MASK_MAX_RT);
+    if (masks)
+	printf("IRQ masks 0x%02x left in CONFIG by disableRxInterrupt()\n", masks);
+
+    if (rxPackets != txSent || rxLost != txSkippedReported || masks)
+	return 1;
+    if (edgeMax > budget)
+    {
+	printf("edge latency budget of %uus exceeded\n", budget);
+	return 3;
+    }
+    return 0;
+}
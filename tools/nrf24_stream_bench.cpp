@@ -0,0 +1,323 @@
+// nrf24_stream_bench.cpp
+//
+// Runs NRF24Stream against the nRF24 model in host/ and measures its goodput.
+//
+// Sender: sendStream() is called for a range of buffer lengths, sent NOACK and
+// acknowledged, with each transmission (each attempt, and each acknowledgement) lost
+// independently with probability 0, 1%, 10% and 30%. The far end is a model of
+// recvStream() that reassembles the fragments that reach it and answers each poll
+// that gets through with its status in the ACK payload, as the library's receiver
+// does. The sender uses an auto retransmit delay of 500us and 15 retries, as the
+// nrf24_stream_client example does.
+//
+// Receiver: fragments of a 1500 octet buffer are fed to recvStream() with 20% loss,
+// followed by a poll, and the missing ones are resent from the status it loads,
+// until it reports the buffer complete. A fragment repeated afterwards must be
+// answered with a complete status and not start a new buffer.
+//
+// Stall: the radio is reset (CONFIG back to its power on value) after the first
+// fragment, so the poll never ends in TX_DS or MAX_RT, and sendStream() must give
+// up by its timeout.
+//
+// Prints the time and goodput of the largest buffer for each mode and loss, or of
+// every buffer with -v. The exit status is 1 if any transfer fails or delivers the
+// wrong data, the receiver does not reassemble its buffer, or the stalled send does
+// not return in time.
+//
+// Build (from the top of the repository):
+//   g++ -O2 -DARDUINO=100 -Itools/host -ILibraries/SpscQueue -ILibraries/NRF24
+//       -o nrf24_stream_bench tools/nrf24_stream_bench.cpp tools/host/host.cpp
+//       Libraries/NRF24/NRF24.cpp Libraries/NRF24/NRF24Stream.cpp
+//
+// Usage:
+//   nrf24_stream_bench [-v] [-r 250k|1M|2M] [-s seed]
+
+#include <host.h>
+#include <NRF24Stream.h>
+#include <stdio.h>
+#include <string.h>
+#include <random>
+
+#define SEND_TIMEOUT_MS 5000
+#define RX_LEN          1500
+#define RX_LOSS         0.2
+#define RX_ROUNDS       20
+#define FRAGMENT_GAP_US 300
+
+static double       loss = 0.0;
+static std::mt19937 rng(1);
+
+// State of the modelled receiver
+static uint8_t      rxBuf[NRF24_STREAM_MAX_LEN];
+static uint8_t      rxBitmap[NRF24_STREAM_MAX_FRAGMENTS / 8];
+static int          rxId = -1;
+static uint16_t     rxFragments;
+static uint16_t     rxLen;
+
+static bool lost()
+{
+    return loss > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < loss;
+}
+
+static bool has(const uint8_t* bitmap, uint16_t i)
+{
+    return bitmap[i / 8] & (1 << (i % 8));
+}
+
+// The status the modelled receiver loads as its ACK payload
+static std::vector<uint8_t> rxStatus()
+{
+    std::vector<uint8_t> status(NRF24_MAX_MESSAGE_LEN, 0);
+    uint16_t first = 0;
+    while (first < NRF24_STREAM_MAX_FRAGMENTS && has(rxBitmap, first))
+	first++;
+    uint8_t base = first / 8;
+    status[0] = NRF24_STREAM_STATUS | (rxFragments && first >= rxFragments ? NRF24_STREAM_COMPLETE : 0);
+    status[1] = rxId;
+    status[2] = base * 8;
+    for (uint8_t i = 0; i < NRF24_STREAM_WINDOW / 8 && base + i < (int)sizeof(rxBitmap); i++)
+	status[NRF24_STREAM_HEADER_LEN + i] = rxBitmap[base + i];
+    return status;
+}
+
+static void rxFrame(const std::vector<uint8_t>& d)
+{
+    if (d[1] != rxId)
+    {
+	rxId = d[1];
+	memset(rxBitmap, 0, sizeof(rxBitmap));
+	rxFragments = 0;
+    }
+    if ((d[0] & NRF24_STREAM_TYPE) != NRF24_STREAM_DATA)
+	return;
+    uint16_t offset = (uint16_t)d[2] * NRF24_STREAM_FRAGMENT_LEN;
+    memcpy(rxBuf + offset, &d[NRF24_STREAM_HEADER_LEN], d.size() - NRF24_STREAM_HEADER_LEN);
+    rxBitmap[d[2] / 8] |= 1 << (d[2] % 8);
+    if (d[0] & NRF24_STREAM_LAST)
+    {
+	rxFragments = d[2] + 1;
+	rxLen = offset + d.size() - NRF24_STREAM_HEADER_LEN;
+    }
+}
+
+static HostRadio::Result transmit(const HostPayload& p)
+{
+    HostRadio& radio = host_radio();
+    HostRadio::Result r;
+    r.acked = false;
+    r.retries = 0;
+
+    bool delivered = false;
+    if (p.noack)
+	delivered = !lost();
+    else
+    {
+	uint8_t arc = radio.reg(NRF24_REG_04_SETUP_RETR) & NRF24_ARC;
+	for (uint8_t i = 0; i <= arc && !r.acked; i++)
+	{
+	    if (lost())
+		continue;
+	    delivered = true;
+	    if (!lost())
+	    {
+		r.acked = true;
+		r.retries = i;
+	    }
+	}
+    }
+    if (delivered && p.data.size() >= NRF24_STREAM_HEADER_LEN)
+	rxFrame(p.data);
+    if (r.acked && (p.data[0] & NRF24_STREAM_TYPE) == NRF24_STREAM_POLL)
+	r.ackPayload = rxStatus();
+    return r;
+}
+
+// Sends every length at every loss, and returns the number of failures
+static unsigned benchSend(NRF24Stream& stream, const uint8_t* data, bool verbose)
+{
+    static const double losses[] = { 0, 0.01, 0.1, 0.3 };
+    static const uint16_t lens[] = { 0, 1, NRF24_STREAM_FRAGMENT_LEN, NRF24_STREAM_FRAGMENT_LEN + 1, 1000, NRF24_STREAM_MAX_LEN };
+    unsigned failures = 0;
+
+    printf("mode   loss  length     time us  kbytes/s\n");
+    for (int noack = 1; noack >= 0; noack--)
+    {
+	for (size_t l = 0; l < sizeof(losses) / sizeof(losses[0]); l++)
+	{
+	    for (size_t n = 0; n < sizeof(lens) / sizeof(lens[0]); n++)
+	    {
+		loss = losses[l];
+		memset(rxBuf, 0, sizeof(rxBuf));
+		uint32_t start = host_now;
+		bool ok = stream.sendStream(data, lens[n], noack, SEND_TIMEOUT_MS);
+		uint32_t elapsed = host_now - start;
+		bool same = ok && rxLen == lens[n] && !memcmp(rxBuf, data, lens[n]);
+		if (!same)
+		    failures++;
+		if (verbose || !same || n == sizeof(lens) / sizeof(lens[0]) - 1)
+		    printf("%-5s %4.0f%% %7u %11u %9.1f%s\n", noack ? "noack" : "ack", loss * 100, lens[n],
+			   elapsed, lens[n] * 1000.0 / elapsed, !ok ? "  failed" : !same ? "  wrong data" : "");
+	    }
+	}
+    }
+    return failures;
+}
+
+// The fragments of the receiver test buffer
+static std::vector<uint8_t> fragment(const uint8_t* data, uint8_t id, uint16_t i)
+{
+    uint16_t fragments = (RX_LEN + NRF24_STREAM_FRAGMENT_LEN - 1) / NRF24_STREAM_FRAGMENT_LEN;
+    uint16_t offset = i * NRF24_STREAM_FRAGMENT_LEN;
+    uint16_t len = RX_LEN - offset < NRF24_STREAM_FRAGMENT_LEN ? RX_LEN - offset : NRF24_STREAM_FRAGMENT_LEN;
+    std::vector<uint8_t> f;
+    f.push_back(NRF24_STREAM_DATA | (i == fragments - 1 ? NRF24_STREAM_LAST : 0));
+    f.push_back(id);
+    f.push_back(i);
+    f.insert(f.end(), data + offset, data + offset + len);
+    return f;
+}
+
+// Feeds the receiver a buffer with loss, resending what its status says is missing
+static bool benchReceive(const uint8_t* data)
+{
+    HostRadio& radio = host_radio();
+    NRF24Stream stream;
+    static uint8_t buf[RX_LEN];
+    uint16_t len = 0;
+    uint8_t id = 77;
+    uint16_t fragments = (RX_LEN + NRF24_STREAM_FRAGMENT_LEN - 1) / NRF24_STREAM_FRAGMENT_LEN;
+    std::vector<uint16_t> missing;
+    uint16_t i;
+    bool done = false;
+    int round;
+
+    radio.onTransmit = nullptr;
+    stream.init();
+    loss = RX_LOSS;
+    for (i = 0; i < fragments; i++)
+	missing.push_back(i);
+    for (round = 1; round <= RX_ROUNDS; round++)
+    {
+	uint32_t t = host_now + 500;
+	for (i = 0; i < missing.size(); i++, t += FRAGMENT_GAP_US)
+	{
+	    if (lost())
+		continue;
+	    std::vector<uint8_t> f = fragment(data, id, missing[i]);
+	    host_at(t, [f]() { host_radio().inject(1, &f[0], f.size()); });
+	}
+	len = sizeof(buf);
+	done = stream.recvStream(buf, &len, (t - host_now) / 1000 + 5);
+	if (done)
+	    break;
+
+	// Poll, as the sender does, and take the status the receiver had loaded
+	std::vector<uint8_t> status;
+	uint8_t poll[NRF24_STREAM_HEADER_LEN] = { NRF24_STREAM_POLL, id, 0 };
+	if (!radio.takeAckPayload(1, status))
+	{
+	    printf("receiver round %d: no status loaded\n", round);
+	    return false;
+	}
+	radio.inject(1, poll, sizeof(poll));
+	uint16_t pollLen = sizeof(buf);
+	stream.recvStream(buf, &pollLen, 2);
+	if (status[0] & NRF24_STREAM_COMPLETE)
+	    break;
+	missing.clear();
+	for (i = status[2]; i < fragments; i++)
+	{
+	    uint16_t n = i - status[2];
+	    if (n < NRF24_STREAM_WINDOW && (status[NRF24_STREAM_HEADER_LEN + n / 8] & (1 << (n % 8))))
+		continue;
+	    missing.push_back(i);
+	}
+    }
+    bool same = done && len == RX_LEN && !memcmp(buf, data, RX_LEN);
+    printf("receiver: %u octets in %d rounds at %.0f%% loss, %s\n", RX_LEN, round, RX_LOSS * 100,
+	   same ? "complete" : done ? "wrong data" : "incomplete");
+
+    // A late repeat of a fragment is answered, and does not restart the buffer
+    std::vector<uint8_t> f = fragment(data, id, 0), status;
+    radio.inject(1, &f[0], f.size());
+    len = sizeof(buf);
+    bool restarted = stream.recvStream(buf, &len, 2);
+    bool answered = radio.takeAckPayload(1, status) && (status[0] & NRF24_STREAM_COMPLETE);
+    if (restarted || !answered)
+	printf("receiver: repeated fragment %s\n", restarted ? "restarted the buffer" : "not answered as complete");
+    return same && !restarted && answered;
+}
+
+// Sends with a radio that stops after the first fragment, and checks sendStream() gives up
+static bool benchStall(NRF24Stream& stream, const uint8_t* data)
+{
+    HostRadio& radio = host_radio();
+    uint32_t start = host_now;
+    uint32_t limit = (SEND_TIMEOUT_MS + 2 * NRF24_STREAM_POLL_TIMEOUT) * 1000;
+    bool ok = true;
+
+    loss = 0;
+    radio.onTransmit = [&](const HostPayload& p) {
+	radio.poke(NRF24_REG_00_CONFIG, NRF24_EN_CRC);
+	return transmit(p);
+    };
+    host_end_time = start + 2 * limit;
+    try
+    {
+	ok = stream.sendStream(data, NRF24_STREAM_FRAGMENT_LEN, true, SEND_TIMEOUT_MS);
+    }
+    catch (HostTimeout&)
+    {
+	printf("stalled radio: sendStream() did not return\n");
+	host_end_time = 0;
+	return false;
+    }
+    host_end_time = 0;
+    uint32_t elapsed = host_now - start;
+    printf("stalled radio: sendStream() returned %s after %ums\n", ok ? "true" : "false", elapsed / 1000);
+    return !ok && elapsed <= limit;
+}
+
+int main(int argc, char** argv)
+{
+    bool verbose = false;
+    uint8_t rate = NRF24::NRF24DataRate2Mbps;
+    for (int a = 1; a < argc; a++)
+    {
+	if (!strcmp(argv[a], "-v"))
+	    verbose = true;
+	else if (!strcmp(argv[a], "-r") && a + 1 < argc)
+	{
+	    a++;
+	    if (!strcmp(argv[a], "250k"))
+		rate = NRF24::NRF24DataRate250kbps;
+	    else if (!strcmp(argv[a], "1M"))
+		rate = NRF24::NRF24DataRate1Mbps;
+	}
+	else if (!strcmp(argv[a], "-s") && a + 1 < argc)
+	    rng.seed(atoi(argv[++a]));
+	else
+	{
+	    fprintf(stderr, "usage: %s [-v] [-r 250k|1M|2M] [-s seed]\n", argv[0]);
+	    return 2;
+	}
+    }
+
+    static uint8_t data[NRF24_STREAM_MAX_LEN];
+    for (size_t i = 0; i < sizeof(data); i++)
+	data[i] = rng();
+
+    NRF24Stream stream;
+    host_radio().onTransmit = transmit;
+    stream.init();
+    stream.setRF(rate, NRF24::NRF24TransmitPower0dBm);
+    // 500us, enough for the 32 octet status in the ACK payload at 1 and 2Mbps
+    stream.setRetry(rate == NRF24::NRF24DataRate250kbps ? 5 : 1, 15);
+
+    unsigned failures = benchSend(stream, data, verbose);
+    bool received = benchReceive(data);
+    bool stalled = benchStall(stream, data);
+    if (failures)
+	printf("%u transfers failed\n", failures);
+    return failures || !received || !stalled ? 1 : 0;
+}
@@ -0,0 +1,219 @@
+// nrf24_trace.cpp
+//
+// Decodes the SPI transaction traces written by NRF24::traceDump() (built with
+// NRF24_TRACE 1) into readable nRF24 commands, one transaction per line, with the
+// register names, the STATUS flags clocked out with each command, the data, and the
+// time since the previous transaction, which shows where the time goes between them.
+//
+// The input is the serial output of the sketch, captured raw: text printed between
+// dumps is skipped, and the dumps are decoded in order, as one trace. Times are from
+// the first transaction, in microsecs, to the 4 microsec resolution of the trace.
+// Transactions the sketch could not record, because the trace buffer was full, are
+// reported where they were lost; the gap across them is then only an upper bound.
+// Transactions by the background transfer queue are marked "bg". Runs of the same
+// transaction, as when polling STATUS, are shown once, then counted, with the time of
+// the last one.
+//
+// Capture:
+//   stty -F /dev/ttyACM0 115200 raw && cat /dev/ttyACM0 > trace.bin
+//
+// Build (from the top of the repository):
+//   g++ -O2 -DARDUINO=100 -Itools/host -ILibraries/NRF24 -o nrf24_trace tools/nrf24_trace.cpp
+//
+// Usage:
+//   nrf24_trace [trace.bin]
+
+#include <NRF24.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static const char* registerNames[] =
+{
+    "CONFIG", "EN_AA", "EN_RXADDR", "SETUP_AW", "SETUP_RETR", "RF_CH", "RF_SETUP", "STATUS",
+    "OBSERVE_TX", "RPD", "RX_ADDR_P0", "RX_ADDR_P1", "RX_ADDR_P2", "RX_ADDR_P3", "RX_ADDR_P4", "RX_ADDR_P5",
+    "TX_ADDR", "RX_PW_P0", "RX_PW_P1", "RX_PW_P2", "RX_PW_P3", "RX_PW_P4", "RX_PW_P5", "FIFO_STATUS",
+    "0x18", "0x19", "0x1a", "0x1b", "DYNPD", "FEATURE", "0x1e", "0x1f"
+};
+
+static std::string commandName(uint8_t command)
+{
+    char buf[32];
+    if (command <= (NRF24_COMMAND_R_REGISTER | NRF24_REGISTER_MASK))
+	snprintf(buf, sizeof(buf), "R %s", registerNames[command & NRF24_REGISTER_MASK]);
+    else if ((command & ~NRF24_REGISTER_MASK) == NRF24_COMMAND_W_REGISTER)
+	snprintf(buf, sizeof(buf), "W %s", registerNames[command & NRF24_REGISTER_MASK]);
+    else if ((command & 0xf8) == NRF24_COMMAND_W_ACK_PAYLOAD(0))
+	snprintf(buf, sizeof(buf), "W_ACK_PAYLOAD P%u", command & 0x7);
+    else
+    {
+	switch (command)
+	{
+	case NRF24_COMMAND_R_RX_PAYLOAD:       return "R_RX_PAYLOAD";
+	case NRF24_COMMAND_W_TX_PAYLOAD:       return "W_TX_PAYLOAD";
+	case NRF24_COMMAND_FLUSH_TX:           return "FLUSH_TX";
+	case NRF24_COMMAND_FLUSH_RX:           return "FLUSH_RX";
+	case NRF24_COMMAND_REUSE_TX_PL:        return "REUSE_TX_PL";
+	case NRF24_COMMAND_R_RX_PL_WID:        return "R_RX_PL_WID";
+	case NRF24_COMMAND_W_TX_PAYLOAD_NOACK: return "W_TX_PAYLOAD_NOACK";
+	case NRF24_COMMAND_NOP:                return "NOP";
+	}
+	snprintf(buf, sizeof(buf), "0x%02x", command);
+    }
+    return buf;
+}
+
+static std::string statusFlags(uint8_t status)
+{
+    std::string s;
+    uint8_t pipe = (status & NRF24_RX_P_NO) >> 1;
+    if (status & NRF24_RX_DR)
+	s += "RX_DR ";
+    if (status & NRF24_TX_DS)
+	s += "TX_DS ";
+    if (status & NRF24_MAX_RT)
+	s += "MAX_RT ";
+    if (status & NRF24_STATUS_TX_FULL)
+	s += "TX_FULL ";
+    // The pipe of the message at the head of the RX FIFO, 7 if it is empty
+    if (pipe < 6)
+	s += std::string("P") + (char)('0' + pipe);
+    else if (pipe == 6)
+	s += "P?";
+    return s;
+}
+
+// Decoding state, carried across dumps
+static bool     started = false;
+static uint16_t lastStamp;
+static uint64_t now;              // Microsecs since the first transaction
+static bool     afterLoss = false;
+
+// Decodes one dump's records. Returns false if they are malformed
+static bool decodeRecords(const uint8_t* p, size_t len)
+{
+    while (len)
+    {
+	if (len < NRF24_TRACE_HEADER_LEN)
+	    return false;
+	uint8_t flags = p[0];
+	uint8_t dataLen = flags == NRF24_TRACE_REPEAT ? 0 : flags & NRF24_TRACE_DATA_LEN;
+	if (len < (size_t)NRF24_TRACE_HEADER_LEN + dataLen)
+	    return false;
+	uint16_t stamp = p[1] | (p[2] << 8);
+	uint8_t command = p[3];
+	uint8_t status = p[4];
+	bool repeat = flags == NRF24_TRACE_REPEAT;
+
+	char gap[16];
+	if (!started)
+	    strcpy(gap, "");
+	else if (flags & NRF24_TRACE_LONG_GAP)
+	{
+	    // Over 65536 ticks since the last one: only the remainder is known
+	    now += 65536 * 4;
+	    strcpy(gap, "long");
+	}
+	else
+	{
+	    uint32_t delta = (uint16_t)(stamp - lastStamp) * 4;
+	    snprintf(gap, sizeof(gap), "%s+%u", afterLoss ? "<" : "", delta);
+	}
+	now += (uint16_t)(stamp - lastStamp) * 4;
+	if (!started)
+	    now = 0;
+	lastStamp = stamp;
+	started = true;
+	afterLoss = false;
+
+	if (repeat)
+	{
+	    // The count is in the command and status octets
+	    printf("%12.3f %10s     repeated %u more times\n", now / 1000.0, gap, command | (status << 8));
+	    p += NRF24_TRACE_HEADER_LEN;
+	    len -= NRF24_TRACE_HEADER_LEN;
+	    continue;
+	}
+	printf("%12.3f %10s %2s  %-22s %02x %-24s", now / 1000.0, gap,
+	       flags & NRF24_TRACE_BACKGROUND ? "bg" : "",
+	       commandName(command).c_str(), status, statusFlags(status).c_str());
+	uint8_t i;
+	for (i = 0; i < dataLen; i++)
+	    printf(" %02x", p[NRF24_TRACE_HEADER_LEN + i]);
+	printf("\n");
+
+	p += NRF24_TRACE_HEADER_LEN + dataLen;
+	len -= NRF24_TRACE_HEADER_LEN + dataLen;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    FILE* f = stdin;
+    if (argc > 2 || (argc == 2 && argv[1][0] == '-'))
+    {
+	fprintf(stderr, "usage: %s [trace.bin]\n", argv[0]);
+	return 2;
+    }
+    if (argc == 2 && !(f = fopen(argv[1], "rb")))
+    {
+	perror(argv[1]);
+	return 1;
+    }
+
+    std::vector<uint8_t> in;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+	in.insert(in.end(), buf, buf + n);
+
+    printf("%12s %10s %2s  %-22s %-27s %s\n", "time(ms)", "gap(us)", "", "command", "status", "data");
+    const size_t magicLen = strlen(NRF24_TRACE_MAGIC);
+    size_t pos = 0, dumps = 0;
+    uint32_t lost = 0;
+    int status = 0;
+    while (true)
+    {
+	// The next dump, skipping any text before it
+	uint8_t* start = (uint8_t*)memmem(&in[0] + pos, in.size() - pos, NRF24_TRACE_MAGIC, magicLen);
+	if (!start)
+	    break;
+	pos = start - &in[0] + magicLen;
+	if (in.size() - pos < 4)
+	{
+	    fprintf(stderr, "dump %zu: truncated\n", dumps);
+	    status = 1;
+	    break;
+	}
+	uint16_t dumpLost = in[pos] | (in[pos + 1] << 8);
+	uint16_t len = in[pos + 2] | (in[pos + 3] << 8);
+	pos += 4;
+	if (in.size() - pos < len)
+	{
+	    fprintf(stderr, "dump %zu: truncated\n", dumps);
+	    status = 1;
+	    break;
+	}
+	// Losses are counted when they happen, but reported with the next dump,
+	// so they come after the last record of this one
+	if (!decodeRecords(&in[pos], len))
+	{
+	    fprintf(stderr, "dump %zu: malformed record\n", dumps);
+	    status = 1;
+	}
+	if (dumpLost)
+	{
+	    printf("%12s %10s     %u transactions lost\n", "", "", dumpLost);
+	    afterLoss = true;
+	    lost += dumpLost;
+	}
+	pos += len;
+	dumps++;
+    }
+    printf("%zu dumps, %u transactions lost\n", dumps, lost);
+    if (!dumps)
+	return 1;
+    return status;
+}
@@ -0,0 +1,183 @@
+// rctrainer_check.cpp
+//
+// Checks the RcTrainer PPM decoder against glitches that split a channel pulse in two,
+// both halves in range, on the host model. A clean 6 channel frame is sent every
+// FRAME_US, each with its own channel values, and every GLITCH_EVERY'th frame has an
+// extra edge in the middle of one channel, a different channel each time. Such a
+// frame carries a channel too many, so the decoder must reject it at the sync gap, and
+// must not have published it before then with its channels shifted by one.
+//
+// The sketch side reads the frame count and the channels every POLL_US, and checks
+// that every frame it sees is one of the clean frames sent, whole, and that each clean
+// frame is seen within RCTRAINER_MAX_PULSE and a poll of its last channel. Built with
+// RCTRAINER_FRAME_QUEUE set to 1, as below, it checks that readFrame() gives every clean
+// frame, in order, as well.
+//
+// Prints the frames sent, seen and rejected. The exit status is 1 if a glitched or
+// shifted frame is seen, a clean frame is missed or late, or the rejected count is wrong.
+//
+// Build (from the top of the repository):
+//   g++ -O2 -DARDUINO=100 -DRCTRAINER_FRAME_QUEUE=1 -Itools/host -ILibraries/SpscQueue -ILibraries/NRF24 -ILibraries/RcTrainer-1.0/RcTrainer
+//       -o rctrainer_check tools/rctrainer_check.cpp tools/host/host.cpp
+//       Libraries/RcTrainer-1.0/RcTrainer/RcTrainer.cpp
+//
+// Usage:
+//   rctrainer_check [-v] [-n frames]
+
+#include <host.h>
+#include <RcTrainer.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define CHANNELS     6
+#define FRAME_US     22500
+#define GLITCH_EVERY 3
+#define POLL_US      50
+
+static RcTrainer tx(0);
+
+// The clean frames, in order
+struct Sent
+{
+    uint16_t values[CHANNELS];
+    uint32_t end;              // Time of the edge that ends its last channel
+    bool     seen;
+};
+static std::vector<Sent> sent;
+
+static uint32_t failures = 0;
+static bool     verbose = false;
+
+static void fail(const char* what, uint32_t time)
+{
+    if (failures++ < 10)
+	printf("%10u: %s\n", time, what);
+}
+
+// Checks the channel values the sketch sees: they must be the last clean frame to end,
+// or the one before it while the last is held for RCTRAINER_MAX_PULSE
+static void checkChannels(const uint16_t* values, uint32_t time)
+{
+    size_t last = 0;
+    while (last + 1 < sent.size() && sent[last + 1].end <= time)
+	last++;
+    if (!memcmp(sent[last].values, values, sizeof(sent[last].values)))
+	sent[last].seen = true;
+    else if (!last || memcmp(sent[last - 1].values, values, sizeof(sent[last - 1].values)))
+	fail("channels seen that were never sent clean", time);
+    else if (time > sent[last].end + RCTRAINER_MAX_PULSE + POLL_US + 10)
+	fail("clean frame published late", time);
+}
+
+#if RCTRAINER_FRAME_QUEUE
+static size_t readNext = 0;    // The clean frame readFrame() should give next
+
+// Checks a frame from readFrame(): the clean frames must come whole, in order
+static void checkFrame(const RcTrainerFrame& frame, uint32_t time)
+{
+    if (readNext >= sent.size() || frame.channels != CHANNELS
+	|| memcmp(sent[readNext].values, frame.values, sizeof(sent[readNext].values))
+	|| frame.time != sent[readNext].end)
+	fail("frame read that is not the next clean frame", time);
+    else
+	readNext++;
+}
+#endif
+
+int main(int argc, char** argv)
+{
+    uint32_t frames = 300;
+    for (int a = 1; a < argc; a++)
+    {
+	if (!strcmp(argv[a], "-v"))
+	    verbose = true;
+	else if (!strcmp(argv[a], "-n") && a + 1 < argc)
+	    frames = atoi(argv[++a]);
+	else
+	{
+	    fprintf(stderr, "usage: %s [-v] [-n frames]\n", argv[0]);
+	    return 2;
+	}
+    }
+
+    // The edges, all queued up front, the first after a sync gap. Frame f has channel i
+    // at 1400 + 100i + 3 * (f % 30), so every frame of the 30 before and after it differs
+    // in every channel, and both halves of a split channel are in range
+    uint32_t t = RCTRAINER_MIN_INTERFRAME_INTERVAL + 1000;
+    uint32_t glitched = 0;
+    for (uint32_t f = 0; f < frames; f++)
+    {
+	uint32_t start = t;
+	bool glitch = f >= 4 && f % GLITCH_EVERY == 0;
+	uint8_t split = (f / GLITCH_EVERY) % CHANNELS;
+	Sent s;
+	host_queue_edge(0, t);
+	for (uint8_t i = 0; i < CHANNELS; i++)
+	{
+	    s.values[i] = 1400 + 100 * i + 3 * (f % 30);
+	    if (glitch && i == split)
+		host_queue_edge(0, t + s.values[i] / 2);
+	    t += s.values[i];
+	    host_queue_edge(0, t);
+	}
+	s.end = t;
+	s.seen = false;
+	if (glitch)
+	    glitched++;
+	else if (f >= 2)
+	    sent.push_back(s);   // The first two lock the decoder on, published at the sync gap
+	t = start + FRAME_US;
+    }
+    // The sync gap of the last frame
+    host_queue_edge(0, t);
+    uint32_t end = t + FRAME_US;
+
+    uint16_t lastCount = 0;
+#if RCTRAINER_FRAME_QUEUE
+    bool locked = false;
+#endif
+    while (host_now < end)
+    {
+	host_advance(POLL_US);
+#if RCTRAINER_FRAME_QUEUE
+	RcTrainerFrame frame;
+	while (tx.readFrame(&frame))
+	{
+	    if (locked)
+		checkFrame(frame, host_now);
+	    locked = true;
+	}
+#endif
+	// From when the first clean frame after the lock is due
+	if (host_now > sent[0].end + RCTRAINER_MAX_PULSE + POLL_US + 10)
+	{
+	    // frameCount() first, as the sketch does, so a held frame is published before
+	    // the channels are read rather than between two of them
+	    uint16_t values[CHANNELS];
+	    uint16_t count = tx.frameCount();
+	    for (uint8_t i = 0; i < CHANNELS; i++)
+		values[i] = tx.getChannelRaw(i);
+	    if (verbose && count != lastCount)
+		printf("%10u: frame %u, channel 0 %u\n", host_now, count, values[0]);
+	    lastCount = count;
+	    checkChannels(values, host_now);
+	}
+    }
+
+    uint32_t missed = 0;
+    for (size_t i = 0; i < sent.size(); i++)
+	if (!sent[i].seen)
+	    missed++;
+#if RCTRAINER_FRAME_QUEUE
+    if (readNext != sent.size())
+	fail("clean frames missing from readFrame()", host_now);
+#endif
+    printf("frames %u sent, %u glitched, %u clean seen, %u missed, %u rejected\n",
+	   frames, glitched, (uint32_t)sent.size() - missed, missed, tx.badFrameCount());
+    if (missed)
+	fail("clean frames missed", host_now);
+    if (tx.badFrameCount() != glitched)
+	fail("rejected count is not the glitched count", host_now);
+    return failures ? 1 : 0;
+}
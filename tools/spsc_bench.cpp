@@ -0,0 +1,179 @@
+// spsc_bench.cpp
+//
+// Throughput of the SpscQueue template on a PC, with the producer and the consumer on
+// two threads, as an interrupt handler and loop() are on the target, for several
+// queue sizes and item sizes: a byte, a pointer (as in the NRF24 background transfer
+// queue) and an RcTrainerFrame sized item, added and taken in place. Each run also
+// checks that every item arrives once, in order, and unchanged, and the exit status
+// is 1 if any does not. Then the cost of one push and pop on a single thread, which
+// is close to what the handoff adds to an interrupt handler.
+//
+// On a PC the queue orders its items with memory fences; on AVR they are compiler
+// barriers only, and the indexes are single octets, so the figures here are for the
+// algorithm, not the target.
+//
+// Build (from the top of the repository):
+//   g++ -O2 -pthread -ILibraries/SpscQueue -o spsc_bench tools/spsc_bench.cpp
+//
+// Usage:
+//   spsc_bench [-n items]
+
+#include <SpscQueue.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <thread>
+
+// As RcTrainerFrame, with RCTRAINER_MAX_CHANNELS of 10
+struct Frame
+{
+    uint32_t time;
+    uint8_t  channels;
+    uint16_t values[10];
+};
+
+static uint64_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Items carry a sequence number, so the consumer can check them
+static inline void fill(uint8_t& item, uint32_t seq) { item = seq; }
+static inline bool check(const uint8_t& item, uint32_t seq) { return item == (uint8_t)seq; }
+static inline void fill(void*& item, uint32_t seq) { item = (void*)(uintptr_t)seq; }
+static inline bool check(void* const& item, uint32_t seq) { return item == (void*)(uintptr_t)seq; }
+static inline void fill(Frame& item, uint32_t seq)
+{
+    item.time = seq;
+    item.channels = 8;
+    for (uint8_t i = 0; i < 10; i++)
+	item.values[i] = seq + i;
+}
+static inline bool check(const Frame& item, uint32_t seq)
+{
+    for (uint8_t i = 0; i < 10; i++)
+	if (item.values[i] != (uint16_t)(seq + i))
+	    return false;
+    return item.time == seq && item.channels == 8;
+}
+
+static bool failed = false;
+
+// Producer and consumer threads, items in place. Prints the rate, and how often each
+// side found the queue full or empty. A side that has to wait yields, so that the
+// other can run on a PC with one core
+template <typename T, uint8_t N>
+static void threads(const char* name, uint32_t count)
+{
+    static SpscQueue<T, N> queue;
+    uint32_t fullSpins = 0, emptySpins = 0, bad = 0;
+
+    uint64_t start = now();
+    std::thread producer([&]() {
+	for (uint32_t seq = 0; seq < count; seq++)
+	{
+	    T* slot;
+	    while (!(slot = queue.back()))
+	    {
+		fullSpins++;
+		std::this_thread::yield();
+	    }
+	    fill(*slot, seq);
+	    queue.push();
+	}
+    });
+    for (uint32_t seq = 0; seq < count; seq++)
+    {
+	T* item;
+	while (!(item = queue.front()))
+	{
+	    emptySpins++;
+	    std::this_thread::yield();
+	}
+	if (!check(*item, seq))
+	    bad++;
+	queue.pop();
+    }
+    producer.join();
+    double secs = (now() - start) / 1e9;
+
+    printf("%-6s %3u  %7.1f Mitems/s  %5.1f%% full  %5.1f%% empty%s\n", name, N,
+	   count / secs / 1e6, 100.0 * fullSpins / (fullSpins + count),
+	   100.0 * emptySpins / (emptySpins + count), bad ? "  ITEMS WRONG" : "");
+    if (bad || !queue.empty())
+	failed = true;
+}
+
+// One push and one pop at a time, on one thread, by copy
+template <typename T, uint8_t N>
+static void single(const char* name, uint32_t count)
+{
+    static SpscQueue<T, N> queue;
+    T in, out;
+    uint32_t bad = 0;
+
+    uint64_t start = now();
+    for (uint32_t seq = 0; seq < count; seq++)
+    {
+	fill(in, seq);
+	if (!queue.push(in) || !queue.pop(out) || !check(out, seq))
+	    bad++;
+    }
+    double ns = (double)(now() - start) / count;
+    printf("%-6s %3u  %5.1f ns per push and pop%s\n", name, N, ns, bad ? "  ITEMS WRONG" : "");
+    if (bad)
+	failed = true;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t count = 1000000;
+    for (int a = 1; a < argc; a++)
+    {
+	if (!strcmp(argv[a], "-n") && a + 1 < argc)
+	    count = atoi(argv[++a]);
+	else
+	{
+	    fprintf(stderr, "usage: %s [-n items]\n", argv[0]);
+	    return 2;
+	}
+    }
+
+    printf("two threads, %u items each:\n", count);
+    printf("item   len  rate               producer waits  consumer waits\n");
+    threads<uint8_t, 2>("byte", count);
+    threads<uint8_t, 16>("byte", count);
+    threads<uint8_t, 128>("byte", count);
+    threads<void*, 4>("ptr", count);
+    threads<void*, 128>("ptr", count);
+    threads<Frame, 2>("frame", count);
+    threads<Frame, 16>("frame", count);
+
+    printf("one thread:\n");
+    single<uint8_t, 2>("byte", count);
+    single<void*, 4>("ptr", count);
+    single<Frame, 2>("frame", count);
+
+    // A full queue takes no more, and gives its items back in order
+    SpscQueue<uint8_t, 8> queue;
+    uint8_t i, item;
+    for (i = 0; queue.push(i); i++)
+	;
+    if (i != queue.capacity() || queue.count() != i)
+	failed = true;
+    for (i = 0; queue.pop(item); i++)
+	if (item != i)
+	    failed = true;
+    if (i != queue.capacity())
+	failed = true;
+
+    if (failed)
+    {
+	printf("queue gave wrong items\n");
+	return 1;
+    }
+    return 0;
+}
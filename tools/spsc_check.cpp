@@ -0,0 +1,261 @@
+// spsc_check.cpp
+//
+// Checks the SpscQueue template on one thread, deterministically, at its limits: an
+// empty queue gives NULL from front() and nothing from pop(), a full one NULL from
+// back() and nothing from push(), clear() empties it from any state, and the 8 bit
+// head and tail wrap round correctly, with N of 128 where head - tail is 128 and 0 at
+// once modulo 256 only because a full queue is told apart from an empty one by the
+// difference, not by the indexes being equal. Then a random mix of pushes, pops and
+// clears, by copy and in place, is run against a std::deque, for several sizes.
+//
+// Prints each failed check, and the number of checks made. The exit status is 1 if any
+// fails, so it can be run after every change to the queue.
+//
+// Build (from the top of the repository):
+//   g++ -O2 -ILibraries/SpscQueue -o spsc_check tools/spsc_check.cpp
+//
+// Usage:
+//   spsc_check [-n steps] [-s seed]
+
+#include <SpscQueue.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <random>
+
+static uint32_t checks = 0;
+static uint32_t failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(bool ok, const char* what, int line)
+{
+    checks++;
+    if (!ok)
+    {
+	printf("line %d: %s failed\n", line, what);
+	failures++;
+    }
+}
+
+// An empty queue has nothing to give, and leaves the item it is asked for alone
+template <uint8_t N>
+static void checkEmpty(SpscQueue<uint8_t, N>& queue)
+{
+    uint8_t item = 0xA5;
+    CHECK(queue.empty());
+    CHECK(!queue.full());
+    CHECK(queue.count() == 0);
+    CHECK(queue.front() == NULL);
+    CHECK(!queue.pop(item));
+    CHECK(item == 0xA5);
+    CHECK(queue.back() != NULL);
+}
+
+// A full queue takes nothing more
+template <uint8_t N>
+static void checkFull(SpscQueue<uint8_t, N>& queue)
+{
+    CHECK(queue.full());
+    CHECK(!queue.empty());
+    CHECK(queue.count() == N);
+    CHECK(queue.back() == NULL);
+    CHECK(!queue.push(0));
+    CHECK(queue.count() == N);
+    CHECK(queue.front() != NULL);
+}
+
+// Limits, clear() and front()/back() in place, for one size
+template <uint8_t N>
+static void limits()
+{
+    SpscQueue<uint8_t, N> queue;
+    uint8_t item;
+    checkEmpty(queue);
+    CHECK(queue.capacity() == N);
+
+    // Filled by copy to the limit, emptied in order
+    for (uint8_t i = 0; i < N; i++)
+	CHECK(queue.push(i));
+    checkFull(queue);
+    for (uint8_t i = 0; i < N; i++)
+	CHECK(queue.pop(item) && item == i);
+    checkEmpty(queue);
+
+    // In place: back() is the slot front() gives once it is pushed, and neither moves
+    // until push() and pop()
+    uint8_t* slot = queue.back();
+    CHECK(slot != NULL && queue.back() == slot);
+    *slot = 42;
+    CHECK(queue.front() == NULL);
+    queue.push();
+    CHECK(queue.front() == slot && *queue.front() == 42);
+    CHECK(queue.front() == slot);
+    queue.pop();
+    checkEmpty(queue);
+
+    // clear() from part full, full and empty
+    for (uint8_t i = 0; i < N / 2 + 1; i++)
+	queue.push(i);
+    queue.clear();
+    checkEmpty(queue);
+    for (uint8_t i = 0; queue.push(i); i++)
+	;
+    checkFull(queue);
+    queue.clear();
+    checkEmpty(queue);
+    queue.clear();
+    checkEmpty(queue);
+
+    // And works as before after it
+    CHECK(queue.push(7));
+    CHECK(queue.pop(item) && item == 7);
+    CHECK(queue.push(8));
+    CHECK(queue.pop(item) && item == 8);
+    checkEmpty(queue);
+}
+
+// Runs the head and tail round their 8 bit range several times, each time stopping
+// with the queue full and empty across the wrap, for one size
+template <uint8_t N>
+static void wrap()
+{
+    SpscQueue<uint8_t, N> queue;
+    uint32_t in = 0, out = 0;
+    uint8_t item;
+
+    // Advance both indexes in steps of 1 to 255 - N, so they are at every offset from
+    // the wrap in turn, with the queue full then empty at each
+    for (uint32_t round = 0; round < 3 * 256; round++)
+    {
+	uint8_t skip = round % 256 % (256 - N) + 1;
+	for (uint8_t i = 0; i < skip; i++)
+	{
+	    CHECK(queue.push(in++));
+	    CHECK(queue.pop(item) && item == (uint8_t)out++);
+	}
+	while (queue.push(in))
+	    in++;
+	CHECK(in - out == N);
+	checkFull(queue);
+	while (queue.pop(item))
+	    CHECK(item == (uint8_t)out++);
+	CHECK(in == out);
+	checkEmpty(queue);
+    }
+
+    // Kept full while items stream through, more than 256 of them
+    for (uint8_t i = 0; i < N; i++)
+	queue.push(in++);
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+	checkFull(queue);
+	CHECK(queue.pop(item) && item == (uint8_t)out++);
+	CHECK(queue.count() == N - 1);
+	CHECK(queue.push(in++));
+    }
+    queue.clear();
+    checkEmpty(queue);
+}
+
+// A random mix of operations against a std::deque, for one size. Pushes and pops
+// take turns to be the more likely, every 4N steps, so the queue goes full and empty
+template <uint8_t N>
+static void model(std::mt19937& rng, uint32_t steps)
+{
+    SpscQueue<uint16_t, N> queue;
+    std::deque<uint16_t> reference;
+    uint16_t next = 0;
+    uint16_t item;
+
+    for (uint32_t step = 0; step < steps; step++)
+    {
+	uint32_t op = rng() % 100;
+	uint32_t pushes = step / (4 * N) % 2 ? 30 : 68;
+	if (op < pushes)
+	{
+	    // Push, by copy or in place
+	    bool room = reference.size() < N;
+	    if (op & 1)
+		CHECK(queue.push(next) == room);
+	    else
+	    {
+		uint16_t* slot = queue.back();
+		CHECK((slot != NULL) == room);
+		if (slot)
+		{
+		    *slot = next;
+		    queue.push();
+		}
+	    }
+	    if (room)
+		reference.push_back(next++);
+	}
+	else if (op < 98)
+	{
+	    // Pop, by copy or in place
+	    bool any = !reference.empty();
+	    if (op & 1)
+	    {
+		item = 0xFFFF;
+		CHECK(queue.pop(item) == any);
+		CHECK(item == (any ? reference.front() : 0xFFFF));
+	    }
+	    else
+	    {
+		uint16_t* slot = queue.front();
+		CHECK((slot != NULL) == any);
+		if (slot)
+		{
+		    CHECK(*slot == reference.front());
+		    queue.pop();
+		}
+	    }
+	    if (any)
+		reference.pop_front();
+	}
+	else
+	{
+	    queue.clear();
+	    reference.clear();
+	}
+	CHECK(queue.count() == reference.size());
+	CHECK(queue.empty() == reference.empty());
+	CHECK(queue.full() == (reference.size() == N));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t steps = 100000;
+    std::mt19937 rng(1);
+    for (int a = 1; a < argc; a++)
+    {
+	if (!strcmp(argv[a], "-n") && a + 1 < argc)
+	    steps = atoi(argv[++a]);
+	else if (!strcmp(argv[a], "-s") && a + 1 < argc)
+	    rng.seed(atoi(argv[++a]));
+	else
+	{
+	    fprintf(stderr, "usage: %s [-n steps] [-s seed]\n", argv[0]);
+	    return 2;
+	}
+    }
+
+    limits<1>();
+    limits<2>();
+    limits<8>();
+    limits<128>();
+
+    wrap<1>();
+    wrap<4>();
+    wrap<128>();
+
+    model<1>(rng, steps);
+    model<4>(rng, steps);
+    model<128>(rng, steps);
+
+    printf("%u checks, %u failed\n", checks, failures);
+    return failures ? 1 : 0;
+}